@@ -43,9 +43,10 @@
 #ifndef __SRC_PSASCAN_SRC_APPROX_RANK_HPP_INCLUDED
 #define __SRC_PSASCAN_SRC_APPROX_RANK_HPP_INCLUDED
 
-#include <thread>
 #include <algorithm>
 
+#include "utils/thread_pool.hpp"
+
 
 namespace psascan_private {
 
@@ -89,31 +90,30 @@ class approx_rank {
   public:
     approx_rank(const unsigned char *text, long length, long max_threads) {
       // Compute symbol counts in each block.
-      long max_block_size = (length + max_threads - 1) / max_threads;
-      long n_threads = (length + max_block_size - 1) / max_block_size;
-      long **symbol_count = new long*[n_threads];
-      for (long j = 0; j < n_threads; ++j) {
+      long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+      long max_block_size = (length + max_tasks - 1) / max_tasks;
+      long n_blocks = (length + max_block_size - 1) / max_block_size;
+      long **symbol_count = new long*[n_blocks];
+      for (long j = 0; j < n_blocks; ++j) {
         symbol_count[j] = new long[256];
         std::fill(symbol_count[j], symbol_count[j] + 256, 0L);
       }
 
-      std::thread **threads = new std::thread*[n_threads];
-      for (long t = 0; t < n_threads; ++t) {
+      task_group tasks;
+      for (long t = 0; t < n_blocks; ++t) {
         long block_beg = t * max_block_size;
         long block_end = std::min(block_beg + max_block_size, length);
 
-        threads[t] = new std::thread(compute_symbol_count_aux,
+        tasks.add(compute_symbol_count_aux,
             text, block_beg, block_end, symbol_count[t]);
       }
-
-      for (long t = 0; t < n_threads; ++t) threads[t]->join();
-      for (long t = 0; t < n_threads; ++t) delete threads[t];
+      tasks.wait();
 
       // Compute (exclusive) partial sums over symbol counts.
       m_count = new long[256];
       std::fill(m_count, m_count + 256, 0L);
       long *temp_count = new long[256];
-      for (long i = 0; i < n_threads; ++i) {
+      for (long i = 0; i < n_blocks; ++i) {
         std::copy(symbol_count[i], symbol_count[i] + 256, temp_count);
         std::copy(m_count, m_count + 256, symbol_count[i]);
         for (long j = 0; j < 256; ++j)
@@ -130,21 +130,18 @@ class approx_rank {
         else m_list[i] = NULL;
       }
 
-      for (long t = 0; t < n_threads; ++t) {
+      for (long t = 0; t < n_blocks; ++t) {
         long block_beg = t * max_block_size;
         long block_end = std::min(block_beg + max_block_size, length);
 
-        threads[t] = new std::thread(compute_occ_list_aux, text,
+        tasks.add(compute_occ_list_aux, text,
             block_beg, block_end, symbol_count[t], m_list);
       }
-
-      for (long t = 0; t < n_threads; ++t) threads[t]->join();
-      for (long t = 0; t < n_threads; ++t) delete threads[t];
-      delete[] threads;
+      tasks.wait();
 
 
       // Clean up.
-      for (long j = 0; j < n_threads; ++j)
+      for (long j = 0; j < n_blocks; ++j)
         delete[] symbol_count[j];
       delete[] symbol_count;
     }
@@ -39,6 +39,8 @@
 #include <stdint.h>
 
 #include "utils/utils.hpp"
+#include "utils/numa.hpp"
+#include "utils/huge_pages.hpp"
 
 
 namespace psascan_private {
@@ -50,12 +52,14 @@ struct bitvector {
 
   public:
     bitvector(std::string filename) {
-      utils::read_objects_from_file<unsigned char>(m_data, m_alloc_bytes, filename);
+      m_alloc_bytes = utils::file_size(filename);
+      m_data = (unsigned char *)huge_pages::allocate(m_alloc_bytes, false, true);
+      utils::read_n_objects_from_file<unsigned char>(m_data, m_alloc_bytes, filename);
     }
 
     bitvector(long length) {
       m_alloc_bytes = (length + 7) / 8;
-      m_data = (unsigned char *)calloc(m_alloc_bytes, sizeof(unsigned char));
+      m_data = (unsigned char *)huge_pages::allocate(m_alloc_bytes, true, true);
     }
 
     inline bool get(long i) const {
@@ -75,6 +79,11 @@ struct bitvector {
       else set(i);
     }
 
+    // Spread the bitvector over NUMA nodes (see numa.hpp).
+    void numa_interleave() const {
+      numa::interleave(m_data, m_alloc_bytes);
+    }
+
     inline void save(std::string filename) const {
       utils::write_objects_to_file<unsigned char>(m_data, m_alloc_bytes, filename);
     }
@@ -100,7 +109,7 @@ struct bitvector {
     }
 
     ~bitvector() {
-      free(m_data);
+      huge_pages::deallocate(m_data);
     }
 };
 
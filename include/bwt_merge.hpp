@@ -34,9 +34,9 @@
 #ifndef __SRC_PSASCAN_SRC_BWT_MERGE_HPP_INCLUDED
 #define __SRC_PSASCAN_SRC_BWT_MERGE_HPP_INCLUDED
 
-#include <thread>
 #include <algorithm>
 
+#include "utils/thread_pool.hpp"
 #include "bitvector.hpp"
 #include "ranksel_support.hpp"
 
@@ -87,15 +87,16 @@ long merge_bwt(const unsigned char *left_bwt, const unsigned char *right_bwt,
   long *right_ptr = new long[n_ranges];
   long *rank_at_range_beg = new long[n_ranges];
 
-  std::thread **threads = new std::thread*[n_ranges];
-  for (long t = 0; t < n_ranges; ++t) {
-    long range_beg = t * max_range_size;
-    threads[t] = new std::thread(compute_initial_rank,
-        range_beg, bv_ranksel, std::ref(rank_at_range_beg[t]));
-  }
+  {
+    task_group tasks;
+    for (long t = 0; t < n_ranges; ++t) {
+      long range_beg = t * max_range_size;
+      tasks.add(compute_initial_rank,
+          range_beg, bv_ranksel, std::ref(rank_at_range_beg[t]));
+    }
 
-  for (long t = 0; t < n_ranges; ++t) threads[t]->join();
-  for (long t = 0; t < n_ranges; ++t) delete threads[t];
+    tasks.wait();
+  }
 
   for (long t = 0; t < n_ranges; ++t) {
     long range_beg = t * max_range_size;
@@ -107,17 +108,18 @@ long merge_bwt(const unsigned char *left_bwt, const unsigned char *right_bwt,
   // 4
   //
   // Merge BWTs in parallel.
-  for (long t = 0; t < n_ranges; ++t) {
-    long range_beg = max_range_size * t;
-    long range_end = std::min(range_beg + max_range_size, block_size);
+  {
+    task_group tasks;
+    for (long t = 0; t < n_ranges; ++t) {
+      long range_beg = max_range_size * t;
+      long range_end = std::min(range_beg + max_range_size, block_size);
 
-    threads[t] = new std::thread(merge_bwt_aux, range_beg, range_end,
-        left_ptr[t], right_ptr[t], left_bwt, right_bwt, bwt, bv);
-  }
+      tasks.add(merge_bwt_aux, range_beg, range_end,
+          left_ptr[t], right_ptr[t], left_bwt, right_bwt, bwt, bv);
+    }
 
-  for (long t = 0; t < n_ranges; ++t) threads[t]->join();
-  for (long t = 0; t < n_ranges; ++t) delete threads[t];
-  delete[] threads;
+    tasks.wait();
+  }
   delete[] left_ptr;
   delete[] right_ptr;
 
@@ -0,0 +1,247 @@
+/**
+ * @file    src/psascan_src/checkpoint.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_CHECKPOINT_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_CHECKPOINT_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <set>
+
+#include "utils/utils.hpp"
+#include "io/distributed_file.hpp"
+#include "io/multifile.hpp"
+#include "io/temp_file_placement.hpp"
+#include "half_block_info.hpp"
+
+
+namespace psascan_private {
+
+//==============================================================================
+// The checkpoint describes the state of the computation after processing
+// a block: the partial SAs (and BWTs) and the gap arrays of the processed
+// half-blocks, and the gt_begin bitvectors of the tail. All these are
+// already stored on disk, so that the computation can be resumed from the
+// next block. The checkpoint file is a text file with the following lines:
+//
+//   psascan-checkpoint
+//   text_length max_block_size sizeof(block_offset_type) compute_bwt
+//   next_block_id (-1 if all blocks were processed)
+//   number of half-blocks, then for each half-block:
+//     beg end has_bwt
+//     gap_filename
+//     state of the partial SA (see distributed_file::save_state)
+//     state of the partial BWT (only if has_bwt = 1)
+//   number of tail files, then for each file:
+//     beg end
+//     filename
+//==============================================================================
+template<typename block_offset_type>
+void save_checkpoint(std::string filename, long text_length,
+    long max_block_size, bool compute_bwt, long next_block_id,
+    const std::vector<half_block_info<block_offset_type> > &hblock_info,
+    const multifile *tail_gt_begin_rev) {
+  std::string tmp_filename = filename + ".tmp";
+  std::FILE *f = utils::open_file(tmp_filename, "w");
+  fprintf(f, "psascan-checkpoint\n");
+  fprintf(f, "%ld %ld %lu %d\n", text_length, max_block_size,
+      sizeof(block_offset_type), (int)compute_bwt);
+  fprintf(f, "%ld\n", next_block_id);
+
+  fprintf(f, "%lu\n", hblock_info.size());
+  for (size_t i = 0; i < hblock_info.size(); ++i) {
+    fprintf(f, "%ld %ld %d\n%s\n", hblock_info[i].beg, hblock_info[i].end,
+        (int)(hblock_info[i].bwt != NULL), hblock_info[i].gap_filename.c_str());
+    hblock_info[i].psa->save_state(f);
+    if (hblock_info[i].bwt != NULL)
+      hblock_info[i].bwt->save_state(f);
+  }
+
+  long n_tail_files = 0;
+  if (tail_gt_begin_rev != NULL)
+    n_tail_files = (long)tail_gt_begin_rev->files_info.size();
+  fprintf(f, "%ld\n", n_tail_files);
+  for (long i = 0; i < n_tail_files; ++i) {
+    const single_file_info &info = tail_gt_begin_rev->files_info[i];
+    fprintf(f, "%ld %ld\n%s\n", info.m_beg, info.m_end, info.m_filename.c_str());
+  }
+
+  std::fclose(f);
+
+  // Flush the files of the state to disk before the checkpoint
+  // referring to them replaces the previous one.
+  for (size_t i = 0; i < hblock_info.size(); ++i) {
+    std::vector<std::string> parts = hblock_info[i].psa->part_filenames();
+    if (hblock_info[i].bwt != NULL) {
+      std::vector<std::string> bwt_parts = hblock_info[i].bwt->part_filenames();
+      parts.insert(parts.end(), bwt_parts.begin(), bwt_parts.end());
+    }
+    if (!hblock_info[i].gap_filename.empty())
+      parts.push_back(hblock_info[i].gap_filename);
+    for (size_t j = 0; j < parts.size(); ++j)
+      utils::file_sync(parts[j]);
+  }
+  for (long i = 0; i < n_tail_files; ++i)
+    utils::file_sync(tail_gt_begin_rev->files_info[i].m_filename);
+
+  utils::file_rename(tmp_filename, filename);
+}
+
+//==============================================================================
+// Restore the state of the computation from the checkpoint. Returns false
+// if the checkpoint file does not exist. The parameters of the computation
+// have to be the same as when the checkpoint was saved.
+//==============================================================================
+template<typename block_offset_type>
+bool load_checkpoint(std::string filename, long text_length,
+    long max_block_size, bool compute_bwt, long &next_block_id,
+    std::vector<half_block_info<block_offset_type> > &hblock_info,
+    multifile* &tail_gt_begin_rev) {
+  if (!utils::file_exists(filename))
+    return false;
+
+  std::FILE *f = utils::open_file(filename, "r");
+  std::string line, params, block_id;
+  long saved_text_length, saved_max_block_size;
+  unsigned long saved_offset_size;
+  int saved_compute_bwt;
+  if (!utils::read_line(f, line) || line != "psascan-checkpoint" ||
+      !utils::read_line(f, params) || !utils::read_line(f, block_id) ||
+      sscanf(params.c_str(), "%ld %ld %lu %d", &saved_text_length,
+        &saved_max_block_size, &saved_offset_size, &saved_compute_bwt) != 4 ||
+      sscanf(block_id.c_str(), "%ld", &next_block_id) != 1) {
+    fprintf(stderr, "\nError: the checkpoint file %s is corrupted\n",
+        filename.c_str());
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (saved_text_length != text_length ||
+      saved_max_block_size != max_block_size ||
+      saved_offset_size != sizeof(block_offset_type) ||
+      saved_compute_bwt != (int)compute_bwt) {
+    fprintf(stderr,
+"\nError: the checkpoint %s was created for different input or\n"
+"parameters. Resume the computation using the same input, RAM budget,\n"
+"number of threads and BWT setting.\n", filename.c_str());
+    std::exit(EXIT_FAILURE);
+  }
+
+  bool ok = true;
+  long n_hblocks = 0;
+  if (!utils::read_line(f, line) ||
+      sscanf(line.c_str(), "%ld", &n_hblocks) != 1) ok = false;
+  for (long i = 0; ok && i < n_hblocks; ++i) {
+    half_block_info<block_offset_type> info;
+    int has_bwt = 0;
+    info.psa = NULL;
+    info.bwt = NULL;
+    if (!utils::read_line(f, line) ||
+        sscanf(line.c_str(), "%ld %ld %d", &info.beg, &info.end, &has_bwt) != 3 ||
+        !utils::read_line(f, info.gap_filename) ||
+        (!info.gap_filename.empty() && !utils::file_exists(info.gap_filename)) ||
+        (info.psa = distributed_file<block_offset_type>::load_state(f)) == NULL ||
+        (has_bwt && (info.bwt = distributed_file<unsigned char>::load_state(f)) == NULL))
+      ok = false;
+    else hblock_info.push_back(info);
+  }
+
+  long n_tail_files = 0;
+  if (ok && (!utils::read_line(f, line) ||
+        sscanf(line.c_str(), "%ld", &n_tail_files) != 1)) ok = false;
+  tail_gt_begin_rev = NULL;
+  if (ok && n_tail_files > 0) {
+    tail_gt_begin_rev = new multifile();
+    for (long i = 0; ok && i < n_tail_files; ++i) {
+      long beg, end;
+      std::string tail_filename;
+      if (!utils::read_line(f, line) ||
+          sscanf(line.c_str(), "%ld %ld", &beg, &end) != 2 ||
+          !utils::read_line(f, tail_filename) ||
+          !utils::file_exists(tail_filename))
+        ok = false;
+      else tail_gt_begin_rev->add_file(beg, end, tail_filename);
+    }
+  }
+  std::fclose(f);
+
+  if (!ok) {
+    fprintf(stderr, "\nError: the checkpoint file %s is corrupted or some\n"
+        "of the files it refers to are missing\n", filename.c_str());
+    std::exit(EXIT_FAILURE);
+  }
+
+  return true;
+}
+
+//==============================================================================
+// Delete the temporary files not referenced by the restored state, i.e.,
+// the files of the block that was being processed when the computation
+// was interrupted (including the excess values of its gap array, which
+// would otherwise be appended to). Returns the number of deleted files.
+//==============================================================================
+template<typename block_offset_type>
+long delete_leftover_files(const temp_file_placement &temp,
+    const std::vector<half_block_info<block_offset_type> > &hblock_info,
+    const multifile *tail_gt_begin_rev) {
+  std::set<std::string> referenced;
+  for (size_t i = 0; i < hblock_info.size(); ++i) {
+    std::vector<std::string> parts = hblock_info[i].psa->part_filenames();
+    if (hblock_info[i].bwt != NULL) {
+      std::vector<std::string> bwt_parts = hblock_info[i].bwt->part_filenames();
+      parts.insert(parts.end(), bwt_parts.begin(), bwt_parts.end());
+    }
+    referenced.insert(parts.begin(), parts.end());
+    referenced.insert(hblock_info[i].gap_filename);
+  }
+  if (tail_gt_begin_rev != NULL)
+    for (size_t i = 0; i < tail_gt_begin_rev->files_info.size(); ++i)
+      referenced.insert(tail_gt_begin_rev->files_info[i].m_filename);
+
+  long n_deleted = 0;
+  std::vector<std::string> filenames = temp.existing_temp_files();
+  for (size_t i = 0; i < filenames.size(); ++i) {
+    if (referenced.find(filenames[i]) == referenced.end()) {
+      utils::file_delete(filenames[i]);
+      ++n_deleted;
+    }
+  }
+
+  return n_deleted;
+}
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_CHECKPOINT_HPP_INCLUDED
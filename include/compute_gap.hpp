@@ -44,7 +44,9 @@
 
 #include "utils/utils.hpp"
 #include "io/multifile.hpp"
+#include "io/temp_file_placement.hpp"
 #include "rank.hpp"
+#include "interleaved_rank.hpp"
 #include "gap_array.hpp"
 #include "gap_buffer.hpp"
 #include "stream.hpp"
@@ -56,17 +58,23 @@ namespace psascan_private {
 
 //==============================================================================
 // Compute the gap for an arbitrary range of suffixes of tail. This version is
-// more general, and can be used also when processing half-blocks.
+// more general, and can be used also when processing half-blocks. The rank
+// data structure over the BWT of the block is either rank4n (rank.hpp) or
+// interleaved_rank (interleaved_rank.hpp). The gt bitvectors of the slices
+// are spread over the temporary directories (see temp_file_placement.hpp).
+// The work of streaming threads is recorded under stats_step (run_stats.hpp).
 //==============================================================================
-template<typename block_offset_type>
-void compute_gap(const rank4n<> *rank, buffered_gap_array *gap,
+template<typename block_offset_type, typename rank_type = rank4n<> >
+void compute_gap(const rank_type *rank, buffered_gap_array *gap,
     long tail_begin, long tail_end, long text_length, long max_threads,
-    long block_isa0, long gap_buf_size, unsigned char block_last_symbol,
-    std::vector<long> initial_ranks, std::string text_filename, std::string output_filename,
-    const multifile *tail_gt_begin_rev, multifile *newtail_gt_begin_rev) {
+    long block_isa0, long gap_buf_size, long n_gap_buffers, unsigned char block_last_symbol,
+    std::vector<long> initial_ranks, const concatenated_text *text, const temp_file_placement &temp,
+    const multifile *tail_gt_begin_rev, multifile *newtail_gt_begin_rev,
+    const char *stats_step) {
   long tail_length = tail_end - tail_begin;
-  long stream_max_block_size = (tail_length + max_threads - 1) / max_threads;
-  long n_threads = (tail_length + stream_max_block_size - 1) / stream_max_block_size;
+  long slice_length = stream_slice_length(tail_length, max_threads);
+  long n_slices = (tail_length + slice_length - 1) / slice_length;
+  long n_threads = std::min(n_slices, max_threads);
 
   fprintf(stderr, "    Stream:");
   long double stream_start = utils::wclock();
@@ -87,7 +95,6 @@ void compute_gap(const rank4n<> *rank, buffered_gap_array *gap,
   // 2
   //
   // Allocate gap buffers.
-  long n_gap_buffers = 2 * max_threads;
   gap_buffer<block_offset_type> **gap_buffers = new gap_buffer<block_offset_type>*[n_gap_buffers];
   for (long i = 0L; i < n_gap_buffers; ++i)
     gap_buffers[i] = new gap_buffer<block_offset_type>(gap_buf_size, max_threads);
@@ -106,23 +113,27 @@ void compute_gap(const rank4n<> *rank, buffered_gap_array *gap,
 
   // 5
   //
-  // Start threads doing the backward search.
-  stream_info info(n_threads, tail_length);
+  // Start threads doing the backward search. Each thread
+  // repeatedly takes the next slice of the tail not yet
+  // streamed by any other thread.
+  stream_info info(n_threads, tail_length, n_slices);
   std::thread **streamers = new std::thread*[n_threads];
-  std::vector<std::string> gt_filenames(n_threads);
+  std::vector<std::string> gt_filenames(n_slices);
 
-  for (long t = 0L; t < n_threads; ++t) {
-    long stream_block_beg = tail_begin + t * stream_max_block_size;
-    long stream_block_end = std::min(stream_block_beg + stream_max_block_size, tail_end);
+  for (long t = 0L; t < n_slices; ++t) {
+    long stream_block_beg = tail_begin + t * slice_length;
+    long stream_block_end = std::min(stream_block_beg + slice_length, tail_end);
 
-    gt_filenames[t] = output_filename + ".gt_tail." + utils::random_string_hash();
+    gt_filenames[t] = temp.file_base(t) + ".gt_tail." + utils::random_string_hash();
     newtail_gt_begin_rev->add_file(text_length - stream_block_end, text_length - stream_block_beg, gt_filenames[t]);
-
-    streamers[t] = new std::thread(parallel_stream<block_offset_type>, full_gap_buffers, empty_gap_buffers, stream_block_beg,
-        stream_block_end, initial_ranks[t], count, block_isa0, rank, block_last_symbol, text_filename, text_length,
-        std::ref(gt_filenames[t]), &info, t, gap->m_length, gap_buf_size, tail_gt_begin_rev, max_threads);
   }
 
+  for (long t = 0L; t < n_threads; ++t)
+    streamers[t] = new std::thread(parallel_stream<block_offset_type, rank_type>, full_gap_buffers, empty_gap_buffers,
+        tail_begin, tail_end, slice_length, std::cref(initial_ranks), count, block_isa0, rank,
+        block_last_symbol, text, text_length, std::cref(gt_filenames), &info, t, gap->m_length,
+        gap_buf_size, tail_gt_begin_rev, max_threads, stats_step);
+
   // 6
   //
   // Start threads doing the gap array updates.
@@ -42,6 +42,8 @@
 #include <algorithm>
 
 #include "utils/parallel_utils.hpp"
+#include "utils/thread_pool.hpp"
+#include "utils/huge_pages.hpp"
 #include "bitvector.hpp"
 #include "ranksel_support.hpp"
 #include "gap_array.hpp"
@@ -193,9 +195,9 @@ void compute_right_gap(long left_block_size, long right_block_size,
     n_ranges = (right_gap_size + max_range_size - 1) / max_range_size;
   }
 
-  long *range_gap = (long *)malloc(max_range_size * sizeof(long));
-  unsigned char *active_vbyte_slab = (unsigned char *)malloc(max_range_size * sizeof(long));
-  unsigned char *passive_vbyte_slab = (unsigned char *)malloc(max_range_size * sizeof(long));
+  long *range_gap = (long *)huge_pages::allocate(max_range_size * sizeof(long));
+  unsigned char *active_vbyte_slab = (unsigned char *)huge_pages::allocate(max_range_size * sizeof(long));
+  unsigned char *passive_vbyte_slab = (unsigned char *)huge_pages::allocate(max_range_size * sizeof(long));
   long active_vbyte_slab_length;
   long passive_vbyte_slab_length;
 
@@ -230,8 +232,9 @@ void compute_right_gap(long left_block_size, long right_block_size,
     long bv_section_size = bv_section_end - bv_section_beg;
 
     // Split the current bitvector section into
-    // equal parts. Each thread handles one part.
-    long max_part_size = (bv_section_size + max_threads - 1) / max_threads;
+    // equal parts. Each task handles one part.
+    long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+    long max_part_size = (bv_section_size + max_tasks - 1) / max_tasks;
     long n_parts = (bv_section_size + max_part_size - 1) / max_part_size;
 
     parallel_utils::parallel_fill<long>(range_gap, range_size, 0L, max_threads);
@@ -240,18 +243,16 @@ void compute_right_gap(long left_block_size, long right_block_size,
     long *res_sum = new long[n_parts];
     long *res_rank = new long[n_parts];
 
-    std::thread **threads = new std::thread*[n_parts];
+    task_group tasks;
     for (long t = 0; t < n_parts; ++t) {
       long part_beg = bv_section_beg + t * max_part_size;
       long part_end = std::min(part_beg + max_part_size, bv_section_end);
 
-      threads[t] = new std::thread(rblock_handle_bv_part, part_beg, part_end, range_beg,
+      tasks.add(rblock_handle_bv_part, part_beg, part_end, range_beg,
           range_gap, block_gap, bv, bv_ranksel, std::ref(res_sum[t]), std::ref(res_rank[t]));
     }
 
-    for (long t = 0; t < n_parts; ++t) threads[t]->join();
-    for (long t = 0; t < n_parts; ++t) delete threads[t];
-    delete[] threads;
+    tasks.wait();
 
     // Update range_gap with values computed at part boundaries.
     for (long t = 0; t < n_parts; ++t)
@@ -295,9 +296,9 @@ void compute_right_gap(long left_block_size, long right_block_size,
   // Clean up.
   delete async_writer;
   delete bv_ranksel;
-  free(range_gap);
-  free(active_vbyte_slab);
-  free(passive_vbyte_slab);
+  huge_pages::deallocate(range_gap);
+  huge_pages::deallocate(active_vbyte_slab);
+  huge_pages::deallocate(passive_vbyte_slab);
 
   long double compute_gap_time = utils::wclock() - compute_gap_start;
   long double compute_gap_speed = (block_size / (1024.L * 1024)) / compute_gap_time;
@@ -37,14 +37,15 @@
 #include <string>
 #include <vector>
 #include <algorithm>
-#include <thread>
 
 #include "utils/utils.hpp"
+#include "utils/thread_pool.hpp"
 #include "io/background_block_reader.hpp"
 #include "io/background_chunk_reader.hpp"
 #include "io/multifile_bit_stream_reader.hpp"
 #include "approx_rank.hpp"
 #include "sparse_isa.hpp"
+#include "stream_info.hpp"
 
 
 namespace psascan_private {
@@ -170,7 +171,7 @@ void em_compute_single_initial_rank(
     long pat_beg,    // same here
     long text_length,
     long max_lcp,
-    std::string text_filename,
+    const concatenated_text *text,
     const multifile *tail_gt_begin_reversed,
     std::pair<long, long> &result) {
   if (pat_beg == text_length) {
@@ -187,10 +188,10 @@ void em_compute_single_initial_rank(
 #ifdef EM_STARTING_POS_MODULE_DEBUG_MODE
   long chunk_length = utils::random_long(1L, 10L); 
   background_chunk_reader *chunk_reader =
-    new background_chunk_reader(text_filename, pat_beg, pat_end, chunk_length);
+    new background_chunk_reader(text, pat_beg, pat_end, chunk_length);
 #else
   background_chunk_reader *chunk_reader =
-    new background_chunk_reader(text_filename, pat_beg, pat_end);
+    new background_chunk_reader(text, pat_beg, pat_end);
 #endif
 
   // The current range is [left, right).
@@ -228,7 +229,7 @@ void em_compute_initial_ranks(
     long block_beg,  // wrt to text beg
     long block_end,  // same here
     long text_length,
-    std::string text_filename,
+    const concatenated_text *text,
     const multifile *tail_gt_begin_reversed,
     std::vector<long> &result,
     long max_threads,
@@ -240,25 +241,23 @@ void em_compute_initial_ranks(
   // for streaming is much more natural to use this indexing.
   long block_length = block_end - block_beg;
   long tail_length = tail_end - block_end;
-  long stream_max_block_size = (tail_length + max_threads - 1) / max_threads;
+  long stream_max_block_size = stream_slice_length(tail_length, max_threads);
   long n_threads = (tail_length + stream_max_block_size - 1) / stream_max_block_size;
 
+  // There can be more slices than threads, in which case the
+  // slices wait in the thread pool until a thread is free.
   std::vector<std::pair<long, long> > ranges(n_threads);
-  std::thread **threads = new std::thread*[n_threads];
-
-  for (int t = n_threads - 1; t >= 0; --t) {
+  task_group tasks;
+  for (long t = n_threads - 1; t >= 0; --t) {
     long stream_block_beg = block_end + t * stream_max_block_size;
     long stream_block_end = std::min(stream_block_beg + stream_max_block_size, tail_end);
     long stream_block_size = stream_block_end - stream_block_beg;
 
-    threads[t] = new std::thread(em_compute_single_initial_rank<saidx_t>,
+    tasks.add(em_compute_single_initial_rank<saidx_t>,
         block, block_psa, block_beg, block_end, stream_block_beg, text_length,
-        stream_block_size, text_filename, tail_gt_begin_reversed, std::ref(ranges[t]));
+        stream_block_size, text, tail_gt_begin_reversed, std::ref(ranges[t]));
   }
-
-  for (int t = 0; t < n_threads; ++t) threads[t]->join();
-  for (int t = 0; t < n_threads; ++t) delete threads[t];
-  delete[] threads;
+  tasks.wait();
 
   // Refine ranges until all are single elements.
   result.resize(n_threads);
@@ -461,7 +460,7 @@ void em_compute_single_initial_rank_2(
     long max_lcp,
     long tail_begin,
     background_block_reader *mid_block_reader,
-    std::string text_filename,
+    const concatenated_text *text,
     const multifile *tail_gt_begin_reversed,
     long &result) {
   if (pat_beg == text_length) {
@@ -478,10 +477,10 @@ void em_compute_single_initial_rank_2(
 #ifdef EM_STARTING_POS_MODULE_DEBUG_MODE
   long chunk_length = utils::random_long(1L, 10L); 
   background_chunk_reader *chunk_reader =
-    new background_chunk_reader(text_filename, pat_beg, pat_end, chunk_length);
+    new background_chunk_reader(text, pat_beg, pat_end, chunk_length);
 #else
   background_chunk_reader *chunk_reader =
-    new background_chunk_reader(text_filename, pat_beg, pat_end);
+    new background_chunk_reader(text, pat_beg, pat_end);
 #endif
 
   // The current range is [left, right).
@@ -517,7 +516,7 @@ void em_compute_initial_ranks(
     long block_beg,  // wrt to text beg
     long block_end,  // same here
     long text_length,
-    std::string text_filename,
+    const concatenated_text *text,
     const multifile *tail_gt_begin_reversed,
     std::vector<long> &result,
     long max_threads,
@@ -529,30 +528,27 @@ void em_compute_initial_ranks(
   long mid_block_beg = block_end;
   long mid_block_end = tail_begin;
   long mid_block_size = mid_block_end - mid_block_beg;
-  long stream_max_block_size = (tail_length + max_threads - 1) / max_threads;
+  long stream_max_block_size = stream_slice_length(tail_length, max_threads);
   long n_threads = (tail_length + stream_max_block_size - 1) / stream_max_block_size;
 
   // Start reading the text between the block and the tail in the backgrond.
   background_block_reader *mid_block_reader =
-    new background_block_reader(text_filename, mid_block_beg, mid_block_size);
+    new background_block_reader(text, mid_block_beg, mid_block_size);
 
-  // Compute the initial ranks.
+  // Compute the initial ranks (there can be more slices
+  // than threads, see above).
   std::vector<long> res(n_threads);
-  std::thread **threads = new std::thread*[n_threads];
-
-  for (int t = 0; t < n_threads; ++t) {
+  task_group tasks;
+  for (long t = 0; t < n_threads; ++t) {
     long stream_block_beg = tail_begin + t * stream_max_block_size;
     long max_lcp = std::min(block_length + mid_block_size, text_length - stream_block_beg);
 
-    threads[t] = new std::thread(em_compute_single_initial_rank_2<saidx_t>,
+    tasks.add(em_compute_single_initial_rank_2<saidx_t>,
         block, block_psa, block_beg, block_end, stream_block_beg, text_length,
-        max_lcp, tail_begin, mid_block_reader, text_filename,
+        max_lcp, tail_begin, mid_block_reader, text,
         tail_gt_begin_reversed, std::ref(res[t]));
   }
-
-  for (int t = 0; t < n_threads; ++t) threads[t]->join();
-  for (int t = 0; t < n_threads; ++t) delete threads[t];
-  delete[] threads;
+  tasks.wait();
 
   mid_block_reader->stop();
   delete mid_block_reader;
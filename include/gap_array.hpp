@@ -40,12 +40,15 @@
 #include <vector>
 #include <mutex>
 #include <string>
-#include <thread>
+#include <atomic>
 #include <algorithm>
+#include <utility>
 #include <parallel/algorithm>
 
 #include "utils/utils.hpp"
 #include "utils/parallel_utils.hpp"
+#include "utils/huge_pages.hpp"
+#include "utils/thread_pool.hpp"
 #include "io/async_stream_writer.hpp"
 #include "bitvector.hpp"
 
@@ -60,8 +63,7 @@ struct buffered_gap_array {
     }
 
     m_length = length;
-    m_count = (unsigned char *)malloc(m_length);
-    std::fill(m_count, m_count + m_length, 0);
+    m_count = (unsigned char *)huge_pages::allocate(m_length, true, true);
 
     m_excess = new long[k_excess_limit];
 
@@ -73,10 +75,19 @@ struct buffered_gap_array {
     m_excess_filled = 0L;
     m_excess_disk = 0L;
     m_sorted_excess = NULL;
+    m_excess_count = NULL;
     m_sequential_read_initialized = false;
+
+    // Excess values are counted in buckets of
+    // 2^m_bucket_shift consecutive positions.
+    m_bucket_shift = 0L;
+    while (((m_length - 1) >> m_bucket_shift) >= k_excess_buckets)
+      ++m_bucket_shift;
+    m_bucket_size.assign(((m_length - 1) >> m_bucket_shift) + 1, 0L);
   }
 
   void add_excess(long x) {
+    ++m_bucket_size[x >> m_bucket_shift];
     m_excess[m_excess_filled++] = x;
     if (m_excess_filled == k_excess_limit) {
       m_gap_writing_mutex.lock();
@@ -87,6 +98,13 @@ struct buffered_gap_array {
     }
   }
 
+  // Add many excess values at once (safe to call from many threads).
+  void add_excess(const long *x, long n) {
+    std::lock_guard<std::mutex> lk(m_excess_mutex);
+    for (long i = 0; i < n; ++i)
+      add_excess(x[i]);
+  }
+
   void flush_excess_to_disk() {
     if (m_excess_filled > 0) {
       utils::add_objects_to_file(m_excess, m_excess_filled, m_storage_filename);
@@ -95,28 +113,93 @@ struct buffered_gap_array {
     }
   }
 
-  void start_sequential_access() {
+  //==============================================================================
+  // Prepare the excess values for reading in the order of positions, using
+  // at most ram_budget bytes. The values are kept as runs (a position and
+  // the number of its excess values), so that the RAM does not depend on
+  // how the values are distributed: there is at most one run per position
+  // and one per value, and each takes 2 * sizeof(long) bytes.
+  //
+  // The number of values in every bucket of positions is counted while
+  // adding them. A bucket with at most as many values as positions (and at
+  // most max_runs values) becomes a sparse segment: its values are
+  // distributed into it (using counting sort), sorted, and replaced with
+  // runs. The other buckets are split into dense segments of at most
+  // max_runs positions, where the values are counted for every position.
+  // Either way, a segment takes at most max_runs slots, and there is no
+  // global sort. If the segments do not fit into the budget, they are split
+  // into groups (passes) of consecutive segments that fit, and only one
+  // pass is kept in RAM at a time. The next pass is loaded by get_next()
+  // when it reaches its range of positions. Random access (m_sorted_excess
+  // holding all runs) is only possible if there is a single pass.
+  //==============================================================================
+  void start_sequential_access(long ram_budget, long max_threads) {
     if (!m_sequential_read_initialized) {
       m_sequential_read_initialized = true;
-      m_total_excess = m_excess_filled + m_excess_disk;
-      m_sorted_excess = (long *)malloc(m_total_excess * sizeof(long));
-      std::copy(m_excess, m_excess + m_excess_filled, m_sorted_excess);
-      if (m_excess_disk > 0L) {
-        long *dest = m_sorted_excess + m_excess_filled;
-        long toread = m_excess_disk;
-        utils::read_n_objects_from_file(dest, toread, m_storage_filename.c_str());
+      m_max_threads = std::max(1L, max_threads);
+      m_total_excess_all = m_excess_filled + m_excess_disk;
+
+      // Split buckets into segments.
+      long max_runs = std::max(1L, ram_budget / (2L * (long)sizeof(long)));
+      long n_buckets = (long)m_bucket_size.size();
+      m_segments.clear();
+      m_bucket_first_segment.assign(n_buckets, 0L);
+      m_bucket_segment_width.assign(n_buckets, 0L);
+      for (long b = 0; b < n_buckets; ++b) {
+        long beg = (b << m_bucket_shift);
+        long end = std::min(m_length, (b + 1) << m_bucket_shift);
+        m_bucket_first_segment[b] = (long)m_segments.size();
+        if (m_bucket_size[b] <= std::min(end - beg, max_runs)) {
+          m_bucket_segment_width[b] = end - beg;
+          m_segments.push_back(excess_segment(beg, end, false, m_bucket_size[b]));
+        } else {
+          long width = std::min(end - beg, max_runs);
+          m_bucket_segment_width[b] = width;
+          for (long seg_beg = beg; seg_beg < end; seg_beg += width) {
+            long seg_end = std::min(end, seg_beg + width);
+            m_segments.push_back(excess_segment(seg_beg, seg_end, true, seg_end - seg_beg));
+          }
+        }
+      }
+
+      // Split segments into passes.
+      long n_segments = (long)m_segments.size();
+      long max_slots = 0L;
+      m_pass_segment_beg.assign(1, 0L);
+      for (long seg = 0, slots = 0; seg < n_segments; ++seg) {
+        if (slots > 0 && slots + m_segments[seg].m_slots > max_runs) {
+          m_pass_segment_beg.push_back(seg);
+          slots = 0L;
+        }
+        slots += m_segments[seg].m_slots;
+        max_slots = std::max(max_slots, slots);
       }
-      std::sort(m_sorted_excess, m_sorted_excess + m_total_excess);
+      m_pass_segment_beg.push_back(n_segments);
+
+      m_sorted_excess = (long *)malloc(std::max(1L, max_slots) * sizeof(long));
+      m_excess_count = (long *)malloc(std::max(1L, max_slots) * sizeof(long));
+      m_cur_pass = -1L;
     }
 
+    if (m_cur_pass != 0)
+      load_pass(0);
     m_excess_ptr = 0;
     m_current_pos = 0;
   }
 
+  inline long n_excess_passes() const {
+    return (long)m_pass_segment_beg.size() - 1;
+  }
+
   inline long get_next() {
+    if (m_current_pos == m_pass_end_pos) {
+      load_pass(m_cur_pass + 1);
+      m_excess_ptr = 0;
+    }
+
     long c = 0;
-    while (m_excess_ptr < m_total_excess && m_sorted_excess[m_excess_ptr] == m_current_pos)
-      ++m_excess_ptr, ++c;
+    if (m_excess_ptr < m_total_excess && m_sorted_excess[m_excess_ptr] == m_current_pos)
+      c = m_excess_count[m_excess_ptr++];
     long result = c * 256L + m_count[m_current_pos];
 
     ++m_current_pos;
@@ -126,6 +209,9 @@ struct buffered_gap_array {
   void stop_sequential_access() {
     if (m_sequential_read_initialized) {
       free(m_sorted_excess);
+      free(m_excess_count);
+      m_sorted_excess = NULL;
+      m_excess_count = NULL;
       m_sequential_read_initialized = false;
     } else {
       fprintf(stderr, "\nError: attempting to stop sequential "
@@ -143,7 +229,7 @@ struct buffered_gap_array {
       std::exit(EXIT_FAILURE);
     }
 
-    free(m_count);
+    huge_pages::deallocate(m_count);
     delete[] m_excess;
   }
 
@@ -152,13 +238,14 @@ struct buffered_gap_array {
       utils::file_delete(m_storage_filename);
   }
   
-  // Write to a given file using v-byte encoding.
-  void save_to_file(std::string fname) {
+  // Write to a given file using v-byte encoding. The excess values
+  // take at most ram_budget bytes of RAM. Returns the file size.
+  long save_to_file(std::string fname, long ram_budget, long max_threads) {
     fprintf(stderr, "    Write gap to file: ");
     long double gap_write_start = utils::wclock();
     long bytes_written = 0L;
 
-    start_sequential_access();
+    start_sequential_access(ram_budget, max_threads);
     typedef async_stream_writer<unsigned char> stream_writer_type;
     stream_writer_type *writer = new stream_writer_type(fname);
 
@@ -179,6 +266,7 @@ struct buffered_gap_array {
     long double gap_write_time = utils::wclock() - gap_write_start;
     long double io_speed = (bytes_written / (1024.L * 1024)) / gap_write_time;
     fprintf(stderr, "%.2Lf (%.2LfMiB/s)\n", gap_write_time, io_speed);
+    return bytes_written;
   }
   
   
@@ -194,10 +282,8 @@ struct buffered_gap_array {
 
     // Compute gap[j].
     long gap_j = gap->m_count[j];
-    while (excess_pointer < gap->m_total_excess && gap->m_sorted_excess[excess_pointer] == j) {
-      gap_j += 256L;
-      ++excess_pointer;
-    }
+    if (excess_pointer < gap->m_total_excess && gap->m_sorted_excess[excess_pointer] == j)
+      gap_j += 256L * gap->m_excess_count[excess_pointer++];
 
     long p = beg;
     long ones = std::min(end - p, gap_j - (beg - S));
@@ -209,10 +295,8 @@ struct buffered_gap_array {
 
       // Compute gap[j].
       gap_j = gap->m_count[j];
-      while (excess_pointer < gap->m_total_excess && gap->m_sorted_excess[excess_pointer] == j) {
-        gap_j += 256L;
-        ++excess_pointer;
-      }
+      if (excess_pointer < gap->m_total_excess && gap->m_sorted_excess[excess_pointer] == j)
+        gap_j += 256L * gap->m_excess_count[excess_pointer++];
 
       ones = std::min(end - p, gap_j);
 
@@ -234,10 +318,8 @@ struct buffered_gap_array {
     long excess_ptr = std::lower_bound(gap->m_sorted_excess, gap->m_sorted_excess + gap->m_total_excess, j) - gap->m_sorted_excess;
     while (j < gap->m_length) {
       long gap_j = gap->m_count[j];
-      while (excess_ptr < gap->m_total_excess && gap->m_sorted_excess[excess_ptr] == j) {
-        gap_j += 256L;
-        ++excess_ptr;
-      }
+      if (excess_ptr < gap->m_total_excess && gap->m_sorted_excess[excess_ptr] == j)
+        gap_j += 256L * gap->m_excess_count[excess_ptr++];
 
       if (gapsum_j + gap_j + j + 1 <= range_beg) {
         gapsum_j += gap_j;
@@ -258,10 +340,15 @@ struct buffered_gap_array {
       long chunk_end = std::min(chunk_beg + max_chunk_size, gap->m_length);
 
       // Compute sum of gap values inside chunk. We assume that
-      // the excess values are in RAM and were sorted.
-      long occ = std::upper_bound(gap->m_sorted_excess, gap->m_sorted_excess + gap->m_total_excess, chunk_end - 1)
-        - std::lower_bound(gap->m_sorted_excess, gap->m_sorted_excess + gap->m_total_excess, chunk_beg);
-      long gap_sum_inside_chunk = 256L * std::max(0L, occ);
+      // the runs of excess values are in RAM.
+      long run_beg = std::lower_bound(gap->m_sorted_excess, gap->m_sorted_excess + gap->m_total_excess, chunk_beg)
+        - gap->m_sorted_excess;
+      long run_end = std::lower_bound(gap->m_sorted_excess, gap->m_sorted_excess + gap->m_total_excess, chunk_end)
+        - gap->m_sorted_excess;
+      long occ = 0L;
+      for (long run = run_beg; run < run_end; ++run)
+        occ += gap->m_excess_count[run];
+      long gap_sum_inside_chunk = 256L * occ;
       for (long j = chunk_beg; j < chunk_end; ++j)
         gap_sum_inside_chunk += gap->m_count[j];
 
@@ -270,7 +357,14 @@ struct buffered_gap_array {
     }
   }
 
-  bitvector* convert_to_bitvector(long max_threads) {
+  // Convert the gap array into a bitvector, where gap[j] is encoded
+  // as gap[j] ones followed by a zero (the last zero is omitted). The
+  // excess values take at most ram_budget bytes of RAM.
+  bitvector* convert_to_bitvector(long max_threads, long ram_budget) {
+    start_sequential_access(ram_budget, max_threads);
+    if (n_excess_passes() > 1)
+      return convert_to_bitvector_sequential();
+
     // 1
     //
     // The term chunks is used to compute sparse gapsum array.
@@ -284,24 +378,24 @@ struct buffered_gap_array {
     // 2
     //
     // Compute the sum of gap value inside each chunk. Since there can be
-    // more chunks than threads, we split chunks into groups and let each
-    // thread compute the sum of gap values inside the group of chunks.
-    long chunk_group_size = (n_chunks + max_threads - 1) / max_threads;
+    // more chunks than tasks, we split chunks into groups and let each
+    // task compute the sum of gap values inside the group of chunks.
+    long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+    long chunk_group_size = (n_chunks + max_tasks - 1) / max_tasks;
     long n_chunk_groups = (n_chunks + chunk_group_size - 1) / chunk_group_size;
 
-    start_sequential_access();
-    std::thread **threads = new std::thread*[n_chunk_groups];
-    for (long t = 0; t < n_chunk_groups; ++t) {
-      long chunk_group_beg = t * chunk_group_size;
-      long chunk_group_end = std::min(chunk_group_beg + chunk_group_size, n_chunks);
+    {
+      task_group tasks;
+      for (long t = 0; t < n_chunk_groups; ++t) {
+        long chunk_group_beg = t * chunk_group_size;
+        long chunk_group_end = std::min(chunk_group_beg + chunk_group_size, n_chunks);
 
-      threads[t] = new std::thread(compute_gapsum_for_chunk_group, chunk_group_beg,
-          chunk_group_end, max_chunk_size, sparse_gapsum, this);
-    }
+        tasks.add(compute_gapsum_for_chunk_group, chunk_group_beg,
+            chunk_group_end, max_chunk_size, sparse_gapsum, this);
+      }
 
-    for (long t = 0; t < n_chunk_groups; ++t) threads[t]->join();
-    for (long t = 0; t < n_chunk_groups; ++t) delete threads[t];
-    delete[] threads;
+      tasks.wait();
+    }
 
 
     // 3
@@ -317,44 +411,47 @@ struct buffered_gap_array {
 
     // 4
     //
-    // Compute all initial gap pointers. For a thread handling range [beg..end), the
+    // Compute all initial gap pointers. For a task handling range [beg..end), the
     // initial_gap_ptr values is the largest j, such that gapsum[j] + j <= beg.
     // After we find j, we store the value of gapsum[j] + j in initial_gapsum_value.
     long result_length = (m_length + gap_total_sum) - 1;
     bitvector *result = new bitvector(result_length + 1);  // +1 is to make room for sentinel
 
-    long max_range_size = (result_length + max_threads - 1) / max_threads;
+    long max_range_size = (result_length + max_tasks - 1) / max_tasks;
     while (max_range_size & 7) ++max_range_size;
     long n_ranges = (result_length + max_range_size - 1) / max_range_size;
 
     long *initial_gap_ptr = new long[n_ranges];
     long *initial_gapsum_value = new long[n_ranges];
 
-    threads = new std::thread*[n_ranges];
-    for (long t = 0; t < n_ranges; ++t) {
-      long range_beg = t * max_range_size;
-      threads[t] = new std::thread(compute_j_aux, range_beg, n_chunks, max_chunk_size,
-          sparse_gapsum, std::ref(initial_gap_ptr[t]), std::ref(initial_gapsum_value[t]), this);
+    {
+      task_group tasks;
+      for (long t = 0; t < n_ranges; ++t) {
+        long range_beg = t * max_range_size;
+        tasks.add(compute_j_aux, range_beg, n_chunks, max_chunk_size,
+            sparse_gapsum, std::ref(initial_gap_ptr[t]), std::ref(initial_gapsum_value[t]), this);
+      }
+
+      tasks.wait();
     }
-    for (long t = 0; t < n_ranges; ++t) threads[t]->join();
-    for (long t = 0; t < n_ranges; ++t) delete threads[t];
 
 
     // 5
     //
-    // Compute the bitvector. Each thread fills in the range of bits.
-    for (long t = 0; t < n_ranges; ++t) {
-      long range_beg = t * max_range_size;
-      long range_end = std::min(range_beg + max_range_size, result_length);
+    // Compute the bitvector. Each task fills in the range of bits.
+    {
+      task_group tasks;
+      for (long t = 0; t < n_ranges; ++t) {
+        long range_beg = t * max_range_size;
+        long range_end = std::min(range_beg + max_range_size, result_length);
+
+        tasks.add(convert_gap_to_bitvector_aux, range_beg,
+            range_end, initial_gap_ptr[t], initial_gapsum_value[t], this, result);
+      }
 
-      threads[t] = new std::thread(convert_gap_to_bitvector_aux, range_beg,
-          range_end, initial_gap_ptr[t], initial_gapsum_value[t], this, result);
+      tasks.wait();
     }
 
-    for (long t = 0; t < n_ranges; ++t) threads[t]->join();
-    for (long t = 0; t < n_ranges; ++t) delete threads[t];
-    delete[] threads;
-
     delete[] initial_gap_ptr;
     delete[] initial_gapsum_value;
     stop_sequential_access();
@@ -363,7 +460,194 @@ struct buffered_gap_array {
     return result;
   }
   
+  // Used by convert_to_bitvector if the excess values do not fit into RAM
+  // (and hence cannot be accessed in parallel): the gap is read sequentially.
+  bitvector *convert_to_bitvector_sequential() {
+    long gap_total_sum = 256L * m_total_excess_all;
+    for (long j = 0; j < m_length; ++j)
+      gap_total_sum += m_count[j];
+
+    long result_length = (m_length + gap_total_sum) - 1;
+    bitvector *result = new bitvector(result_length + 1);  // +1 is to make room for sentinel
+    for (long j = 0, p = 0; p < result_length; ++j) {
+      long gap_j = get_next();
+      for (long k = 0; k < gap_j; ++k) result->set(p++);
+      ++p;
+    }
+
+    stop_sequential_access();
+    return result;
+  }
+
+  // A range of positions whose excess values are loaded together (see
+  // start_sequential_access). A sparse segment stores its values, a dense
+  // segment a count for every position, in m_slots slots.
+  struct excess_segment {
+    long m_beg;
+    long m_end;
+    bool m_dense;
+    long m_slots;
+
+    excess_segment(long beg, long end, bool dense, long slots) {
+      m_beg = beg;
+      m_end = end;
+      m_dense = dense;
+      m_slots = slots;
+    }
+  };
+
+  // Segment containing position x of the current pass.
+  inline long segment_of(long x) const {
+    long b = (x >> m_bucket_shift);
+    return m_bucket_first_segment[b] +
+      (x - (b << m_bucket_shift)) / m_bucket_segment_width[b];
+  }
+
+  // Count the values of the slice of src that belong to the sparse segments
+  // of the current pass (into hist), or if scatter is true, move them to
+  // m_sorted_excess at positions given by hist and count the values of the
+  // dense segments.
+  static void distribute_excess_aux(const buffered_gap_array *gap,
+      const long *src, long length, const long *slot_beg, long *hist,
+      bool scatter) {
+    long first_segment = gap->m_pass_segment_beg[gap->m_cur_pass];
+    for (long i = 0; i < length; ++i) {
+      long x = src[i];
+      if (x < gap->m_pass_beg_pos || x >= gap->m_pass_end_pos) continue;
+      long seg = gap->segment_of(x) - first_segment;
+      const excess_segment &segment = gap->m_segments[first_segment + seg];
+      if (!segment.m_dense) {
+        if (scatter) gap->m_sorted_excess[hist[seg]++] = x;
+        else ++hist[seg];
+      } else if (scatter)
+        __sync_fetch_and_add(gap->m_excess_count + slot_beg[seg] + (x - segment.m_beg), 1L);
+    }
+  }
+
+  // Distribute the values src[0..length) belonging to the segments
+  // of the current pass to their slots, starting at slot_ptr.
+  void distribute_excess(const long *src, long length,
+      const std::vector<long> &slot_beg, std::vector<long> &slot_ptr) {
+    long n_segments = (long)slot_ptr.size();
+    long n_threads = std::max(1L, std::min(m_max_threads, length / (1L << 16)));
+    long slice = (length + n_threads - 1) / n_threads;
+    std::vector<std::vector<long> > hist(n_threads, std::vector<long>(n_segments, 0L));
+
+    for (long scatter = 0; scatter < 2; ++scatter) {
+      if (scatter) {
+
+        // Compute where each thread writes the values of each segment.
+        for (long seg = 0; seg < n_segments; ++seg) {
+          for (long t = 0; t < n_threads; ++t) {
+            long count = hist[t][seg];
+            hist[t][seg] = slot_ptr[seg];
+            slot_ptr[seg] += count;
+          }
+        }
+      }
+
+      task_group tasks;
+      for (long t = 0; t < n_threads; ++t) {
+        long beg = std::min(length, t * slice);
+        long end = std::min(length, beg + slice);
+        tasks.add(distribute_excess_aux, this, src + beg,
+            end - beg, slot_beg.data(), hist[t].data(), (bool)scatter);
+      }
+      tasks.wait();
+    }
+  }
+
+  static void sort_segments_aux(long *tab,
+      const std::vector<std::pair<long, long> > *ranges,
+      std::atomic<long> *next_range) {
+    long r;
+    while ((r = next_range->fetch_add(1L)) < (long)ranges->size())
+      std::sort(tab + (*ranges)[r].first, tab + (*ranges)[r].second);
+  }
+
+  // Load the runs of excess values of the given pass into m_sorted_excess
+  // and m_excess_count: distribute the values (from RAM and disk) to the
+  // segments, sort the sparse segments and replace the slots with runs.
+  void load_pass(long pass) {
+    if (pass == m_cur_pass) return;
+    if (pass >= n_excess_passes()) {
+      fprintf(stderr, "\nError: reading past the end of gap array\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    m_cur_pass = pass;
+    long first_segment = m_pass_segment_beg[pass];
+    long n_segments = m_pass_segment_beg[pass + 1] - first_segment;
+    m_pass_beg_pos = m_segments[first_segment].m_beg;
+    m_pass_end_pos = m_segments[first_segment + n_segments - 1].m_end;
+
+    std::vector<long> slot_beg(n_segments + 1, 0L);
+    for (long seg = 0; seg < n_segments; ++seg)
+      slot_beg[seg + 1] = slot_beg[seg] + m_segments[first_segment + seg].m_slots;
+    std::vector<long> slot_ptr(slot_beg.begin(), slot_beg.end() - 1);
+    for (long seg = 0; seg < n_segments; ++seg)
+      if (m_segments[first_segment + seg].m_dense)
+        std::fill(m_excess_count + slot_beg[seg], m_excess_count + slot_beg[seg + 1], 0L);
+
+    // Distribute values.
+    if (slot_beg[n_segments] > 0) {
+      distribute_excess(m_excess, m_excess_filled, slot_beg, slot_ptr);
+      if (m_excess_disk > 0) {
+        long buf_size = std::min(m_excess_disk, (1L << 20));
+        long *buf = (long *)malloc(buf_size * sizeof(long));
+        std::FILE *f = utils::open_file(m_storage_filename.c_str(), "r");
+        for (long done = 0; done < m_excess_disk; done += buf_size) {
+          long toread = std::min(buf_size, m_excess_disk - done);
+          utils::read_n_objects_from_file(buf, toread, f);
+          distribute_excess(buf, toread, slot_beg, slot_ptr);
+        }
+        std::fclose(f);
+        free(buf);
+      }
+    }
+
+    // Sort sparse segments in parallel.
+    std::vector<std::pair<long, long> > ranges;
+    for (long seg = 0; seg < n_segments; ++seg)
+      if (!m_segments[first_segment + seg].m_dense && slot_beg[seg] < slot_beg[seg + 1])
+        ranges.push_back(std::make_pair(slot_beg[seg], slot_beg[seg + 1]));
+    std::atomic<long> next_range(0L);
+    long n_tasks = std::max(1L, std::min(m_max_threads *
+          thread_pool::k_tasks_per_thread, (long)ranges.size()));
+    {
+      task_group tasks;
+      for (long t = 0; t < n_tasks; ++t)
+        tasks.add(sort_segments_aux, m_sorted_excess, &ranges, &next_range);
+      tasks.wait();
+    }
+
+    // Replace the slots with runs. Every slot gives at most one
+    // run, so the runs can be written over the slots already read.
+    long n_runs = 0L;
+    for (long seg = 0; seg < n_segments; ++seg) {
+      const excess_segment &segment = m_segments[first_segment + seg];
+      if (segment.m_dense) {
+        for (long i = slot_beg[seg]; i < slot_beg[seg + 1]; ++i) {
+          long count = m_excess_count[i];
+          if (count > 0) {
+            m_sorted_excess[n_runs] = segment.m_beg + (i - slot_beg[seg]);
+            m_excess_count[n_runs++] = count;
+          }
+        }
+      } else {
+        for (long i = slot_beg[seg], j; i < slot_beg[seg + 1]; i = j) {
+          long x = m_sorted_excess[i];
+          for (j = i + 1; j < slot_beg[seg + 1] && m_sorted_excess[j] == x; ++j);
+          m_sorted_excess[n_runs] = x;
+          m_excess_count[n_runs++] = j - i;
+        }
+      }
+    }
+    m_total_excess = n_runs;
+  }
+
   static const long k_excess_limit = (1L << 22);
+  static const long k_excess_buckets = (1L << 10);
 
   unsigned char *m_count;
   long m_length;
@@ -377,16 +661,30 @@ struct buffered_gap_array {
   long m_excess_ptr;
   long m_current_pos;
 
+  // Buckets of positions, their segments and grouping into passes.
+  long m_bucket_shift;
+  std::vector<long> m_bucket_size;      // number of excess values in bucket
+  std::vector<long> m_bucket_first_segment;
+  std::vector<long> m_bucket_segment_width;
+  std::vector<excess_segment> m_segments;
+  std::vector<long> m_pass_segment_beg; // first segment of each pass
+  long m_cur_pass;                      // pass in m_sorted_excess
+  long m_pass_beg_pos;                  // range of positions of m_cur_pass
+  long m_pass_end_pos;
+  long m_total_excess_all;              // in all passes
+  long m_max_threads;
+
 public:
-  long *m_sorted_excess;
-  long m_total_excess; 
+  long *m_sorted_excess;  // positions of runs of excess values
+  long *m_excess_count;   // number of excess values in each run
+  long m_total_excess;    // number of runs
 };
 
 
 struct gap_array_2n {
   gap_array_2n(const buffered_gap_array *gap, long max_threads) {
     m_length = gap->m_length;
-    m_count = (uint16_t *)malloc(m_length * sizeof(uint16_t));
+    m_count = (uint16_t *)huge_pages::allocate(m_length * sizeof(uint16_t));
     parallel_utils::parallel_copy<unsigned char, uint16_t>(gap->m_count, m_count, m_length, max_threads);
     m_storage_filename = gap->m_storage_filename;
     m_excess_disk = gap->m_excess_disk;
@@ -394,12 +692,12 @@ struct gap_array_2n {
 
   gap_array_2n(long length) {
     m_length = length;
-    m_count = (uint16_t *)malloc(m_length * sizeof(uint16_t));
+    m_count = (uint16_t *)huge_pages::allocate(m_length * sizeof(uint16_t));
   }
 
   ~gap_array_2n() {
     if (m_count)
-      free(m_count);
+      huge_pages::deallocate(m_count);
   }
 
   static void apply_excess_aux(gap_array_2n *gap, const long *tab,
@@ -443,16 +741,16 @@ struct gap_array_2n {
     long *buffer = (long *)malloc(elems * sizeof(long));
 
     std::FILE *f = utils::open_file(m_storage_filename.c_str(), "r");
-    std::thread **threads = new std::thread*[max_threads];
 
-    // After sorting the buffer, when we split it equally between threads
-    // we obey the rule, the every thread only counts the number of 
+    // After sorting the buffer, when we split it equally between tasks
+    // we obey the rule, the every task only counts the number of 
     // elements equal to the first element in the handled range, but does
-    // not do any updates for these elements. This prevents two threads
+    // not do any updates for these elements. This prevents two tasks
     // trying to update the same elements in the m_count array. The
-    // length of the first run is computed and returned by each thread.
+    // length of the first run is computed and returned by each task.
     // It is then updated sequentially.
-    uint64_t *first_run_length = new uint64_t[max_threads];
+    long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+    uint64_t *first_run_length = new uint64_t[max_tasks];
  
     while (m_excess_disk > 0) {
       // Read a portion of excess values from disk.
@@ -463,22 +761,22 @@ struct gap_array_2n {
       __gnu_parallel::sort(buffer, buffer + toread);
 
       // Update m_count and m_excess with elements from the buffer.
-      // The buffer is dividied into blocks, each blocks handles one
-      // block. Each thread updates the values except the first run
+      // The buffer is dividied into blocks, each task handles one
+      // block. Each task updates the values except the first run
       // of the block, which is handled separatelly (sequentially).
-      long max_block_size = (toread + max_threads - 1) / max_threads;
+      long max_block_size = (toread + max_tasks - 1) / max_tasks;
       long n_blocks = (toread + max_block_size - 1) / max_block_size;
 
+      task_group tasks;
       for (long t = 0; t < n_blocks; ++t) {
         long block_beg = t * max_block_size;
         long block_end = std::min(block_beg + max_block_size, toread);
 
-        threads[t] = new std::thread(apply_excess_aux, this, buffer,
+        tasks.add(apply_excess_aux, this, buffer,
             block_beg, block_end, std::ref(first_run_length[t]));
       }
 
-      for (long t = 0; t < n_blocks; ++t) threads[t]->join();
-      for (long t = 0; t < n_blocks; ++t) delete threads[t];
+      tasks.wait();
 
       // Sequentially handle the elements in the first run of each block.
       for (long t = 0; t < n_blocks; ++t) {
@@ -498,7 +796,6 @@ struct gap_array_2n {
 
     __gnu_parallel::sort(m_excess.begin(), m_excess.end());
 
-    delete[] threads;
     delete[] first_run_length;
 
     std::fclose(f);
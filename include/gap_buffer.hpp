@@ -40,6 +40,8 @@
 #include <mutex>
 #include <condition_variable>
 
+#include "utils/huge_pages.hpp"
+
 
 namespace psascan_private {
 
@@ -48,14 +50,14 @@ struct gap_buffer {
   gap_buffer(long size_bytes, long n_increasers)
       : m_filled(0L),
         m_size(size_bytes / sizeof(value_type)) {
-    m_content = new value_type[m_size];
+    m_content = (value_type *)huge_pages::allocate(m_size * sizeof(value_type));
 
     sblock_size = new long[n_increasers];
     sblock_beg = new long[n_increasers];
   }
   
   ~gap_buffer() {
-    delete[] m_content;
+    huge_pages::deallocate(m_content);
     delete[] sblock_size;
     delete[] sblock_beg;
   }
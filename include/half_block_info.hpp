@@ -49,6 +49,7 @@ struct half_block_info {
 
   std::string gap_filename;
   distributed_file<block_offset_type> *psa;
+  distributed_file<unsigned char> *bwt;  // NULL if BWT is not computed
 
   bool operator < (const half_block_info &i) const {
     return beg < i.beg;
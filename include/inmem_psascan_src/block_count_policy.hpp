@@ -0,0 +1,130 @@
+/**
+ * @file    src/psascan_src/inmem_psascan_src/block_count_policy.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_INMEM_PSASCAN_SRC_BLOCK_COUNT_POLICY_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_INMEM_PSASCAN_SRC_BLOCK_COUNT_POLICY_HPP_INCLUDED
+
+#include <cmath>
+#include <algorithm>
+
+#include "../utils/numa.hpp"
+#include "merge_schedule.hpp"
+
+
+namespace psascan_private {
+namespace inmem_psascan_private {
+
+// True if the blocks are sorted using the multithreaded
+// libsais (built with -DUSE_LIBSAIS -DLIBSAIS_OPENMP).
+#if defined(USE_LIBSAIS) && defined(LIBSAIS_OPENMP)
+const bool multithreaded_block_sort = true;
+#else
+const bool multithreaded_block_sort = false;
+#endif
+
+// Parameters of the cost model, in units of the time to sort one byte
+// of text using one thread. These are unmeasured placeholders, not yet
+// calibrated against the multithreaded libsais:
+// - the speedup of sorting a block using p threads is p^block_sort_scaling,
+// - one left merge (see merge_schedule.hpp) costs left_merge_cost per byte,
+// - computing the BWT of the blocks costs block_bwt_cost per byte.
+// The merging and the BWT computation use all threads.
+const long double block_sort_scaling = 0.7L;
+const long double left_merge_cost = 0.08L;
+const long double block_bwt_cost = 0.02L;
+
+// The number of threads sorting block block_id. The threads
+// are split evenly between the n_blocks blocks.
+inline long block_sort_threads(long block_id, long n_blocks,
+    long max_threads) {
+  if (!multithreaded_block_sort || n_blocks >= max_threads) return 1L;
+  return max_threads / n_blocks + (block_id < max_threads % n_blocks);
+}
+
+//==============================================================================
+// Choose the number of blocks into which inmem_psascan splits the text.
+//
+// With a single-threaded suffix sorter, every thread sorts one block, i.e.,
+// the text is split into max_threads blocks. With the multithreaded libsais,
+// each block can be sorted by several threads, and fewer, larger blocks
+// need less merging. The number of blocks is then chosen to minimize the
+// estimated time of sorting the blocks plus the time of merging them,
+// using the cost of the merge schedule (with the same limit on the size of
+// the left side of the merges as used by inmem_psascan) for each candidate
+// number of blocks.
+//
+// The blocks must be shorter than 2GiB (after aligning their size to
+// alignment_unit), and in NUMA mode there is at least one block per node.
+//==============================================================================
+inline long choose_n_blocks(long text_length, long max_threads,
+    long alignment_unit, float rl_ratio, long double max_left_fraction) {
+  if (!multithreaded_block_sort || max_threads <= 1)
+    return max_threads;
+
+  long max_block_size = (2L << 30) - alignment_unit - 1;
+  long min_blocks = (text_length + max_block_size - 1) / max_block_size;
+  if (numa::enabled())
+    min_blocks = std::max(min_blocks, numa::n_nodes());
+  min_blocks = std::max(1L, min_blocks);
+  if (min_blocks >= max_threads)
+    return max_threads;
+
+  long best_n_blocks = max_threads;
+  long double best_cost = 0.L;
+  for (long n_blocks = min_blocks; n_blocks <= max_threads; ++n_blocks) {
+    long double block_size = (long double)text_length / n_blocks;
+    long sort_threads = block_sort_threads(n_blocks - 1, n_blocks, max_threads);
+    long double cost = block_size /
+      std::pow((long double)sort_threads, block_sort_scaling);
+
+    if (n_blocks > 1) {
+      int max_left_size = std::max(1, (int)floor(n_blocks * max_left_fraction));
+      MergeSchedule schedule(n_blocks, rl_ratio, max_left_size);
+      cost += (left_merge_cost * schedule.cost(n_blocks) + block_bwt_cost) *
+        text_length / max_threads;
+    }
+
+    if (n_blocks == min_blocks || cost < best_cost) {
+      best_cost = cost;
+      best_n_blocks = n_blocks;
+    }
+  }
+
+  return best_n_blocks;
+}
+
+}  // namespace inmem_psascan_private
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_INMEM_PSASCAN_SRC_BLOCK_COUNT_POLICY_HPP_INCLUDED
@@ -46,9 +46,9 @@
 
 #include <cstring>
 #include <algorithm>
-#include <thread>
 
 #include "../bitvector.hpp"
+#include "../utils/thread_pool.hpp"
 #include "srank_aux.hpp"
 
 
@@ -137,18 +137,16 @@ void gt_end_to_gt_begin(const unsigned char *text, long text_length,
   //----------------------------------------------------------------------------
   // STEP 2: compute remaining bits in every block.
   //----------------------------------------------------------------------------
-  std::thread **threads = new std::thread*[n_blocks];
+  task_group tasks;
   for (long i = 0; i < n_blocks; ++i) {
     long block_end = text_length - (n_blocks - 1 - i) * max_block_size;
     long block_beg = std::max(0L, block_end - max_block_size);
 
-    threads[i] = new std::thread(gt_end_to_gt_begin_aux,
+    tasks.add(gt_end_to_gt_begin_aux,
         text, text_length, block_beg, block_end, gt);
   }
 
-  for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_blocks; ++i) delete threads[i];
-  delete[] threads;
+  tasks.wait();
 }
 
 }  // namespace inmem_psascan_private
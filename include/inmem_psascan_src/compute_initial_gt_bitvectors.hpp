@@ -46,12 +46,12 @@
 #include <cstdio>
 #include <cstring>
 #include <algorithm>
-#include <thread>
 
 #include "../io/multifile.hpp"
 #include "../io/multifile_bit_stream_reader.hpp"
 #include "../io/background_block_reader.hpp"
 #include "../bitvector.hpp"
+#include "../utils/thread_pool.hpp"
 #include "srank_aux.hpp"
 
 
@@ -294,23 +294,23 @@ void compute_initial_gt_bitvectors(const unsigned char *text, long text_length,
   // Process blocks right-to-left.
   fprintf(stderr, "  Computing decided bits: ");
   start = utils::wclock();
-  std::thread **threads = new std::thread*[n_blocks];
-  for (long i = 0; i < n_blocks; ++i) {
-    long block_end = text_length - (n_blocks - 1 - i) * max_block_size;
-    long block_beg = std::max(0L, block_end - max_block_size);
+  {
+    task_group tasks;
+    for (long i = 0; i < n_blocks; ++i) {
+      long block_end = text_length - (n_blocks - 1 - i) * max_block_size;
+      long block_beg = std::max(0L, block_end - max_block_size);
+
+      // Compute bitvectors 'gt' and 'undecided' for block i.
+      tasks.add(compute_partial_gt_end,
+          text, text_length, block_beg, block_end, max_block_size, gt,
+          undecided, std::ref(all_decided[i]), text_end, supertext_length,
+          tail_gt_begin_reversed, tail_prefix_background_reader,
+          tail_prefix_preread);
+    }
 
-    // Compute bitvectors 'gt' and 'undecided' for block i.
-    threads[i] = new std::thread(compute_partial_gt_end,
-        text, text_length, block_beg, block_end, max_block_size, gt,
-        undecided, std::ref(all_decided[i]), text_end, supertext_length,
-        tail_gt_begin_reversed, tail_prefix_background_reader,
-        tail_prefix_preread);
+    // Wait for the tasks to finish.
+    tasks.wait();
   }
-
-  // Wait for the threads to finish and clean up.
-  for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_blocks; ++i) delete threads[i];
-  delete[] threads;
   fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
 
   //----------------------------------------------------------------------------
@@ -326,18 +326,19 @@ void compute_initial_gt_bitvectors(const unsigned char *text, long text_length,
 
   fprintf(stderr, "  Computing undecided bits: ");
   start = utils::wclock();
-  threads = new std::thread*[n_microblocks];
-  for (long i = 0; i < n_microblocks; ++i) {
-    long mb_beg = i * max_microblock_size;
-    long mb_end = std::min(mb_beg + max_microblock_size, max_block_size);
+  {
+    task_group tasks;
+    for (long i = 0; i < n_microblocks; ++i) {
+      long mb_beg = i * max_microblock_size;
+      long mb_end = std::min(mb_beg + max_microblock_size, max_block_size);
+
+      tasks.add(compute_final_gt, text_length, max_block_size,
+          mb_beg, mb_end, std::ref(gt), std::ref(undecided), all_decided);
+    }
 
-    threads[i] = new std::thread(compute_final_gt, text_length, max_block_size,
-        mb_beg, mb_end, std::ref(gt), std::ref(undecided), all_decided);
+    // Wait for the tasks to finish.
+    tasks.wait();
   }
-
-  // Wait for the threads to finish and clean up.
-  for (long i = 0; i < n_microblocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_microblocks; ++i) delete threads[i];
   fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
   
   // Fill in the skipped (due to parallel byte access issue) undecided bits.
@@ -351,7 +352,6 @@ void compute_initial_gt_bitvectors(const unsigned char *text, long text_length,
 
   fprintf(stderr, "  Deallocating: ");
   start = utils::wclock();
-  delete[] threads;
   delete undecided;
   delete[] all_decided;
   fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
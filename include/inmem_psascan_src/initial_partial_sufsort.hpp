@@ -35,58 +35,211 @@
 #ifndef __SRC_PSASCAN_SRC_INMEM_PSASCAN_SRC_INITIAL_PARTIAL_SUFSORT_HPP_INCLUDED
 #define __SRC_PSASCAN_SRC_INMEM_PSASCAN_SRC_INITIAL_PARTIAL_SUFSORT_HPP_INCLUDED
 
+#include <cstdint>
+#include <cstdlib>
 #include <algorithm>
 #include <thread>
 
 #include "../bitvector.hpp"
+#include "../utils/numa.hpp"
+#include "../utils/thread_pool.hpp"
+#include "../utils/huge_pages.hpp"
 
 #ifdef USE_LIBSAIS
     #include "sais_template.hpp"    
 #else
     #include "divsufsort_template.hpp"
 #endif
+#ifdef HAVE_LIBSAIS16
+    #include "sais16_template.hpp"
+#endif
 
 #include "bwtsa.hpp"
 #include "parallel_shrink.hpp"
 #include "parallel_expand.hpp"
 #include "parallel_copy.hpp"
+#include "block_count_policy.hpp"
 
 
 namespace psascan_private {
 namespace inmem_psascan_private {
 
 //==============================================================================
-// Rename the given block using its gt bitvector.
+// Describes how the block was renamed. The original block is restored by
+// adding m_delta to all symbols in the range [m_lo..m_hi]. If m_text16 !=
+// NULL, the renamed block did not fit into the byte alphabet and was
+// written into m_text16 (the original block is then left unchanged).
+// m_text16 is either allocated (m_text16_owned = true) or placed in the
+// unused part of the bwtsa array (see text16_ram_per_symbol). If pSAscan
+// is built without libsais16, such block cannot be renamed (m_error).
+//==============================================================================
+struct block_renaming {
+  long m_lo;
+  long m_hi;
+  long m_delta;
+  std::uint16_t *m_text16;
+  bool m_text16_owned;
+  bool m_error;
+
+  block_renaming() {
+    m_lo = 0;
+    m_hi = -1;
+    m_delta = 0;
+    m_text16 = NULL;
+    m_text16_owned = false;
+    m_error = false;
+  }
+};
+
+//==============================================================================
+// The RAM (in bytes per symbol) taken by the 16-bit copies of the blocks in
+// which all 256 symbols occur, in addition to the text, bwtsa array and gt
+// bitvector. The suffix arrays of the blocks are first computed as 32-bit
+// integers in the first 4 bytes per symbol of the bwtsa array. If the bwtsa
+// objects take at least 6 bytes (i.e., with 40-bit offsets), the 16-bit
+// texts fit into the rest of the array. Otherwise, they are allocated.
+//==============================================================================
+inline long double text16_ram_per_symbol(long saidx_size) {
+  return (saidx_size + 1 >= 6) ? 0.L : 2.L;
+}
+
+
+//==============================================================================
+// Rename the given block using its gt bitvector. The occurrences of the
+// last symbol of the block are split into two symbols. To make room for
+// the new symbol, only the symbols between the last symbol and the nearest
+// symbol not occurring in the block are shifted. If all 256 symbols occur
+// in the block, the renamed block is written over 16-bit alphabet into
+// text16_space (or into a new array if text16_space == NULL).
 //==============================================================================
 void rename_block(unsigned char *text, long text_length, long block_beg,
-    long block_length, bitvector *gt, bool &renaming_error) {
+    long block_length, bitvector *gt, std::uint16_t *text16_space,
+    block_renaming &renaming) {
   long block_end = block_beg + block_length;
   long beg_rev = text_length - block_end;
   unsigned char *block = text + block_beg;
-  unsigned char last = block[block_length - 1];
-  bool err = false;
-  for (long i = 0; i + 1 < block_length; ++i)
-    if (block[i] > last || (block[i] == last && gt->get(beg_rev + i + 1))) {
-      if (block[i] == 255)
-        err = true;
-      ++block[i];
+  long last = block[block_length - 1];
+
+  // Find the nearest symbols (above and below
+  // the last symbol) not occurring in the block.
+  bool occurs[256];
+  std::fill(occurs, occurs + 256, false);
+  for (long i = 0; i < block_length; ++i)
+    occurs[block[i]] = true;
+  long free_above = last + 1;
+  while (free_above < 256 && occurs[free_above]) ++free_above;
+  long free_below = last - 1;
+  while (free_below >= 0 && occurs[free_below]) --free_below;
+
+  if (free_above < 256) {
+    for (long i = 0; i + 1 < block_length; ++i)
+      if ((block[i] > last && block[i] < free_above) ||
+          (block[i] == last && gt->get(beg_rev + i + 1)))
+        ++block[i];
+    ++block[block_length - 1];
+
+    renaming.m_lo = last + 1;
+    renaming.m_hi = free_above;
+    renaming.m_delta = -1;
+  } else if (free_below >= 0) {
+    for (long i = 0; i + 1 < block_length; ++i)
+      if ((block[i] < last && block[i] > free_below) ||
+          (block[i] == last && !gt->get(beg_rev + i + 1)))
+        --block[i];
+
+    renaming.m_lo = free_below;
+    renaming.m_hi = last - 1;
+    renaming.m_delta = 1;
+  } else {
+    #ifdef HAVE_LIBSAIS16
+    std::uint16_t *text16 = text16_space;
+    if (text16 == NULL) {
+      text16 = (std::uint16_t *)huge_pages::allocate(
+          block_length * (long)sizeof(std::uint16_t));
+      renaming.m_text16_owned = true;
     }
-  if (block[block_length - 1] == 255)
-    err = true;
-  ++block[block_length - 1];
+    for (long i = 0; i + 1 < block_length; ++i) {
+      text16[i] = block[i];
+      if (block[i] > last || (block[i] == last && gt->get(beg_rev + i + 1)))
+        ++text16[i];
+    }
+    text16[block_length - 1] = last + 1;
+    renaming.m_text16 = text16;
+    #else
+    (void)text16_space;
+    renaming.m_error = true;
+    #endif
+  }
+}
+
 
-  if (err)
-    renaming_error = true;
+//==============================================================================
+// Exit if some of the blocks could not be renamed (see block_renaming).
+//==============================================================================
+void check_renaming(const block_renaming *renaming, long n_blocks) {
+  for (long i = 0; i < n_blocks; ++i) {
+    if (renaming[i].m_error) {
+      fprintf(stdout, "\n\nError: a block containing all 256 byte values was "
+          "detected in the input text!\nSee the section on limitations in the "
+          "README for more information.\n");
+      std::fflush(stdout);
+      std::exit(EXIT_FAILURE);
+    }
+  }
+}
+
+
+//==============================================================================
+// Compute the suffix array of the (renamed) block using n_threads threads
+// (see block_count_policy.hpp, with divsufsort n_threads is always 1).
+//==============================================================================
+void sort_block(const unsigned char *block, int *sa,
+    long block_length, block_renaming &renaming, long n_threads) {
+  if (renaming.m_text16 != NULL) {
+    #ifdef HAVE_LIBSAIS16
+    if (n_threads > 1)
+      run_sais16_parallel<int>(renaming.m_text16, sa, block_length, n_threads);
+    else run_sais16<int>(renaming.m_text16, sa, block_length);
+    if (renaming.m_text16_owned)
+      huge_pages::deallocate(renaming.m_text16);
+    renaming.m_text16 = NULL;
+    #endif
+  } else {
+    #ifdef USE_LIBSAIS
+    if (n_threads > 1)
+      run_sais_parallel<int>(block, sa, block_length, n_threads);
+    else run_sais<int>(block, sa, block_length);
+    #else
+    (void)n_threads;
+    run_divsufsort<int>(block, sa, block_length);
+    #endif
+  }
+}
+
+
+//==============================================================================
+// Sort the block on the given NUMA node (or anywhere, if node = -1). The
+// range of bwtsa holding the block after expanding the suffix array to
+// bwtsa objects is placed on that node before it is first touched.
+//==============================================================================
+void sort_block_on_node(const unsigned char *block, int *sa,
+    long block_length, block_renaming &renaming, long n_threads,
+    long node, const void *bwtsa_range, long bwtsa_range_bytes) {
+  numa::pin_thread(node);
+  numa::bind(bwtsa_range, bwtsa_range_bytes, node);
+  sort_block(block, sa, block_length, renaming, n_threads);
 }
 
 
 //==============================================================================
 // Re-rename block back to original.
 //==============================================================================
-void rerename_block(unsigned char *block, long block_length) {
-  unsigned char last = block[block_length - 1] - 1;
+void rerename_block(unsigned char *block, long block_length,
+    const block_renaming &renaming) {
+  if (renaming.m_lo > renaming.m_hi) return;
   for (long i = 0; i < block_length; ++i)
-    if (block[i] > last) --block[i];
+    if (renaming.m_lo <= block[i] && block[i] <= renaming.m_hi)
+      block[i] += renaming.m_delta;
 }
 
 
@@ -109,41 +262,28 @@ void initial_partial_sufsort(unsigned char *text, long text_length,
   long n_blocks = (text_length + max_block_size - 1) / max_block_size;
 
   //----------------------------------------------------------------------------
-  // STEP 1: Rename the blocks in parallel.
+  // STEP 1: Rename the blocks in parallel. The 16-bit texts are placed after
+  // the 32-bit suffix arrays (the bwtsa array takes 6 bytes per symbol).
   //----------------------------------------------------------------------------
-
+  block_renaming *renaming = new block_renaming[n_blocks];
+  std::uint16_t *text16_space = (std::uint16_t *)((int *)bwtsa + text_length);
   if (n_blocks > 1 || has_tail) {
     fprintf(stderr, "  Renaming blocks: ");
     start = utils::wclock();
-    bool *renaming_error = new bool[n_blocks];
-    std::fill(renaming_error, renaming_error + n_blocks, false);
-    std::thread **threads = new std::thread*[n_blocks];
+    task_group tasks;
     for (long i = 0; i < n_blocks; ++i) {
       long block_end = text_length - (n_blocks - 1 - i) * max_block_size;
       long block_beg = std::max(0L, block_end - max_block_size);
       long block_size = block_end - block_beg;
 
-      threads[i] = new std::thread(rename_block, text, text_length, block_beg,
-          block_size, gt, std::ref(renaming_error[i]));
+      tasks.add(rename_block, text, text_length, block_beg,
+          block_size, gt, text16_space + block_beg, std::ref(renaming[i]));
     }
 
-    for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-    for (long i = 0; i < n_blocks; ++i) delete threads[i];
-    delete[] threads;
+    tasks.wait();
 
     fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
-
-    bool err = false;
-    for (long i = 0; i < n_blocks; ++i)
-      if (renaming_error[i]) err = true;
-    delete[] renaming_error;
-
-    if (err) {
-      fprintf(stdout, "\n\nError: byte with value 255 was detected in the input text!\n"
-          "See the section on limitations in the README for more information.\n");
-      std::fflush(stdout);
-      std::exit(EXIT_FAILURE);
-    }
+    check_renaming(renaming, n_blocks);
   }
 
   if (max_block_size >= (2L << 30)) {  // Use 64-bit divsufsort.
@@ -169,13 +309,11 @@ void initial_partial_sufsort(unsigned char *text, long text_length,
       long block_beg = std::max(0L, block_end - max_block_size);
       long block_size = block_end - block_beg;
 
-      threads[i] = new std::thread(
-        #ifdef USE_LIBSAIS
-        run_sais<int>,
-        #else
-        run_divsufsort<int>,
-        #endif
-        text + block_beg, temp_sa + block_beg, block_size);
+      threads[i] = new std::thread(sort_block_on_node, text + block_beg,
+          temp_sa + block_beg, block_size, std::ref(renaming[i]),
+          block_sort_threads(i, n_blocks, max_threads),
+          numa::node_of_thread(i, n_blocks), bwtsa + block_beg,
+          block_size * (long)sizeof(bwtsa_t<uint40>));
     }
 
     for (long i = 0; i < n_blocks; ++i) threads[i]->join();
@@ -196,22 +334,22 @@ void initial_partial_sufsort(unsigned char *text, long text_length,
   if (n_blocks > 1 || has_tail) {
     fprintf(stderr, "  Rerenaming blocks: ");
     start = utils::wclock();
-    std::thread **threads = new std::thread*[n_blocks];
+    task_group tasks;
     for (long i = 0; i < n_blocks; ++i) {
       long block_end = text_length - (n_blocks - 1 - i) * max_block_size;
       long block_beg = std::max(0L, block_end - max_block_size);
       long block_size = block_end - block_beg;
 
-      threads[i] = new std::thread(rerename_block,
-          text + block_beg, block_size);
+      tasks.add(rerename_block,
+          text + block_beg, block_size, std::ref(renaming[i]));
     }
 
-    for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-    for (long i = 0; i < n_blocks; ++i) delete threads[i];
-    delete[] threads;
+    tasks.wait();
 
     fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
   }
+
+  delete[] renaming;
 }
 
 template<>
@@ -224,38 +362,24 @@ void initial_partial_sufsort(unsigned char *text, long text_length,
   //----------------------------------------------------------------------------
   // STEP 1: Rename the blocks in parallel.
   //----------------------------------------------------------------------------
+  block_renaming *renaming = new block_renaming[n_blocks];
   if (n_blocks > 1 || has_tail) {
     fprintf(stderr, "  Renaming blocks: ");
     start = utils::wclock();
-    bool *renaming_error = new bool[n_blocks];
-    std::fill(renaming_error, renaming_error + n_blocks, false);
-    std::thread **threads = new std::thread*[n_blocks];
+    task_group tasks;
     for (long i = 0; i < n_blocks; ++i) {
       long block_end = text_length - (n_blocks - 1 - i) * max_block_size;
       long block_beg = std::max(0L, block_end - max_block_size);
       long block_size = block_end - block_beg;
 
-      threads[i] = new std::thread(rename_block, text, text_length, block_beg,
-          block_size, gt, std::ref(renaming_error[i]));
+      tasks.add(rename_block, text, text_length, block_beg,
+          block_size, gt, (std::uint16_t *)NULL, std::ref(renaming[i]));
     }
 
-    for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-    for (long i = 0; i < n_blocks; ++i) delete threads[i];
-    delete[] threads;
+    tasks.wait();
 
     fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
-
-    bool err = false;
-    for (long i = 0; i < n_blocks; ++i)
-      if (renaming_error[i]) err = true;
-    delete[] renaming_error;
-
-    if (err) {
-      fprintf(stdout, "\n\nError: byte with value 255 was detected in the input text!\n"
-          "See the section on limitations in the README for more information.\n");
-      std::fflush(stdout);
-      std::exit(EXIT_FAILURE);
-    }
+    check_renaming(renaming, n_blocks);
   }
   
   int *temp_sa = (int *)bwtsa;
@@ -275,13 +399,11 @@ void initial_partial_sufsort(unsigned char *text, long text_length,
     long block_beg = std::max(0L, block_end - max_block_size);
     long block_size = block_end - block_beg;
 
-    threads[i] = new std::thread(
-        #ifdef USE_LIBSAIS
-        run_sais<int>,
-        #else
-        run_divsufsort<int>,
-        #endif
-        text + block_beg, temp_sa + block_beg, block_size);
+    threads[i] = new std::thread(sort_block_on_node, text + block_beg,
+        temp_sa + block_beg, block_size, std::ref(renaming[i]),
+        block_sort_threads(i, n_blocks, max_threads),
+        numa::node_of_thread(i, n_blocks), bwtsa + block_beg,
+        block_size * (long)sizeof(bwtsa_t<int>));
   }
 
   for (long i = 0; i < n_blocks; ++i) threads[i]->join();
@@ -300,22 +422,22 @@ void initial_partial_sufsort(unsigned char *text, long text_length,
   if (n_blocks > 1 || has_tail) {
     fprintf(stderr, "  Rerenaming blocks: ");
     start = utils::wclock();
-    threads = new std::thread*[n_blocks];
+    task_group tasks;
     for (long i = 0; i < n_blocks; ++i) {
       long block_end = text_length - (n_blocks - 1 - i) * max_block_size;
       long block_beg = std::max(0L, block_end - max_block_size);
       long block_size = block_end - block_beg;
 
-      threads[i] = new std::thread(rerename_block,
-          text + block_beg, block_size);
+      tasks.add(rerename_block,
+          text + block_beg, block_size, std::ref(renaming[i]));
     }
 
-    for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-    for (long i = 0; i < n_blocks; ++i) delete threads[i];
-    delete[] threads;
+    tasks.wait();
 
     fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
   }
+
+  delete[] renaming;
 }
 
 }  // namespace inmem_psascan_private
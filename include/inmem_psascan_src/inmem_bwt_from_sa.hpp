@@ -35,9 +35,9 @@
 #define __SRC_PSASCAN_SRC_INMEM_PSASCAN_SRC_INMEM_BWT_FROM_SA_HPP_INCLUDED
 
 #include <algorithm>
-#include <thread>
 
 #include "../utils/utils.hpp"
+#include "../utils/thread_pool.hpp"
 #include "bwtsa.hpp"
 
 
@@ -62,18 +62,16 @@ void compute_bwt_in_bwtsa(const unsigned char *text, long length,
   long *index_0 = new long[n_blocks];
 
   // Compute bwt and find i0, where sa[i0] == 0.
-  std::thread **threads = new std::thread*[n_blocks];
+  task_group tasks;
   for (long i = 0; i < n_blocks; ++i) {
     long block_beg = i * max_block_size;
     long block_end = std::min(block_beg + max_block_size, length);
 
-    threads[i] = new std::thread(compute_bwt_in_bwtsa_aux<saidx_t>,
+    tasks.add(compute_bwt_in_bwtsa_aux<saidx_t>,
         text, block_beg, block_end, dest, index_0 + i);
   }
 
-  for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_blocks; ++i) delete threads[i];
-  delete[] threads;
+  tasks.wait();
 
   // Find and return i0.
   result = -1;
@@ -40,6 +40,7 @@
 #include <algorithm>
 
 #include "../io/multifile.hpp"
+#include "../io/concatenated_text.hpp"
 #include "../bitvector.hpp"
 #include "inmem_gap_array.hpp"
 #include "inmem_compute_gap.hpp"
@@ -69,10 +70,11 @@ pagearray<bwtsa_t<saidx_t>, pagesize_log> *inmem_bwtsa_merge(
     long text_beg,
     long text_end,
     long supertext_length,
-    std::string supertext_filename,
+    const concatenated_text *supertext,
     const multifile *tail_gt_begin_reversed,
     long *i0_array,
-    long **block_rank_matrix) {
+    long **block_rank_matrix,
+    long gap_buf_size) {
   typedef pagearray<bwtsa_t<saidx_t>, pagesize_log> pagearray_type;
 
   long shift = (max_block_size - text_length % max_block_size) % max_block_size;
@@ -124,8 +126,8 @@ pagearray<bwtsa_t<saidx_t>, pagesize_log> *inmem_bwtsa_merge(
   pagearray_type *l_bwtsa = inmem_bwtsa_merge<saidx_t, pagesize_log>(text,
       text_length, bwtsa, gt, max_block_size, lrange_beg, lrange_end,
       max_threads, need_gt, true, left_i0, schedule, text_beg, text_end,
-      supertext_length, supertext_filename, tail_gt_begin_reversed, i0_array,
-      block_rank_matrix);
+      supertext_length, supertext, tail_gt_begin_reversed, i0_array,
+      block_rank_matrix, gap_buf_size);
 
   // 2.b
   // 
@@ -134,8 +136,8 @@ pagearray<bwtsa_t<saidx_t>, pagesize_log> *inmem_bwtsa_merge(
   pagearray_type *r_bwtsa = inmem_bwtsa_merge<saidx_t, pagesize_log>(text,
       text_length, bwtsa, gt, max_block_size, rrange_beg, rrange_end,
       max_threads, true, need_bwt, right_i0, schedule, text_beg, text_end,
-      supertext_length, supertext_filename, tail_gt_begin_reversed, i0_array,
-      block_rank_matrix);
+      supertext_length, supertext, tail_gt_begin_reversed, i0_array,
+      block_rank_matrix, gap_buf_size);
 
   //----------------------------------------------------------------------------
   // STEP 3: Merge partial SAs and BWTs.
@@ -153,7 +155,7 @@ pagearray<bwtsa_t<saidx_t>, pagesize_log> *inmem_bwtsa_merge(
   long double streaming_time;
   long double start1 = utils::wclock();
   inmem_compute_gap<saidx_t, pagesize_log>(text, text_length, lbeg, lsize,
-      rsize, *l_bwtsa, gt, gap, max_threads, need_gt, left_i0, (1L << 21),
+      rsize, *l_bwtsa, gt, gap, max_threads, need_gt, left_i0, gap_buf_size,
       rank_init_time, streaming_time, block_rank_matrix, lrange_beg,
       lrange_size, rrange_size);
   fprintf(stderr, "  Time: %.2Lf\n", utils::wclock() - start1);
@@ -42,6 +42,7 @@
 
 #include "../io/multifile.hpp"
 #include "../bitvector.hpp"
+#include "../utils/thread_pool.hpp"
 #include "../gap_buffer.hpp"
 #include "rank.hpp"
 #include "inmem_gap_array.hpp"
@@ -104,7 +105,6 @@ void inmem_compute_gap(const unsigned char *text, long text_length, long left_bl
   start = utils::wclock();
   std::vector<long> initial_ranks(n_threads);
   std::vector<std::pair<long, long> > initial_ranges(n_threads);
-  std::thread **threads = new std::thread*[n_threads];
 
   // 3.a
   //
@@ -122,22 +122,23 @@ void inmem_compute_gap(const unsigned char *text, long text_length, long left_bl
   // Compute the starting position for all
   // starting positions other than the last one.
   long prev_stream_block_size = last_stream_block_end - last_stream_block_beg;
-  for (long i = n_threads - 2; i >= 0; --i) {
-    long stream_block_beg = right_block_beg + i * max_stream_block_size;
-    long stream_block_end = std::min(stream_block_beg + max_stream_block_size, right_block_end);
-    long stream_block_size = stream_block_end - stream_block_beg;
-    const unsigned char *pat = text + stream_block_end;
+  {
+    task_group tasks;
+    for (long i = n_threads - 2; i >= 0; --i) {
+      long stream_block_beg = right_block_beg + i * max_stream_block_size;
+      long stream_block_end = std::min(stream_block_beg + max_stream_block_size, right_block_end);
+      long stream_block_size = stream_block_end - stream_block_beg;
+      const unsigned char *pat = text + stream_block_end;
 
-    threads[i] = new std::thread(compute_range<pagearray_bwtsa_type>,
-        text, left_block_beg, left_block_size, pat, prev_stream_block_size,
-        std::ref(bwtsa), std::ref(initial_ranges[i]));
+      tasks.add(compute_range<pagearray_bwtsa_type>,
+          text, left_block_beg, left_block_size, pat, prev_stream_block_size,
+          std::ref(bwtsa), std::ref(initial_ranges[i]));
 
-    prev_stream_block_size = stream_block_size;
-  }
+      prev_stream_block_size = stream_block_size;
+    }
 
-  for (long i = 0; i + 1 < n_threads; ++i) threads[i]->join();
-  for (long i = 0; i + 1 < n_threads; ++i) delete threads[i];
-  delete[] threads;
+    tasks.wait();
+  }
   fprintf(stderr, "%.2Lf ", utils::wclock() - start);
 
   bool nontrivial_range = false;
@@ -244,7 +245,7 @@ void inmem_compute_gap(const unsigned char *text, long text_length, long left_bl
   // Start streaming threads.
   fprintf(stderr, "    Streaming: ");
   start = utils::wclock();
-  threads = new std::thread*[n_threads];
+  std::thread **threads = new std::thread*[n_threads];
   for (long t = 0; t < n_threads; ++t) {
     long beg = right_block_beg + t * max_stream_block_size;
     long end = std::min(beg + max_stream_block_size, right_block_end);
@@ -252,7 +253,8 @@ void inmem_compute_gap(const unsigned char *text, long text_length, long left_bl
     threads[t] = new std::thread(inmem_parallel_stream<rank_type, saidx_t>,
       text, text_length, beg, end, last, count, full_gap_buffers,
       empty_gap_buffers, initial_ranks[t], i0, rank, gap->m_length, max_threads,
-      gt, temp + t * max_buffer_elems, oracle + t * max_buffer_elems, need_gt);
+      gt, temp + t * max_buffer_elems, oracle + t * max_buffer_elems, need_gt,
+      numa::node_of_thread(t, n_threads));
   }
 
   // Start updating thread.
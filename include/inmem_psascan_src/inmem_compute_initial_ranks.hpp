@@ -755,7 +755,7 @@ void task_solver_code(const unsigned char *text,
 template<typename saidx_t>
 void compute_block_rank_matrix(const unsigned char *text, long text_length, 
     const bwtsa_t<saidx_t> *bwtsa, long max_block_size, long text_beg,
-    long supertext_length, std::string,
+    long supertext_length, const concatenated_text *,
     const multifile *tail_gt_begin_reversed,  background_block_reader *reader,
     const unsigned char *next_block, long **block_rank_matrix) {
   long n_blocks = (text_length + max_block_size - 1) / max_block_size;
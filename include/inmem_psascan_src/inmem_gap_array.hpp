@@ -40,7 +40,9 @@
 #include <algorithm>
 #include <mutex>
 #include <stack>
-#include <thread>
+
+#include "../utils/huge_pages.hpp"
+#include "../utils/thread_pool.hpp"
 
 
 namespace psascan_private {
@@ -55,11 +57,11 @@ struct inmem_gap_array {
 
   inmem_gap_array(long length)
     : m_length(length) {
-    m_count = (unsigned char *)calloc(m_length, sizeof(unsigned char));
+    m_count = (unsigned char *)huge_pages::allocate(m_length, true);
   }
 
   ~inmem_gap_array() {
-    free(m_count);
+    huge_pages::deallocate(m_count);
   }
   
   //===========================================================================
@@ -187,20 +189,20 @@ struct inmem_gap_array {
     long n_blocks = (m_length + max_block_size - 1) / max_block_size;
     long *gapsum = new long[n_blocks];
   
-    // Each thread handles range of blocks.
+    // Each task handles range of blocks.
     long range_size = (n_blocks + max_threads - 1) / max_threads;
     long n_ranges = (n_blocks + range_size - 1) / range_size;
-    std::thread **threads = new std::thread*[max_threads];
-    for (long range_id = 0; range_id < n_ranges; ++range_id) {
-      long range_beg = range_id * range_size;
-      long range_end = std::min(range_beg + range_size, n_blocks);
-
-      threads[range_id] = new std::thread(compute_sum2, this,
-          range_beg, range_end, max_block_size, gapsum);
+    {
+      task_group tasks;
+      for (long range_id = 0; range_id < n_ranges; ++range_id) {
+        long range_beg = range_id * range_size;
+        long range_end = std::min(range_beg + range_size, n_blocks);
+
+        tasks.add(compute_sum2, this,
+            range_beg, range_end, max_block_size, gapsum);
+      }
+      tasks.wait();
     }
-    for (long i = 0; i < n_ranges; ++i) threads[i]->join();
-    for (long i = 0; i < n_ranges; ++i) delete threads[i];
-    delete[] threads;
 
     //-------------------------------------------------------------------------
     // STEP 2: compute partial sum from block counts.
@@ -211,13 +213,13 @@ struct inmem_gap_array {
     //-------------------------------------------------------------------------
     // STEP 3: Answer the queries in parallel.
     //-------------------------------------------------------------------------
-    threads = new std::thread*[n_queries];
-    for (long i = 0; i < n_queries; ++i)
-      threads[i] = new std::thread(answer_single_gap_query, this,
-        max_block_size, gapsum, a[i], std::ref(b[i]), std::ref(c[i]));
-    for (long i = 0; i < n_queries; ++i) threads[i]->join();
-    for (long i = 0; i < n_queries; ++i) delete threads[i];
-    delete[] threads;
+    {
+      task_group tasks;
+      for (long i = 0; i < n_queries; ++i)
+        tasks.add(answer_single_gap_query, this,
+          max_block_size, gapsum, a[i], std::ref(b[i]), std::ref(c[i]));
+      tasks.wait();
+    }
 
     long result = -1;
     if (i0 != -1) 
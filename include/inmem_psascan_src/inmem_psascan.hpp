@@ -43,7 +43,11 @@
 
 #include "../io/multifile.hpp"
 #include "../io/background_block_reader.hpp"
+#include "../io/concatenated_text.hpp"
 #include "../bitvector.hpp"
+#include "../utils/run_stats.hpp"
+#include "../utils/numa.hpp"
+#include "../utils/huge_pages.hpp"
 #include "inmem_gap_array.hpp"
 #include "compute_initial_gt_bitvectors.hpp"
 #include "initial_partial_sufsort.hpp"
@@ -56,11 +60,29 @@
 #include "bwtsa.hpp"
 #include "parallel_shrink.hpp"
 #include "merge_schedule.hpp"
+#include "block_count_policy.hpp"
 
 
 namespace psascan_private {
 namespace inmem_psascan_private {
 
+// Peak RAM usage (in bytes per input byte, including the text, the
+// output SA/BWT and the gt_begin bitvector). Determines the merge schedule.
+// Sorting the blocks takes less (2.125 + sizeof(saidx_t) bytes, plus the
+// 16-bit texts, see text16_ram_per_symbol in initial_partial_sufsort.hpp).
+const long max_ram_usage_per_input_byte = 10L;
+
+// Default size (in bytes) of the gap buffers used in the streaming of the
+// merging. There are 2 * max_threads of them, and each streaming thread
+// also has a temp array and an oracle with as many items as a buffer.
+const long k_default_gap_buf_size = (1L << 21);
+
+// RAM taken by the buffers above, in addition to max_ram_usage_per_input_byte.
+inline long streaming_ram(long max_threads, long gap_buf_size, long saidx_size) {
+  return max_threads * (3L * gap_buf_size +
+      (gap_buf_size / saidx_size) * (long)sizeof(int));
+}
+
 template<typename saidx_t, unsigned pagesize_log = 12>
 void inmem_psascan(
     unsigned char *text,
@@ -74,10 +96,11 @@ void inmem_psascan(
     long text_beg = 0,
     long text_end = 0,
     long supertext_length = 0,
-    std::string supertext_filename = "",
+    const concatenated_text *supertext = NULL,
     const multifile *tail_gt_begin_reversed = NULL,
     long *i0 = NULL,
-    unsigned char *tail_prefix_preread = NULL) {
+    unsigned char *tail_prefix_preread = NULL,
+    long gap_buf_size = k_default_gap_buf_size) {
   static const unsigned pagesize = (1U << pagesize_log);
   long double absolute_start = utils::wclock();
   long double start;
@@ -89,14 +112,11 @@ void inmem_psascan(
     std::exit(EXIT_FAILURE);
   }
 
-  if (max_blocks == -1)
-    max_blocks = max_threads;
-
   if (text_end == 0) {
     supertext_length = text_length;
     text_end = text_length;
     text_beg = 0;
-    supertext_filename = "";
+    supertext = NULL;
     tail_gt_begin_reversed = NULL;
   }
 
@@ -107,7 +127,18 @@ void inmem_psascan(
     std::exit(EXIT_FAILURE);
   }
 
+  // The ratio of the costs of right and left merges (see merge_schedule.hpp)
+  // and the fraction of blocks allowed on the left side of the merges, so
+  // that the merging fits into max_ram_usage_per_input_byte.
+  float rl_ratio = 10.L;  // estimated empirically
+  long double max_left_fraction = ((long double)max_ram_usage_per_input_byte -
+      (2.125L + sizeof(saidx_t))) / 5.L;
+
   long alignment_unit = (long)std::max(pagesize, 8U);
+  if (max_blocks == -1)
+    max_blocks = choose_n_blocks(text_length, max_threads, alignment_unit,
+        rl_ratio, max_left_fraction);
+
   long max_block_size = (text_length + max_blocks - 1) / max_blocks;
   while ((max_block_size & (alignment_unit - 1)) && max_block_size < text_length)
     ++max_block_size;
@@ -133,6 +164,8 @@ void inmem_psascan(
   fprintf(stderr, "Max blocks = %ld\n", max_blocks);
   fprintf(stderr, "Number of blocks = %ld\n", n_blocks);
   fprintf(stderr, "Max threads = %ld\n", max_threads);
+  fprintf(stderr, "Multithreaded block sort = %s\n",
+      multithreaded_block_sort ? "true" : "false");
   fprintf(stderr, "sizeof(saidx_t) = %lu\n", sizeof(saidx_t));
   fprintf(stderr, "Pagesize = %u\n", (1U << pagesize_log));
   fprintf(stderr, "Compute bwt = %s\n", compute_bwt ? "true" : "false");
@@ -140,12 +173,20 @@ void inmem_psascan(
   fprintf(stderr, "Text beg = %ld\n", text_beg);
   fprintf(stderr, "Text end = %ld\n", text_end);
   fprintf(stderr, "Supertext length = %ld (%.2LfMiB)\n", supertext_length, supertext_length / (1024.L * 1024));
-  fprintf(stderr, "Supertext filename = %s\n", supertext_filename.c_str());
+  fprintf(stderr, "Supertext files = %ld\n", supertext ? supertext->n_files() : 0L);
   fprintf(stderr, "Has tail = %s\n", has_tail ? "true" : "false");
   fprintf(stderr, "\n");
 
   bwtsa_t<saidx_t> *bwtsa = (bwtsa_t<saidx_t> *)sa_bwt;
 
+  // In NUMA mode, spread the text and gt_begin (both read by all threads
+  // in every step) evenly across the nodes.
+  if (numa::enabled()) {
+    numa::interleave(text, text_length);
+    if (gt_begin)
+      gt_begin->numa_interleave();
+  }
+
   // Initialize reading of the tail prefix in the background.
   long tail_length = supertext_length - text_end;
   long tail_prefix_length = std::min(text_length, tail_length);
@@ -153,7 +194,7 @@ void inmem_psascan(
   background_block_reader *tail_prefix_background_reader = NULL;
   if (has_tail && tail_prefix_preread == NULL)
     tail_prefix_background_reader =
-      new background_block_reader(supertext_filename, text_end, tail_prefix_length);
+      new background_block_reader(supertext, text_end, tail_prefix_length);
 
   //----------------------------------------------------------------------------
   // STEP 1: compute initial bitvectors, and partial suffix arrays.
@@ -164,13 +205,19 @@ void inmem_psascan(
     compute_initial_gt_bitvectors(text, text_length, gt_begin, max_block_size,
         max_threads, text_end, supertext_length, tail_gt_begin_reversed,
         tail_prefix_background_reader, tail_prefix_preread);
-    fprintf(stderr, "Time: %.2Lf\n\n", utils::wclock() - start);
+    long double initial_bitvectors_time = utils::wclock() - start;
+    fprintf(stderr, "Time: %.2Lf\n\n", initial_bitvectors_time);
+    run_stats::add_step("1", "compute initial bitvectors", initial_bitvectors_time,
+        text_length, 0L, 0L);
   }
 
   fprintf(stderr, "Initial sufsort:\n");
   start = utils::wclock();
   initial_partial_sufsort(text, text_length, gt_begin, bwtsa, max_block_size, max_threads, has_tail);
-  fprintf(stderr, "Time: %.2Lf\n", utils::wclock() - start);
+  long double initial_sufsort_time = utils::wclock() - start;
+  fprintf(stderr, "Time: %.2Lf\n", initial_sufsort_time);
+  run_stats::add_step("1", "initial sufsort", initial_sufsort_time,
+      text_length, 0L, 0L);
 
   //----------------------------------------------------------------------------
   // STEP 2: compute matrix of block ranks.
@@ -181,7 +228,7 @@ void inmem_psascan(
   for (long j = 0; j < n_blocks; ++j)
     block_rank_matrix[j] = new long[n_blocks];
   compute_block_rank_matrix<saidx_t>(text, text_length, bwtsa,
-      max_block_size, text_beg, supertext_length, supertext_filename,
+      max_block_size, text_beg, supertext_length, supertext,
       tail_gt_begin_reversed, tail_prefix_background_reader,
       tail_prefix_preread, block_rank_matrix);
 
@@ -190,10 +237,13 @@ void inmem_psascan(
     if (tail_prefix_background_reader != NULL) {
       tail_prefix_background_reader->stop();
       delete tail_prefix_background_reader;
-    } else free(tail_prefix_preread);
+    } else huge_pages::deallocate(tail_prefix_preread);
   }
 
-  fprintf(stderr, "%.2Lf\n\n", utils::wclock() - start);
+  long double block_rank_matrix_time = utils::wclock() - start;
+  fprintf(stderr, "%.2Lf\n\n", block_rank_matrix_time);
+  run_stats::add_step("2", "compute matrix of initial ranks",
+      block_rank_matrix_time, text_length, 0L, 0L);
 
   //----------------------------------------------------------------------------
   // STEP 3: compute the gt bitvectors for blocks that will be on the right
@@ -203,16 +253,19 @@ void inmem_psascan(
     fprintf(stderr, "Overwriting gt_end with gt_begin: ");
     start = utils::wclock();
     gt_end_to_gt_begin(text, text_length, gt_begin, max_block_size);
-    fprintf(stderr, "%.2Lf\n\n", utils::wclock() - start);
+    long double gt_begin_time = utils::wclock() - start;
+    fprintf(stderr, "%.2Lf\n\n", gt_begin_time);
+    run_stats::add_step("3", "overwrite gt_end with gt_begin",
+        gt_begin_time, text_length, 0L, 0L);
   }
 
-  float rl_ratio = 10.L;  // estimated empirically
-  long max_ram_usage_per_input_byte = 10L;  // peak ram usage = 10n
-  int max_left_size = std::max(1, (int)floor(n_blocks * (((long double)max_ram_usage_per_input_byte - (2.125L + sizeof(saidx_t))) / 5.L)));
+  int max_left_size = std::max(1, (int)floor(n_blocks * max_left_fraction));
   fprintf(stderr, "Assumed rl_ratio: %.2f\n", rl_ratio);
   fprintf(stderr, "Max left size = %d\n", max_left_size);
   fprintf(stderr, "Peak memory usage during last merging = %.3Lfn\n",
       (2.125L + sizeof(saidx_t)) + (5.L * max_left_size) / n_blocks);
+  fprintf(stderr, "Peak memory usage during sorting blocks = %.3Lfn\n",
+      (2.125L + sizeof(saidx_t)) + text16_ram_per_symbol(sizeof(saidx_t)));
   MergeSchedule schedule(n_blocks, rl_ratio, max_left_size);
 
   fprintf(stderr, "Skewed merge schedule:\n");
@@ -221,6 +274,7 @@ void inmem_psascan(
 
   long *i0_array = new long[n_blocks];
   if (n_blocks > 1 || compute_bwt) {
+    start = utils::wclock();
     for (long block_id = 0; block_id < n_blocks; ++block_id) {
       long block_end = text_length - (n_blocks - 1 - block_id) * max_block_size;
       long block_beg = std::max(0L, block_end - max_block_size);
@@ -235,23 +289,31 @@ void inmem_psascan(
       }
     }
     fprintf(stderr, "\n");
+    run_stats::add_step("4", "compute BWT of blocks",
+        utils::wclock() - start, text_length, 0L, 0L);
   }
 
   if (n_blocks > 1) {
+    start = utils::wclock();
     long i0_result;
     pagearray<bwtsa_t<saidx_t>, pagesize_log> *result =
       inmem_bwtsa_merge<saidx_t, pagesize_log>(text, text_length, bwtsa,
           gt_begin, max_block_size, 0, n_blocks, max_threads, compute_gt_begin,
           compute_bwt, i0_result, schedule, text_beg, text_end,
-          supertext_length, supertext_filename, tail_gt_begin_reversed,
-          i0_array, block_rank_matrix);
+          supertext_length, supertext, tail_gt_begin_reversed,
+          i0_array, block_rank_matrix, gap_buf_size);
     if (i0) *i0 = i0_result;
+    run_stats::add_step("5", "merge blocks", utils::wclock() - start,
+        text_length, 0L, 0L);
 
     // Permute SA to plain array.
     fprintf(stderr, "\nPermuting the resulting SA to plain array: ");
     start = utils::wclock();
     result->permute_to_plain_array(max_threads);
-    fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
+    long double permute_time = utils::wclock() - start;
+    fprintf(stderr, "%.2Lf\n", permute_time);
+    run_stats::add_step("6", "permute SA to plain array", permute_time,
+        text_length, 0L, 0L);
 
     delete result;
   } else if (compute_bwt) {
@@ -273,7 +335,7 @@ void inmem_psascan(
     // Allocate aux, copy bwt into aux.
     fprintf(stderr, "Copying bwtsa.bwt into aux memory: ");
     start = utils::wclock();
-    bwt = (unsigned char *)malloc(text_length);
+    bwt = (unsigned char *)huge_pages::allocate(text_length);
     parallel_copy<bwtsa_t<saidx_t>, unsigned char>(bwtsa, bwt, text_length, max_threads);
     fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
   }
@@ -283,7 +345,10 @@ void inmem_psascan(
 
   parallel_shrink<bwtsa_t<saidx_t>, saidx_t>(bwtsa, text_length, max_threads);
 
-  fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
+  long double shrink_time = utils::wclock() - start;
+  fprintf(stderr, "%.2Lf\n", shrink_time);
+  run_stats::add_step("7", "shrink bwtsa into SA and BWT", shrink_time,
+      text_length, 0L, 0L);
 
   if (compute_bwt) {
 
@@ -292,7 +357,7 @@ void inmem_psascan(
     start = utils::wclock();
     unsigned char *dest = (unsigned char *)(((saidx_t *)bwtsa) + text_length);
     parallel_copy<unsigned char, unsigned char>(bwt, dest, text_length, max_threads);
-    free(bwt);
+    huge_pages::deallocate(bwt);
     fprintf(stderr, "%.2Lf\n", utils::wclock() - start);
   }
 
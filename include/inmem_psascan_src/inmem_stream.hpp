@@ -46,6 +46,7 @@
 #include <algorithm>
 
 #include "../utils/utils.hpp"
+#include "../utils/numa.hpp"
 #include "../bitvector.hpp"
 #include "../gap_buffer.hpp"
 #include "rank.hpp"
@@ -80,7 +81,9 @@ void inmem_parallel_stream(
     bitvector *gt,
     block_offset_type *temp,
     int *oracle,
-    bool need_gt) {
+    bool need_gt,
+    long numa_node) {
+  numa::pin_thread(numa_node);
 
   //----------------------------------------------------------------------------
   // STEP 1: initialize structures necessary to do the buffer partitions.
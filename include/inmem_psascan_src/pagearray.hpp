@@ -47,9 +47,10 @@
 #include <vector>
 #include <stack>
 #include <algorithm>
-#include <thread>
 #include <mutex>
 
+#include "../utils/thread_pool.hpp"
+
 
 namespace psascan_private {
 namespace inmem_psascan_private {
@@ -213,15 +214,14 @@ struct pagearray {
 
     std::mutex selector_mutex;
     std::mutex *mutexes = new std::mutex[n_pages];
-    std::thread **threads = new std::thread*[max_threads];
-  
-    for (long i = 0; i < max_threads; ++i)
-      threads[i] = new std::thread(permute_to_plain_array_aux,
-          std::ref(*this), mutexes, std::ref(selector), std::ref(selector_mutex));
-
-    for (long i = 0; i < max_threads; ++i) threads[i]->join();
-    for (long i = 0; i < max_threads; ++i) delete threads[i];
-    delete[] threads;
+    {
+      task_group tasks;
+      for (long i = 0; i < max_threads; ++i)
+        tasks.add(permute_to_plain_array_aux,
+            std::ref(*this), mutexes, std::ref(selector), std::ref(selector_mutex));
+
+      tasks.wait();
+    }
     delete[] mutexes;
     delete[] m_pageindex;
     m_pageindex = NULL;
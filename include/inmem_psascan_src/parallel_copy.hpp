@@ -35,9 +35,9 @@
 #define __SRC_PSASCAN_SRC_INMEM_PSASCAN_SRC_PARALLEL_COPY_HPP_INCLUDED
 
 #include <algorithm>
-#include <thread>
 
 #include "../types/uint40.hpp"
+#include "../utils/thread_pool.hpp"
 #include "bwtsa.hpp"
 
 
@@ -68,22 +68,21 @@ void parallel_copy_aux(const bwtsa_t<int> *src, unsigned char *dest, long length
 // Conversion from T to S has to make sense.
 template<typename T, typename S>
 void parallel_copy(const T *src, S *dest, long length, long max_threads) {
-  long max_block_size = (length + max_threads - 1) / max_threads;
+  long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+  long max_block_size = (length + max_tasks - 1) / max_tasks;
   long n_blocks = (length + max_block_size - 1) / max_block_size;
 
-  std::thread **threads = new std::thread*[n_blocks];
+  task_group tasks;
   for (long i = 0; i < n_blocks; ++i) {
     long block_beg = i * max_block_size;
     long block_end = std::min(block_beg + max_block_size, length);
     long block_size = block_end - block_beg;
 
-    threads[i] = new std::thread(parallel_copy_aux<T, S>,
+    tasks.add(parallel_copy_aux<T, S>,
         src + block_beg, dest + block_beg, block_size);
   }
 
-  for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_blocks; ++i) delete threads[i];
-  delete[] threads;
+  tasks.wait();
 }
 
 // Specialization
@@ -94,24 +93,21 @@ void parallel_copy(
     long length,
     long max_threads) {
 
-  long max_block_size = (length + max_threads - 1) / max_threads;
+  long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+  long max_block_size = (length + max_tasks - 1) / max_tasks;
   long n_blocks = (length + max_block_size - 1) / max_block_size;
 
-  std::thread **threads = new std::thread*[n_blocks];
+  task_group tasks;
   for (long i = 0; i < n_blocks; ++i) {
     long block_beg = i * max_block_size;
     long block_end = std::min(block_beg + max_block_size, length);
     long block_size = block_end - block_beg;
 
-    threads[i] =
-      new std::thread(
-          parallel_copy_aux<bwtsa_t<uint40>, unsigned char>,
-          src + block_beg, dest + block_beg, block_size);
+    tasks.add(parallel_copy_aux<bwtsa_t<uint40>, unsigned char>,
+        src + block_beg, dest + block_beg, block_size);
   }
 
-  for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_blocks; ++i) delete threads[i];
-  delete[] threads;
+  tasks.wait();
 }
 
 // Specialization
@@ -122,22 +118,21 @@ void parallel_copy(
     long length,
     long max_threads) {
 
-  long max_block_size = (length + max_threads - 1) / max_threads;
+  long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+  long max_block_size = (length + max_tasks - 1) / max_tasks;
   long n_blocks = (length + max_block_size - 1) / max_block_size;
 
-  std::thread **threads = new std::thread*[n_blocks];
+  task_group tasks;
   for (long i = 0; i < n_blocks; ++i) {
     long block_beg = i * max_block_size;
     long block_end = std::min(block_beg + max_block_size, length);
     long block_size = block_end - block_beg;
 
-    threads[i] = new std::thread(parallel_copy_aux<bwtsa_t<int>, unsigned char>,
+    tasks.add(parallel_copy_aux<bwtsa_t<int>, unsigned char>,
         src + block_beg, dest + block_beg, block_size);
   }
 
-  for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_blocks; ++i) delete threads[i];
-  delete[] threads;
+  tasks.wait();
 }
 
 }  // namespace inmem_psascan_private
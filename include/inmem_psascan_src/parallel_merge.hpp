@@ -48,10 +48,10 @@
 #include <vector>
 #include <stack>
 #include <algorithm>
-#include <thread>
 #include <mutex>
 
 #include "../utils/utils.hpp"
+#include "../utils/thread_pool.hpp"
 #include "pagearray.hpp"
 #include "inmem_gap_array.hpp"
 
@@ -237,18 +237,18 @@ pagearray_type *parallel_merge(pagearray_type *l_pagearray,
   fprintf(stderr, "merge: ");
   start = utils::wclock();
 
-  std::thread **threads = new std::thread*[n_threads];
-  for (long t = 0; t < n_threads; ++t) {
-    long page_range_beg = t * pages_per_thread;
-    long page_range_end = std::min(page_range_beg + pages_per_thread, n_pages);
+  {
+    task_group tasks;
+    for (long t = 0; t < n_threads; ++t) {
+      long page_range_beg = t * pages_per_thread;
+      long page_range_end = std::min(page_range_beg + pages_per_thread, n_pages);
 
-    threads[t] = new std::thread(parallel_merge_aux<pagearray_type>,
-        l_pagearray, r_pagearray, result, gap,  left_idx[t], right_idx[t],
-        remaining_gap[t], page_range_beg, page_range_end, what_to_add);
+      tasks.add(parallel_merge_aux<pagearray_type>,
+          l_pagearray, r_pagearray, result, gap,  left_idx[t], right_idx[t],
+          remaining_gap[t], page_range_beg, page_range_end, what_to_add);
+    }
+    tasks.wait();
   }
-  for (long t = 0; t < n_threads; ++t) threads[t]->join();
-  for (long t = 0; t < n_threads; ++t) delete threads[t];
-  delete[] threads;
   delete[] left_idx;
   delete[] right_idx;
   delete[] remaining_gap;
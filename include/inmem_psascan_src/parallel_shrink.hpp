@@ -35,7 +35,8 @@
 #define __SRC_PSASCAN_SRC_INMEM_PSASCAN_SRC_PARALLEL_SHRINK_HPP_INCLUDED
 
 #include <algorithm>
-#include <thread>
+
+#include "../utils/thread_pool.hpp"
 
 
 namespace psascan_private {
@@ -82,22 +83,21 @@ S *parallel_shrink(T *tab, long length, long max_threads) {
   // This is safe (no element overwriting) because of how we
   // computed the split.
   long elems = length - split;
-  long max_block_size = (elems + max_threads - 1) / max_threads;
+  long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+  long max_block_size = (elems + max_tasks - 1) / max_tasks;
   long n_blocks = (elems + max_block_size - 1) / max_block_size;
 
-  std::thread **threads = new std::thread*[n_blocks];
+  task_group tasks;
   for (long i = 0; i < n_blocks; ++i) {
     long block_beg = split + i * max_block_size;
     long block_end = std::min(block_beg + max_block_size, length);
     long block_size = block_end - block_beg;
 
-    threads[i] = new std::thread(parallel_shrink_aux<T, S>,
+    tasks.add(parallel_shrink_aux<T, S>,
         tab + block_beg, result + block_beg, block_size);
   }
 
-  for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_blocks; ++i) delete threads[i];
-  delete[] threads;
+  tasks.wait();
 
   return result;
 }
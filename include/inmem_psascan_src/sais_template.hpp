@@ -62,6 +62,37 @@ void run_sais(const unsigned char *text, long *sa, long length) {
   libsais64(text, sa, length, 0, NULL);
 }
 
+// Sort using n_threads threads. Requires libsais built with
+// LIBSAIS_OPENMP, otherwise the calling thread sorts the text.
+template<typename T>
+void run_sais_parallel(const unsigned char *, T*, T, long) {
+  fprintf(stderr, "\nsais: non-standard call. Use either"
+      "int or long for second and third argument.\n");
+  std::exit(EXIT_FAILURE);
+}
+
+template<>
+void run_sais_parallel(const unsigned char *text, int *sa,
+    int length, long n_threads) {
+#ifdef LIBSAIS_OPENMP
+  libsais_omp(text, sa, length, 0, NULL, (int)n_threads);
+#else
+  (void)n_threads;
+  libsais(text, sa, length, 0, NULL);
+#endif
+}
+
+template<>
+void run_sais_parallel(const unsigned char *text, long *sa,
+    long length, long n_threads) {
+#ifdef LIBSAIS_OPENMP
+  libsais64_omp(text, sa, length, 0, NULL, n_threads);
+#else
+  (void)n_threads;
+  libsais64(text, sa, length, 0, NULL);
+#endif
+}
+
 }  // namespace inmem_psascan_private
 }  // namespace psascan_private
 
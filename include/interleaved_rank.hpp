@@ -0,0 +1,275 @@
+/**
+ * @file    src/psascan_src/interleaved_rank.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_INTERLEAVED_RANK_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_INTERLEAVED_RANK_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utils/utils.hpp"
+#include "utils/huge_pages.hpp"
+#include "utils/thread_pool.hpp"
+
+
+namespace psascan_private {
+
+//==============================================================================
+// Rank structure over byte alphabet (an alternative to rank4n), in which
+// the sequence is split into blocks of 2^k_block_size_log symbols. Each block
+// is stored as a 64-byte aligned record holding the 32-bit counts of all
+// symbols up to the block beginning (relative to the superblock of 2^32
+// symbols, whose counts are kept in a separate, tiny array) followed by the
+// symbols of the block. A query thus touches one cache line of the header
+// and scans at most half of the block, starting either at the beginning of
+// the block or at the beginning of the next block, which both is typically
+// fewer cache misses than the query to rank4n, where the headers and the
+// trunks are stored in separate arrays.
+//
+// Space usage is (4 * 256 + 2^k_block_size_log) / 2^k_block_size_log bytes
+// per symbol, i.e., 3n bytes for the default block size.
+//==============================================================================
+template<unsigned k_block_size_log = 9>
+class interleaved_rank {
+  static_assert(k_block_size_log >= 6 && k_block_size_log <= 12,
+      "interleaved_rank: block size has to be in the range [2^6..2^12]");
+
+  private:
+    static const unsigned long k_block_size = (1UL << k_block_size_log);
+    static const unsigned long k_block_size_mask = k_block_size - 1;
+    static const unsigned long k_header_size = 256UL * sizeof(uint32_t);
+    static const unsigned long k_record_size = k_header_size + k_block_size;
+    static const unsigned k_sblock_size_log = 32;
+    static const unsigned k_blocks_in_sblock_log = k_sblock_size_log - k_block_size_log;
+
+    unsigned long m_length;   // length of original sequence
+    unsigned long n_blocks;   // number of blocks
+    unsigned long n_sblocks;  // number of superblocks
+
+    unsigned char *m_records;         // interleaved headers and blocks
+    unsigned long *m_sblock_header;   // symbol counts up to superblock beginning
+
+  public:
+    unsigned long *m_count;  // symbol counts
+
+  public:
+    interleaved_rank(const unsigned char *text, unsigned long length, unsigned max_threads) {
+      m_length = length;
+      n_blocks = (m_length + k_block_size - 1) / k_block_size;
+      n_sblocks = (n_blocks + (1UL << k_blocks_in_sblock_log) - 1) >> k_blocks_in_sblock_log;
+
+      m_count = (unsigned long *)malloc(256L * sizeof(unsigned long));
+      std::fill(m_count, m_count + 256, 0UL);
+      if (!m_length) return;
+
+      // The records are allocated so that (if
+      // supported) they can be backed by huge pages.
+      unsigned long records_size = n_blocks * k_record_size;
+      m_records = (unsigned char *)huge_pages::allocate(records_size);
+      if (m_records == NULL) {
+        fprintf(stderr, "\nError: allocation of %lu bytes for rank failed\n", records_size);
+        std::exit(EXIT_FAILURE);
+      }
+      m_sblock_header = (unsigned long *)malloc(n_sblocks * 256L * sizeof(unsigned long));
+
+      // 1
+      //
+      // Split blocks into ranges processed by different tasks. The
+      // range size is a power of two not exceeding the superblock
+      // size, so that every range is contained in one superblock.
+      unsigned long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+      unsigned long range_size = 1;
+      while (range_size * max_tasks < n_blocks &&
+          range_size < (1UL << k_blocks_in_sblock_log)) range_size <<= 1;
+      unsigned long n_ranges = (n_blocks + range_size - 1) / range_size;
+      unsigned long *range_count = new unsigned long[n_ranges * 256];
+
+      // 2
+      //
+      // Copy the symbols into records, and compute symbol
+      // counts in every block and in every range.
+      {
+        task_group tasks;
+        for (unsigned long i = 0; i < n_ranges; ++i) {
+          unsigned long range_beg = i * range_size;
+          unsigned long range_end = std::min(range_beg + range_size, n_blocks);
+          tasks.add(encode_aux, std::ref(*this), text,
+              range_beg, range_end, range_count + i * 256);
+        }
+        tasks.wait();
+      }
+
+      // 3
+      //
+      // Compute superblock headers and turn range counts into counts up
+      // to the range beginning relative to the containing superblock.
+      for (unsigned long i = 0; i < n_ranges; ++i) {
+        unsigned long block_id = i * range_size;
+        unsigned long sblock_id = (block_id >> k_blocks_in_sblock_log);
+        if (!(block_id & ((1UL << k_blocks_in_sblock_log) - 1)))
+          std::copy(m_count, m_count + 256, m_sblock_header + sblock_id * 256);
+        for (unsigned c = 0; c < 256; ++c) {
+          unsigned long cnt = range_count[i * 256 + c];
+          range_count[i * 256 + c] = m_count[c] - m_sblock_header[sblock_id * 256 + c];
+          m_count[c] += cnt;
+        }
+      }
+
+      // 4
+      //
+      // Turn block counts into counts up to the block beginning.
+      {
+        task_group tasks;
+        for (unsigned long i = 0; i < n_ranges; ++i) {
+          unsigned long range_beg = i * range_size;
+          unsigned long range_end = std::min(range_beg + range_size, n_blocks);
+          tasks.add(compute_headers_aux, std::ref(*this),
+              range_beg, range_end, range_count + i * 256);
+        }
+        tasks.wait();
+      }
+      delete[] range_count;
+
+      m_count[0] -= n_blocks * k_block_size - m_length;  // remove padding
+    }
+
+    static void encode_aux(interleaved_rank &r, const unsigned char *text,
+        unsigned long block_range_beg, unsigned long block_range_end,
+        unsigned long *range_count) {
+      std::fill(range_count, range_count + 256, 0UL);
+      for (unsigned long block_id = block_range_beg; block_id < block_range_end; ++block_id) {
+        unsigned long block_beg = (block_id << k_block_size_log);
+        unsigned long block_end = std::min(block_beg + k_block_size, r.m_length);
+        uint32_t *header = r.header(block_id);
+        unsigned char *block = r.payload(block_id);
+
+        std::fill(header, header + 256, 0U);
+        std::copy(text + block_beg, text + block_end, block);
+        std::fill(block + (block_end - block_beg), block + k_block_size, 0);
+        for (unsigned long j = 0; j < k_block_size; ++j)
+          ++header[block[j]];
+        for (unsigned c = 0; c < 256; ++c)
+          range_count[c] += header[c];
+      }
+    }
+
+    static void compute_headers_aux(interleaved_rank &r,
+        unsigned long block_range_beg, unsigned long block_range_end,
+        const unsigned long *range_count) {
+      uint32_t *cur_count = new uint32_t[256];
+      std::copy(range_count, range_count + 256, cur_count);
+      for (unsigned long block_id = block_range_beg; block_id < block_range_end; ++block_id) {
+        uint32_t *header = r.header(block_id);
+        for (unsigned c = 0; c < 256; ++c) {
+          uint32_t block_count = header[c];
+          header[c] = cur_count[c];
+          cur_count[c] += block_count;
+        }
+      }
+      delete[] cur_count;
+    }
+
+    inline long rank(long i, unsigned char c) const {
+      if (i <= 0) return 0L;
+      else if ((unsigned long)i >= m_length) return m_count[c];
+
+      unsigned long block_id = (i >> k_block_size_log);
+      long block_i = (i & k_block_size_mask);
+      const unsigned char *block = payload(block_id);
+      __builtin_prefetch(block + block_i);
+
+      if ((unsigned long)block_i < k_block_size / 2) {
+        // Count the occurrences of c in the block up to position i.
+        return rank_up_to_block(block_id, c) + count(block, block_i, c);
+      } else if (block_id + 1 == n_blocks) {
+        // Subtract occurrences of c after position i in the last block.
+        return m_count[c] - count(block + block_i, m_length - i, c);
+      } else {
+        // Subtract occurrences of c in the block after position i.
+        return rank_up_to_block(block_id + 1, c) -
+          count(block + block_i, k_block_size - block_i, c);
+      }
+    }
+
+    ~interleaved_rank() {
+      if (m_length) {
+        huge_pages::deallocate(m_records);
+        free(m_sblock_header);
+      }
+      free(m_count);
+    }
+
+  private:
+    inline uint32_t *header(unsigned long block_id) const {
+      return (uint32_t *)(m_records + block_id * k_record_size);
+    }
+
+    inline unsigned char *payload(unsigned long block_id) const {
+      return m_records + block_id * k_record_size + k_header_size;
+    }
+
+    inline long rank_up_to_block(unsigned long block_id, unsigned char c) const {
+      unsigned long sblock_id = (block_id >> k_blocks_in_sblock_log);
+      return m_sblock_header[(sblock_id << 8) + c] + header(block_id)[c];
+    }
+
+    // Return the number of occurrences of c in s[0..length).
+    // Requires length < 2^12 (to avoid overflows of byte counters).
+    static inline long count(const unsigned char *s, long length, unsigned char c) {
+      long result = 0, j = 0;
+#ifdef __SSE2__
+      __m128i pattern = _mm_set1_epi8((char)c);
+      __m128i acc = _mm_setzero_si128();
+      for (; j + 16 <= length; j += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(s + j));
+        acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(x, pattern));
+      }
+      __m128i sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+      result += _mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4);
+#endif
+      for (; j < length; ++j)
+        result += (s[j] == c);
+      return result;
+    }
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_INTERLEAVED_RANK_HPP_INCLUDED
@@ -41,6 +41,7 @@
 #include <algorithm>
 
 #include "../utils/utils.hpp"
+#include "io_uring_engine.hpp"
 
 
 namespace psascan_private {
@@ -87,6 +88,22 @@ struct async_backward_skip_stream_reader {
 
   async_backward_skip_stream_reader(
       std::string filename, long skip_elems, long bufsize = (4 << 20)) {
+    m_active_buf_filled = 0L;
+    m_passive_buf_filled = 0L;
+    m_active_buf_pos = -1L;
+
+    // Use io_uring if possible.
+    m_uring = io_uring_buffers::create(std::max(1UL,
+          (bufsize / io_uring_engine::k_queue_depth) / sizeof(value_type)) * sizeof(value_type));
+    if (m_uring != NULL) {
+      m_fd = io_uring_engine::open_fd(filename, O_RDONLY);
+      m_buf_size = m_uring->buf_size() / sizeof(value_type);
+      m_active_buf_id = -1L;
+      m_read_end = io_uring_engine::fd_size(m_fd) / sizeof(value_type) - skip_elems;
+      submit_reads();
+      return;
+    }
+
     m_file = utils::open_file(filename.c_str(), "r");
     std::fseek(m_file, -(skip_elems * sizeof(value_type)), SEEK_END);
 
@@ -95,9 +112,6 @@ struct async_backward_skip_stream_reader {
         (bufsize + sizeof(value_type) - 1) / sizeof(value_type));
     m_buf_size = elems / 2;
 
-    m_active_buf_filled = 0L;
-    m_passive_buf_filled = 0L;
-    m_active_buf_pos = -1L;
     m_active_buf = (value_type *)malloc(m_buf_size * sizeof(value_type));
     m_passive_buf = (value_type *)malloc(m_buf_size * sizeof(value_type));
 
@@ -109,6 +123,11 @@ struct async_backward_skip_stream_reader {
   }
   
   ~async_backward_skip_stream_reader() {
+    if (m_uring != NULL) {
+      delete m_uring;
+      close(m_fd);
+      return;
+    }
 
     // Let the I/O thread know that we're done.
     std::unique_lock<std::mutex> lk(m_mutex);
@@ -126,11 +145,38 @@ struct async_backward_skip_stream_reader {
     std::fclose(m_file);
   }
 
+  // Schedule reading of the preceding parts of the
+  // file into all free buffers (io_uring only).
+  void submit_reads() {
+    while (m_read_end > 0 && m_uring->n_free() > 0) {
+      long toread = std::min(m_buf_size, m_read_end);
+      m_read_end -= toread;
+      m_uring->submit(false, m_uring->get_free(), m_fd,
+          toread * sizeof(value_type), m_read_end * sizeof(value_type));
+    }
+  }
+
   // This function checks if the reading thread has already
   // prefetched the next buffer (the request should have been
   // issued before), and waits in case the prefetching was not
   // completed yet.
   void receive_new_buffer() {
+    if (m_uring != NULL) {
+      if (m_active_buf_id != -1L)
+        m_uring->release(m_active_buf_id);
+      if (m_uring->n_pending() == 0) {
+        fprintf(stderr, "\nError: reading past the beginning of file\n");
+        std::exit(EXIT_FAILURE);
+      }
+
+      long bytes = 0L;
+      m_active_buf_id = m_uring->complete_oldest(&bytes);
+      m_active_buf = (value_type *)m_uring->buffer(m_active_buf_id);
+      m_active_buf_filled = bytes / sizeof(value_type);
+      m_active_buf_pos = m_active_buf_filled - 1L;
+      submit_reads();
+      return;
+    }
 
     // Wait until the I/O thread finishes reading the previous
     // buffer. In most cases this step is instantaneous.
@@ -184,6 +230,12 @@ private:
 
   std::FILE *m_file;
   std::thread *m_thread;
+
+  // Used instead of the above if reading with io_uring.
+  io_uring_buffers *m_uring;
+  long m_active_buf_id;
+  long m_read_end;  // the file is read backwards up to here (in items)
+  int m_fd;
 };
 
 }  // namespace psascan_private
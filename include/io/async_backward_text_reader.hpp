@@ -0,0 +1,179 @@
+/**
+ * @file    src/psascan_src/io/async_backward_text_reader.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_IO_ASYNC_BACKWARD_TEXT_READER_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_IO_ASYNC_BACKWARD_TEXT_READER_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+#include "concatenated_text.hpp"
+
+
+namespace psascan_private {
+
+// Reads the text backwards, starting from the symbol preceding
+// the last skip_elems symbols. Same as async_backward_skip_stream_reader,
+// but the text can be a concatenation of files.
+struct async_backward_text_reader {
+  static void io_thread_code(async_backward_text_reader *reader) {
+    concatenated_text::cursor text_cursor;
+    while (true) {
+
+      // Wait until the passive buffer is available.
+      std::unique_lock<std::mutex> lk(reader->m_mutex);
+      while (!(reader->m_avail) && !(reader->m_finished))
+        reader->m_cv.wait(lk);
+
+      if (!(reader->m_avail) && (reader->m_finished)) {
+
+        // We're done, terminate the thread.
+        lk.unlock();
+        return;
+      }
+      lk.unlock();
+
+      // Safely read the data from disk.
+      long toread = std::min(reader->m_buf_size, reader->m_read_end);
+      if (toread > 0) {
+        reader->m_read_end -= toread;
+        reader->m_text->read(reader->m_read_end, toread,
+            reader->m_passive_buf, text_cursor);
+        reader->m_passive_buf_filled = toread;
+      }
+
+      // Let the caller know that the I/O thread finished reading.
+      lk.lock();
+      reader->m_avail = false;
+      lk.unlock();
+      reader->m_cv.notify_one();
+    }
+  }
+
+  async_backward_text_reader(const concatenated_text *text,
+      long skip_elems, long bufsize = (4 << 20)) {
+    m_text = text;
+    m_read_end = text->length() - skip_elems;
+    m_active_buf_filled = 0L;
+    m_passive_buf_filled = 0L;
+    m_active_buf_pos = -1L;
+
+    // Initialize buffers.
+    m_buf_size = std::max(1L, bufsize / 2L);
+    m_active_buf = (unsigned char *)malloc(m_buf_size);
+    m_passive_buf = (unsigned char *)malloc(m_buf_size);
+
+    m_finished = false;
+
+    // Start the I/O thread and immediately start reading.
+    m_avail = true;
+    m_thread = new std::thread(io_thread_code, this);
+  }
+
+  ~async_backward_text_reader() {
+
+    // Let the I/O thread know that we're done.
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_finished = true;
+    lk.unlock();
+    m_cv.notify_one();
+
+    // Wait for the thread to finish.
+    m_thread->join();
+
+    // Clean up.
+    delete m_thread;
+    free(m_active_buf);
+    free(m_passive_buf);
+  }
+
+  // This function checks if the reading thread has already
+  // prefetched the next buffer (the request should have been
+  // issued before), and waits in case the prefetching was not
+  // completed yet.
+  void receive_new_buffer() {
+
+    // Wait until the I/O thread finishes reading the previous
+    // buffer. In most cases this step is instantaneous.
+    std::unique_lock<std::mutex> lk(m_mutex);
+    while (m_avail == true)
+      m_cv.wait(lk);
+
+    // Set the new active buffer.
+    std::swap(m_active_buf, m_passive_buf);
+    m_active_buf_filled = m_passive_buf_filled;
+    m_active_buf_pos = m_active_buf_filled - 1L;
+
+    // Let the I/O thread know that it can now prefetch
+    // another buffer.
+    m_avail = true;
+    lk.unlock();
+    m_cv.notify_one();
+  }
+
+  inline unsigned char read() {
+    if (m_active_buf_pos < 0L)
+      receive_new_buffer();
+
+    return m_active_buf[m_active_buf_pos--];
+  }
+
+private:
+  const concatenated_text *m_text;
+  long m_read_end;  // the text is read backwards up to here
+
+  unsigned char *m_active_buf;
+  unsigned char *m_passive_buf;
+
+  long m_buf_size;
+  long m_active_buf_pos;
+  long m_active_buf_filled;
+  long m_passive_buf_filled;
+
+  // Used for synchronization with the I/O thread.
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_avail;
+  bool m_finished;
+
+  std::thread *m_thread;
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_IO_ASYNC_BACKWARD_TEXT_READER_HPP_INCLUDED
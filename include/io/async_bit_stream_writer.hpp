@@ -40,6 +40,7 @@
 #include <algorithm>
 
 #include "../utils/utils.hpp"
+#include "io_uring_engine.hpp"
 
 
 namespace psascan_private {
@@ -74,6 +75,22 @@ struct async_bit_stream_writer {
   }
 
   async_bit_stream_writer(std::string filename, long bufsize = (4 << 20)) {
+    m_bit_pos = 0L;
+    m_active_buf_filled = 0L;
+    m_passive_buf_filled = 0L;
+
+    // Use io_uring if possible.
+    m_uring = io_uring_buffers::create(bufsize / io_uring_engine::k_queue_depth);
+    if (m_uring != NULL) {
+      m_fd = io_uring_engine::open_fd(filename, O_WRONLY | O_CREAT | O_TRUNC);
+      m_file_pos = 0L;
+      m_buf_size = m_uring->buf_size();
+      m_active_buf_id = m_uring->get_free();
+      m_active_buf = m_uring->buffer(m_active_buf_id);
+      m_active_buf[0] = 0;
+      return;
+    }
+
     m_file = utils::open_file(filename.c_str(), "w");
 
     // Initialize buffers.    
@@ -82,11 +99,7 @@ struct async_bit_stream_writer {
 
     m_active_buf = (unsigned char *)malloc(m_buf_size);
     m_passive_buf = (unsigned char *)malloc(m_buf_size);
-
     m_active_buf[0] = 0;
-    m_bit_pos = 0L;
-    m_active_buf_filled = 0L;
-    m_passive_buf_filled = 0L;
 
     m_avail = false;
     m_finished = false;
@@ -102,6 +115,12 @@ struct async_bit_stream_writer {
     if (m_active_buf_filled > 0L)
       send_active_buf_to_write();
 
+    if (m_uring != NULL) {
+      delete m_uring;
+      close(m_fd);
+      return;
+    }
+
     // Let the I/O thread know that we're done.
     std::unique_lock<std::mutex> lk(m_mutex);
     m_finished = true;
@@ -121,6 +140,19 @@ struct async_bit_stream_writer {
   // Passes on the active buffer (full, unless it's the last one,
   // partially filled, buffer passed from destructor) to the I/O thread.
   void send_active_buf_to_write() {
+    if (m_uring != NULL) {
+
+      // Submit the write and take another buffer
+      // (possibly waiting for the oldest write).
+      m_uring->submit(true, m_active_buf_id, m_fd, m_active_buf_filled, m_file_pos);
+      m_file_pos += m_active_buf_filled;
+      m_active_buf_id = m_uring->get_free();
+      m_active_buf = m_uring->buffer(m_active_buf_id);
+      m_active_buf_filled = 0L;
+      m_bit_pos = 0L;
+      m_active_buf[0] = 0;
+      return;
+    }
 
     // Wait until the I/O thread finishes writing the previous buffer.
     std::unique_lock<std::mutex> lk(m_mutex);
@@ -175,6 +207,12 @@ private:
 
   std::FILE *m_file;
   std::thread *m_thread;
+
+  // Used instead of the above if writing with io_uring.
+  io_uring_buffers *m_uring;
+  long m_active_buf_id;
+  long m_file_pos;
+  int m_fd;
 };
 
 }  // namespace psascan_private
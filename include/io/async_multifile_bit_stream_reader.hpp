@@ -37,11 +37,13 @@
 #include <thread>
 #include <mutex>
 #include <vector>
+#include <deque>
 #include <algorithm>
 #include <condition_variable>
 
 #include "../utils/utils.hpp"
 #include "multifile.hpp"
+#include "io_uring_engine.hpp"
 
 
 namespace psascan_private {
@@ -51,14 +53,24 @@ struct async_multifile_bit_stream_reader {
       long bufsize = (4L << 20)) {
     m_files_info = m->files_info;
   
-    long items = std::max(2L, bufsize);
-    m_buf_size = items / 2L;
-
     // Reset counters.
     m_active_buf_filled = 0;
     m_passive_buf_filled = 0;
     m_active_buf_pos = 0;
 
+    // Use io_uring if possible.
+    m_uring = io_uring_buffers::create(bufsize / io_uring_engine::k_queue_depth);
+    if (m_uring != NULL) {
+      m_buf_size = m_uring->buf_size();
+      m_active_buf_id = -1L;
+      m_fd = -1;
+      init_uring(start_pos);
+      return;
+    }
+
+    long items = std::max(2L, bufsize);
+    m_buf_size = items / 2L;
+
     // Initialize buffers.
     m_active_buf = (unsigned char *)malloc(m_buf_size);
     m_passive_buf = (unsigned char *)malloc(m_buf_size);
@@ -120,6 +132,15 @@ struct async_multifile_bit_stream_reader {
   }
 
   ~async_multifile_bit_stream_reader() {
+    if (m_uring != NULL) {
+      delete m_uring;
+      for (size_t i = 0; i < m_chunks.size(); ++i)
+        if (m_chunks[i].m_last_in_file)
+          close(m_chunks[i].m_fd);
+      if (m_fd != -1)
+        close(m_fd);
+      return;
+    }
 
     // Let the I/O thread know that we are done.
     std::unique_lock<std::mutex> lk(m_mutex);
@@ -138,6 +159,87 @@ struct async_multifile_bit_stream_reader {
       std::fclose(m_file);
   }
 
+  // Initialize reading with io_uring. The first buffer
+  // is received immediately, as in init().
+  void init_uring(long start_pos) {
+    m_total_read_buf = start_pos;
+    m_cur_byte = 0;
+    m_cur_bit = 0;
+    for (size_t j = 0; j < m_files_info.size(); ++j) {
+      if (m_files_info[j].m_beg <= start_pos && start_pos < m_files_info[j].m_end) {
+        m_file_id = j;
+        m_fd = io_uring_engine::open_fd(m_files_info[j].m_filename, O_RDONLY);
+        m_cur_bit = ((start_pos - m_files_info[j].m_beg) & 7L);
+        m_total_read_buf -= m_cur_bit;
+        break;
+      }
+    }
+
+    if (m_fd != -1) {
+      long skip = m_cur_bit;
+      submit_reads();
+      receive_new_buffer();
+      m_cur_bit = skip;
+      m_active_buf_pos = skip;
+    }
+  }
+
+  // Schedule reading of the following parts of
+  // files into all free buffers (io_uring only).
+  void submit_reads() {
+    while (m_uring->n_free() > 0) {
+      if (m_fd == -1) {
+
+        // Find the next file to open.
+        for (size_t j = 0; j < m_files_info.size(); ++j)
+          if (m_files_info[j].m_beg == m_total_read_buf) {
+            m_file_id = j;
+            m_fd = io_uring_engine::open_fd(m_files_info[j].m_filename, O_RDONLY);
+            break;
+          }
+
+        // No more data to prefetch.
+        if (m_fd == -1) return;
+      }
+
+      const single_file_info &info = m_files_info[m_file_id];
+      long file_left = info.m_end - m_total_read_buf;
+      long offset = (m_total_read_buf - info.m_beg) >> 3;
+      uring_chunk chunk;
+      chunk.m_fd = m_fd;
+      chunk.m_bits = std::min(file_left, 8L * m_buf_size);
+      chunk.m_last_in_file = (chunk.m_bits == file_left);
+      m_total_read_buf += chunk.m_bits;
+      m_chunks.push_back(chunk);
+      m_uring->submit(false, m_uring->get_free(), m_fd,
+          (chunk.m_bits + 7L) / 8L, offset);
+      if (chunk.m_last_in_file)
+        m_fd = -1;
+    }
+  }
+
+  void receive_new_buffer_uring() {
+    if (m_active_buf_id != -1L)
+      m_uring->release(m_active_buf_id);
+    if (m_chunks.empty()) {
+      fprintf(stderr, "\nError: reading past the end of multifile\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    uring_chunk chunk = m_chunks.front();
+    m_chunks.pop_front();
+    m_active_buf_id = m_uring->complete_oldest();
+    m_active_buf = m_uring->buffer(m_active_buf_id);
+    if (chunk.m_last_in_file)
+      close(chunk.m_fd);
+
+    m_active_buf_filled = chunk.m_bits;
+    m_active_buf_pos = 0;
+    m_cur_byte = 0;
+    m_cur_bit = 0;
+    submit_reads();
+  }
+
   static void async_io_code(async_multifile_bit_stream_reader *file) {
     while (true) {
 
@@ -188,6 +290,10 @@ struct async_multifile_bit_stream_reader {
   }
 
   void receive_new_buffer() {
+    if (m_uring != NULL) {
+      receive_new_buffer_uring();
+      return;
+    }
 
     // Wait until the I/O thread finishes reading the previous
     // buffer. Most of the time this step is instantaneous.
@@ -232,6 +338,18 @@ private:
   std::condition_variable m_cv;
   bool m_finished;
   bool m_avail;
+
+  // Used instead of the above if reading with io_uring.
+  struct uring_chunk {
+    int m_fd;
+    long m_bits;
+    bool m_last_in_file;  // the file is closed after receiving the chunk
+  };
+
+  io_uring_buffers *m_uring;
+  long m_active_buf_id;
+  std::deque<uring_chunk> m_chunks;
+  int m_fd;  // file of the next chunk to read
 };
 
 }  // namespace psascan_private
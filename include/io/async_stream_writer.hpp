@@ -40,6 +40,7 @@
 #include <algorithm>
 
 #include "../utils/utils.hpp"
+#include "io_uring_engine.hpp"
 
 
 namespace psascan_private {
@@ -75,17 +76,38 @@ struct async_stream_writer {
     }
   }
 
-  async_stream_writer(std::string filename, long bufsize = (4 << 20)) {
-    m_file = utils::open_file(filename.c_str(), "w");
+  // If offset is non-negative, the file has to exist and the writing
+  // starts at the given offset (in bytes) without truncating the file.
+  async_stream_writer(std::string filename, long bufsize = (4 << 20),
+      long offset = -1L) {
+    m_active_buf_filled = 0L;
+    m_passive_buf_filled = 0L;
+
+    // Use io_uring if possible.
+    m_uring = io_uring_buffers::create(std::max(1UL,
+          (bufsize / io_uring_engine::k_queue_depth) / sizeof(value_type)) * sizeof(value_type));
+    if (m_uring != NULL) {
+      m_fd = io_uring_engine::open_fd(filename, (offset < 0L) ?
+          (O_WRONLY | O_CREAT | O_TRUNC) : O_WRONLY);
+      m_file_pos = std::max(0L, offset);
+      m_buf_size = m_uring->buf_size() / sizeof(value_type);
+      m_active_buf_id = m_uring->get_free();
+      m_active_buf = (value_type *)m_uring->buffer(m_active_buf_id);
+      return;
+    }
+
+    if (offset < 0L)
+      m_file = utils::open_file(filename.c_str(), "w");
+    else {
+      m_file = utils::open_file(filename.c_str(), "r+");
+      std::fseek(m_file, offset, SEEK_SET);
+    }
 
     // Initialize buffers.    
     long elems = std::max(2UL,
         (bufsize + sizeof(value_type) - 1) / sizeof(value_type));
     m_buf_size = elems / 2;  // both buffers are of the same size
 
-    m_active_buf_filled = 0L;
-    m_passive_buf_filled = 0L;
-
     m_active_buf = (value_type *)malloc(m_buf_size * sizeof(value_type));
     m_passive_buf = (value_type *)malloc(m_buf_size * sizeof(value_type));
 
@@ -102,6 +124,12 @@ struct async_stream_writer {
     if (m_active_buf_filled > 0L)
       send_active_buf_to_write();
 
+    if (m_uring != NULL) {
+      delete m_uring;
+      close(m_fd);
+      return;
+    }
+
     // Let the I/O thread know that we're done.
     std::unique_lock<std::mutex> lk(m_mutex);
     m_finished = true;
@@ -121,6 +149,18 @@ struct async_stream_writer {
   // Passes on the active buffer (full, unless it's the last one,
   // partially filled, buffer passed from destructor) to the I/O thread.
   void send_active_buf_to_write() {
+    if (m_uring != NULL) {
+
+      // Submit the write and take another buffer
+      // (possibly waiting for the oldest write).
+      long bytes = m_active_buf_filled * sizeof(value_type);
+      m_uring->submit(true, m_active_buf_id, m_fd, bytes, m_file_pos);
+      m_file_pos += bytes;
+      m_active_buf_id = m_uring->get_free();
+      m_active_buf = (value_type *)m_uring->buffer(m_active_buf_id);
+      m_active_buf_filled = 0L;
+      return;
+    }
 
     // Wait until the I/O thread finishes writing the previous buffer.
     std::unique_lock<std::mutex> lk(m_mutex);
@@ -164,6 +204,12 @@ private:
 
   std::FILE *m_file;
   std::thread *m_thread;
+
+  // Used instead of the above if writing with io_uring.
+  io_uring_buffers *m_uring;
+  long m_active_buf_id;
+  long m_file_pos;
+  int m_fd;
 };
 
 }  // namespace psascan_private
@@ -41,6 +41,8 @@
 #include <algorithm>
 
 #include "../utils/utils.hpp"
+#include "io_uring_engine.hpp"
+#include "fd_pool.hpp"
 
 
 namespace psascan_private {
@@ -64,13 +66,10 @@ struct async_vbyte_stream_reader {
       lk.unlock();
 
       // Safely read the data from disk.
-      long count =
-        std::fread(reader->m_passive_buf, 1,
-            reader->m_buf_size + 128, reader->m_file);
-      if (count > reader->m_buf_size) {
-        reader->m_passive_buf_filled = reader->m_buf_size;
-        std::fseek(reader->m_file, reader->m_buf_size - count, SEEK_CUR);
-      } else reader->m_passive_buf_filled = count;
+      long count = reader->m_file->read(reader->m_passive_buf,
+          reader->m_buf_size + 128, reader->m_read_beg);
+      reader->m_passive_buf_filled = std::min(count, reader->m_buf_size);
+      reader->m_read_beg += reader->m_passive_buf_filled;
  
       // Let the caller know that the I/O thread finished reading.
       lk.lock();
@@ -81,15 +80,33 @@ struct async_vbyte_stream_reader {
   }
 
   async_vbyte_stream_reader(std::string filename, long bufsize = (4L << 20)) {
-    m_file = utils::open_file(filename.c_str(), "r");
+    m_active_buf_filled = 0L;
+    m_passive_buf_filled = 0L;
+    m_active_buf_pos = 0L;
 
-    // Initialize buffers.
+    // Use io_uring if possible. As in the I/O thread, every buffer
+    // overlaps the next one by 128 bytes, so that an integer never
+    // spans two buffers.
     long elems = std::max(4096L, bufsize);
+    m_uring = io_uring_buffers::create(elems / io_uring_engine::k_queue_depth + 128);
+    if (m_uring != NULL) {
+      m_fd = io_uring_engine::open_fd(filename, O_RDONLY);
+      m_buf_size = m_uring->buf_size() - 128;
+      m_active_buf_id = -1L;
+      m_file_size = io_uring_engine::fd_size(m_fd);
+      m_read_beg = 0L;
+      submit_reads();
+      return;
+    }
+
+    // The file descriptor is taken from fd_pool for every read,
+    // since the merging uses one such reader per half-block.
+    m_file = new pooled_file(filename);
+    m_read_beg = 0L;
+
+    // Initialize buffers.
     m_buf_size = elems / 2;
 
-    m_active_buf_filled = 0L;
-    m_passive_buf_filled = 0L;
-    m_active_buf_pos = 0L;
     m_active_buf = (unsigned char *)malloc(m_buf_size + 128);
     m_passive_buf = (unsigned char *)malloc(m_buf_size + 128);
 
@@ -101,6 +118,11 @@ struct async_vbyte_stream_reader {
   }
 
   ~async_vbyte_stream_reader() {
+    if (m_uring != NULL) {
+      delete m_uring;
+      close(m_fd);
+      return;
+    }
 
     // Let the I/O thread know that we're done.
     std::unique_lock<std::mutex> lk(m_mutex);
@@ -115,7 +137,17 @@ struct async_vbyte_stream_reader {
     delete m_thread;
     free(m_active_buf);
     free(m_passive_buf);
-    std::fclose(m_file);
+    delete m_file;
+  }
+
+  // Schedule reading of the following parts of the
+  // file into all free buffers (io_uring only).
+  void submit_reads() {
+    while (m_read_beg < m_file_size && m_uring->n_free() > 0) {
+      m_uring->submit(false, m_uring->get_free(), m_fd,
+          m_buf_size + 128, m_read_beg);
+      m_read_beg += m_buf_size;
+    }
   }
 
   // This function checks if the reading thread has already
@@ -123,6 +155,22 @@ struct async_vbyte_stream_reader {
   // issued before), and waits in case the prefetching was not
   // completed yet.
   void receive_new_buffer(long skipped_bytes) {
+    if (m_uring != NULL) {
+      if (m_active_buf_id != -1L)
+        m_uring->release(m_active_buf_id);
+      if (m_uring->n_pending() == 0) {
+        fprintf(stderr, "\nError: reading past the end of file\n");
+        std::exit(EXIT_FAILURE);
+      }
+
+      long bytes = 0L;
+      m_active_buf_id = m_uring->complete_oldest(&bytes);
+      m_active_buf = m_uring->buffer(m_active_buf_id);
+      m_active_buf_filled = std::min(bytes, m_buf_size);
+      m_active_buf_pos = skipped_bytes;
+      submit_reads();
+      return;
+    }
 
     // Wait until the I/O thread finishes reading the previous
     // buffer. In most cases, this step is instantaneous.
@@ -182,8 +230,15 @@ private:
   bool m_avail;
   bool m_finished;
 
-  std::FILE *m_file;
+  pooled_file *m_file;
   std::thread *m_thread;
+  long m_read_beg;  // offset of the next read
+
+  // Used instead of the above if reading with io_uring.
+  io_uring_buffers *m_uring;
+  long m_active_buf_id;
+  long m_file_size;
+  int m_fd;
 };
 
 }  // namespace psascan_private
@@ -42,6 +42,8 @@
 #include <condition_variable>
 
 #include "../utils/utils.hpp"
+#include "../utils/huge_pages.hpp"
+#include "concatenated_text.hpp"
 
 
 namespace psascan_private {
@@ -67,10 +69,11 @@ struct background_block_reader {
     std::condition_variable m_cv;
 
     std::thread *m_thread;
-    std::FILE *m_file;
+    const concatenated_text *m_text;
 
   private:
     static void io_thread_main(background_block_reader &reader) {
+      concatenated_text::cursor text_cursor;
       while (true) {
         std::unique_lock<std::mutex> lk(reader.m_mutex);
         long fetched = reader.m_fetched;
@@ -81,27 +84,23 @@ struct background_block_reader {
 
         long toread = std::min(reader.m_size - fetched, reader.k_chunk_size);
         unsigned char *dest = reader.m_data + fetched;
-        utils::read_n_objects_from_file(dest, toread, reader.m_file);
+        reader.m_text->read(reader.m_start + fetched, toread, dest, text_cursor);
 
         lk.lock();
         reader.m_fetched += toread;
         lk.unlock();
         reader.m_cv.notify_all();
       }
-      
-      // Close the file and exit.
-      std::fclose(reader.m_file);
     }
 
   public:
-    background_block_reader(std::string filename, long start, long size) {
+    background_block_reader(const concatenated_text *text, long start, long size) {
       m_start = start;
       m_size = size;
          
-      // Initialize file and buffer.
-      m_data = (unsigned char *)malloc(m_size);
-      m_file = utils::open_file(filename, "r");
-      std::fseek(m_file, m_start, SEEK_SET);
+      // Initialize buffer.
+      m_data = (unsigned char *)huge_pages::allocate(m_size);
+      m_text = text;
       m_fetched = 0;
 
       // Start the I/O thread.
@@ -116,10 +115,9 @@ struct background_block_reader {
           "destroying an object of backgroud_block_reader.\n");
         std::exit(EXIT_FAILURE);
       }
-      
-      // Note: m_file is already closed.
+
       delete m_thread;
-      free(m_data);
+      huge_pages::deallocate(m_data);
     }
 
     inline void stop() {
@@ -139,6 +137,18 @@ struct background_block_reader {
       lk.unlock();
     }
 
+    // Wait until the whole block is read and pass the ownership
+    // of the buffer to the caller (who is responsible for freeing it
+    // with huge_pages::deallocate).
+    inline unsigned char *release_data() {
+      wait(m_size);
+      stop();
+
+      unsigned char *data = m_data;
+      m_data = NULL;
+      return data;
+    }
+
     inline void wait(long target_fetched) {
       std::unique_lock<std::mutex> lk(m_mutex);
       while (m_fetched < target_fetched)
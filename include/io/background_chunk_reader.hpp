@@ -43,13 +43,15 @@
 #include <condition_variable>
 
 #include "../utils/utils.hpp"
+#include "concatenated_text.hpp"
 
 
 namespace psascan_private {
 
 struct background_chunk_reader {
   private:
-    std::FILE *m_file;
+    const concatenated_text *m_text;
+    concatenated_text::cursor m_text_cursor;
     long m_chunk_length;
     long m_end;
     
@@ -81,8 +83,8 @@ struct background_chunk_reader {
         
         long next_chunk_length =
           std::min(r.m_chunk_length, r.m_end - r.m_cur);
-        utils::read_n_objects_from_file(
-            r.m_passive_chunk, next_chunk_length, r.m_file);
+        r.m_text->read(r.m_cur, next_chunk_length,
+            r.m_passive_chunk, r.m_text_cursor);
         
         lk.lock();
         r.m_cur += next_chunk_length;
@@ -92,7 +94,7 @@ struct background_chunk_reader {
     }
 
   public:
-    background_chunk_reader(std::string filename, long beg,
+    background_chunk_reader(const concatenated_text *text, long beg,
         long end, long chunk_length = (1L << 20)) {
       if (beg > end) {
         fprintf(stderr, "Error: beg > end in background_chunk_reader.\n");
@@ -108,8 +110,7 @@ struct background_chunk_reader {
       m_chunk = (unsigned char *)malloc(m_chunk_length);
       m_passive_chunk = (unsigned char *)malloc(m_chunk_length);
       
-      m_file = utils::open_file(filename, "r");
-      std::fseek(m_file, m_cur, SEEK_SET);
+      m_text = text;
 
       m_signal_stop = false;
       m_signal_read_next_chunk = true;
@@ -150,8 +151,6 @@ struct background_chunk_reader {
       // in this case this call will do nothing.
       m_thread->join();
 
-      std::fclose(m_file);
-
       // Clean up.  
       delete m_thread;
       free(m_chunk);
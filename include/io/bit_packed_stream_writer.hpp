@@ -0,0 +1,95 @@
+/**
+ * @file    src/psascan_src/io/bit_packed_stream_writer.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_IO_BIT_PACKED_STREAM_WRITER_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_IO_BIT_PACKED_STREAM_WRITER_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <string>
+
+
+namespace psascan_private {
+
+// Writes the stream of values using the given number of bits per value
+// (starting from the least significant bits of the first byte) through
+// the byte writer. The first value starts at the given offset (in bytes),
+// i.e., when writing in parallel, every range except the last one has to
+// hold a multiple of 8 values.
+template<typename byte_writer_type>
+struct bit_packed_stream_writer {
+  bit_packed_stream_writer(std::string filename, long bufsize,
+      long offset, long bits) {
+    if (bits < 1 || bits > 56) {
+      fprintf(stderr, "\nError: unsupported number of bits (%ld) "
+          "in bit_packed_stream_writer.\n", bits);
+      std::exit(EXIT_FAILURE);
+    }
+
+    if (offset < 0) m_writer = new byte_writer_type(filename, bufsize);
+    else m_writer = new byte_writer_type(filename, bufsize, offset);
+    m_bits = bits;
+    m_mask = (1UL << bits) - 1;
+    m_buf = 0;
+    m_buf_filled = 0;
+  }
+
+  ~bit_packed_stream_writer() {
+    if (m_buf_filled > 0)
+      m_writer->write((unsigned char)m_buf);
+    delete m_writer;
+  }
+
+  inline void write(std::uint64_t x) {
+    m_buf |= ((x & m_mask) << m_buf_filled);
+    m_buf_filled += m_bits;
+    while (m_buf_filled >= 8) {
+      m_writer->write((unsigned char)m_buf);
+      m_buf >>= 8;
+      m_buf_filled -= 8;
+    }
+  }
+
+private:
+  byte_writer_type *m_writer;
+  long m_bits;
+  std::uint64_t m_mask;
+  std::uint64_t m_buf;
+  long m_buf_filled;  // number of bits in m_buf
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_IO_BIT_PACKED_STREAM_WRITER_HPP_INCLUDED
@@ -0,0 +1,163 @@
+/**
+ * @file    src/psascan_src/io/concatenated_text.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_IO_CONCATENATED_TEXT_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_IO_CONCATENATED_TEXT_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../utils/utils.hpp"
+
+
+namespace psascan_private {
+
+//==============================================================================
+// The input text given as a concatenation of a list of files (documents).
+// The concatenation is never materialized: reading a range of the text reads
+// the corresponding ranges of the files. The files are opened only when read,
+// so the list can be arbitrarily long.
+//==============================================================================
+struct concatenated_text {
+  // Keeps the last file used by a sequence of reads open. Every
+  // thread reading the text concurrently needs its own cursor.
+  struct cursor {
+    cursor() {
+      m_file_id = -1L;
+      m_fd = -1;
+    }
+
+    ~cursor() {
+      if (m_fd != -1)
+        close(m_fd);
+    }
+
+    long m_file_id;
+    int m_fd;
+  };
+
+  concatenated_text(const std::vector<std::string> &filenames) {
+    if (filenames.empty()) {
+      fprintf(stderr, "\nError: no input files given\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    m_filenames = filenames;
+    m_beg.push_back(0L);
+    for (size_t i = 0; i < m_filenames.size(); ++i) {
+      struct stat st;
+      if (stat(m_filenames[i].c_str(), &st)) {
+        fprintf(stderr, "\nError: cannot stat %s\n", m_filenames[i].c_str());
+        std::perror("stat");
+        std::exit(EXIT_FAILURE);
+      }
+      m_beg.push_back(m_beg.back() + (long)st.st_size);
+    }
+  }
+
+  inline long length() const {
+    return m_beg.back();
+  }
+
+  inline long n_files() const {
+    return (long)m_filenames.size();
+  }
+
+  inline const std::string &filename(long file_id) const {
+    return m_filenames[file_id];
+  }
+
+  // The file containing text[pos] (empty files never contain any position).
+  inline long file_id(long pos) const {
+    return file_id(pos, 0L, n_files());
+  }
+
+  // As above, if it is known that the result is in [lo..hi).
+  inline long file_id(long pos, long lo, long hi) const {
+    return (std::upper_bound(m_beg.begin() + lo + 1,
+          m_beg.begin() + hi + 1, pos) - m_beg.begin()) - 1L;
+  }
+
+  // Read text[beg..beg + length) into dest.
+  void read(long beg, long length, unsigned char *dest, cursor &c) const {
+    while (length > 0) {
+      long id = c.m_file_id;
+      if (id == -1L || beg < m_beg[id] || m_beg[id + 1] <= beg) {
+        id = file_id(beg);
+        if (c.m_fd != -1)
+          close(c.m_fd);
+        c.m_file_id = id;
+        c.m_fd = open(m_filenames[id].c_str(), O_RDONLY);
+        if (c.m_fd == -1) {
+          fprintf(stderr, "\nError: cannot open %s\n", m_filenames[id].c_str());
+          std::perror("open");
+          std::exit(EXIT_FAILURE);
+        }
+      }
+
+      long toread = std::min(length, m_beg[id + 1] - beg);
+      long r = pread(c.m_fd, dest, toread, beg - m_beg[id]);
+      if (r <= 0) {
+        if (r < 0 && errno == EINTR) continue;
+        fprintf(stderr, "\nError: reading %s failed\n", m_filenames[id].c_str());
+        std::perror("pread");
+        std::exit(EXIT_FAILURE);
+      }
+
+      beg += r;
+      length -= r;
+      dest += r;
+    }
+  }
+
+  void read(long beg, long length, unsigned char *dest) const {
+    cursor c;
+    read(beg, length, dest, c);
+  }
+
+private:
+  std::vector<std::string> m_filenames;
+  std::vector<long> m_beg;  // m_beg[i] = starting position of i-th file
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_IO_CONCATENATED_TEXT_HPP_INCLUDED
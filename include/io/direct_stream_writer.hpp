@@ -0,0 +1,250 @@
+/**
+ * @file    src/psascan_src/io/direct_stream_writer.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_IO_DIRECT_STREAM_WRITER_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_IO_DIRECT_STREAM_WRITER_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace psascan_private {
+
+// Writes the stream of values (starting at the given offset in bytes)
+// using O_DIRECT, bypassing the page cache. The file has to exist. The
+// writing is double-buffered like in async_stream_writer. Only the parts
+// of the range not aligned to k_align (the beginning and the end) are
+// written through the page cache.
+template<typename value_type>
+struct direct_stream_writer {
+  static const long k_align = 4096L;
+
+  // Check whether the file system holding the file supports O_DIRECT.
+  static bool is_supported(std::string filename) {
+    int fd = open(filename.c_str(), O_WRONLY | O_DIRECT);
+    if (fd == -1) return false;
+    close(fd);
+    return true;
+  }
+
+  static void io_thread_code(direct_stream_writer<value_type> *writer) {
+    while (true) {
+
+      // Wait until the passive buffer is available.
+      std::unique_lock<std::mutex> lk(writer->m_mutex);
+      while (!(writer->m_avail) && !(writer->m_finished))
+        writer->m_cv.wait(lk);
+
+      if (!(writer->m_avail) && (writer->m_finished)) {
+
+        // We're done, terminate the thread.
+        lk.unlock();
+        return;
+      }
+      lk.unlock();
+
+      // Safely write the data to disk.
+      writer->write_at(writer->m_passive_buf,
+          writer->m_passive_buf_filled, writer->m_passive_buf_pos);
+
+      // Let the caller know that the I/O thread finished writing.
+      lk.lock();
+      writer->m_avail = false;
+      lk.unlock();
+      writer->m_cv.notify_one();
+    }
+  }
+
+  direct_stream_writer(std::string filename, long bufsize = (4 << 20),
+      long offset = 0L) {
+    m_direct_fd = open(filename.c_str(), O_WRONLY | O_DIRECT);
+    m_fd = open(filename.c_str(), O_WRONLY);
+    if (m_direct_fd == -1 || m_fd == -1) {
+      std::perror(filename.c_str());
+      std::exit(EXIT_FAILURE);
+    }
+
+    // Initialize buffers.
+    m_buf_size = std::max(k_align,
+        ((bufsize / 2 + k_align - 1) / k_align) * k_align);
+    if (posix_memalign((void **)&m_active_buf, k_align, m_buf_size) ||
+        posix_memalign((void **)&m_passive_buf, k_align, m_buf_size)) {
+      fprintf(stderr, "\nError: allocation of aligned "
+          "buffers in direct_stream_writer failed.\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    // If the offset is not aligned, the first
+    // buffer is filled only up to the alignment.
+    m_active_buf_pos = offset;
+    m_active_buf_filled = 0L;
+    m_active_buf_cap = m_buf_size;
+    if (offset % k_align)
+      m_active_buf_cap = k_align - (offset % k_align);
+    m_passive_buf_filled = 0L;
+    m_passive_buf_pos = 0L;
+
+    m_avail = false;
+    m_finished = false;
+
+    // Start the I/O thread.
+    m_thread = new std::thread(io_thread_code, this);
+  }
+
+  ~direct_stream_writer() {
+
+    // Write the partially filled active buffer to disk.
+    if (m_active_buf_filled > 0L)
+      send_active_buf_to_write();
+
+    // Let the I/O thread know that we're done.
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_finished = true;
+    lk.unlock();
+    m_cv.notify_one();
+
+    // Wait for the thread to finish.
+    m_thread->join();
+
+    // Clean up.
+    delete m_thread;
+    free(m_active_buf);
+    free(m_passive_buf);
+    close(m_direct_fd);
+    close(m_fd);
+  }
+
+  // Passes on the active buffer to the I/O thread.
+  void send_active_buf_to_write() {
+
+    // Wait until the I/O thread finishes writing the previous buffer.
+    std::unique_lock<std::mutex> lk(m_mutex);
+    while (m_avail == true)
+      m_cv.wait(lk);
+
+    // Set the new passive buffer.
+    std::swap(m_active_buf, m_passive_buf);
+    m_passive_buf_filled = m_active_buf_filled;
+    m_passive_buf_pos = m_active_buf_pos;
+    m_active_buf_pos += m_active_buf_filled;
+    m_active_buf_filled = 0L;
+    m_active_buf_cap = m_buf_size;
+
+    // Let the I/O thread know that the buffer is waiting.
+    m_avail = true;
+    lk.unlock();
+    m_cv.notify_one();
+  }
+
+  inline void write(value_type x) {
+    const unsigned char *src = (const unsigned char *)&x;
+    if (m_active_buf_cap - m_active_buf_filled >= (long)sizeof(value_type)) {
+      std::memcpy(m_active_buf + m_active_buf_filled, src, sizeof(value_type));
+      m_active_buf_filled += sizeof(value_type);
+    } else {
+
+      // The value overlaps the buffer boundary.
+      for (long j = 0; j < (long)sizeof(value_type); ++j) {
+        m_active_buf[m_active_buf_filled++] = src[j];
+        if (m_active_buf_filled == m_active_buf_cap)
+          send_active_buf_to_write();
+      }
+      return;
+    }
+
+    if (m_active_buf_filled == m_active_buf_cap)
+      send_active_buf_to_write();
+  }
+
+private:
+  // Write the aligned prefix of the buffer with O_DIRECT
+  // and the rest (if any) through the page cache.
+  void write_at(const unsigned char *buf, long length, long pos) {
+    long direct_length = 0L;
+    if (pos % k_align == 0)
+      direct_length = length - (length % k_align);
+    write_fully(m_direct_fd, buf, direct_length, pos);
+    write_fully(m_fd, buf + direct_length, length - direct_length,
+        pos + direct_length);
+  }
+
+  static void write_fully(int fd, const unsigned char *buf,
+      long length, long pos) {
+    while (length > 0) {
+      long written = pwrite(fd, buf, length, pos);
+      if (written <= 0) {
+        std::perror("pwrite");
+        std::exit(EXIT_FAILURE);
+      }
+      buf += written;
+      length -= written;
+      pos += written;
+    }
+  }
+
+  unsigned char *m_active_buf;
+  unsigned char *m_passive_buf;
+
+  long m_buf_size;          // size of each of the buffers (in bytes)
+  long m_active_buf_cap;
+  long m_active_buf_filled;
+  long m_active_buf_pos;    // file offset of the active buffer
+  long m_passive_buf_filled;
+  long m_passive_buf_pos;   // file offset of the passive buffer
+
+  // Used for synchronization with the I/O thread.
+  bool m_avail;     // signals availability of buffer for I/O thread
+  bool m_finished;  // signals the end of writing
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+
+  int m_direct_fd;
+  int m_fd;
+  std::thread *m_thread;
+};
+
+template<typename value_type>
+const long direct_stream_writer<value_type>::k_align;
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_IO_DIRECT_STREAM_WRITER_HPP_INCLUDED
@@ -36,30 +36,46 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <thread>
 #include <mutex>
+#include <vector>
+#include <deque>
 #include <algorithm>
 #include <condition_variable>
 
 #include "../utils/utils.hpp"
+#include "io_uring_engine.hpp"
+#include "fd_pool.hpp"
 
 
 namespace psascan_private {
 
+//==============================================================================
+// A file split into parts of at most max_bytes / sizeof(value_type) items.
+// If bits > 0, the items are stored in the parts bit-packed, using the given
+// number of bits per item (starting from the least significant bit of the
+// first byte of each part), and unpacked by the I/O thread when reading.
+//==============================================================================
 template<typename value_type>
 struct distributed_file {
-  distributed_file(std::string filename_base, long max_bytes) {
+  distributed_file(std::string filename_base, long max_bytes, long bits = 0L) {
     m_state = STATE_INIT;
     m_max_items = std::max(1UL, max_bytes / sizeof(value_type));
     m_filename = filename_base + ".distrfile." + utils::random_string_hash();
+    m_keep_parts = false;
+    set_bits(bits);
   }
 
   distributed_file(std::string filename_base, long max_bytes,
-      const value_type *begin, const value_type *end) {
+      const value_type *begin, const value_type *end, long bits = 0L) {
     m_state = STATE_INIT;
     m_max_items = std::max(1UL, max_bytes / sizeof(value_type));
     m_filename = filename_base + ".distrfile." + utils::random_string_hash();
+    m_keep_parts = false;
+    set_bits(bits);
 
     initialize_writing();
     write(begin, end);
@@ -90,7 +106,7 @@ struct distributed_file {
     if (m_cur_file_write != m_max_items) {
       long left = m_max_items - m_cur_file_write;
       long towrite = std::min(left, end - begin);
-      utils::add_objects_to_file(begin, towrite, m_file);
+      add_items_to_cur_file(begin, towrite);
       m_cur_file_write += towrite;
       m_total_write += towrite;
       begin += towrite;
@@ -98,11 +114,12 @@ struct distributed_file {
 
     // Write remaining items.
     while (begin < end) {
+      flush_packed();
       std::fclose(m_file);
       make_new_file();
 
       long towrite = std::min(m_max_items, end - begin);
-      utils::add_objects_to_file(begin, towrite, m_file);
+      add_items_to_cur_file(begin, towrite);
       m_cur_file_write += towrite;
       m_total_write += towrite;
       begin += towrite;
@@ -121,10 +138,53 @@ struct distributed_file {
       std::exit(EXIT_FAILURE);
     }
 
+    flush_packed();
     std::fclose(m_file);
     m_state = STATE_WRITTEN;
   }
 
+  // Write the description of the (completely written) file to f,
+  // so that it can be restored with load_state after a restart.
+  void save_state(std::FILE *f) const {
+    if (m_state != STATE_WRITTEN) {
+      fprintf(stderr, "\nError: saving state of a file in state %s\n",
+          state_string().c_str());
+      std::exit(EXIT_FAILURE);
+    }
+
+    fprintf(f, "%ld %ld %ld %ld %ld\n%s\n", m_max_items, m_files_cnt,
+        m_total_write, m_cur_file_write, m_bits, m_filename.c_str());
+  }
+
+  // Restore the file saved with save_state. Returns NULL if the
+  // description is malformed or any of the parts is missing.
+  static distributed_file<value_type> *load_state(std::FILE *f) {
+    long max_items, files_cnt, total_write, cur_file_write, bits;
+    std::string line, filename;
+    if (!utils::read_line(f, line) ||
+        sscanf(line.c_str(), "%ld %ld %ld %ld %ld", &max_items, &files_cnt,
+          &total_write, &cur_file_write, &bits) != 5 ||
+        !utils::read_line(f, filename) || max_items <= 0 || files_cnt <= 0 ||
+        bits < 0 || bits > k_max_bits)
+      return NULL;
+
+    distributed_file<value_type> *file = new distributed_file<value_type>(
+        filename, max_items * (long)sizeof(value_type), bits);
+    file->m_filename = filename;
+    file->m_files_cnt = files_cnt;
+    file->m_total_write = total_write;
+    file->m_cur_file_write = cur_file_write;
+    file->m_state = STATE_WRITTEN;
+    for (long part = 0; part < files_cnt; ++part) {
+      if (!utils::file_exists(file->part_filename(part))) {
+        delete file;
+        return NULL;
+      }
+    }
+
+    return file;
+  }
+
   void initialize_reading(long bufsize = (4 << 20)) {
     if (m_state != STATE_WRITTEN) {
       fprintf(stderr, "\nError: initializing reading in state %s\n",
@@ -132,19 +192,44 @@ struct distributed_file {
       std::exit(EXIT_FAILURE);
     }
 
-    // Compute buffer size.
-    m_state = STATE_READING;
-    long items = std::max(2UL,
-        (bufsize + sizeof(value_type) - 1) / sizeof(value_type));
-    m_buf_size = items / 2L;
-
     // Reset counters.
+    m_state = STATE_READING;
     m_active_buf_filled = 0;
     m_passive_buf_filled = 0;
     m_active_buf_pos = 0;
     m_total_read_buf = 0;
     m_total_read_user = 0;
     m_cur_file = -1;
+    m_read_file = NULL;
+
+    // Use io_uring if possible. Bit-packed parts are always
+    // read (and unpacked) by the I/O thread.
+    m_uring = NULL;
+    if (m_bits == 0)
+      m_uring = io_uring_buffers::create(std::max(1UL,
+            (bufsize / io_uring_engine::k_queue_depth) / sizeof(value_type)) * sizeof(value_type));
+    if (m_uring != NULL) {
+      m_buf_size = m_uring->buf_size() / sizeof(value_type);
+      m_active_buf_id = -1L;
+      m_fd = -1;
+      submit_reads();
+      return;
+    }
+
+    // Compute buffer size.
+    long items = std::max(2UL,
+        (bufsize + sizeof(value_type) - 1) / sizeof(value_type));
+    m_buf_size = items / 2L;
+    m_packed_buf = NULL;
+    if (m_bits > 0) {
+
+      // The packed data is read into an extra buffer. To keep the
+      // total size, each of the three buffers holds a third of the
+      // items. The buffer size is a multiple of 8 so that every
+      // read (except the last one in each part) ends at byte boundary.
+      m_buf_size = std::max(8L, (items / 3L) & ~7L);
+      m_packed_buf = (unsigned char *)malloc(packed_bytes(m_buf_size) + 8L);
+    }
 
     // Initialize buffers.
     m_active_buf = (value_type *)malloc(m_buf_size * sizeof(value_type));
@@ -185,6 +270,14 @@ struct distributed_file {
       std::exit(EXIT_FAILURE);
     }
 
+    // With io_uring, the last part was already
+    // deleted when its last chunk was received.
+    if (m_uring != NULL) {
+      delete m_uring;
+      m_state = STATE_READ;
+      return;
+    }
+
     // Let the I/O thread know that we are done.
     std::unique_lock<std::mutex> lk(m_mutex);
     m_finished = true;
@@ -199,17 +292,101 @@ struct distributed_file {
     close_and_destroy_cur_file();
     free(m_active_buf);
     free(m_passive_buf);
+    free(m_packed_buf);
 
     // Enter the terminal state.
     m_state = STATE_READ;
   }
 
+  // Prepare the file for concurrent reading of the given (disjoint)
+  // ranges of items. For each part we count the ranges overlapping
+  // it, so that the part can be deleted once all readers are done.
+  void initialize_parallel_reading(
+      const std::vector<std::pair<long, long> > &ranges) {
+    if (m_state != STATE_WRITTEN) {
+      fprintf(stderr, "\nError: initializing parallel reading in state %s\n",
+          state_string().c_str());
+      std::exit(EXIT_FAILURE);
+    }
+
+    m_state = STATE_PARALLEL_READING;
+    m_part_readers = std::vector<long>(m_files_cnt, 0L);
+    for (size_t i = 0; i < ranges.size(); ++i) {
+      if (ranges[i].first == ranges[i].second) continue;
+      long first_part = ranges[i].first / m_max_items;
+      long last_part = (ranges[i].second - 1) / m_max_items;
+      for (long part = first_part; part <= last_part; ++part)
+        ++m_part_readers[part];
+    }
+
+    // Remove parts not needed by any reader.
+    for (long part = 0; part < m_files_cnt; ++part)
+      if (!m_part_readers[part])
+        release_part_file(part);
+  }
+
+  // Called by a range reader after it is done with the given part.
+  void release_part(long part) {
+    std::unique_lock<std::mutex> lk(m_mutex);
+    if (m_state != STATE_PARALLEL_READING || m_part_readers[part] <= 0) {
+      fprintf(stderr, "\nError: releasing part %ld in state %s\n",
+          part, state_string().c_str());
+      std::exit(EXIT_FAILURE);
+    }
+
+    if (--m_part_readers[part] == 0)
+      release_part_file(part);
+  }
+
+  void finish_parallel_reading() {
+    if (m_state != STATE_PARALLEL_READING) {
+      fprintf(stderr, "\nError: finishing parallel reading in state %s\n",
+          state_string().c_str());
+      std::exit(EXIT_FAILURE);
+    }
+
+    for (long part = 0; part < m_files_cnt; ++part) {
+      if (m_part_readers[part]) {
+        fprintf(stderr, "\nError: not all parts were read from "
+            "distributed file %s\n", m_filename.c_str());
+        std::exit(EXIT_FAILURE);
+      }
+    }
+
+    m_state = STATE_READ;
+  }
+
+  std::string part_filename(long part) const {
+    return m_filename + ".part" + utils::intToStr(part);
+  }
+
+  // Do not delete the parts after reading them. Used for the partial
+  // SAs and BWTs referenced by the checkpoint, which have to be kept
+  // until the merging completes (see psascan.hpp).
+  void keep_parts() {
+    m_keep_parts = true;
+  }
+
+  std::vector<std::string> part_filenames() const {
+    std::vector<std::string> filenames;
+    for (long part = 0; part < m_files_cnt; ++part)
+      filenames.push_back(part_filename(part));
+    return filenames;
+  }
+
+  // Delete the part that is no longer needed by the readers.
+  void release_part_file(long part) {
+    if (!m_keep_parts)
+      utils::file_delete(part_filename(part));
+  }
+
   std::string state_string() const {
     switch(m_state) {
       case STATE_INIT:    return "STATE_INIT";
       case STATE_WRITING: return "STATE_WRITING";
       case STATE_WRITTEN: return "STATE_WRITTEN";
       case STATE_READING: return "STATE_READING";
+      case STATE_PARALLEL_READING: return "STATE_PARALLEL_READING";
       case STATE_READ:    return "STATE_READ";
       default: return "undefined state";
     }
@@ -222,15 +399,14 @@ struct distributed_file {
       std::exit(EXIT_FAILURE);
     }
 
-    if (!m_file) {
+    if (!m_read_file) {
       fprintf(stderr, "\nError: deleting a NULL file\n");
       std::exit(EXIT_FAILURE);
     }
 
-    std::fclose(m_file);
-    std::string cur_fname = m_filename + ".part" +
-      utils::intToStr(m_cur_file);
-    utils::file_delete(cur_fname);
+    delete m_read_file;
+    m_read_file = NULL;
+    release_part_file(m_cur_file);
   }
 
   template<typename T>
@@ -265,15 +441,23 @@ struct distributed_file {
         file->open_next_file();
       }
 
-      // Read the data from disk.
+      // Read the data from disk. The buffer size is a multiple of
+      // 8, so with bit-packing every read starts at byte boundary.
       long file_left = file->m_max_items - file->m_cur_file_read;
       long items_left = file->m_total_write - file->m_total_read_buf;
       long left = std::min(file_left, items_left);
       file->m_passive_buf_filled = std::min(left, file->m_buf_size);
+      if (file->m_bits > 0) {
+        file->m_read_file->read_exactly(file->m_packed_buf,
+            file->packed_bytes(file->m_passive_buf_filled),
+            file->packed_bytes(file->m_cur_file_read));
+        file->unpack(file->m_packed_buf, 0L, file->m_passive_buf_filled,
+            file->m_passive_buf);
+      } else file->m_read_file->read_exactly(file->m_passive_buf,
+          file->m_passive_buf_filled * sizeof(value_type),
+          file->m_cur_file_read * sizeof(value_type));
       file->m_cur_file_read += file->m_passive_buf_filled;
       file->m_total_read_buf += file->m_passive_buf_filled;
-      utils::read_n_objects_from_file(file->m_passive_buf,
-          file->m_passive_buf_filled, file->m_file);
 
       // Let the caller know that the I/O thread finished reading.
       lk.lock();
@@ -289,6 +473,10 @@ struct distributed_file {
           state_string().c_str());
       std::exit(EXIT_FAILURE);
     }
+    if (m_uring != NULL) {
+      receive_new_buffer_uring();
+      return;
+    }
 
     // Wait until the I/O thread finishes reading the revious
     // buffer. Most of the time this step is instantaneous.
@@ -308,6 +496,58 @@ struct distributed_file {
     m_cv.notify_one();
   }
 
+  // Schedule reading of the following chunks of parts
+  // into all free buffers (io_uring only).
+  void submit_reads() {
+    while (m_uring->n_free() > 0 && m_total_read_buf < m_total_write) {
+      if (m_fd == -1) {
+        ++m_cur_file;
+        m_fd = io_uring_engine::open_fd(part_filename(m_cur_file), O_RDONLY);
+        m_cur_file_read = 0;
+      }
+
+      long file_left = m_max_items - m_cur_file_read;
+      long items_left = m_total_write - m_total_read_buf;
+      uring_chunk chunk;
+      chunk.m_fd = m_fd;
+      chunk.m_part = m_cur_file;
+      chunk.m_items = std::min(m_buf_size, std::min(file_left, items_left));
+      chunk.m_last_in_part = (chunk.m_items == std::min(file_left, items_left));
+      m_chunks.push_back(chunk);
+      m_uring->submit(false, m_uring->get_free(), m_fd,
+          chunk.m_items * sizeof(value_type),
+          m_cur_file_read * sizeof(value_type));
+      m_cur_file_read += chunk.m_items;
+      m_total_read_buf += chunk.m_items;
+      if (chunk.m_last_in_part)
+        m_fd = -1;
+    }
+  }
+
+  void receive_new_buffer_uring() {
+    if (m_active_buf_id != -1L)
+      m_uring->release(m_active_buf_id);
+    if (m_chunks.empty()) {
+      fprintf(stderr, "\nError: trying to read past the end of file\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    uring_chunk chunk = m_chunks.front();
+    m_chunks.pop_front();
+    m_active_buf_id = m_uring->complete_oldest();
+    m_active_buf = (value_type *)m_uring->buffer(m_active_buf_id);
+    m_active_buf_filled = chunk.m_items;
+    m_active_buf_pos = 0;
+
+    // The part is no longer needed after its last chunk.
+    if (chunk.m_last_in_part) {
+      close(chunk.m_fd);
+      release_part_file(chunk.m_part);
+    }
+
+    submit_reads();
+  }
+
   void open_next_file() {
     if (m_state != STATE_READING) {
       fprintf(stderr, "\nError: opening a new file in state %s\n",
@@ -316,8 +556,7 @@ struct distributed_file {
     }
 
     ++m_cur_file;
-    m_file = utils::open_file(m_filename + ".part" +
-        utils::intToStr(m_cur_file), "r");
+    m_read_file = new pooled_file(part_filename(m_cur_file));
     m_cur_file_read = 0;
   }
 
@@ -334,17 +573,101 @@ struct distributed_file {
     m_cur_file_write = 0;
   }
 
+  void set_bits(long bits) {
+    if (bits < 0 || bits > k_max_bits ||
+        (bits > 0 && (std::uint64_t)bits > 8UL * sizeof(value_type))) {
+      fprintf(stderr, "\nError: unsupported number of bits (%ld) "
+          "in distributed_file\n", bits);
+      std::exit(EXIT_FAILURE);
+    }
+
+    m_bits = bits;
+    m_packed_bits_buf = 0;
+    m_packed_bits_filled = 0;
+  }
+
+  // Number of bytes taken by the given number of packed items.
+  inline long packed_bytes(long n_items) const {
+    return (n_items * m_bits + 7L) / 8L;
+  }
+
+  // Write the items to the current part (packing them, if requested).
+  void add_items_to_cur_file(const value_type *begin, long length) {
+    if (m_bits == 0) {
+      utils::add_objects_to_file(begin, length, m_file);
+      return;
+    }
+
+    static const long k_out_buf_size = (1L << 16);
+    unsigned char out_buf[k_out_buf_size];
+    long out_buf_filled = 0;
+    std::uint64_t mask = (1UL << m_bits) - 1;
+    for (long i = 0; i < length; ++i) {
+      m_packed_bits_buf |= (((std::uint64_t)begin[i] & mask) << m_packed_bits_filled);
+      m_packed_bits_filled += m_bits;
+      while (m_packed_bits_filled >= 8) {
+        out_buf[out_buf_filled++] = (unsigned char)m_packed_bits_buf;
+        m_packed_bits_buf >>= 8;
+        m_packed_bits_filled -= 8;
+        if (out_buf_filled == k_out_buf_size) {
+          utils::add_objects_to_file(out_buf, out_buf_filled, m_file);
+          out_buf_filled = 0;
+        }
+      }
+    }
+    if (out_buf_filled > 0)
+      utils::add_objects_to_file(out_buf, out_buf_filled, m_file);
+  }
+
+  // Write the remaining bits of the last packed item of the current part.
+  void flush_packed() {
+    if (m_packed_bits_filled > 0) {
+      unsigned char c = (unsigned char)m_packed_bits_buf;
+      utils::add_objects_to_file(&c, 1L, m_file);
+    }
+    m_packed_bits_buf = 0;
+    m_packed_bits_filled = 0;
+  }
+
+  // Unpack n_items items, the first starting at the given bit of
+  // src. At least 8 bytes following the packed data have to be
+  // readable (their values do not matter).
+  void unpack(const unsigned char *src, long bit_offset, long n_items,
+      value_type *dest) const {
+    std::uint64_t mask = (1UL << m_bits) - 1;
+    for (long i = 0, pos = bit_offset; i < n_items; ++i, pos += m_bits) {
+      std::uint64_t w;
+      std::memcpy(&w, src + (pos >> 3), sizeof(w));
+      dest[i] = (value_type)((w >> (pos & 7L)) & mask);
+    }
+  }
+
 
   enum { STATE_INIT,    // right after creating (before init_writing)
          STATE_WRITING, // after initialize_writing, writing possible
          STATE_WRITTEN, // after finish_writing, waiting for initialize_reading
          STATE_READING, // after initialize_reading, reading possible
+         STATE_PARALLEL_READING, // after initialize_parallel_reading
          STATE_READ     // after finish_reading, waiting for death
   } m_state;
 
-  std::FILE *m_file;       // file handler
+  // Items wider than this are not supported by unpack.
+  static const long k_max_bits = 56L;
+
+  std::FILE *m_file;       // file handler (writing)
   std::string m_filename;  // file name base
+
+  // The part being read. The merging reads from many distributed
+  // files at the same time, so the descriptors are taken from fd_pool.
+  pooled_file *m_read_file;
   long m_max_items;        // max items per file
+  bool m_keep_parts;       // see keep_parts()
+
+  // Bit-packing of items (m_bits == 0 if items are stored as is).
+  long m_bits;
+  std::uint64_t m_packed_bits_buf;  // bits not yet written to disk
+  long m_packed_bits_filled;        // number of bits in m_packed_bits_buf
+  unsigned char *m_packed_buf;      // packed data before unpacking
 
   // Buffers used for asynchronous reading.
   value_type *m_active_buf;
@@ -371,6 +694,118 @@ struct distributed_file {
   std::condition_variable m_cv;
   bool m_finished;
   bool m_avail;
+
+  // Used instead of the above if reading with io_uring.
+  struct uring_chunk {
+    int m_fd;
+    long m_part;
+    long m_items;
+    bool m_last_in_part;  // the part is deleted after receiving the chunk
+  };
+
+  io_uring_buffers *m_uring;
+  long m_active_buf_id;
+  std::deque<uring_chunk> m_chunks;
+  int m_fd;  // part of the next chunk to read
+
+  // Number of range readers still using each part.
+  std::vector<long> m_part_readers;
+};
+
+
+//==============================================================================
+// Synchronous reader of items [beg..end) of a distributed file. Many such
+// readers (each handling a different range) can be used concurrently, see
+// distributed_file::initialize_parallel_reading. The parts are read using
+// descriptors from fd_pool.
+//==============================================================================
+template<typename value_type>
+struct distributed_file_range_reader {
+  distributed_file_range_reader(distributed_file<value_type> *file,
+      long beg, long end, long bufsize = (1L << 20)) {
+    m_distr_file = file;
+    m_pos = beg;
+    m_end = end;
+    m_file = NULL;
+    m_cur_part = -1;
+
+    m_buf_size = std::max(1UL, bufsize / sizeof(value_type));
+    m_packed_buf = NULL;
+    if (file->m_bits > 0) {
+      m_buf_size = std::max(1L, m_buf_size / 2L);
+      m_packed_buf = (unsigned char *)malloc(
+          file->packed_bytes(m_buf_size) + 16L);
+    }
+    m_buf = (value_type *)malloc(m_buf_size * sizeof(value_type));
+    m_buf_filled = 0L;
+    m_buf_pos = 0L;
+  }
+
+  ~distributed_file_range_reader() {
+    if (m_pos != m_end) {
+      fprintf(stderr, "\nError: not all items were read from the range\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    if (m_file) {
+      delete m_file;
+      m_distr_file->release_part(m_cur_part);
+    }
+    free(m_buf);
+    free(m_packed_buf);
+  }
+
+  inline value_type read() {
+    if (m_buf_pos == m_buf_filled)
+      refill();
+
+    ++m_pos;
+    return m_buf[m_buf_pos++];
+  }
+
+private:
+  void refill() {
+    long part = m_pos / m_distr_file->m_max_items;
+    long part_offset = m_pos % m_distr_file->m_max_items;
+    if (part != m_cur_part) {
+      if (m_file) {
+        delete m_file;
+        m_distr_file->release_part(m_cur_part);
+      }
+
+      m_cur_part = part;
+      m_file = new pooled_file(m_distr_file->part_filename(part));
+    }
+
+    long part_left = m_distr_file->m_max_items - part_offset;
+    m_buf_filled = std::min(m_buf_size, std::min(part_left, m_end - m_pos));
+    m_buf_pos = 0L;
+    if (m_distr_file->m_bits > 0) {
+
+      // The range of packed items does not have
+      // to start at byte boundary.
+      long bits = m_distr_file->m_bits;
+      long read_beg = (part_offset * bits) / 8L;
+      long read_end = ((part_offset + m_buf_filled) * bits + 7L) / 8L;
+      m_file->read_exactly(m_packed_buf, read_end - read_beg, read_beg);
+      m_distr_file->unpack(m_packed_buf, (part_offset * bits) & 7L,
+          m_buf_filled, m_buf);
+    } else m_file->read_exactly(m_buf, m_buf_filled * sizeof(value_type),
+        part_offset * sizeof(value_type));
+  }
+
+  distributed_file<value_type> *m_distr_file;
+  pooled_file *m_file;
+  long m_cur_part;
+
+  long m_pos;  // index of the next item to read
+  long m_end;
+
+  value_type *m_buf;
+  long m_buf_size;
+  long m_buf_filled;
+  long m_buf_pos;
+  unsigned char *m_packed_buf;  // used if the file is bit-packed
 };
 
 }  // psascan_private
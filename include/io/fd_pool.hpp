@@ -0,0 +1,204 @@
+/**
+ * @file    src/psascan_src/io/fd_pool.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_IO_FD_POOL_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_IO_FD_POOL_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <list>
+#include <mutex>
+#include <algorithm>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "io_uring_engine.hpp"
+
+
+namespace psascan_private {
+
+struct pooled_file;
+
+//==============================================================================
+// A bounded set of open file descriptors shared by all pooled_files. The
+// merging reads from two files per half-block (from every merging thread),
+// which for large inputs can be many more files than the limit on open
+// files allows. A pooled_file keeps no descriptor of its own: it is opened
+// (or reused, if still open) for every read, and closed when the pool is
+// full and a descriptor is needed for another file. The reads are done at
+// explicit offsets, so reopening a file needs no other state. The pool
+// uses at most a quarter of the limit on open files (and the io_uring
+// rings another quarter, see io_uring_engine.hpp), leaving the rest
+// for other files.
+//==============================================================================
+struct fd_pool {
+  static long capacity() {
+    static long max_fds = std::max(4L, io_uring_engine::open_files_limit() / 4);
+    return max_fds;
+  }
+
+  // Return the descriptor of the given file, opening it if necessary.
+  // The descriptor stays open (pinned) until the matching release().
+  static int acquire(pooled_file *file);
+
+  static void release(pooled_file *file);
+
+  // Close the descriptor of the file (if open).
+  static void close_file(pooled_file *file);
+
+private:
+  struct state {
+    state() : m_open(0L) {}
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::list<pooled_file*> m_lru;  // open files, most recently used first
+    long m_open;
+  };
+
+  static state &get_state() {
+    static state s;
+    return s;
+  }
+
+  // Close the least recently used file that is not pinned.
+  // Returns false if all open files are pinned.
+  static bool evict(state &s);
+};
+
+//==============================================================================
+// A read-only file with the descriptor managed by fd_pool.
+//==============================================================================
+struct pooled_file {
+  pooled_file(std::string filename) {
+    m_filename = filename;
+    m_fd = -1;
+    m_pins = 0L;
+  }
+
+  ~pooled_file() {
+    fd_pool::close_file(this);
+  }
+
+  // Read length bytes starting at the given offset. Fewer
+  // bytes are read only if the end of file is reached.
+  long read(void *buf, long length, long offset) {
+    int fd = fd_pool::acquire(this);
+    long ret = io_uring_engine::transfer_fully(false, fd,
+        (unsigned char *)buf, length, offset);
+    fd_pool::release(this);
+    return ret;
+  }
+
+  // As above, but exactly length bytes have to be read.
+  void read_exactly(void *buf, long length, long offset) {
+    if (read(buf, length, offset) != length) {
+      fprintf(stderr, "\nError: unexpected end of file %s\n",
+          m_filename.c_str());
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+private:
+  friend struct fd_pool;
+
+  std::string m_filename;
+  int m_fd;      // -1 if not open
+  long m_pins;   // number of reads in progress
+  std::list<pooled_file*>::iterator m_lru_pos;
+};
+
+inline int fd_pool::acquire(pooled_file *file) {
+  state &s = get_state();
+  std::unique_lock<std::mutex> lk(s.m_mutex);
+  if (file->m_fd != -1) {
+    s.m_lru.splice(s.m_lru.begin(), s.m_lru, file->m_lru_pos);
+    ++file->m_pins;
+    return file->m_fd;
+  }
+
+  // Make room for the new descriptor. If all open files are
+  // being read, wait until one of the reads finishes.
+  while (s.m_open >= capacity())
+    if (!evict(s))
+      s.m_cv.wait(lk);
+
+  file->m_fd = io_uring_engine::open_fd(file->m_filename, O_RDONLY);
+  s.m_lru.push_front(file);
+  file->m_lru_pos = s.m_lru.begin();
+  file->m_pins = 1L;
+  ++s.m_open;
+  return file->m_fd;
+}
+
+inline void fd_pool::release(pooled_file *file) {
+  state &s = get_state();
+  std::unique_lock<std::mutex> lk(s.m_mutex);
+  --file->m_pins;
+  lk.unlock();
+  s.m_cv.notify_all();
+}
+
+inline void fd_pool::close_file(pooled_file *file) {
+  state &s = get_state();
+  std::unique_lock<std::mutex> lk(s.m_mutex);
+  if (file->m_fd == -1) return;
+  close(file->m_fd);
+  file->m_fd = -1;
+  s.m_lru.erase(file->m_lru_pos);
+  --s.m_open;
+  lk.unlock();
+  s.m_cv.notify_all();
+}
+
+inline bool fd_pool::evict(state &s) {
+  for (std::list<pooled_file*>::reverse_iterator it = s.m_lru.rbegin();
+      it != s.m_lru.rend(); ++it) {
+    pooled_file *file = *it;
+    if (file->m_pins == 0) {
+      close(file->m_fd);
+      file->m_fd = -1;
+      s.m_lru.erase(file->m_lru_pos);
+      --s.m_open;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_IO_FD_POOL_HPP_INCLUDED
@@ -0,0 +1,497 @@
+/**
+ * @file    src/psascan_src/io/io_uring_engine.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_IO_IO_URING_ENGINE_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_IO_IO_URING_ENGINE_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PSASCAN_HAVE_IO_URING
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+
+namespace psascan_private {
+
+//==============================================================================
+// The asynchronous stream readers and writers in this directory can do their
+// I/O with io_uring instead of starting an I/O thread. Each such stream owns
+// a small ring and k_queue_depth buffers: one is used by the caller and up
+// to k_queue_depth - 1 requests are kept in flight, all of them submitted
+// and reaped by the thread using the stream. If io_uring is not supported
+// by the kernel (or was not available at build time), it was disabled with
+// --io-engine=threads, or the limit on the number of rings is reached, the
+// factories return NULL and the stream falls back to its I/O thread.
+//==============================================================================
+struct io_uring_engine {
+  static const long k_queue_depth = 4L;
+
+  static void disable() {
+    disabled_flag() = true;
+  }
+
+  static bool enabled() {
+#ifdef PSASCAN_HAVE_IO_URING
+    static bool supported = probe();
+    return supported && !disabled_flag();
+#else
+    return false;
+#endif
+  }
+
+  // Reserve one ring. Every ring and the file used with it take two
+  // file descriptors, so the rings are allowed to use only a quarter
+  // of the limit on open files, leaving the rest for other files
+  // (another quarter is used by fd_pool, see fd_pool.hpp).
+  static bool acquire_ring() {
+    static long max_rings = open_files_limit() / 8;
+    long cur = ring_count().fetch_add(1L);
+    if (cur >= max_rings) {
+      ring_count().fetch_sub(1L);
+      return false;
+    } else return true;
+  }
+
+  static void release_ring() {
+    ring_count().fetch_sub(1L);
+  }
+
+  static int open_fd(std::string filename, int flags) {
+    int fd = open(filename.c_str(), flags, 0644);
+    if (fd == -1) {
+      std::perror(filename.c_str());
+      std::exit(EXIT_FAILURE);
+    }
+    return fd;
+  }
+
+  static long open_files_limit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) || rl.rlim_cur == RLIM_INFINITY)
+      return (1L << 16);
+    return (long)rl.rlim_cur;
+  }
+
+  static long fd_size(int fd) {
+    struct stat st;
+    if (fstat(fd, &st)) {
+      std::perror("fstat");
+      std::exit(EXIT_FAILURE);
+    }
+    return (long)st.st_size;
+  }
+
+  // Read or write (depending on is_write) exactly
+  // length bytes, unless the end of file is reached.
+  static long transfer_fully(bool is_write, int fd,
+      unsigned char *buf, long length, long pos) {
+    long total = 0L;
+    while (total < length) {
+      long r = is_write ?
+        pwrite(fd, buf + total, length - total, pos + total) :
+        pread(fd, buf + total, length - total, pos + total);
+      if (r < 0 && errno == EINTR) continue;
+      if (r < 0 || (r == 0 && is_write)) {
+        std::perror(is_write ? "pwrite" : "pread");
+        std::exit(EXIT_FAILURE);
+      }
+      if (r == 0) break;
+      total += r;
+    }
+    return total;
+  }
+
+private:
+  static bool &disabled_flag() {
+    static bool disabled = false;
+    return disabled;
+  }
+
+  static std::atomic<long> &ring_count() {
+    static std::atomic<long> count(0L);
+    return count;
+  }
+
+#ifdef PSASCAN_HAVE_IO_URING
+  static bool probe() {
+    struct io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, 1, &p);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+  }
+#endif
+};
+
+#ifdef PSASCAN_HAVE_IO_URING
+
+//==============================================================================
+// A minimal io_uring instance (set up with raw system calls) used by one
+// thread. Requests are submitted one at a time.
+//==============================================================================
+struct io_uring_ring {
+  io_uring_ring() : m_fd(-1) {}
+
+  bool init(unsigned entries) {
+    struct io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    m_fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (m_fd < 0) return false;
+
+    m_sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    m_sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    m_single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP);
+    if (m_single_mmap)
+      m_sq_len = m_cq_len = std::max(m_sq_len, m_cq_len);
+
+    m_sq_ptr = mmap(NULL, m_sq_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    m_cq_ptr = m_sq_ptr;
+    if (m_sq_ptr != MAP_FAILED && !m_single_mmap)
+      m_cq_ptr = mmap(NULL, m_cq_len, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    m_sqes = (struct io_uring_sqe *)mmap(NULL, m_sqes_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (m_sq_ptr == MAP_FAILED || m_cq_ptr == MAP_FAILED || m_sqes == MAP_FAILED) {
+      unmap();
+      close(m_fd);
+      m_fd = -1;
+      return false;
+    }
+
+    unsigned char *sq = (unsigned char *)m_sq_ptr;
+    unsigned char *cq = (unsigned char *)m_cq_ptr;
+    m_sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    m_sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    m_sq_array = (unsigned *)(sq + p.sq_off.array);
+    m_cq_head = (unsigned *)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    m_cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+  }
+
+  ~io_uring_ring() {
+    if (m_fd >= 0) {
+      unmap();
+      close(m_fd);
+    }
+  }
+
+  bool register_buffers(const struct iovec *iov, unsigned count) {
+    return syscall(__NR_io_uring_register, m_fd,
+        IORING_REGISTER_BUFFERS, iov, count) == 0;
+  }
+
+  // Return the entry for the next request (cleared).
+  struct io_uring_sqe *get_sqe() {
+    unsigned idx = (*m_sq_tail) & (*m_sq_mask);
+    struct io_uring_sqe *sqe = m_sqes + idx;
+    std::memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[idx] = idx;
+    return sqe;
+  }
+
+  // Submit the request prepared in the entry returned by get_sqe().
+  // The entry stays in the ring until io_uring_enter reports it as
+  // consumed; a return value of 0 means, like EAGAIN or EBUSY, that
+  // the kernel could not take it yet, so we retry.
+  void submit() {
+    __atomic_store_n(m_sq_tail, *m_sq_tail + 1, __ATOMIC_RELEASE);
+    while (true) {
+      long ret = syscall(__NR_io_uring_enter, m_fd, 1, 0, 0, NULL, 0);
+      if (ret > 0) return;
+      if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        std::perror("io_uring_enter");
+        std::exit(EXIT_FAILURE);
+      }
+      sched_yield();
+    }
+  }
+
+  // Wait for any completed request.
+  void wait(unsigned long &user_data, int &result) {
+    while (true) {
+      unsigned head = *m_cq_head;
+      if (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = m_cqes + (head & (*m_cq_mask));
+        user_data = cqe->user_data;
+        result = cqe->res;
+        __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+        return;
+      }
+
+      if (syscall(__NR_io_uring_enter, m_fd, 0, 1,
+            IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR) {
+        std::perror("io_uring_enter");
+        std::exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+private:
+  void unmap() {
+    if (m_sqes != MAP_FAILED) munmap(m_sqes, m_sqes_len);
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr, m_cq_len);
+    if (m_sq_ptr != MAP_FAILED) munmap(m_sq_ptr, m_sq_len);
+  }
+
+  int m_fd;
+  bool m_single_mmap;
+  void *m_sq_ptr;
+  void *m_cq_ptr;
+  size_t m_sq_len;
+  size_t m_cq_len;
+  size_t m_sqes_len;
+
+  unsigned *m_sq_tail;
+  unsigned *m_sq_mask;
+  unsigned *m_sq_array;
+  unsigned *m_cq_head;
+  unsigned *m_cq_tail;
+  unsigned *m_cq_mask;
+  struct io_uring_sqe *m_sqes;
+  struct io_uring_cqe *m_cqes;
+};
+
+#endif  // PSASCAN_HAVE_IO_URING
+
+//==============================================================================
+// A set of k_queue_depth buffers, each of buf_size bytes, which can be read
+// into or written from asynchronously. The buffers are registered with the
+// ring if possible (this can fail due to the limit on locked memory, in
+// which case plain vectored requests are used).
+//==============================================================================
+struct io_uring_buffers {
+  // Return NULL if io_uring cannot be used.
+  static io_uring_buffers *create(long buf_size) {
+#ifdef PSASCAN_HAVE_IO_URING
+    if (!io_uring_engine::enabled() || !io_uring_engine::acquire_ring())
+      return NULL;
+
+    io_uring_buffers *b = new io_uring_buffers(std::max(1L, buf_size));
+    if (!b->m_ring.init(2 * io_uring_engine::k_queue_depth)) {
+      delete b;
+      return NULL;
+    }
+    b->m_registered = b->m_ring.register_buffers(&(b->m_iov[0]), b->m_iov.size());
+    return b;
+#else
+    (void)buf_size;
+    return NULL;
+#endif
+  }
+
+  ~io_uring_buffers() {
+    wait_all();
+    for (size_t i = 0; i < m_iov.size(); ++i)
+      free(m_iov[i].iov_base);
+#ifdef PSASCAN_HAVE_IO_URING
+    io_uring_engine::release_ring();
+#endif
+  }
+
+  long buf_size() const {
+    return m_buf_size;
+  }
+
+  unsigned char *buffer(long id) const {
+    return (unsigned char *)m_iov[id].iov_base;
+  }
+
+  long n_free() const {
+    return (long)m_free.size();
+  }
+
+  long n_pending() const {
+    return (long)m_pending.size();
+  }
+
+  // Start reading (or writing) the given free buffer. For reads, the
+  // length is only an upper bound (the read stops at the end of file).
+  void submit(bool is_write, long id, int fd, long length, long pos) {
+    std::vector<long>::iterator it = std::find(m_free.begin(), m_free.end(), id);
+    if (it == m_free.end() || length > m_buf_size) {
+      fprintf(stderr, "\nError: invalid io_uring request\n");
+      std::exit(EXIT_FAILURE);
+    }
+    m_free.erase(it);
+
+    request &r = m_requests[id];
+    r.m_is_write = is_write;
+    r.m_fd = fd;
+    r.m_length = length;
+    r.m_pos = pos;
+    r.m_done = false;
+    m_pending.push_back(id);
+
+#ifdef PSASCAN_HAVE_IO_URING
+    struct io_uring_sqe *sqe = m_ring.get_sqe();
+    sqe->fd = fd;
+    sqe->off = pos;
+    sqe->user_data = id;
+    if (m_registered) {
+      sqe->opcode = is_write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      sqe->addr = (unsigned long)m_iov[id].iov_base;
+      sqe->len = length;
+      sqe->buf_index = id;
+    } else {
+      r.m_iov.iov_base = m_iov[id].iov_base;
+      r.m_iov.iov_len = length;
+      sqe->opcode = is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->addr = (unsigned long)&r.m_iov;
+      sqe->len = 1;
+    }
+    m_ring.submit();
+#endif
+  }
+
+  // Take a free buffer (waiting for the oldest request to
+  // finish if there are none). Only used by writers.
+  long get_free() {
+    if (m_free.empty())
+      complete_oldest();
+    long id = m_free.back();
+    return id;
+  }
+
+  // Wait for the oldest request to finish. Return its buffer id and
+  // store the number of transferred bytes. Unlike the buffers of writes,
+  // the buffer of a read is not released until release() is called.
+  long complete_oldest(long *transferred = NULL) {
+    long id = m_pending.front();
+    m_pending.pop_front();
+    request &r = m_requests[id];
+
+#ifdef PSASCAN_HAVE_IO_URING
+    while (!r.m_done) {
+      unsigned long user_data = 0;
+      int res = 0;
+      m_ring.wait(user_data, res);
+      m_requests[user_data].m_done = true;
+      m_requests[user_data].m_result = res;
+    }
+#endif
+
+    if (r.m_result < 0) {
+      errno = -r.m_result;
+      std::perror(r.m_is_write ? "io_uring write" : "io_uring read");
+      std::exit(EXIT_FAILURE);
+    }
+
+    // Finish short transfers synchronously.
+    long done = r.m_result;
+    if (done < r.m_length && (r.m_is_write || done > 0))
+      done += io_uring_engine::transfer_fully(r.m_is_write, r.m_fd,
+          buffer(id) + done, r.m_length - done, r.m_pos + done);
+
+    if (transferred) *transferred = done;
+    if (r.m_is_write) m_free.push_back(id);
+    return id;
+  }
+
+  void release(long id) {
+    m_free.push_back(id);
+  }
+
+  void wait_all() {
+    while (!m_pending.empty()) {
+      bool is_write = m_requests[m_pending.front()].m_is_write;
+      long id = complete_oldest();
+      if (!is_write) release(id);
+    }
+  }
+
+private:
+  struct request {
+    bool m_is_write;
+    bool m_done;
+    int m_fd;
+    int m_result;
+    long m_length;
+    long m_pos;
+    struct iovec m_iov;
+  };
+
+  io_uring_buffers(long buf_size) {
+    m_buf_size = buf_size;
+    m_registered = false;
+    m_iov.resize(io_uring_engine::k_queue_depth);
+    m_requests.resize(io_uring_engine::k_queue_depth);
+    for (long i = 0; i < io_uring_engine::k_queue_depth; ++i) {
+      if (posix_memalign(&m_iov[i].iov_base, 4096, m_buf_size)) {
+        fprintf(stderr, "\nError: allocation of io_uring buffers failed\n");
+        std::exit(EXIT_FAILURE);
+      }
+      m_iov[i].iov_len = m_buf_size;
+      m_free.push_back(io_uring_engine::k_queue_depth - 1 - i);
+    }
+  }
+
+  long m_buf_size;
+  bool m_registered;
+  std::vector<struct iovec> m_iov;
+  std::vector<request> m_requests;
+  std::vector<long> m_free;
+  std::deque<long> m_pending;
+
+#ifdef PSASCAN_HAVE_IO_URING
+  io_uring_ring m_ring;
+#endif
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_IO_IO_URING_ENGINE_HPP_INCLUDED
@@ -0,0 +1,167 @@
+/**
+ * @file    src/psascan_src/io/mmap_stream_writer.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_IO_MMAP_STREAM_WRITER_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_IO_MMAP_STREAM_WRITER_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace psascan_private {
+
+// Writes the stream of values directly into memory-mapped windows of
+// the file (starting at the given offset in bytes). The file has to be
+// preallocated (see utils::preallocate_file) to hold all written values.
+// The writeback of every full window is started immediately and the
+// pages of the window before it are dropped from the page cache, so
+// the output does not evict other files (text, gap arrays) from it.
+template<typename value_type>
+struct mmap_stream_writer {
+  mmap_stream_writer(std::string filename, long bufsize = (4 << 20),
+      long offset = 0L) {
+    m_fd = open(filename.c_str(), O_RDWR);
+    if (m_fd == -1) {
+      std::perror(filename.c_str());
+      std::exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    fstat(m_fd, &st);
+    m_file_size = st.st_size;
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    m_window_size = std::max(page_size,
+        ((bufsize + page_size - 1) / page_size) * page_size);
+    m_window = NULL;
+    m_window_beg = offset - (offset % page_size);
+    m_window_end = m_window_beg;
+    m_prev_window_beg = -1L;
+    m_prev_window_end = -1L;
+    m_pos = offset;
+  }
+
+  ~mmap_stream_writer() {
+    unmap_window();
+    if (m_prev_window_beg >= 0)
+      drop_from_cache(m_prev_window_beg, m_prev_window_end);
+    close(m_fd);
+  }
+
+  inline void write(value_type x) {
+    const unsigned char *src = (const unsigned char *)&x;
+    if (m_window_end - m_pos >= (long)sizeof(value_type)) {
+      std::memcpy(m_window + (m_pos - m_window_beg), src, sizeof(value_type));
+      m_pos += sizeof(value_type);
+    } else {
+
+      // The value overlaps the window boundary (or no
+      // window is mapped yet, then m_window_end <= m_pos).
+      for (long j = 0; j < (long)sizeof(value_type); ++j) {
+        if (m_pos >= m_window_end)
+          map_next_window();
+        m_window[m_pos - m_window_beg] = src[j];
+        ++m_pos;
+      }
+    }
+  }
+
+private:
+  void map_next_window() {
+    long beg = m_window_end;
+    unmap_window();
+    long end = std::min(beg + m_window_size, m_file_size);
+    if (end <= beg) {
+      fprintf(stderr, "\nError: writing beyond the end "
+          "of preallocated file in mmap_stream_writer.\n");
+      std::exit(EXIT_FAILURE);
+    }
+
+    void *window = mmap(NULL, end - beg, PROT_READ | PROT_WRITE,
+        MAP_SHARED, m_fd, beg);
+    if (window == MAP_FAILED) {
+      std::perror("mmap");
+      std::exit(EXIT_FAILURE);
+    }
+
+    m_window = (unsigned char *)window;
+    m_window_beg = beg;
+    m_window_end = end;
+  }
+
+  void unmap_window() {
+    if (m_window == NULL)
+      return;
+
+    // Start the writeback of the window and drop the
+    // previous window (written by now) from page cache.
+    munmap(m_window, m_window_end - m_window_beg);
+    sync_file_range(m_fd, m_window_beg, m_window_end - m_window_beg,
+        SYNC_FILE_RANGE_WRITE);
+    if (m_prev_window_beg >= 0)
+      drop_from_cache(m_prev_window_beg, m_prev_window_end);
+
+    m_prev_window_beg = m_window_beg;
+    m_prev_window_end = m_window_end;
+    m_window = NULL;
+  }
+
+  void drop_from_cache(long beg, long end) {
+    sync_file_range(m_fd, beg, end - beg, SYNC_FILE_RANGE_WAIT_BEFORE |
+        SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(m_fd, beg, end - beg, POSIX_FADV_DONTNEED);
+  }
+
+  int m_fd;
+  long m_file_size;
+  long m_window_size;
+
+  unsigned char *m_window;
+  long m_window_beg;
+  long m_window_end;
+  long m_prev_window_beg;
+  long m_prev_window_end;
+  long m_pos;  // current position in the file
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_IO_MMAP_STREAM_WRITER_HPP_INCLUDED
@@ -0,0 +1,179 @@
+/**
+ * @file    src/psascan_src/io/temp_file_placement.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_IO_TEMP_FILE_PLACEMENT_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_IO_TEMP_FILE_PLACEMENT_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cctype>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include "../utils/utils.hpp"
+
+
+namespace psascan_private {
+
+//==============================================================================
+// Placement of temporary files. Without temporary directories, the temporary
+// files are created next to the output (or next to the gap array, see the -g
+// flag). Otherwise, the file with the given slot number is placed in the
+// directory (slot mod number of directories), so files with consecutive slots
+// land on different directories. Slots are assigned as follows:
+// - the partial SA of the i-th half-block (in the order of hblock_info) gets
+//   slot i, and all other files of that half-block (gap array, BWT,
+//   gt_begin) get slot i + 1, i.e., the partial SA and the gap array that
+//   are read together during the merging are on different devices, and the
+//   partial SAs of consecutive half-blocks are on different devices too,
+// - the files holding the gt bitvectors of the tail slices get slots
+//   0, 1, ..., i.e., the slices streamed in parallel are spread evenly.
+//==============================================================================
+struct temp_file_placement {
+  temp_file_placement(std::string output_filename, std::string gap_filename,
+      const std::vector<std::string> &dirs = std::vector<std::string>()) {
+    m_output_filename = output_filename;
+    m_gap_filename = gap_filename;
+
+    // Keep the name of the output to make the temporary files recognizable.
+    std::string::size_type slash = output_filename.find_last_of('/');
+    m_name = (slash == std::string::npos) ?
+      output_filename : output_filename.substr(slash + 1);
+
+    for (size_t i = 0; i < dirs.size(); ++i) {
+      struct stat st;
+      char path[PATH_MAX];
+      if (stat(dirs[i].c_str(), &st) || !S_ISDIR(st.st_mode) ||
+          !realpath(dirs[i].c_str(), path)) {
+        fprintf(stderr, "Error: temporary directory (%s) does not exist\n",
+            dirs[i].c_str());
+        std::exit(EXIT_FAILURE);
+      }
+      m_dirs.push_back(std::string(path));
+    }
+  }
+
+  // Prefix of the name of a temporary file with the given slot.
+  std::string file_base(long slot) const {
+    if (m_dirs.empty()) return m_output_filename;
+    else return m_dirs[slot % (long)m_dirs.size()] + "/" + m_name;
+  }
+
+  // As above, but for the files holding (parts of) the gap arrays.
+  std::string gap_file_base(long slot) const {
+    if (m_dirs.empty()) return m_gap_filename;
+    else return file_base(slot);
+  }
+
+  const std::vector<std::string> &dirs() const {
+    return m_dirs;
+  }
+
+  // Return the names of all temporary files (of this output) that exist
+  // in the locations of the temporary files, i.e., the files whose names
+  // are one of the bases followed by a suffix used for temporary files.
+  // The base of the gap array itself holds the excess values of the gap.
+  std::vector<std::string> existing_temp_files() const {
+    std::vector<std::string> bases;
+    long n_slots = std::max(1L, (long)m_dirs.size());
+    for (long slot = 0; slot < n_slots; ++slot) {
+      bases.push_back(file_base(slot));
+      bases.push_back(gap_file_base(slot));
+    }
+    std::sort(bases.begin(), bases.end());
+    bases.erase(std::unique(bases.begin(), bases.end()), bases.end());
+
+    std::vector<std::string> filenames;
+    for (size_t i = 0; i < bases.size(); ++i) {
+      std::string::size_type slash = bases[i].find_last_of('/');
+      std::string dirname = bases[i].substr(0, slash + 1);
+      std::string prefix = bases[i].substr(slash + 1);
+      bool is_gap_base = (bases[i] == m_gap_filename || !m_dirs.empty());
+      DIR *dir = opendir(dirname.empty() ? "." : dirname.c_str());
+      if (dir == NULL)
+        continue;
+
+      struct dirent *entry;
+      while ((entry = readdir(dir)) != NULL) {
+        std::string name(entry->d_name);
+        if (name.compare(0, prefix.length(), prefix) != 0)
+          continue;
+        std::string suffix = name.substr(prefix.length());
+        if ((suffix.empty() && is_gap_base) || (!suffix.empty() &&
+              suffix[0] == '.' && is_temp_suffix(suffix.substr(1))))
+          filenames.push_back(dirname + name);
+      }
+      closedir(dir);
+    }
+
+    return filenames;
+  }
+
+private:
+  static bool is_number(std::string s) {
+    if (s.empty()) return false;
+    for (size_t i = 0; i < s.length(); ++i)
+      if (!std::isdigit(s[i])) return false;
+    return true;
+  }
+
+  // Suffixes (after the base and a dot) of the temporary files: the
+  // BWTs and the gt_begin bitvectors (a hash), the gap arrays (gap.hash),
+  // the gt bitvectors of the tail (gt_tail.hash), the parts of the partial
+  // SAs and BWTs (distrfile.hash.partN) and the gap bitvector of the
+  // left half-block (left_block_gap_bv).
+  static bool is_temp_suffix(std::string s) {
+    if (is_number(s) || s == "left_block_gap_bv") return true;
+    if (s.compare(0, 4, "gap.") == 0) return is_number(s.substr(4));
+    if (s.compare(0, 8, "gt_tail.") == 0) return is_number(s.substr(8));
+    if (s.compare(0, 10, "distrfile.") != 0) return false;
+    s = s.substr(10);
+    std::string::size_type dot = s.find(".part");
+    return (dot != std::string::npos && is_number(s.substr(0, dot)) &&
+        is_number(s.substr(dot + 5)));
+  }
+
+  std::string m_output_filename;
+  std::string m_gap_filename;
+  std::string m_name;
+  std::vector<std::string> m_dirs;
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_IO_TEMP_FILE_PLACEMENT_HPP_INCLUDED
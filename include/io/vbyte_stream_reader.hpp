@@ -0,0 +1,118 @@
+/**
+ * @file    src/psascan_src/io/vbyte_stream_reader.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_IO_VBYTE_STREAM_READER_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_IO_VBYTE_STREAM_READER_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+#include "../utils/utils.hpp"
+#include "fd_pool.hpp"
+
+
+namespace psascan_private {
+
+//==============================================================================
+// Synchronous reader of v-byte encoded stream. Unlike the asynchronous
+// version, the reading can start at arbitrary byte offset of the file and
+// the reader keeps track of the number of bytes consumed so far. No I/O
+// thread is created, which makes it suitable for the case where many
+// readers are used concurrently by different threads. The file descriptor
+// is taken from fd_pool only for the time of each read.
+//==============================================================================
+template<typename value_type>
+struct vbyte_stream_reader {
+  vbyte_stream_reader(std::string filename, long bufsize = (1L << 20),
+      long offset = 0L) {
+    m_file = new pooled_file(filename);
+
+    m_buf_size = std::max(4096L, bufsize);
+    m_buf = (unsigned char *)malloc(m_buf_size + 128);
+    m_buf_filled = 0L;
+    m_buf_pos = 0L;
+    m_buf_offset = offset;
+  }
+
+  ~vbyte_stream_reader() {
+    free(m_buf);
+    delete m_file;
+  }
+
+  inline value_type read() {
+    if (m_buf_pos >= m_buf_filled)
+      refill();
+
+    value_type result = 0L;
+    long offset = 0L;
+    while (m_buf[m_buf_pos] & 0x80) {
+      result |= (((value_type)m_buf[m_buf_pos++] & 0x7F) << offset);
+      offset += 7;
+    }
+    result |= ((value_type)m_buf[m_buf_pos++] << offset);
+
+    return result;
+  }
+
+  // Return the offset (in bytes) of the next value in the file.
+  inline long bytes_read() const {
+    return m_buf_offset + m_buf_pos;
+  }
+
+private:
+  void refill() {
+
+    // Values are at most 10 bytes long, so we read 128 extra bytes
+    // to guarantee that the last value in the buffer is complete.
+    long skipped = m_buf_pos - m_buf_filled;
+    m_buf_offset += m_buf_filled;
+    long count = m_file->read(m_buf, m_buf_size + 128, m_buf_offset);
+    m_buf_filled = std::min(count, m_buf_size);
+    m_buf_pos = skipped;
+  }
+
+  unsigned char *m_buf;
+  long m_buf_size;
+  long m_buf_filled;
+  long m_buf_pos;
+  long m_buf_offset;  // file offset of m_buf[0]
+
+  pooled_file *m_file;
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_IO_VBYTE_STREAM_READER_HPP_INCLUDED
@@ -0,0 +1,372 @@
+/**
+ * @file    src/psascan_src/memory_planner.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_MEMORY_PLANNER_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_MEMORY_PLANNER_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "utils/utils.hpp"
+#include "inmem_psascan_src/inmem_psascan.hpp"
+#include "interleaved_rank.hpp"
+
+
+namespace psascan_private {
+
+// Rank data structure over the BWT used during streaming (steps 3.c and
+// 5.b of process_block()) and the RAM (in bytes per symbol) it takes. When
+// switching to rank4n<>, use 4.2 (an estimate including the rare trunk).
+typedef interleaved_rank<> stream_rank_type;
+const long double k_rank_ram_per_symbol = 3.L;
+
+// RAM used by the process independently of the block size (code,
+// libraries, stacks of threads and small allocations). The planning
+// does not depend on the actual usage, so that it gives the same
+// result when resuming the computation.
+const long k_baseline_ram = (8L << 20);
+
+// Allocations of at least this size are mapped separately, so that their
+// RAM is returned to the system when freed (the default of glibc, which
+// it would otherwise raise, see pSAscan()).
+const long k_mmap_threshold = (128L << 10);
+
+// RAM taken by buffers of readers and writers of one streaming thread
+// (the text reader and the gt_begin reader and writer). With io_uring,
+// each buffer is split into io_uring_engine::k_queue_depth parts, which
+// are all resident from the start (registered with the ring).
+const long k_stream_io_ram_per_thread = (6L << 20);
+
+// Peak RSS of in-memory pSAscan per symbol and per thread (in addition
+// to its streaming buffers), measured on texts with 4 to 256 distinct
+// symbols and 1 to 8 threads. Its merge schedule is based on
+// inmem_psascan_private::max_ram_usage_per_input_byte, which does not
+// include the rank and the small per-thread arrays of each merging.
+const long double k_inmem_ram_per_symbol = 11.L;
+const long k_inmem_ram_per_thread = (4L << 20);
+
+// Fraction of the RAM budget not used by the plan. The measured RSS
+// of the steps exceeds the model by up to a few percent (e.g., due to
+// the rounding of large arrays to huge pages and the thread stacks).
+const long double k_ram_headroom = 0.1L;
+
+// The range of gap buffer sizes considered by the planner.
+const long k_max_gap_buf_size = (1L << 21);
+const long k_min_gap_buf_size = (1L << 16);
+
+// Maximal fraction of the RAM budget that the planner
+// allows to use for the buffers of streaming threads.
+const long double k_max_streaming_ram_fraction = 1.L / 16;
+
+// Predicted peak RAM usage of a single step of process_block().
+struct phase_ram_usage {
+  std::string m_label;  // step of process_block(), e.g., "5.b"
+  std::string m_description;
+  long m_ram;
+
+  phase_ram_usage(std::string label, std::string description, long double ram) {
+    m_label = label;
+    m_description = description;
+    m_ram = (long)ram;
+  }
+};
+
+//==============================================================================
+// The parameters of the computation chosen to fit into the RAM budget.
+//==============================================================================
+struct memory_plan {
+  long m_ram_use;
+  long m_ram_target;            // m_ram_use without the headroom
+  long m_baseline_ram;          // independent of the block size
+  long m_max_block_size;
+  long m_max_left_block_size;   // of the last block (processed first)
+  long m_block_offset_size;     // sizeof(block_offset_type)
+  long m_n_gap_buffers;
+  long m_gap_buf_size;
+  long m_streaming_ram;         // gap buffers and buffers of streaming threads
+  long m_inmem_fixed_ram;       // of in-memory pSAscan, independent of block size
+  long m_merge_ram;             // buffers of readers and writers of merging
+  long m_predicted_peak;        // of process_block()
+
+  // Predicted peaks of steps of process_block()
+  // for the largest non-last and last block.
+  std::vector<phase_ram_usage> m_phases;
+};
+
+// RAM used during streaming (step 3.c and 5.b of process_block())
+// in addition to the rank and gap array: gap buffers, and for each
+// thread, temp and oracle arrays and buffers of readers/writers.
+long predict_streaming_ram(long max_threads, long n_gap_buffers,
+    long gap_buf_size, long block_offset_size) {
+  long oracle_size = (gap_buf_size / block_offset_size) * (long)sizeof(int);
+  return n_gap_buffers * gap_buf_size + max_threads * (gap_buf_size +
+      oracle_size + k_stream_io_ram_per_thread);
+}
+
+//==============================================================================
+// Append to phases the predicted peak RAM usage of the steps of
+// process_block() for the block of given size. The peak within each
+// step is the sum of the sizes of the arrays allocated at that time.
+//==============================================================================
+void predict_block_ram(long block_size, long left_block_size, bool last_block,
+    long block_offset_size, long streaming_ram, long inmem_fixed_ram,
+    std::vector<phase_ram_usage> &phases) {
+  long double b = block_size;
+  long double l = left_block_size;
+  long double r = block_size - left_block_size;
+  long double s = block_offset_size;
+  std::string which = last_block ? "last block: " : "block: ";
+
+  if (r > 0) {
+    phases.push_back(phase_ram_usage("1.a", which +
+          "in-memory pSAscan of right half-block", k_inmem_ram_per_symbol * r +
+          inmem_fixed_ram));
+    phases.push_back(phase_ram_usage("1.c", which +
+          "right half-block text, SA, BWT, gt_begin, sparse ISA, "
+          "prefetched left half-block", (2.L + s + 3.L / 16) * r + l));
+  }
+
+  // The text of the right half-block is freed before the merging of
+  // in-memory pSAscan, which takes the most space. While sorting the
+  // blocks, it is kept along with the 16-bit texts of the blocks.
+  phases.push_back(phase_ram_usage("2.b", which +
+        "in-memory pSAscan of left half-block", std::max(k_inmem_ram_per_symbol * l +
+          inmem_fixed_ram, (2.L + s + 1.L / 8 + inmem_psascan_private::text16_ram_per_symbol(
+            block_offset_size)) * l + r)));
+
+  if (r > 0) {
+    phases.push_back(phase_ram_usage("3.c", which +
+          "streaming of right half-block: BWT, rank, gap array of left "
+          "half-block", (2.L + k_rank_ram_per_symbol) * l + streaming_ram));
+  }
+
+  if (!last_block) {
+    phases.push_back(phase_ram_usage("4.c", which +
+          "merging BWTs of half-blocks", 2.L * b + b / 8));
+    phases.push_back(phase_ram_usage("5.a", which +
+          "rank construction over the BWT of the block",
+          (1.L + k_rank_ram_per_symbol) * b));
+    phases.push_back(phase_ram_usage("5.b", which +
+          "streaming of the tail: rank, gap array of block",
+          (1.L + k_rank_ram_per_symbol) * b + streaming_ram));
+    phases.push_back(phase_ram_usage("6", which +
+          "gap arrays of half-blocks: 2-byte gap array, bitvector, buffers, "
+          "prefetched right half-block of the next block",
+          2.L * b + b / 8 + 0.875L * b + b / 2));
+  }
+}
+
+// Predicted peak RAM usage during processing of all blocks of the text,
+// when the maximal block size and left half-block size are as given.
+long predict_peak_ram(long text_length, long max_block_size,
+    long max_left_block_size, long block_offset_size, long streaming_ram,
+    long inmem_fixed_ram, std::vector<phase_ram_usage> &phases) {
+  phases.clear();
+
+  // The last block can have any length up to max_block_size.
+  long last_block_size = std::min(max_block_size, text_length);
+  predict_block_ram(last_block_size, std::min(last_block_size,
+        max_left_block_size), true, block_offset_size, streaming_ram,
+      inmem_fixed_ram, phases);
+  if (text_length > max_block_size)
+    predict_block_ram(max_block_size, std::max(1L, max_block_size / 2L),
+        false, block_offset_size, streaming_ram, inmem_fixed_ram, phases);
+
+  long peak = 0;
+  for (size_t i = 0; i < phases.size(); ++i)
+    peak = std::max(peak, phases[i].m_ram);
+  return peak;
+}
+
+// Find the largest block size for which the predicted peak fits into
+// ram_use. Returns 0 if even the smallest block does not fit.
+long max_block_size_for_budget(long ram_use, long text_length,
+    long max_left_block_size, long block_offset_size, long streaming_ram,
+    long inmem_fixed_ram) {
+  std::vector<phase_ram_usage> phases;
+  if (predict_peak_ram(text_length, 2L, max_left_block_size,
+        block_offset_size, streaming_ram, inmem_fixed_ram, phases) > ram_use)
+    return 0L;
+
+  // Invariant: block size lo fits, hi + 1 does not (or hi = text_length).
+  long lo = 2L, hi = std::max(2L, text_length);
+  while (lo < hi) {
+    long mid = lo + (hi - lo + 1) / 2;
+    if (predict_peak_ram(text_length, mid, max_left_block_size,
+          block_offset_size, streaming_ram, inmem_fixed_ram,
+          phases) <= ram_use) lo = mid;
+    else hi = mid - 1;
+  }
+
+  return lo;
+}
+
+//==============================================================================
+// Choose the buffers used in streaming and the largest block size for the
+// given size of block offsets. The buffers are taken as large as possible
+// (up to the defaults of earlier versions), but so that they take at most a
+// small fraction of the budget, since a larger block size reduces the total
+// time more than larger buffers.
+//==============================================================================
+void plan_block_size(memory_plan &plan, long text_length, long max_threads,
+    long block_offset_size) {
+  std::vector<std::pair<long, long> > candidates;
+  for (long size = k_max_gap_buf_size; size >= k_min_gap_buf_size; size /= 2)
+    candidates.push_back(std::make_pair(2L * max_threads, size));
+  candidates.push_back(std::make_pair(max_threads + 1L, k_min_gap_buf_size));
+
+  size_t c = 0;
+  while (c + 1 < candidates.size() &&
+      predict_streaming_ram(max_threads, candidates[c].first,
+        candidates[c].second, block_offset_size) >
+      k_max_streaming_ram_fraction * plan.m_ram_target)
+    ++c;
+
+  plan.m_n_gap_buffers = candidates[c].first;
+  plan.m_gap_buf_size = candidates[c].second;
+  plan.m_block_offset_size = block_offset_size;
+  plan.m_streaming_ram = predict_streaming_ram(max_threads,
+      plan.m_n_gap_buffers, plan.m_gap_buf_size, block_offset_size);
+  plan.m_inmem_fixed_ram = max_threads * k_inmem_ram_per_thread +
+    inmem_psascan_private::streaming_ram(max_threads, plan.m_gap_buf_size,
+        block_offset_size);
+  plan.m_max_left_block_size = std::max(1L, (long)((plan.m_ram_target -
+          plan.m_baseline_ram - plan.m_inmem_fixed_ram) / k_inmem_ram_per_symbol));
+  plan.m_max_block_size = max_block_size_for_budget(
+      plan.m_ram_target - plan.m_baseline_ram, text_length, plan.m_max_left_block_size, block_offset_size,
+      plan.m_streaming_ram, plan.m_inmem_fixed_ram);
+}
+
+//==============================================================================
+// Choose the block size, the number and size of gap buffers so that
+// the predicted peak RAM usage of process_block() fits into ram_use
+// (without the headroom). The merging uses the same RAM for buffers.
+// Returns a plan with m_max_block_size == 0 if ram_use is too small.
+//==============================================================================
+memory_plan plan_memory_aux(long ram_use, long text_length, long max_threads) {
+  memory_plan plan;
+  plan.m_ram_use = ram_use;
+  plan.m_ram_target = (long)((1.L - k_ram_headroom) * ram_use);
+  plan.m_baseline_ram = std::min(plan.m_ram_target / 2L, k_baseline_ram);
+  plan.m_merge_ram = plan.m_ram_target - plan.m_baseline_ram;
+
+  // Block offsets are stored using 32-bit integers if possible. If the
+  // block with 40-bit offsets would not be longer, use the longest
+  // block that still allows 32-bit offsets.
+  plan_block_size(plan, text_length, max_threads, 4L);
+  if (plan.m_max_block_size >= (1L << 31)) {
+    plan_block_size(plan, text_length, max_threads, 5L);
+    if (plan.m_max_block_size < (1L << 31)) {
+      plan_block_size(plan, text_length, max_threads, 4L);
+      plan.m_max_block_size = (1L << 31) - 1;
+    }
+  }
+
+  if (plan.m_max_block_size == 0)
+    return plan;
+
+  plan.m_predicted_peak = plan.m_baseline_ram + predict_peak_ram(text_length,
+      plan.m_max_block_size, plan.m_max_left_block_size,
+      plan.m_block_offset_size, plan.m_streaming_ram,
+      plan.m_inmem_fixed_ram, plan.m_phases);
+
+  return plan;
+}
+
+memory_plan plan_memory(long ram_use, long text_length, long max_threads) {
+  memory_plan plan = plan_memory_aux(ram_use, text_length, max_threads);
+  if (plan.m_max_block_size == 0) {
+    fprintf(stderr, "Error: not enough memory to run pSAscan (the buffers "
+        "used in streaming need %ldMiB, in-memory pSAscan %ldMiB)\n",
+        (plan.m_streaming_ram >> 20) + 1, (plan.m_inmem_fixed_ram >> 20) + 1);
+    std::exit(EXIT_FAILURE);
+  }
+
+  return plan;
+}
+
+//==============================================================================
+// Return the smallest RAM budget (in bytes, rounded up to whole MiB)
+// for which plan_memory() succeeds with the given number of threads.
+//==============================================================================
+long min_ram_use(long text_length, long max_threads) {
+  long lo = 0L, hi = 1L;  // lo MiB is too little, hi MiB is enough.
+  while (plan_memory_aux(hi << 20, text_length,
+        max_threads).m_max_block_size == 0) {
+    lo = hi;
+    hi <<= 1;
+  }
+  while (lo + 1 < hi) {
+    long mid = (lo + hi) / 2L;
+    if (plan_memory_aux(mid << 20, text_length,
+          max_threads).m_max_block_size == 0) lo = mid;
+    else hi = mid;
+  }
+
+  return hi << 20;
+}
+
+void print_memory_plan(const memory_plan &plan) {
+  fprintf(stderr, "Memory plan:\n");
+  fprintf(stderr, "  max block size = %ld (%.1LfMiB)\n", plan.m_max_block_size,
+      1.L * plan.m_max_block_size / (1L << 20));
+  fprintf(stderr, "  max left half-block size = %ld (%.1LfMiB)\n",
+      plan.m_max_left_block_size, 1.L * plan.m_max_left_block_size / (1L << 20));
+  fprintf(stderr, "  #gap buffers = %ld\n", plan.m_n_gap_buffers);
+  fprintf(stderr, "  gap buffer size = %ld\n", plan.m_gap_buf_size);
+  fprintf(stderr, "  RAM for streaming buffers = %.1LfMiB\n",
+      1.L * plan.m_streaming_ram / (1L << 20));
+  fprintf(stderr, "  RAM of in-memory pSAscan independent of block size = %.1LfMiB\n",
+      1.L * plan.m_inmem_fixed_ram / (1L << 20));
+  fprintf(stderr, "  RAM for merging buffers = %.1LfMiB\n",
+      1.L * plan.m_merge_ram / (1L << 20));
+  fprintf(stderr, "  RAM independent of block size = %.1LfMiB\n",
+      1.L * plan.m_baseline_ram / (1L << 20));
+  fprintf(stderr, "  predicted peak RAM usage of steps:\n");
+  for (size_t i = 0; i < plan.m_phases.size(); ++i)
+    fprintf(stderr, "    %-4s %8.1LfMiB  %s\n", plan.m_phases[i].m_label.c_str(),
+        1.L * plan.m_phases[i].m_ram / (1L << 20),
+        plan.m_phases[i].m_description.c_str());
+  fprintf(stderr, "  predicted peak RAM usage = %.1LfMiB (%.1Lf%% of budget, "
+      "headroom %.0Lf%%)\n\n",
+      1.L * plan.m_predicted_peak / (1L << 20),
+      (100.L * plan.m_predicted_peak) / plan.m_ram_use, 100.L * k_ram_headroom);
+}
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_MEMORY_PLANNER_HPP_INCLUDED
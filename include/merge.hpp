@@ -36,54 +36,101 @@
 
 #include <cstdio>
 #include <cmath>
+#include <cstdint>
 #include <string>
 #include <vector>
+#include <thread>
 #include <algorithm>
 
 #include "utils/utils.hpp"
+#include "utils/run_stats.hpp"
 #include "types/uint40.hpp"
+#include "types/uint48.hpp"
 #include "io/distributed_file.hpp"
 #include "io/async_stream_writer.hpp"
+#include "io/mmap_stream_writer.hpp"
+#include "io/direct_stream_writer.hpp"
+#include "io/bit_packed_stream_writer.hpp"
 #include "io/async_vbyte_stream_reader.hpp"
+#include "io/vbyte_stream_reader.hpp"
+#include "io/concatenated_text.hpp"
 #include "half_block_info.hpp"
 
 
 namespace psascan_private {
 
-// Merge partial suffix arrays into final suffix array.
-template<typename block_offset_type>
-void merge(std::string output_filename, long ram_use, std::vector<half_block_info<block_offset_type> > &hblock_info) {
-  long n_block = (long)hblock_info.size();
-  long text_length = 0;
-
-  std::sort(hblock_info.begin(), hblock_info.end());
-  for (size_t j = 0; j < hblock_info.size(); ++j)
-    text_length += hblock_info[j].end - hblock_info[j].beg;
+// The method of writing the final suffix array to disk.
+enum output_writer_kind {
+  OUTPUT_WRITER_STDIO,   // buffered fwrite from a background thread
+  OUTPUT_WRITER_MMAP,    // preallocated file, memory-mapped windows
+  OUTPUT_WRITER_DIRECT   // preallocated file, O_DIRECT
+};
 
-  long pieces = (1 + sizeof(block_offset_type)) * n_block - 1 + sizeof(uint40);
-  long buffer_size = (ram_use + pieces - 1) / pieces;
+// Width (in bits) of the integers in the final suffix array is one of
+// 32, 40, 48, 64 or OUTPUT_WIDTH_PACKED, which denotes ceil(log2(n)).
+const long OUTPUT_WIDTH_PACKED = 0L;
 
-  fprintf(stderr, "\nMerge partial suffix arrays:\n");
-  fprintf(stderr, "  buffer size per block = %ld (%.2LfMiB)\n",
-      sizeof(block_offset_type) * buffer_size,
-      (1.L * sizeof(block_offset_type) * buffer_size) / (1 << 20));
-  fprintf(stderr, "  sizeof(output_type) = %ld\n", sizeof(uint40));
+// Number of bits used to encode one value of the
+// final suffix array of text of the given length.
+long output_bits_per_value(long output_width, long text_length) {
+  if (output_width != OUTPUT_WIDTH_PACKED) return output_width;
+  else return std::max(1L, utils::log2ceil(text_length));
+}
 
-  typedef async_vbyte_stream_reader<long> vbyte_reader_type;
-  typedef async_stream_writer<uint40> output_writer_type;
+// Create the writer of the final suffix array, writing at the given offset
+// (in bytes), or at the beginning of the file (truncating it in case of
+// stdio writer) if offset is negative.
+template<typename output_writer_type>
+struct output_writer_factory {
+  static output_writer_type *create(std::string filename,
+      long bufsize, long offset, long) {
+    if (offset < 0) return new output_writer_type(filename, bufsize);
+    else return new output_writer_type(filename, bufsize, offset);
+  }
+};
 
-  output_writer_type *output = new output_writer_type(output_filename, sizeof(uint40) * buffer_size);
-  vbyte_reader_type **gap = new vbyte_reader_type*[n_block - 1];
-  for (long i = 0; i < n_block; ++i) {
-    hblock_info[i].psa->initialize_reading(sizeof(block_offset_type) * buffer_size);
-    if (i + 1 != n_block)
-      gap[i] = new vbyte_reader_type(hblock_info[i].gap_filename, buffer_size);
+template<typename byte_writer_type>
+struct output_writer_factory<bit_packed_stream_writer<byte_writer_type> > {
+  typedef bit_packed_stream_writer<byte_writer_type> output_writer_type;
+  static output_writer_type *create(std::string filename,
+      long bufsize, long offset, long bits) {
+    return new output_writer_type(filename, bufsize, offset, bits);
   }
+};
 
-  long *gap_head = new long[n_block];
-  for (long i = 0; i + 1 < n_block; ++i)
-    gap_head[i] = gap[i]->read();
-  gap_head[n_block - 1] = 0;
+//==============================================================================
+// Merge the given number of items of the final suffix array. The readers of
+// partial suffix arrays and gap arrays, and the gap heads describe the state
+// of merging at the beginning of the range. Used both by sequential and
+// parallel merging (where each thread handles a range of the final SA).
+// If bwt_output != NULL, the parts of the BWT of the half-blocks are merged
+// along with the partial suffix arrays, and the position (relative to the
+// beginning of the range) at which SA[i] = 0 is stored in primary_index.
+// If da_output != NULL, the document array (the index of the input file
+// containing each suffix, see concatenated_text.hpp) is written to it.
+//==============================================================================
+template<typename block_offset_type, typename psa_reader_type,
+  typename gap_reader_type, typename output_writer_type,
+  typename bwt_reader_type, typename bwt_writer_type, typename da_writer_type>
+void merge_range(long range_length, long text_length,
+    const std::vector<half_block_info<block_offset_type> > &hblock_info,
+    psa_reader_type **psa, gap_reader_type **gap, long *gap_head,
+    output_writer_type *output, bool print_progress, long progress_scale,
+    long output_bits, bwt_reader_type **bwt, bwt_writer_type *bwt_output,
+    long &primary_index, const concatenated_text *text,
+    da_writer_type *da_output) {
+  long n_block = (long)hblock_info.size();
+
+  // The files overlapping each half-block, to speed up
+  // the search for the file containing a given suffix.
+  std::vector<long> doc_beg(n_block, 0L);
+  std::vector<long> doc_end(n_block, 0L);
+  if (da_output != NULL) {
+    for (long j = 0; j < n_block; ++j) {
+      doc_beg[j] = text->file_id(hblock_info[j].beg);
+      doc_end[j] = text->file_id(hblock_info[j].end - 1) + 1;
+    }
+  }
 
   long tmp = (long)sqrtl((long double)n_block);
   long sblock_size = 1L;
@@ -107,16 +154,20 @@ void merge(std::string output_filename, long ram_use, std::vector<half_block_inf
   }
 
   long double merge_start = utils::wclock();
-  for (long i = 0, dbg = 0; i < text_length; ++i, ++dbg) {
+  for (long i = 0, dbg = 0; i < range_length; ++i, ++dbg) {
     if (dbg == (1 << 23)) {
-      long double elapsed = utils::wclock() - merge_start;
-      long inp_vol = (1L + sizeof(block_offset_type)) * i;
-      long out_vol = sizeof(uint40) * i;
-      long tot_vol = inp_vol + out_vol;
-      long double tot_vol_m = tot_vol / (1024.L * 1024);
-      long double io_speed = tot_vol_m / elapsed;
-      fprintf(stderr, "\r  %.1Lf%%. Time = %.2Lfs. I/O: %2.LfMiB/s",
-          (100.L * i) / text_length, elapsed, io_speed);
+      if (print_progress) {
+        long double elapsed = utils::wclock() - merge_start;
+        long inp_vol = (1L + sizeof(block_offset_type) +
+            (bwt_output != NULL)) * i * progress_scale;
+        long out_vol = ((output_bits + 8L * (bwt_output != NULL)) *
+            i * progress_scale) / 8L;
+        long tot_vol = inp_vol + out_vol;
+        long double tot_vol_m = tot_vol / (1024.L * 1024);
+        long double io_speed = tot_vol_m / elapsed;
+        fprintf(stderr, "\r  %.1Lf%%. Time = %.2Lfs. I/O: %2.LfMiB/s",
+            (100.L * i) / range_length, elapsed, io_speed);
+      }
       dbg = 0;
     }
 
@@ -140,7 +191,13 @@ void merge(std::string output_filename, long ram_use, std::vector<half_block_inf
       ++j;
     }
 
-    long SA_i = hblock_info[j].psa->read() + hblock_info[j].beg;
+    long SA_i = psa[j]->read() + hblock_info[j].beg;
+    if (bwt_output != NULL) {
+      bwt_output->write(bwt[j]->read());
+      if (SA_i == 0) primary_index = i;
+    }
+    if (da_output != NULL)
+      da_output->write((std::uint32_t)text->file_id(SA_i, doc_beg[j], doc_end[j]));
 
     if (j != n_block - 1) gap_head[j] = gap[j]->read();
     new_min = std::min(new_min, gap_head[j]);
@@ -157,26 +214,573 @@ void merge(std::string output_filename, long ram_use, std::vector<half_block_inf
 
     output->write(SA_i);
   }
+
+  delete[] sblock_info;
+}
+
+
+//==============================================================================
+// Sample of the gap array of a half-block: offset (in bytes) of the v-byte
+// encoded value gap[idx] and the sum gap[0] + .. + gap[idx - 1].
+//==============================================================================
+struct gap_sample {
+  long m_idx;
+  long m_offset;
+  long m_sum;
+};
+
+void compute_gap_samples(std::string gap_filename, long gap_length,
+    long sampling_rate, std::vector<gap_sample> &samples) {
+  typedef vbyte_stream_reader<long> vbyte_reader_type;
+  vbyte_reader_type *reader = new vbyte_reader_type(gap_filename);
+
+  long sum = 0;
+  for (long j = 0; j < gap_length; ++j) {
+    if (!(j & (sampling_rate - 1))) {
+      gap_sample sample;
+      sample.m_idx = j;
+      sample.m_offset = reader->bytes_read();
+      sample.m_sum = sum;
+      samples.push_back(sample);
+    }
+    sum += reader->read();
+  }
+
+  delete reader;
+}
+
+void compute_gap_samples_aux(long thread_id, long n_threads,
+    const std::vector<std::string> &gap_filenames,
+    const std::vector<long> &gap_lengths, long sampling_rate,
+    std::vector<std::vector<gap_sample> > &samples) {
+  for (size_t i = thread_id; i < gap_filenames.size(); i += n_threads)
+    compute_gap_samples(gap_filenames[i], gap_lengths[i],
+        sampling_rate, samples[i]);
+}
+
+//==============================================================================
+// Consider the merging of half-block with all the half-blocks to the right
+// of it. Given the position pos in the result of that merging, compute the
+// number of items from the half-block preceding pos (returned as psa_beg),
+// the gap head at that point and the offset of the next gap value in the
+// gap file.
+//==============================================================================
+void locate_in_gap(std::string gap_filename, long sampling_rate,
+    const std::vector<gap_sample> &samples, long pos, long &psa_beg,
+    long &gap_head, long &gap_offset) {
+
+  // Find the last sample (idx, sum) such that idx + sum <= pos.
+  long lo = 0, hi = (long)samples.size() - 1;
+  while (lo < hi) {
+    long mid = (lo + hi + 1) / 2;
+    if (samples[mid].m_idx + samples[mid].m_sum <= pos) lo = mid;
+    else hi = mid - 1;
+  }
+
+  // Scan the gap values following the sample. Item j of the half-block
+  // is at position j + gap[0] + .. + gap[j] in the merged sequence, we
+  // look for the first item at position >= pos.
+  typedef vbyte_stream_reader<long> vbyte_reader_type;
+  vbyte_reader_type *reader = new vbyte_reader_type(gap_filename,
+      std::min(1L << 20, 10L * sampling_rate), samples[lo].m_offset);
+
+  long j = samples[lo].m_idx;
+  long sum = samples[lo].m_sum;
+  while (true) {
+    long gap_j = reader->read();
+    if (j + sum + gap_j >= pos) {
+      psa_beg = j;
+      gap_head = j + sum + gap_j - pos;
+      gap_offset = reader->bytes_read();
+      break;
+    }
+    sum += gap_j;
+    ++j;
+  }
+
+  delete reader;
+}
+
+template<typename block_offset_type, typename output_writer_type,
+  typename bwt_writer_type, typename da_writer_type>
+void parallel_merge_aux(std::string output_filename, long text_length,
+    long buffer_size, long range_beg, long range_end, bool print_progress,
+    long n_ranges, long output_bits,
+    std::vector<half_block_info<block_offset_type> > &hblock_info,
+    const long *psa_beg, const long *psa_end, const long *initial_gap_head,
+    const long *gap_offset, std::string bwt_filename, long &primary_index,
+    const concatenated_text *text, std::string da_filename, long thread_id) {
+  long double thread_start = utils::wclock();
+  long n_block = (long)hblock_info.size();
+
+  typedef distributed_file_range_reader<block_offset_type> psa_reader_type;
+  typedef distributed_file_range_reader<unsigned char> bwt_reader_type;
+  typedef vbyte_stream_reader<long> vbyte_reader_type;
+
+  long output_bytes = (output_bits + 7L) / 8L;
+  output_writer_type *output =
+    output_writer_factory<output_writer_type>::create(output_filename,
+        output_bytes * buffer_size, (output_bits * range_beg) / 8L,
+        output_bits);
+  bwt_writer_type *bwt_output = NULL;
+  if (!bwt_filename.empty())
+    bwt_output = output_writer_factory<bwt_writer_type>::create(bwt_filename,
+        buffer_size, range_beg, 8L);
+  da_writer_type *da_output = NULL;
+  if (!da_filename.empty())
+    da_output = output_writer_factory<da_writer_type>::create(da_filename,
+        sizeof(std::uint32_t) * buffer_size,
+        (long)sizeof(std::uint32_t) * range_beg, 32L);
+  psa_reader_type **psa = new psa_reader_type*[n_block];
+  bwt_reader_type **bwt = new bwt_reader_type*[n_block];
+  vbyte_reader_type **gap = new vbyte_reader_type*[n_block];
+  long *gap_head = new long[n_block];
+  for (long i = 0; i < n_block; ++i) {
+    psa[i] = new psa_reader_type(hblock_info[i].psa, psa_beg[i], psa_end[i],
+        sizeof(block_offset_type) * buffer_size);
+    bwt[i] = NULL;
+    if (bwt_output != NULL)
+      bwt[i] = new bwt_reader_type(hblock_info[i].bwt, psa_beg[i],
+          psa_end[i], buffer_size);
+    gap[i] = NULL;
+    gap_head[i] = initial_gap_head[i];
+    if (i + 1 != n_block)
+      gap[i] = new vbyte_reader_type(hblock_info[i].gap_filename,
+          buffer_size, gap_offset[i]);
+  }
+
+  long range_primary_index = -1;
+  merge_range<block_offset_type>(range_end - range_beg, text_length,
+      hblock_info, psa, gap, gap_head, output, print_progress, n_ranges,
+      output_bits, bwt, bwt_output, range_primary_index, text, da_output);
+  if (range_primary_index >= 0)
+    primary_index = range_beg + range_primary_index;
+
+  // Clean up.
+  delete output;
+  if (bwt_output != NULL)
+    delete bwt_output;
+  if (da_output != NULL)
+    delete da_output;
+  for (long i = 0; i < n_block; ++i) {
+    delete psa[i];
+    if (bwt[i] != NULL)
+      delete bwt[i];
+    if (gap[i] != NULL)
+      delete gap[i];
+  }
+
+  delete[] psa;
+  delete[] bwt;
+  delete[] gap;
+  delete[] gap_head;
+
+  long range_length = range_end - range_beg;
+  long bwt_bytes = bwt_filename.empty() ? 0L : 1L;
+  long da_bytes = da_filename.empty() ? 0L : (long)sizeof(std::uint32_t);
+  run_stats::add_thread("4", thread_id, utils::wclock() - thread_start,
+      range_length, (1 + sizeof(block_offset_type) + bwt_bytes) * range_length,
+      (bwt_bytes + da_bytes) * range_length + (output_bits * range_length) / 8L);
+}
+
+//==============================================================================
+// Parallel merging. The final suffix array is split into n_ranges equal
+// ranges. For every range boundary we find the corresponding position in
+// each of the partial suffix arrays and the gap arrays (which requires
+// only a single scan of gap arrays, to compute their sparse prefix sums).
+// Each thread then merges its range independently and writes the result
+// into its own region of the output file. The range boundaries are
+// multiples of 8, so that every range starts at a byte boundary also
+// in the bit-packed output. Returns the primary index of the BWT if it was
+// computed, and -1 otherwise.
+//==============================================================================
+template<typename block_offset_type, typename output_writer_type,
+  typename bwt_writer_type, typename da_writer_type>
+long parallel_merge(std::string output_filename, long ram_use,
+    long n_ranges, std::vector<half_block_info<block_offset_type> > &hblock_info,
+    long text_length, long output_bits, std::string bwt_filename,
+    const concatenated_text *text, std::string da_filename) {
+  long n_block = (long)hblock_info.size();
+  long output_bytes = (output_bits + 7L) / 8L;
+  std::vector<long> range_boundary(n_ranges + 1);
+  for (long t = 0; t < n_ranges; ++t)
+    range_boundary[t] = (((text_length * t) / n_ranges) / 8L) * 8L;
+  range_boundary[n_ranges] = text_length;
+
+  fprintf(stderr, "\nMerge partial suffix arrays (parallel):\n");
+  fprintf(stderr, "  number of threads = %ld\n", n_ranges);
+
+  // 1
+  //
+  // Compute sparse prefix sums of gap arrays. The sampling
+  // rate is chosen, so that the samples take at most ram_use / 2.
+  long double sampling_start = utils::wclock();
+  long max_samples = std::max(1L, (ram_use / 2L) / (long)sizeof(gap_sample));
+  long sampling_rate = (1L << 10);
+  while ((text_length + n_block) / sampling_rate > max_samples)
+    sampling_rate <<= 1;
+
+  std::vector<std::string> gap_filenames;
+  std::vector<long> gap_lengths;
+  for (long i = 0; i + 1 < n_block; ++i) {
+    gap_filenames.push_back(hblock_info[i].gap_filename);
+    gap_lengths.push_back(hblock_info[i].end - hblock_info[i].beg + 1);
+  }
+
+  std::vector<std::vector<gap_sample> > samples(n_block);
+  std::thread **threads = new std::thread*[n_ranges];
+  for (long t = 0; t < n_ranges; ++t)
+    threads[t] = new std::thread(compute_gap_samples_aux, t, n_ranges,
+        std::ref(gap_filenames), std::ref(gap_lengths), sampling_rate,
+        std::ref(samples));
+  for (long t = 0; t < n_ranges; ++t) threads[t]->join();
+  for (long t = 0; t < n_ranges; ++t) delete threads[t];
+  long double sampling_time = utils::wclock() - sampling_start;
+  fprintf(stderr, "  sampling rate = %ld\n", sampling_rate);
+  fprintf(stderr, "  compute gap samples: %.2Lfs\n", sampling_time);
+  long gap_bytes = 0L;
+  if (run_stats::enabled())
+    for (size_t i = 0; i < gap_filenames.size(); ++i)
+      gap_bytes += utils::file_size(gap_filenames[i]);
+  run_stats::add_step("1", "compute gap samples", sampling_time,
+      text_length, gap_bytes, 0L);
+
+  // 2
+  //
+  // Compute the starting position of each range in the partial suffix
+  // arrays and gap arrays. Position pos in the final SA corresponds to
+  // position pos - psa_beg[0] in the merged half-blocks [1..n_block), etc.
+  long **psa_beg = new long*[n_ranges + 1];
+  long **gap_head = new long*[n_ranges];
+  long **gap_offset = new long*[n_ranges];
+  for (long t = 0; t <= n_ranges; ++t) {
+    psa_beg[t] = new long[n_block];
+    if (t == n_ranges) {
+      for (long i = 0; i < n_block; ++i)
+        psa_beg[t][i] = hblock_info[i].end - hblock_info[i].beg;
+      break;
+    }
+
+    gap_head[t] = new long[n_block];
+    gap_offset[t] = new long[n_block];
+    long pos = range_boundary[t];
+    for (long i = 0; i + 1 < n_block; ++i) {
+      locate_in_gap(hblock_info[i].gap_filename, sampling_rate, samples[i],
+          pos, psa_beg[t][i], gap_head[t][i], gap_offset[t][i]);
+      pos -= psa_beg[t][i];
+    }
+    psa_beg[t][n_block - 1] = pos;
+    gap_head[t][n_block - 1] = 0;
+    gap_offset[t][n_block - 1] = 0;
+  }
+  samples.clear();
+
+  // 3
+  //
+  // Prepare partial suffix arrays for reading.
+  for (long i = 0; i < n_block; ++i) {
+    std::vector<std::pair<long, long> > ranges;
+    for (long t = 0; t < n_ranges; ++t)
+      ranges.push_back(std::make_pair(psa_beg[t][i], psa_beg[t + 1][i]));
+    hblock_info[i].psa->initialize_parallel_reading(ranges);
+    if (!bwt_filename.empty())
+      hblock_info[i].bwt->initialize_parallel_reading(ranges);
+  }
+
+  long bwt_bytes = bwt_filename.empty() ? 0L : 1L;
+  long da_bytes = da_filename.empty() ? 0L : (long)sizeof(std::uint32_t);
+  long pieces = ((1 + sizeof(block_offset_type) + bwt_bytes) * n_block - 1 +
+      output_bytes + bwt_bytes + da_bytes) * n_ranges;
+  long buffer_size = (ram_use + pieces - 1) / pieces;
+  fprintf(stderr, "  buffer size per block = %ld (%.2LfMiB)\n",
+      sizeof(block_offset_type) * buffer_size,
+      (1.L * sizeof(block_offset_type) * buffer_size) / (1 << 20));
+  fprintf(stderr, "  output width = %ld bits\n", output_bits);
+
+  // 4
+  //
+  // Merge ranges in parallel.
+  run_stats::add_step("2-3", "locate range boundaries",
+      utils::wclock() - sampling_start - sampling_time, text_length, 0L, 0L);
+  long double merge_start = utils::wclock();
+  long primary_index = -1;
+  for (long t = 0; t < n_ranges; ++t) {
+    threads[t] = new std::thread(
+        parallel_merge_aux<block_offset_type, output_writer_type,
+          bwt_writer_type, da_writer_type>,
+        output_filename, text_length, buffer_size, range_boundary[t],
+        range_boundary[t + 1], (t == 0), n_ranges, output_bits,
+        std::ref(hblock_info), psa_beg[t], psa_beg[t + 1],
+        gap_head[t], gap_offset[t], bwt_filename, std::ref(primary_index),
+        text, da_filename, t);
+  }
+  for (long t = 0; t < n_ranges; ++t) threads[t]->join();
+  for (long t = 0; t < n_ranges; ++t) delete threads[t];
+  delete[] threads;
+
+  long double merge_time = utils::wclock() - merge_start;
+  long io_volume = (1 + sizeof(block_offset_type) + 2 * bwt_bytes +
+      da_bytes) * text_length + (output_bits * text_length) / 8L;
+  long double io_speed = (io_volume / (1024.L * 1024)) / merge_time;
+  fprintf(stderr, "\r  100.0%%. Time: %.2Lfs. I/O: %.2LfMiB/s\n", merge_time, io_speed);
+  long read_volume = (1 + sizeof(block_offset_type) + bwt_bytes) * text_length;
+  run_stats::add_step("4", "merge ranges", merge_time, text_length,
+      read_volume, io_volume - read_volume);
+
+  // Clean up.
+  for (long i = 0; i < n_block; ++i) {
+    hblock_info[i].psa->finish_parallel_reading();
+    delete hblock_info[i].psa;
+    if (!bwt_filename.empty()) {
+      hblock_info[i].bwt->finish_parallel_reading();
+      delete hblock_info[i].bwt;
+    }
+  }
+
+  for (long t = 0; t <= n_ranges; ++t) {
+    delete[] psa_beg[t];
+    if (t != n_ranges) {
+      delete[] gap_head[t];
+      delete[] gap_offset[t];
+    }
+  }
+  delete[] psa_beg;
+  delete[] gap_head;
+  delete[] gap_offset;
+
+  return primary_index;
+}
+
+// Sequential merging. Returns the primary index of
+// the BWT if it was computed, and -1 otherwise.
+template<typename block_offset_type, typename output_writer_type,
+  typename bwt_writer_type, typename da_writer_type>
+long serial_merge(std::string output_filename, long ram_use,
+    std::vector<half_block_info<block_offset_type> > &hblock_info,
+    long text_length, long output_bits, std::string bwt_filename,
+    const concatenated_text *text, std::string da_filename) {
+  long n_block = (long)hblock_info.size();
+  long output_bytes = (output_bits + 7L) / 8L;
+  long bwt_bytes = bwt_filename.empty() ? 0L : 1L;
+  long da_bytes = da_filename.empty() ? 0L : (long)sizeof(std::uint32_t);
+  long pieces = (1 + sizeof(block_offset_type) + bwt_bytes) * n_block - 1 +
+    output_bytes + bwt_bytes + da_bytes;
+  long buffer_size = (ram_use + pieces - 1) / pieces;
+
+  fprintf(stderr, "\nMerge partial suffix arrays:\n");
+  fprintf(stderr, "  buffer size per block = %ld (%.2LfMiB)\n",
+      sizeof(block_offset_type) * buffer_size,
+      (1.L * sizeof(block_offset_type) * buffer_size) / (1 << 20));
+  fprintf(stderr, "  output width = %ld bits\n", output_bits);
+
+  typedef distributed_file<block_offset_type> psa_reader_type;
+  typedef distributed_file<unsigned char> bwt_reader_type;
+  typedef async_vbyte_stream_reader<long> vbyte_reader_type;
+
+  output_writer_type *output =
+    output_writer_factory<output_writer_type>::create(output_filename,
+        output_bytes * buffer_size, -1L, output_bits);
+  bwt_writer_type *bwt_output = NULL;
+  if (!bwt_filename.empty())
+    bwt_output = output_writer_factory<bwt_writer_type>::create(bwt_filename,
+        buffer_size, -1L, 8L);
+  da_writer_type *da_output = NULL;
+  if (!da_filename.empty())
+    da_output = output_writer_factory<da_writer_type>::create(da_filename,
+        sizeof(std::uint32_t) * buffer_size, -1L, 32L);
+  psa_reader_type **psa = new psa_reader_type*[n_block];
+  bwt_reader_type **bwt = new bwt_reader_type*[n_block];
+  vbyte_reader_type **gap = new vbyte_reader_type*[n_block - 1];
+  for (long i = 0; i < n_block; ++i) {
+    psa[i] = hblock_info[i].psa;
+    psa[i]->initialize_reading(sizeof(block_offset_type) * buffer_size);
+    bwt[i] = hblock_info[i].bwt;
+    if (bwt_output != NULL)
+      bwt[i]->initialize_reading(buffer_size);
+    if (i + 1 != n_block)
+      gap[i] = new vbyte_reader_type(hblock_info[i].gap_filename, buffer_size);
+  }
+
+  long *gap_head = new long[n_block];
+  for (long i = 0; i + 1 < n_block; ++i)
+    gap_head[i] = gap[i]->read();
+  gap_head[n_block - 1] = 0;
+
+  long double merge_start = utils::wclock();
+  long primary_index = -1;
+  merge_range<block_offset_type>(text_length, text_length, hblock_info,
+      psa, gap, gap_head, output, true, 1L, output_bits, bwt, bwt_output,
+      primary_index, text, da_output);
   long double merge_time = utils::wclock() - merge_start;
-  long io_volume = (1 + sizeof(block_offset_type) + sizeof(uint40)) * text_length;
+  long io_volume = (1 + sizeof(block_offset_type) + 2 * bwt_bytes +
+      da_bytes) * text_length + (output_bits * text_length) / 8L;
   long double io_speed = (io_volume / (1024.L * 1024)) / merge_time;
   fprintf(stderr, "\r  100.0%%. Time: %.2Lfs. I/O: %.2LfMiB/s\n", merge_time, io_speed);
+  long read_volume = (1 + sizeof(block_offset_type) + bwt_bytes) * text_length;
+  run_stats::add_step("1", "merge (serial)", merge_time, text_length,
+      read_volume, io_volume - read_volume);
 
   // Clean up.
   delete output;
+  if (bwt_output != NULL)
+    delete bwt_output;
+  if (da_output != NULL)
+    delete da_output;
   for (long i = 0; i < n_block; ++i) {
     hblock_info[i].psa->finish_reading();
     delete hblock_info[i].psa;
+    if (bwt_output != NULL) {
+      hblock_info[i].bwt->finish_reading();
+      delete hblock_info[i].bwt;
+    }
     if (i + 1 != n_block)
       delete gap[i];
   }
 
+  delete[] psa;
+  delete[] bwt;
   delete[] gap;
   delete[] gap_head;
-  delete[] sblock_info;
   
-  for (int i = 0; i + 1 < n_block; ++i)
-    utils::file_delete(hblock_info[i].gap_filename);
+  return primary_index;
+}
+
+template<typename block_offset_type, typename output_writer_type,
+  typename bwt_writer_type, typename da_writer_type>
+long merge_aux(std::string output_filename, long ram_use,
+    std::vector<half_block_info<block_offset_type> > &hblock_info,
+    long n_merge_threads, long text_length, long output_bits,
+    std::string bwt_filename, const concatenated_text *text,
+    std::string da_filename) {
+  if (n_merge_threads > 1)
+    return parallel_merge<block_offset_type, output_writer_type,
+           bwt_writer_type, da_writer_type>(output_filename, ram_use,
+               n_merge_threads, hblock_info, text_length, output_bits,
+               bwt_filename, text, da_filename);
+  else
+    return serial_merge<block_offset_type, output_writer_type,
+           bwt_writer_type, da_writer_type>(output_filename, ram_use,
+               hblock_info, text_length, output_bits, bwt_filename,
+               text, da_filename);
+}
+
+template<typename block_offset_type,
+  template<typename> class output_writer_template>
+long merge_aux(std::string output_filename, long ram_use,
+    std::vector<half_block_info<block_offset_type> > &hblock_info,
+    long n_merge_threads, long text_length, long output_width,
+    std::string bwt_filename, const concatenated_text *text,
+    std::string da_filename) {
+  typedef output_writer_template<unsigned char> bwt_writer_type;
+  typedef output_writer_template<std::uint32_t> da_writer_type;
+  long output_bits = output_bits_per_value(output_width, text_length);
+  switch (output_width) {
+    case 32L:
+      return merge_aux<block_offset_type, output_writer_template<std::uint32_t>,
+             bwt_writer_type, da_writer_type>(output_filename, ram_use,
+                 hblock_info, n_merge_threads, text_length, output_bits,
+                 bwt_filename, text, da_filename);
+    case 48L:
+      return merge_aux<block_offset_type, output_writer_template<uint48>,
+             bwt_writer_type, da_writer_type>(output_filename, ram_use,
+                 hblock_info, n_merge_threads, text_length, output_bits,
+                 bwt_filename, text, da_filename);
+    case 64L:
+      return merge_aux<block_offset_type, output_writer_template<std::uint64_t>,
+             bwt_writer_type, da_writer_type>(output_filename, ram_use,
+                 hblock_info, n_merge_threads, text_length, output_bits,
+                 bwt_filename, text, da_filename);
+    case OUTPUT_WIDTH_PACKED:
+      return merge_aux<block_offset_type, bit_packed_stream_writer<
+             output_writer_template<unsigned char> >, bwt_writer_type,
+             da_writer_type>(output_filename, ram_use, hblock_info,
+                 n_merge_threads, text_length, output_bits, bwt_filename,
+                 text, da_filename);
+    default:
+      return merge_aux<block_offset_type, output_writer_template<uint40>,
+             bwt_writer_type, da_writer_type>(output_filename, ram_use,
+                 hblock_info, n_merge_threads, text_length, output_bits,
+                 bwt_filename, text, da_filename);
+  }
+}
+
+// Merge partial suffix arrays into final suffix array. If bwt_filename
+// is not empty, the partial BWTs are merged into the final BWT, written
+// to bwt_filename. The symbol at the primary index (where SA[i] = 0) is
+// set to 0, and the primary index is written (in decimal) to
+// bwt_filename + ".idx". If da_filename is not empty, the document
+// array (for every suffix, the index of the input file of the text
+// in which it starts) is written to da_filename as 32-bit integers.
+template<typename block_offset_type>
+void merge(std::string output_filename, long ram_use,
+    std::vector<half_block_info<block_offset_type> > &hblock_info,
+    long n_merge_threads = 1,
+    output_writer_kind output_writer = OUTPUT_WRITER_STDIO,
+    long output_width = 40L, std::string bwt_filename = std::string(""),
+    const concatenated_text *text = NULL,
+    std::string da_filename = std::string("")) {
+  long text_length = 0;
+
+  std::sort(hblock_info.begin(), hblock_info.end());
+  for (size_t j = 0; j < hblock_info.size(); ++j)
+    text_length += hblock_info[j].end - hblock_info[j].beg;
+  n_merge_threads = std::min(n_merge_threads, text_length);
+
+  if (output_writer == OUTPUT_WRITER_DIRECT) {
+    std::fclose(utils::open_file(output_filename, "w"));
+    if (!direct_stream_writer<uint40>::is_supported(output_filename)) {
+      fprintf(stderr, "\nWarning: O_DIRECT is not supported for %s, "
+          "using memory-mapped output instead.\n", output_filename.c_str());
+      output_writer = OUTPUT_WRITER_MMAP;
+    }
+  }
+
+  // With the exception of sequential stdio writer (which
+  // creates the file itself), the output file has to exist.
+  long output_bits = output_bits_per_value(output_width, text_length);
+  long output_size = (output_bits * text_length + 7L) / 8L;
+  if (output_writer != OUTPUT_WRITER_STDIO) {
+    utils::preallocate_file(output_filename, output_size);
+    if (!bwt_filename.empty())
+      utils::preallocate_file(bwt_filename, text_length);
+    if (!da_filename.empty())
+      utils::preallocate_file(da_filename,
+          (long)sizeof(std::uint32_t) * text_length);
+  } else if (n_merge_threads > 1) {
+    std::fclose(utils::open_file(output_filename, "w"));
+    if (!bwt_filename.empty())
+      std::fclose(utils::open_file(bwt_filename, "w"));
+    if (!da_filename.empty())
+      std::fclose(utils::open_file(da_filename, "w"));
+  }
+
+  long primary_index = -1;
+  run_stats::begin_section(-1L, 0L, text_length);
+  switch (output_writer) {
+    case OUTPUT_WRITER_MMAP:
+      primary_index = merge_aux<block_offset_type, mmap_stream_writer>(
+          output_filename, ram_use, hblock_info, n_merge_threads,
+          text_length, output_width, bwt_filename, text, da_filename);
+      break;
+    case OUTPUT_WRITER_DIRECT:
+      primary_index = merge_aux<block_offset_type, direct_stream_writer>(
+          output_filename, ram_use, hblock_info, n_merge_threads,
+          text_length, output_width, bwt_filename, text, da_filename);
+      break;
+    default:
+      primary_index = merge_aux<block_offset_type, async_stream_writer>(
+          output_filename, ram_use, hblock_info, n_merge_threads,
+          text_length, output_width, bwt_filename, text, da_filename);
+      break;
+  }
+  run_stats::end_section();
+
+  if (!bwt_filename.empty()) {
+    fprintf(stderr, "  BWT primary index = %ld\n", primary_index);
+    std::FILE *f = utils::open_file(bwt_filename + ".idx", "w");
+    fprintf(f, "%ld\n", primary_index);
+    std::fclose(f);
+  }
 }
 
 }  // namespace psascan_private
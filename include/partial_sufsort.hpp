@@ -46,12 +46,19 @@
 
 #include "inmem_psascan_src/inmem_psascan.hpp"
 #include "utils/utils.hpp"
+#include "utils/run_stats.hpp"
+#include "utils/huge_pages.hpp"
 #include "io/multifile.hpp"
 #include "io/distributed_file.hpp"
-#include "rank.hpp"
+#include "io/temp_file_placement.hpp"
+#include "io/concatenated_text.hpp"
+#include "io/background_block_reader.hpp"
+#include "interleaved_rank.hpp"
 #include "gap_array.hpp"
 #include "bitvector.hpp"
 #include "half_block_info.hpp"
+#include "checkpoint.hpp"
+#include "memory_planner.hpp"
 #include "bwt_merge.hpp"
 #include "compute_gap.hpp"
 #include "em_compute_initial_ranks.hpp"
@@ -62,14 +69,80 @@
 namespace psascan_private {
 
 //=============================================================================
-// The main function processing the block.
+// Compute the size of the left half-block.
+//=============================================================================
+long compute_left_block_size(long block_size, bool last_block,
+    long max_left_block_size) {
+  if (!last_block) return std::max(1L, block_size / 2L);
+  else return std::min(block_size, max_left_block_size);
+}
+
+//=============================================================================
+// Write the partial SA of the half-block to disk. If pbwt_filename is not
+// empty, also write the BWT of the half-block (used when merging the BWTs
+// of half-blocks). If bwt_file != NULL, write the BWT of the half-block as
+// a part of the final BWT, i.e., with the symbol preceding the half-block
+// (prev_symbol) at position i0. If pack_psa is true, the partial SA is
+// bit-packed using ceil(log2(length)) bits per entry. Executed in the
+// background, concurrently with the computation of initial ranks, which
+// only reads the same arrays.
+// The partial SA is written to file with prefix psa_file_base, and the BWT
+// to file with prefix bwt_file_base.
+//=============================================================================
+template<typename block_offset_type>
+void write_half_block_aux(std::string psa_file_base, std::string bwt_file_base,
+    long max_part_length,
+    const block_offset_type *psa, const unsigned char *bwt, long length,
+    long i0, unsigned char prev_symbol, std::string pbwt_filename,
+    bool pack_psa, distributed_file<block_offset_type> **psa_file,
+    distributed_file<unsigned char> **bwt_file, long double &elapsed) {
+  long double start = utils::wclock();
+  long psa_bits = pack_psa ? std::max(1L, utils::log2ceil(length)) : 0L;
+  *psa_file = new distributed_file<block_offset_type>(psa_file_base,
+      max_part_length, psa, psa + length, psa_bits);
+  if (!pbwt_filename.empty())
+    utils::write_objects_to_file(bwt, length, pbwt_filename);
+  if (bwt_file != NULL) {
+    *bwt_file = new distributed_file<unsigned char>(bwt_file_base, max_part_length);
+    (*bwt_file)->initialize_writing();
+    (*bwt_file)->write(bwt, bwt + i0);
+    (*bwt_file)->write(&prev_symbol, &prev_symbol + 1);
+    (*bwt_file)->write(bwt + i0 + 1, bwt + length);
+    (*bwt_file)->finish_writing();
+  }
+  elapsed = utils::wclock() - start;
+}
+
+//=============================================================================
+// Return the symbol preceding the half-block starting at position beg
+// (or 0, if the half-block starts the text).
+//=============================================================================
+unsigned char preceding_symbol(const concatenated_text *text, long beg) {
+  unsigned char c = 0;
+  if (beg > 0)
+    text->read(beg - 1, 1, &c);
+  return c;
+}
+
+//=============================================================================
+// The main function processing the block. If compute_bwt is true, the
+// parts of the final BWT corresponding to both half-blocks are written
+// to disk along with their partial SAs. If right_block_reader != NULL,
+// the right half-block was (or is being) read in the background. If
+// next_block_beg >= 0, the reading of the right half-block of the next
+// block [next_block_beg..block_beg) is started once its text is no longer
+// needed, and the reader is returned in next_right_block_reader. If
+// pack_psa is true, the partial SAs are written to disk bit-packed. The
+// temporary files are placed according to temp (see temp_file_placement.hpp).
 //=============================================================================
 template<typename block_offset_type>
 void process_block(long block_beg, long block_end, long text_length, long ram_use,
-    long max_threads, long gap_buf_size, std::string text_filename,
-    std::string output_filename, std::string gap_filename,
+    long max_threads, const memory_plan &plan, const concatenated_text *text,
+    const temp_file_placement &temp,
     multifile *newtail_gt_begin_rev, const multifile *tail_gt_begin_rev,
-    std::vector<half_block_info<block_offset_type> > &hblock_info, bool verbose) {
+    std::vector<half_block_info<block_offset_type> > &hblock_info, bool verbose,
+    bool compute_bwt, background_block_reader *right_block_reader, long next_block_beg,
+    background_block_reader **next_right_block_reader, bool pack_psa) {
   long block_size = block_end - block_beg;
 
   if (block_end != text_length && block_size <= 1) {
@@ -83,9 +156,8 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   bool last_block = (block_end == text_length);
   bool first_block = (block_beg == 0);
 
-  long left_block_size;
-  if (!last_block) left_block_size = std::max(1L, block_size / 2L);
-  else left_block_size = std::min(block_size, std::max(1L, ram_use / 10L));
+  long left_block_size = compute_left_block_size(block_size, last_block,
+      plan.m_max_left_block_size);
   long right_block_size = block_size - left_block_size;
   long left_block_beg = block_beg;
   long left_block_end = block_beg + left_block_size;
@@ -103,17 +175,26 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   long right_block_i0 = 0;
   long left_block_i0 = 0;
 
-  std::string right_block_pbwt_fname = output_filename + "." + utils::random_string_hash();
-  std::string right_block_gt_begin_rev_fname = output_filename + "." + utils::random_string_hash();
+  // Slots of the temporary files (see temp_file_placement.hpp).
+  // The half-blocks are added to hblock_info left first.
+  long left_psa_slot = (long)hblock_info.size();
+  long left_slot = left_psa_slot + 1;
+  long right_psa_slot = left_psa_slot + 1;
+  long right_slot = right_psa_slot + 1;
+
+  std::string right_block_pbwt_fname = temp.file_base(right_slot) + "." + utils::random_string_hash();
+  std::string right_block_gt_begin_rev_fname = temp.file_base(right_slot) + "." + utils::random_string_hash();
 
   half_block_info<block_offset_type> info_left;
   half_block_info<block_offset_type> info_right;
 
   info_left.beg = left_block_beg;
   info_left.end = left_block_end;
+  info_left.bwt = NULL;
   if (right_block_size > 0) {
     info_right.beg = right_block_beg;
     info_right.end = right_block_end;
+    info_right.bwt = NULL;
   }
 
   //----------------------------------------------------------------------------
@@ -121,28 +202,43 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   //----------------------------------------------------------------------------
   multifile *right_block_gt_begin_rev = NULL;
   unsigned char *right_block = NULL;
+  background_block_reader *left_block_reader = NULL;
 
   if (right_block_size > 0) {
     fprintf(stderr, "  Process right half-block:\n");
 
     // 1.a
     //
-    // Read the right half-block from disk.
-    fprintf(stderr, "    Read: ");
-    right_block = (unsigned char *)malloc(right_block_size);
+    // Read the right half-block from disk (or wait
+    // until the reading in the background is finished).
     long double right_block_read_start = utils::wclock();
-    utils::read_block(text_filename, right_block_beg, right_block_size, right_block);
+    if (right_block_reader != NULL) {
+      fprintf(stderr, "    Read (in the background): ");
+      right_block = right_block_reader->release_data();
+      delete right_block_reader;
+      long double right_block_read_wait = utils::wclock() - right_block_read_start;
+      fprintf(stderr, "waited %.2Lfs\n", right_block_read_wait);
+      run_stats::add_step("1.a", "read right half-block (wait for background)",
+          right_block_read_wait, right_block_size, right_block_size, 0L, true);
+    } else {
+      fprintf(stderr, "    Read: ");
+      right_block = (unsigned char *)huge_pages::allocate(right_block_size);
+      text->read(right_block_beg, right_block_size, right_block);
+      long double right_block_read_time = utils::wclock() - right_block_read_start;
+      long double right_block_read_io = (right_block_size / (1024.L * 1024)) / right_block_read_time;
+      fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", right_block_read_time, right_block_read_io);
+      run_stats::add_step("1.a", "read right half-block", right_block_read_time,
+          right_block_size, right_block_size, 0L);
+    }
     block_last_symbol = right_block[right_block_size - 1];
-    long double right_block_read_time = utils::wclock() - right_block_read_start;
-    long double right_block_read_io = (right_block_size / (1024.L * 1024)) / right_block_read_time;
-    fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", right_block_read_time, right_block_read_io);
  
     // 1.b
     //
     // Compute partial SA, BWT and gt_begin of the right half-block.
 
     // Allocate SA, BWT and gt_begin.
-    unsigned char *right_block_sabwt = (unsigned char *)malloc(right_block_size * (sizeof(block_offset_type) + 1));
+    unsigned char *right_block_sabwt = (unsigned char *)huge_pages::allocate(
+        right_block_size * (sizeof(block_offset_type) + 1));
     block_offset_type *right_block_psa_ptr = (block_offset_type *)right_block_sabwt;
     unsigned char *right_block_bwt = (unsigned char *)(right_block_psa_ptr + right_block_size);
     bitvector *right_block_gt_begin_rev_bv = new bitvector(right_block_size);
@@ -163,9 +259,11 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
     }
 
     // Run in-memory pSAscan.
+    run_stats::set_parent("1.b");
     inmem_psascan_private::inmem_psascan<block_offset_type>(right_block, right_block_size, right_block_sabwt,
-        max_threads, !last_block, true, right_block_gt_begin_rev_bv, -1, right_block_beg, right_block_end,
-        text_length, text_filename, tail_gt_begin_rev, &right_block_i0);
+        max_threads, !last_block || compute_bwt, true, right_block_gt_begin_rev_bv, -1, right_block_beg, right_block_end,
+        text_length, text, tail_gt_begin_rev, &right_block_i0, NULL, plan.m_gap_buf_size);
+    run_stats::set_parent("");
 
     // Restore stderr.
     if (!verbose) {
@@ -179,6 +277,25 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
     long double right_block_sascan_speed = (right_block_size / (1024.L * 1024)) / right_block_sascan_time;
     if (verbose) fprintf(stderr, "%s\n", std::string(60, '*').c_str());
     fprintf(stderr, "%.2Lfs. Speed: %.2LfMiB/s\n", right_block_sascan_time, right_block_sascan_speed);
+    run_stats::add_step("1.b", "internal memory sufsort of right half-block",
+        right_block_sascan_time, right_block_size, 0L, 0L);
+
+    // The peak memory usage for the right half-block is behind
+    // us. Start reading the left half-block in the background.
+    left_block_reader = new background_block_reader(text,
+        left_block_beg, left_block_size);
+
+    // 1.d-1.e
+    //
+    // Start writing the partial SA and BWT of the right
+    // half-block to disk in the background.
+    long right_psa_max_part_length = std::max((long)sizeof(block_offset_type), ram_use / 20L);
+    long double right_write_time = 0.L;
+    std::thread *right_block_writer = new std::thread(write_half_block_aux<block_offset_type>,
+        temp.file_base(right_psa_slot), temp.file_base(right_slot), right_psa_max_part_length, right_block_psa_ptr, right_block_bwt,
+        right_block_size, right_block_i0, preceding_symbol(text, right_block_beg),
+        last_block ? std::string("") : right_block_pbwt_fname, pack_psa, &info_right.psa,
+        compute_bwt ? &info_right.bwt : NULL, std::ref(right_write_time));
  
     // 1.c
     //
@@ -187,7 +304,7 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
       fprintf(stderr, "    Compute initial tail ranks (part 1): ");
       long double initial_ranks_first_term_start = utils::wclock();
       em_compute_initial_ranks<block_offset_type>(right_block, right_block_psa_ptr, right_block_bwt,
-          right_block_i0, right_block_beg, right_block_end, text_length, text_filename,
+          right_block_i0, right_block_beg, right_block_end, text_length, text,
           tail_gt_begin_rev, block_initial_ranks, max_threads, block_tail_end, 0);  // Note the space usage!
 
       size_t vec_size = block_initial_ranks.size();
@@ -195,33 +312,27 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
         block_initial_ranks[j] = block_initial_ranks[j + 1];
       block_initial_ranks[vec_size - 1] = 0;
 
-      fprintf(stderr, "%.2Lfs\n", utils::wclock() - initial_ranks_first_term_start);
+      long double initial_ranks_first_term_time = utils::wclock() - initial_ranks_first_term_start;
+      fprintf(stderr, "%.2Lfs\n", initial_ranks_first_term_time);
+      run_stats::add_step("1.c", "compute initial tail ranks (part 1)",
+          initial_ranks_first_term_time, right_block_size, 0L, 0L);
     }
 
-    // 1.d
+    // 1.d-1.e
     //
-    // Write the partial SA of the right half-block to disk.
-    fprintf(stderr, "    Write partial SA to disk: ");
-    long double right_psa_save_start = utils::wclock();
-    long right_psa_max_part_length = std::max((long)sizeof(block_offset_type), ram_use / 20L);
-    info_right.psa = new distributed_file<block_offset_type>(output_filename,
-        right_psa_max_part_length, right_block_psa_ptr, right_block_psa_ptr + right_block_size);
-    long double right_psa_save_time = utils::wclock() - right_psa_save_start;
-    long double right_psa_save_io = ((right_block_size * sizeof(block_offset_type)) / (1024.L * 1024)) / right_psa_save_time;
-    fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", right_psa_save_time, right_psa_save_io);
-
-    // 1.e
-    //
-    // Write the BWT of the right half-block on disk.
-    if (!last_block) {
-      fprintf(stderr, "    Write BWT to disk: ");
-      long double right_bwt_save_start = utils::wclock();
-      utils::write_objects_to_file(right_block_bwt, right_block_size, right_block_pbwt_fname);
-      long double right_bwt_save_time = utils::wclock() - right_bwt_save_start;
-      long double right_bwt_save_io = (right_block_size / (1024.L * 1024)) / right_bwt_save_time;
-      fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", right_bwt_save_time, right_bwt_save_io);
-    }
-    free(right_block_sabwt);
+    // Wait until the partial SA and BWT of the right half-block are written.
+    fprintf(stderr, "    Write partial SA%s to disk: ", last_block ? "" : " and BWT");
+    long double right_write_wait_start = utils::wclock();
+    right_block_writer->join();
+    delete right_block_writer;
+    long right_write_volume = right_block_size * (sizeof(block_offset_type) +
+        (last_block ? 0 : 1) + (compute_bwt ? 1 : 0));
+    long double right_write_io = (right_write_volume / (1024.L * 1024)) / right_write_time;
+    fprintf(stderr, "%.2Lfs, waited %.2Lfs (I/O: %.2LfMiB/s)\n", right_write_time,
+        utils::wclock() - right_write_wait_start, right_write_io);
+    run_stats::add_step("1.d-1.e", "write partial SA and BWT of right half-block",
+        right_write_time, right_block_size, 0L, right_write_volume, true);
+    huge_pages::deallocate(right_block_sabwt);
 
     // 1.f
     //
@@ -236,6 +347,8 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
     long double right_gt_begin_rev_save_time = utils::wclock() - right_gt_begin_rev_save_start;
     long double right_gt_begin_rev_save_io = (right_block_size / (8.L * (1 << 20))) / right_gt_begin_rev_save_time;
     fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", right_gt_begin_rev_save_time, right_gt_begin_rev_save_io);
+    run_stats::add_step("1.f", "write gt_begin of right half-block",
+        right_gt_begin_rev_save_time, right_block_size, 0L, (right_block_size + 7L) / 8L);
   }
 
 
@@ -246,22 +359,37 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
 
   // 2.a
   //
-  // Read the left half-block from disk.
-  fprintf(stderr, "    Read: ");
+  // Read the left half-block from disk (or wait until
+  // the reading in the background is finished).
   long double left_block_read_start = utils::wclock();
-  unsigned char *left_block = (unsigned char *)malloc(left_block_size);
-  utils::read_block(text_filename, left_block_beg, left_block_size, left_block);
+  unsigned char *left_block = NULL;
+  if (left_block_reader != NULL) {
+    fprintf(stderr, "    Read (in the background): ");
+    left_block = left_block_reader->release_data();
+    delete left_block_reader;
+    long double left_block_read_wait = utils::wclock() - left_block_read_start;
+    fprintf(stderr, "waited %.2Lfs\n", left_block_read_wait);
+    run_stats::add_step("2.a", "read left half-block (wait for background)",
+        left_block_read_wait, left_block_size, left_block_size, 0L, true);
+  } else {
+    fprintf(stderr, "    Read: ");
+    left_block = (unsigned char *)huge_pages::allocate(left_block_size);
+    text->read(left_block_beg, left_block_size, left_block);
+    long double left_block_read_time = utils::wclock() - left_block_read_start;
+    long double left_block_read_io = (left_block_size / (1024.L * 1024)) / left_block_read_time;
+    fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", left_block_read_time, left_block_read_io);
+    run_stats::add_step("2.a", "read left half-block", left_block_read_time,
+        left_block_size, left_block_size, 0L);
+  }
   unsigned char left_block_last = left_block[left_block_size - 1];
-  long double left_block_read_time = utils::wclock() - left_block_read_start;
-  long double left_block_read_io = (left_block_size / (1024.L * 1024)) / left_block_read_time;
-  fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", left_block_read_time, left_block_read_io);
 
   // 2.b
   //
   // Compute partial SA, BWT and gt_begin for left half-block.
 
   // Allocate SA, BWT and gt_begin.
-  unsigned char *left_block_sabwt = (unsigned char *)malloc(left_block_size * (sizeof(block_offset_type) + 1) + 1);
+  unsigned char *left_block_sabwt = (unsigned char *)huge_pages::allocate(
+      left_block_size * (sizeof(block_offset_type) + 1) + 1);
   block_offset_type *left_block_psa_ptr = (block_offset_type *)left_block_sabwt;
   unsigned char *left_block_bwt_ptr = (unsigned char *)(left_block_psa_ptr + left_block_size);
   bitvector *left_block_gt_begin_rev_bv = NULL;
@@ -283,9 +411,12 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   }
 
   // Run in-memory pSAscan.
+  run_stats::set_parent("2.b");
   inmem_psascan_private::inmem_psascan<block_offset_type>(left_block, left_block_size, left_block_sabwt,
-      max_threads, (right_block_size > 0), !first_block, left_block_gt_begin_rev_bv, -1, left_block_beg,
-      left_block_end, text_length, text_filename, right_block_gt_begin_rev, &left_block_i0, right_block);
+      max_threads, (right_block_size > 0) || compute_bwt, !first_block, left_block_gt_begin_rev_bv, -1, left_block_beg,
+      left_block_end, text_length, text, right_block_gt_begin_rev, &left_block_i0, right_block,
+      plan.m_gap_buf_size);
+  run_stats::set_parent("");
 
   // Restore stderr.
   if (!verbose) {
@@ -299,6 +430,22 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   long double left_block_sascan_speed = (left_block_size / (1024.L * 1024)) / left_block_sascan_time;
   if (verbose) fprintf(stderr, "%s\n", std::string(60, '*').c_str());
   fprintf(stderr, "%.2Lfs (%.2LfMiB/s)\n", left_block_sascan_time, left_block_sascan_speed);
+  run_stats::add_step("2.b", "internal memory sufsort of left half-block",
+      left_block_sascan_time, left_block_size, 0L, 0L);
+
+  // 2.d
+  //
+  // Start writing the partial SA (and the part of the final BWT) of the
+  // left half-block to disk in the background. The partial SA and BWT are
+  // no longer modified (only read in 2.c, 2.e and 3.a), so the writing
+  // overlaps with the remaining steps.
+  long left_psa_max_part_length = std::max((long)sizeof(block_offset_type), ram_use / 20L);
+  long double left_write_time = 0.L;
+  std::thread *left_block_writer = new std::thread(write_half_block_aux<block_offset_type>,
+      temp.file_base(left_psa_slot), temp.file_base(left_slot), left_psa_max_part_length, left_block_psa_ptr, left_block_bwt_ptr,
+      left_block_size, left_block_i0, preceding_symbol(text, left_block_beg),
+      std::string(""), pack_psa, &info_left.psa, compute_bwt ? &info_left.bwt : NULL,
+      std::ref(left_write_time));
 
   // 2.c
   //
@@ -309,7 +456,7 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
     long double initial_ranks_second_term_start = utils::wclock();
     std::vector<long> block_initial_ranks_second_term;
     em_compute_initial_ranks<block_offset_type>(left_block, left_block_psa_ptr, left_block_beg,
-        left_block_end, text_length, text_filename, tail_gt_begin_rev, block_initial_ranks_second_term,
+        left_block_end, text_length, text, tail_gt_begin_rev, block_initial_ranks_second_term,
         max_threads, block_tail_beg);  // Note the space usage!
 
     after_block_initial_rank = block_initial_ranks_second_term[0];
@@ -320,21 +467,12 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
 
     for (size_t j = 0; j < vec_size; ++j)
       block_initial_ranks[j] += block_initial_ranks_second_term[j];
-    fprintf(stderr, "%.2Lfs\n", utils::wclock() - initial_ranks_second_term_start);
+    long double initial_ranks_second_term_time = utils::wclock() - initial_ranks_second_term_start;
+    fprintf(stderr, "%.2Lfs\n", initial_ranks_second_term_time);
+    run_stats::add_step("2.c", "compute initial tail ranks (part 2)",
+        initial_ranks_second_term_time, left_block_size, 0L, 0L);
   }
 
-  // 2.d
-  //
-  // Write the partial SA of the left half-block to disk.
-  fprintf(stderr, "    Write partial SA to disk: ");
-  long double left_psa_save_start = utils::wclock();
-  long left_psa_max_part_length = std::max((long)sizeof(block_offset_type), ram_use / 20L);
-  info_left.psa = new distributed_file<block_offset_type>(output_filename,
-      left_psa_max_part_length, left_block_psa_ptr, left_block_psa_ptr + left_block_size);
-  long double left_psa_save_time = utils::wclock() - left_psa_save_start;
-  long double left_psa_save_io = ((left_block_size * sizeof(block_offset_type)) / (1024.L * 1024)) / left_psa_save_time;
-  fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", left_psa_save_time, left_psa_save_io);
-
   // 2.e
   //
   // Copy the BWT of the left half-block to separate array.
@@ -342,9 +480,12 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   if (right_block_size > 0) {
     fprintf(stderr, "    Copy BWT of left half-block to separate array: ");
     long double left_bwt_copy_start = utils::wclock();
-    left_block_bwt = (unsigned char *)malloc(left_block_size);
+    left_block_bwt = (unsigned char *)huge_pages::allocate(left_block_size);
     std::copy(left_block_bwt_ptr, left_block_bwt_ptr + left_block_size, left_block_bwt);
-    fprintf(stderr, "%.2Lfs\n", utils::wclock() - left_bwt_copy_start);
+    long double left_bwt_copy_time = utils::wclock() - left_bwt_copy_start;
+    fprintf(stderr, "%.2Lfs\n", left_bwt_copy_time);
+    run_stats::add_step("2.e", "copy BWT of left half-block",
+        left_bwt_copy_time, left_block_size, 0L, 0L);
   }
 
   // 2.f
@@ -353,19 +494,30 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   if (!first_block) {
     fprintf(stderr, "    Write gt_begin to disk: ");
     long double left_gt_begin_rev_save_start = utils::wclock();
-    std::string left_block_gt_begin_rev_fname = output_filename + "." + utils::random_string_hash();
+    std::string left_block_gt_begin_rev_fname = temp.file_base(left_slot) + "." + utils::random_string_hash();
     left_block_gt_begin_rev_bv->save(left_block_gt_begin_rev_fname);
     newtail_gt_begin_rev->add_file(text_length - left_block_end, text_length - left_block_beg, left_block_gt_begin_rev_fname);
     delete left_block_gt_begin_rev_bv;
     long double left_gt_begin_rev_save_time = utils::wclock() - left_gt_begin_rev_save_start;
     long double left_gt_begin_rev_save_io = (left_block_size / (8.L * (1 << 20))) / left_gt_begin_rev_save_time;
     fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", left_gt_begin_rev_save_time, left_gt_begin_rev_save_io);
+    run_stats::add_step("2.f", "write gt_begin of left half-block",
+        left_gt_begin_rev_save_time, left_block_size, 0L, (left_block_size + 7L) / 8L);
   }
 
   if (right_block_size == 0) {
+    fprintf(stderr, "    Write partial SA to disk: ");
+    left_block_writer->join();
+    delete left_block_writer;
+    long left_write_volume = left_block_size * (sizeof(block_offset_type) + (compute_bwt ? 1 : 0));
+    long double left_write_io = (left_write_volume / (1024.L * 1024)) / left_write_time;
+    fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", left_write_time, left_write_io);
+    run_stats::add_step("2.d", "write partial SA of left half-block",
+        left_write_time, left_block_size, 0L, left_write_volume, true);
+
     hblock_info.push_back(info_left);
-    free(left_block);
-    free(left_block_sabwt);
+    huge_pages::deallocate(left_block);
+    huge_pages::deallocate(left_block_sabwt);
     return;
   }
 
@@ -383,7 +535,7 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   long double initial_ranks_right_half_block_start = utils::wclock();
   std::vector<long> initial_ranks2;
   em_compute_initial_ranks<block_offset_type>(left_block, left_block_psa_ptr, left_block_bwt,
-       left_block_i0, left_block_beg, left_block_end, text_length, text_filename, right_block_gt_begin_rev,
+       left_block_i0, left_block_beg, left_block_end, text_length, text, right_block_gt_begin_rev,
        initial_ranks2, max_threads, right_block_end, after_block_initial_rank);  // Note the space usage!
 
   size_t vec_size = initial_ranks2.size();
@@ -391,35 +543,67 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
     initial_ranks2[j] = initial_ranks2[j + 1];
   initial_ranks2[vec_size - 1] = after_block_initial_rank;
 
-  fprintf(stderr, "%.2Lfs\n", utils::wclock() - initial_ranks_right_half_block_start);
-  free(left_block);
-  free(left_block_sabwt);
+  long double initial_ranks_right_half_block_time = utils::wclock() - initial_ranks_right_half_block_start;
+  fprintf(stderr, "%.2Lfs\n", initial_ranks_right_half_block_time);
+  run_stats::add_step("3.a", "compute initial ranks for right half-block",
+      initial_ranks_right_half_block_time, left_block_size, 0L, 0L);
+
+  // 2.d
+  //
+  // Wait until the partial SA of the left half-block is written.
+  fprintf(stderr, "    Write partial SA of left half-block to disk: ");
+  long double left_write_wait_start = utils::wclock();
+  left_block_writer->join();
+  delete left_block_writer;
+  long left_write_volume = left_block_size * (sizeof(block_offset_type) + (compute_bwt ? 1 : 0));
+  long double left_write_io = (left_write_volume / (1024.L * 1024)) / left_write_time;
+  fprintf(stderr, "%.2Lfs, waited %.2Lfs (I/O: %.2LfMiB/s)\n", left_write_time,
+      utils::wclock() - left_write_wait_start, left_write_io);
+  run_stats::add_step("2.d", "write partial SA of left half-block",
+      left_write_time, left_block_size, 0L, left_write_volume, true);
+
+  huge_pages::deallocate(left_block);
+  huge_pages::deallocate(left_block_sabwt);
 
   // 3.b
   //
   // Build the rank over BWT of left half-block.
   fprintf(stderr, "    Construct rank: ");
   long double left_block_rank_build_start = utils::wclock();
-  rank4n<> *left_block_rank = new rank4n<>(left_block_bwt, left_block_size, max_threads);
+  stream_rank_type *left_block_rank = new stream_rank_type(left_block_bwt, left_block_size, max_threads);
   long double left_block_rank_build_time = utils::wclock() - left_block_rank_build_start;
   long double left_block_rank_build_speed = (left_block_size / (1024.L * 1024)) / left_block_rank_build_time;
   fprintf(stderr, "%.2Lfs (%.2LfMiB/s)\n", left_block_rank_build_time, left_block_rank_build_speed);
+  run_stats::add_step("3.b", "construct rank over BWT of left half-block",
+      left_block_rank_build_time, left_block_size, 0L, 0L);
 
   // 3.c
   //
   // Compute gap array of the left half-block wrt to the right half-block.
-  left_block_gap = new buffered_gap_array(left_block_size + 1, gap_filename);
+  long double left_block_gap_start = utils::wclock();
+  left_block_gap = new buffered_gap_array(left_block_size + 1, temp.gap_file_base(left_slot));
   compute_gap<block_offset_type>(left_block_rank, left_block_gap, right_block_beg, right_block_end,
-      text_length, max_threads, left_block_i0, gap_buf_size, left_block_last,
-      initial_ranks2, text_filename, output_filename, right_block_gt_begin_rev, newtail_gt_begin_rev);
+      text_length, max_threads, left_block_i0, plan.m_gap_buf_size, plan.m_n_gap_buffers, left_block_last,
+      initial_ranks2, text, temp, right_block_gt_begin_rev, newtail_gt_begin_rev, "3.c");
+  run_stats::add_step("3.c", "stream right half-block (gap of left half-block)",
+      utils::wclock() - left_block_gap_start, right_block_size,
+      right_block_size + (right_block_size + 7L) / 8L, (right_block_size + 7L) / 8L);
   delete left_block_rank;
   delete right_block_gt_begin_rev;
 
+  // RAM for sorting the excess values of the gap: the memory freed
+  // by the rank and the streaming buffers, minus the gap bitvector.
+  long gap_excess_ram = std::max((1L << 20), (long)((k_rank_ram_per_symbol - 0.25L)
+        * left_block_size) + plan.m_streaming_ram);
+
   if (last_block) {
-    free(left_block_bwt);
+    huge_pages::deallocate(left_block_bwt);
 
-    info_left.gap_filename = gap_filename + ".gap." + utils::random_string_hash();
-    left_block_gap->save_to_file(info_left.gap_filename);
+    info_left.gap_filename = temp.gap_file_base(left_slot) + ".gap." + utils::random_string_hash();
+    long double gap_write_start = utils::wclock();
+    long gap_bytes = left_block_gap->save_to_file(info_left.gap_filename, gap_excess_ram, max_threads);
+    run_stats::add_step("3.c", "write gap of left half-block",
+        utils::wclock() - gap_write_start, left_block_size + 1, 0L, gap_bytes);
     left_block_gap->erase_disk_excess();
     delete left_block_gap;
 
@@ -438,10 +622,12 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   // Convert the partial gap of the left half-block into bitvector.
   fprintf(stderr, "    Convert partial gap array of left half-block to bitvector: ");
   long double convert_to_bitvector_start = utils::wclock();
-  bitvector *left_block_gap_bv = left_block_gap->convert_to_bitvector(max_threads);
+  bitvector *left_block_gap_bv = left_block_gap->convert_to_bitvector(max_threads, gap_excess_ram);
   long double convert_to_bitvector_time = utils::wclock() - convert_to_bitvector_start;
   long double convert_to_bitvector_speed = (block_size / (1024.L * 1024)) / convert_to_bitvector_time;
   fprintf(stderr, "%.2Lfs (%.2LfMiB/s)\n", convert_to_bitvector_time, convert_to_bitvector_speed);
+  run_stats::add_step("4.a", "convert gap of left half-block to bitvector",
+      convert_to_bitvector_time, block_size, 0L, 0L);
 
   left_block_gap->erase_disk_excess();
   delete left_block_gap;
@@ -451,15 +637,17 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   // Read the BWT of the right half-block into RAM.
   fprintf(stderr, "    Read BWT of right half-block: ");
   long double right_block_bwt_read_start = utils::wclock();
-  unsigned char *right_block_bwt = NULL;
-  utils::read_objects_from_file(right_block_bwt, right_block_size, right_block_pbwt_fname);
+  unsigned char *right_block_bwt = (unsigned char *)huge_pages::allocate(right_block_size);
+  utils::read_n_objects_from_file(right_block_bwt, right_block_size, right_block_pbwt_fname);
   long double right_block_bwt_read_time = utils::wclock() - right_block_bwt_read_start;
   long double right_block_bwt_read_io = (right_block_size / (1024.L * 1024)) / right_block_bwt_read_time;
   fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", right_block_bwt_read_time, right_block_bwt_read_io);
+  run_stats::add_step("4.b", "read BWT of right half-block",
+      right_block_bwt_read_time, right_block_size, right_block_size, 0L);
 
   utils::file_delete(right_block_pbwt_fname);
 
-  unsigned char *block_pbwt = (unsigned char *)malloc(block_size);
+  unsigned char *block_pbwt = (unsigned char *)huge_pages::allocate(block_size);
   long block_i0 = 0;
 
   // 4.c
@@ -472,21 +660,25 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   long double bwt_merge_time = utils::wclock() - bwt_merge_start;
   long double bwt_merge_speed = (block_size / (1024.L * 1024)) / bwt_merge_time;
   fprintf(stderr, "%.2Lfs (%.2LfMiB/s)\n", bwt_merge_time, bwt_merge_speed);
+  run_stats::add_step("4.c", "merge BWTs of half-blocks",
+      bwt_merge_time, block_size, 0L, 0L);
 
-  free(left_block_bwt);
-  free(right_block_bwt);
+  huge_pages::deallocate(left_block_bwt);
+  huge_pages::deallocate(right_block_bwt);
 
   // 4.d
   //
   // Write left_block_gap_bv to disk.
   fprintf(stderr, "    Write left half-block gap bitvector to disk: ");
   long double write_left_gap_bv_start = utils::wclock();
-  std::string left_block_gap_bv_filename = gap_filename + ".left_block_gap_bv";
+  std::string left_block_gap_bv_filename = temp.gap_file_base(left_slot) + ".left_block_gap_bv";
   left_block_gap_bv->save(left_block_gap_bv_filename);
   delete left_block_gap_bv;
   long double write_left_gap_bv_time = utils::wclock() - write_left_gap_bv_start;
   long double write_left_gap_bv_io = ((block_size / 8.L) / (1 << 20)) / write_left_gap_bv_time;
   fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", write_left_gap_bv_time, write_left_gap_bv_io);
+  run_stats::add_step("4.d", "write gap bitvector of left half-block",
+      write_left_gap_bv_time, block_size, 0L, (block_size + 7L) / 8L);
 
   //----------------------------------------------------------------------------
   // STEP 5: Compute the gap array of the block.
@@ -497,22 +689,42 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   // Construct the rank data structure over BWT of the block.
   fprintf(stderr, "    Construct rank: ");
   long double whole_block_rank_build_start = utils::wclock();
-  rank4n<> *block_rank = new rank4n<>(block_pbwt, block_size, max_threads);
-  free(block_pbwt);
+  stream_rank_type *block_rank = new stream_rank_type(block_pbwt, block_size, max_threads);
+  huge_pages::deallocate(block_pbwt);
   long double whole_block_rank_build_time = utils::wclock() - whole_block_rank_build_start;
   long double whole_block_rank_build_io = (block_size / (1024.L * 1024)) / whole_block_rank_build_time;
   fprintf(stderr, "%.2Lfs (%.2LfMiB/s)\n", whole_block_rank_build_time, whole_block_rank_build_io);
+  run_stats::add_step("5.a", "construct rank over BWT of block",
+      whole_block_rank_build_time, block_size, 0L, 0L);
 
-  buffered_gap_array *block_gap = new buffered_gap_array(block_size + 1, gap_filename);
+  long double block_gap_start = utils::wclock();
+  buffered_gap_array *block_gap = new buffered_gap_array(block_size + 1, temp.gap_file_base(right_slot));
 
   // 5.b
   //
   // Compute gap for the block. During this step we also compute gt_begin
   // for the new tail.
   compute_gap<block_offset_type>(block_rank, block_gap, block_tail_beg, block_tail_end, text_length,
-      max_threads, block_i0, gap_buf_size, block_last_symbol, block_initial_ranks, text_filename,
-      output_filename, tail_gt_begin_rev, newtail_gt_begin_rev);
+      max_threads, block_i0, plan.m_gap_buf_size, plan.m_n_gap_buffers, block_last_symbol, block_initial_ranks, text,
+      temp, tail_gt_begin_rev, newtail_gt_begin_rev, "5.b");
   delete block_rank;
+  long tail_length = block_tail_end - block_tail_beg;
+  run_stats::add_step("5.b", "stream tail (gap of block)",
+      utils::wclock() - block_gap_start, tail_length,
+      tail_length + (tail_length + 7L) / 8L, (tail_length + 7L) / 8L);
+
+  // The text of the block is no longer needed. Start reading the right
+  // half-block of the next block in the background. The reading overlaps
+  // with the computation of gap arrays for half-blocks.
+  if (next_block_beg >= 0) {
+    long next_block_size = block_beg - next_block_beg;
+    long next_left_block_size = compute_left_block_size(next_block_size, false,
+        plan.m_max_left_block_size);
+    long next_right_block_size = next_block_size - next_left_block_size;
+    if (next_right_block_size > 0)
+      *next_right_block_reader = new background_block_reader(text,
+          next_block_beg + next_left_block_size, next_right_block_size);
+  }
 
   block_gap->flush_excess_to_disk();
 
@@ -525,14 +737,17 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
   long double left_block_gap_bv_read_time = utils::wclock() - left_block_gap_bv_read_start;
   long double left_block_gap_bv_read_io = ((block_size / 8.L) / (1 << 20)) / left_block_gap_bv_read_time;
   fprintf(stderr, "%.2Lfs (I/O: %.2LfMiB/s)\n", left_block_gap_bv_read_time, left_block_gap_bv_read_io);
+  run_stats::add_step("5.c", "read gap bitvector of left half-block",
+      left_block_gap_bv_read_time, block_size, (block_size + 7L) / 8L, 0L);
   utils::file_delete(left_block_gap_bv_filename);
 
   //----------------------------------------------------------------------------
   // STEP 6: Compute gap arrays of half-blocks.
   //----------------------------------------------------------------------------
-  info_left.gap_filename = gap_filename + ".gap." + utils::random_string_hash();
-  info_right.gap_filename = gap_filename + ".gap." + utils::random_string_hash();
+  info_left.gap_filename = temp.gap_file_base(left_slot) + ".gap." + utils::random_string_hash();
+  info_right.gap_filename = temp.gap_file_base(right_slot) + ".gap." + utils::random_string_hash();
 
+  long double half_block_gaps_start = utils::wclock();
   gap_array_2n *block_gap_2n = new gap_array_2n(block_gap, max_threads);
   delete block_gap;
   block_gap_2n->apply_excess_from_disk(std::max((1L << 20), block_size), max_threads);
@@ -545,6 +760,8 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
 
   delete block_gap_2n;
   delete left_block_gap_bv;
+  run_stats::add_step("6", "compute gap arrays of half-blocks",
+      utils::wclock() - half_block_gaps_start, block_size, 0L, 0L);
   
   hblock_info.push_back(info_left);
   hblock_info.push_back(info_right);
@@ -554,32 +771,78 @@ void process_block(long block_beg, long block_end, long text_length, long ram_us
 //=============================================================================
 // Compute partial SAs and gap arrays and write to disk.
 // Return the array of handlers to distributed files as a result.
+// If resume is true, the computation continues from the state stored
+// in checkpoint_filename (if it exists), the files left by the block that
+// was interrupted are deleted, and the state is saved to checkpoint_filename
+// after processing each block. If pack_psa
+// is true, the partial SAs are stored on disk bit-packed. The temporary
+// files are placed according to temp.
 //=============================================================================
 template<typename block_offset_type>
-std::vector<half_block_info<block_offset_type> > partial_sufsort(std::string text_filename, std::string output_filename,
-    std::string gap_filename, long text_length, long max_block_size, long ram_use, long max_threads, long gap_buf_size,
-    bool verbose) {
+std::vector<half_block_info<block_offset_type> > partial_sufsort(const concatenated_text *text,
+    const temp_file_placement &temp, long text_length, const memory_plan &plan, long ram_use, long max_threads,
+    bool verbose, bool compute_bwt, std::string checkpoint_filename, bool resume,
+    bool pack_psa) {
   fprintf(stderr, "sizeof(block_offset_type) = %lu\n\n", sizeof(block_offset_type));
 
+  long max_block_size = plan.m_max_block_size;
   long n_blocks = (text_length + max_block_size - 1) / max_block_size;
   multifile *tail_gt_begin_reversed = NULL;
+  background_block_reader *right_block_reader = NULL;
 
   std::vector<half_block_info<block_offset_type> > hblock_info;
-  for (long block_id = n_blocks - 1; block_id >= 0; --block_id) {
+  long first_block_id = n_blocks - 1;
+  if (resume) {
+    if (load_checkpoint<block_offset_type>(checkpoint_filename, text_length,
+          max_block_size, compute_bwt, first_block_id, hblock_info,
+          tail_gt_begin_reversed))
+      fprintf(stderr, "Resume from checkpoint: %ld/%ld blocks already processed\n\n",
+          n_blocks - 1 - first_block_id, n_blocks);
+    else fprintf(stderr, "Checkpoint %s not found, starting "
+        "from the beginning\n\n", checkpoint_filename.c_str());
+    long n_deleted = delete_leftover_files<block_offset_type>(temp,
+        hblock_info, tail_gt_begin_reversed);
+    if (n_deleted > 0)
+      fprintf(stderr, "Deleted %ld temporary files left by the interrupted "
+          "run\n\n", n_deleted);
+  }
+
+  // The pages of the large arrays freed in one block are reused
+  // by the following steps and blocks (see block_arena.hpp). The
+  // pages kept in the arena stay resident, so the capacity leaves
+  // out the buffers of streaming, which are allocated separately.
+  huge_pages::reserve_arena(plan.m_predicted_peak - plan.m_baseline_ram -
+      plan.m_streaming_ram);
+
+  for (long block_id = first_block_id; block_id >= 0; --block_id) {
     long block_beg = max_block_size * block_id;
     long block_end = std::min(block_beg + max_block_size, text_length);
+    long next_block_beg = (block_id > 0) ? block_beg - max_block_size : -1L;
     fprintf(stderr, "Process block %ld/%ld [%ld..%ld):\n", n_blocks - block_id, n_blocks, block_beg, block_end);
+    run_stats::begin_section(n_blocks - block_id, block_beg, block_end);
 
     multifile *newtail_gt_begin_reversed = new multifile();
-    process_block<block_offset_type>(block_beg, block_end, text_length, ram_use, max_threads, gap_buf_size,
-        text_filename, output_filename, gap_filename, newtail_gt_begin_reversed, tail_gt_begin_reversed,
-        hblock_info, verbose);
+    background_block_reader *next_right_block_reader = NULL;
+    process_block<block_offset_type>(block_beg, block_end, text_length, ram_use, max_threads, plan,
+        text, temp, newtail_gt_begin_reversed, tail_gt_begin_reversed,
+        hblock_info, verbose, compute_bwt, right_block_reader, next_block_beg, &next_right_block_reader,
+        pack_psa);
+    right_block_reader = next_right_block_reader;
+    run_stats::end_section();
+
+    // All files describing the state after processing the block are
+    // on disk now. The tail is not needed after the last block.
+    if (resume)
+      save_checkpoint<block_offset_type>(checkpoint_filename, text_length,
+          max_block_size, compute_bwt, block_id - 1, hblock_info,
+          block_id > 0 ? newtail_gt_begin_reversed : NULL);
 
     delete tail_gt_begin_reversed;
     tail_gt_begin_reversed = newtail_gt_begin_reversed;
   }
 
   delete tail_gt_begin_reversed;
+  huge_pages::release_arena();
   return hblock_info;
 }
 
@@ -40,68 +40,167 @@
 #include <vector>
 #include <algorithm>
 #include <sys/resource.h>
+#include <malloc.h>
 
 #include "utils/utils.hpp"
+#include "utils/run_stats.hpp"
+#include "utils/numa.hpp"
+#include "utils/thread_pool.hpp"
+#include "utils/huge_pages.hpp"
 #include "types/uint40.hpp"
 #include "partial_sufsort.hpp"
 #include "merge.hpp"
 #include "half_block_info.hpp"
+#include "memory_planner.hpp"
+#include "io/io_uring_engine.hpp"
+#include "io/fd_pool.hpp"
+#include "io/temp_file_placement.hpp"
+#include "io/concatenated_text.hpp"
 
 
 namespace psascan_private {
 
-void pSAscan(std::string input_filename, std::string output_filename,
-    std::string gap_filename, long ram_use, long max_threads,
-    bool verbose, long gap_buf_size = (1L << 21)) {
-  long n_gap_buffers = 2 * max_threads;
+// Return the names of the files read by the merging that remain on disk
+// after it: the gap arrays and, if keep_parts is true, the partial SAs
+// (and BWTs). The latter are kept only in the resumable computation, so
+// that --resume can restart the merging, otherwise they are deleted as
+// soon as they are read.
+template<typename block_offset_type>
+std::vector<std::string> merge_input_files(
+    std::vector<half_block_info<block_offset_type> > &hblock_info,
+    bool keep_parts) {
+  std::vector<std::string> filenames;
+  for (size_t i = 0; i < hblock_info.size(); ++i) {
+    if (keep_parts) {
+      std::vector<std::string> parts = hblock_info[i].psa->part_filenames();
+      hblock_info[i].psa->keep_parts();
+      if (hblock_info[i].bwt != NULL) {
+        std::vector<std::string> bwt_parts = hblock_info[i].bwt->part_filenames();
+        parts.insert(parts.end(), bwt_parts.begin(), bwt_parts.end());
+        hblock_info[i].bwt->keep_parts();
+      }
+      filenames.insert(filenames.end(), parts.begin(), parts.end());
+    }
+    if (!hblock_info[i].gap_filename.empty())
+      filenames.push_back(hblock_info[i].gap_filename);
+  }
+  return filenames;
+}
+
+// Delete the checkpoint (first, so that it never refers to
+// missing files) and the files left by the merging.
+void delete_merge_input(std::string checkpoint_filename,
+    const std::vector<std::string> &filenames) {
+  if (utils::file_exists(checkpoint_filename))
+    utils::file_delete(checkpoint_filename);
+  for (size_t i = 0; i < filenames.size(); ++i)
+    if (utils::file_exists(filenames[i]))
+      utils::file_delete(filenames[i]);
+}
+
+// The text is the concatenation of the input files (with no separators).
+// If da_filename is not empty, the document array is written to it.
+void pSAscan(std::vector<std::string> input_filenames,
+    std::string output_filename, std::string gap_filename, long ram_use,
+    long max_threads, bool verbose, long merge_threads = 1,
+    output_writer_kind output_writer = OUTPUT_WRITER_STDIO,
+    long output_width = 40L, std::string bwt_filename = std::string(""),
+    bool resume = false, bool pack_psa = false,
+    std::vector<std::string> temp_dirs = std::vector<std::string>(),
+    std::string da_filename = std::string("")) {
   if (ram_use < 6L) {
     fprintf(stderr, "Error: not enough memory to run pSAscan.\n");
     std::exit(EXIT_FAILURE);
   }
+
+  // The buffers of readers and writers (megabytes each, allocated by the
+  // streaming and I/O threads) are returned to the system when freed.
+  // Otherwise, glibc raises the mmap threshold after the first such buffer
+  // is freed, and the later ones stay in the per-thread malloc arenas
+  // after the step that used them, adding up to megabytes per thread.
+  mallopt(M_MMAP_THRESHOLD, k_mmap_threshold);
   
   // Turn paths absolute.
-  input_filename = utils::absolute_path(input_filename);
+  for (size_t i = 0; i < input_filenames.size(); ++i)
+    input_filenames[i] = utils::absolute_path(input_filenames[i]);
   output_filename = utils::absolute_path(output_filename);
   gap_filename = utils::absolute_path(gap_filename);
-  long length = utils::file_size(input_filename);
-  fprintf(stderr, "Input filename = %s\n", input_filename.c_str());
+  if (!bwt_filename.empty())
+    bwt_filename = utils::absolute_path(bwt_filename);
+  if (!da_filename.empty())
+    da_filename = utils::absolute_path(da_filename);
+  temp_file_placement temp(output_filename, gap_filename, temp_dirs);
+  concatenated_text text(input_filenames);
+  long length = text.length();
+  if (text.n_files() == 1)
+    fprintf(stderr, "Input filename = %s\n", text.filename(0).c_str());
+  else fprintf(stderr, "Input filenames = %s, ... (%ld files)\n",
+      text.filename(0).c_str(), text.n_files());
   fprintf(stderr, "Output filename = %s\n", output_filename.c_str());
-  fprintf(stderr, "Gap filename = %s\n", gap_filename.c_str());
+  if (temp.dirs().empty())
+    fprintf(stderr, "Gap filename = %s\n", gap_filename.c_str());
+  for (size_t i = 0; i < temp.dirs().size(); ++i)
+    fprintf(stderr, "Temporary directory = %s\n", temp.dirs()[i].c_str());
+  if (!bwt_filename.empty())
+    fprintf(stderr, "BWT filename = %s\n", bwt_filename.c_str());
+  if (!da_filename.empty())
+    fprintf(stderr, "Document array filename = %s\n", da_filename.c_str());
   fprintf(stderr, "Input length = %ld (%.1LfMiB)\n", length, 1.L * length / (1L << 20));
+  if (output_width == OUTPUT_WIDTH_PACKED)
+    fprintf(stderr, "Output width = %ld bits (bit-packed)\n",
+        output_bits_per_value(output_width, length));
+  else fprintf(stderr, "Output width = %ld bits\n", output_width);
   fprintf(stderr, "\n");
 
-  long ram_for_threads = n_gap_buffers * gap_buf_size;  // for buffers
-  if (ram_use / 5.2L < (long double)(1L << 31))  // for oracle
-    ram_for_threads += max_threads * gap_buf_size;
-  else ram_for_threads += ((4.L / 5) * max_threads) * gap_buf_size;
-  ram_for_threads += max_threads * gap_buf_size;  // for temp
-  ram_for_threads += max_threads * (6L << 20);  // for reader/writer buffers
-
-  long ram_use_excluding_threads = ram_use - ram_for_threads;
-  if (ram_use_excluding_threads < 6L) {
-    long required_MiB = (ram_for_threads + (1L << 20) - 1) / (1L << 20);
-    fprintf(stderr, "Error: not enough memory to start threads. You need "
-        "at least %ldMiB\n", required_MiB + 1);
+  if (output_width == 32L && length > (1L << 32)) {
+    fprintf(stderr, "Error: the input is too long for 32-bit output.\n");
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (!da_filename.empty() && text.n_files() > (1L << 32)) {
+    fprintf(stderr, "Error: too many input files for the document array.\n");
     std::exit(EXIT_FAILURE);
   }
 
-  fprintf(stderr, "RAM budget = %ld (%.1LfMiB)\n", ram_use, 1.L * ram_use / (1L << 20));
-  fprintf(stderr, "RAM budget (excluding threads) = %ld (%.1LfMiB)\n",
-      ram_use_excluding_threads, 1.L * ram_use_excluding_threads / (1L << 20));
-  long max_block_size = std::max(2L, (long)(ram_use_excluding_threads / 5.2L));
+  // Choose the block size and buffer sizes based
+  // on the model of RAM usage of process_block().
+  fprintf(stderr, "RAM budget = %ld (%.1LfMiB)\n\n", ram_use, 1.L * ram_use / (1L << 20));
+  memory_plan plan = plan_memory(ram_use, length, max_threads);
+  print_memory_plan(plan);
+  long max_block_size = plan.m_max_block_size;
+
+  // Start the threads running the parallel steps of
+  // the block processing (see thread_pool.hpp).
+  thread_pool::start(max_threads);
 
-  fprintf(stderr, "Max block size = %ld (%.1LfMiB)\n\n", max_block_size, 1.L * max_block_size / (1L << 20));
   fprintf(stderr, "Parallel settings:\n");
   fprintf(stderr, "  #streaming threads = %ld\n", max_threads);
-  fprintf(stderr, "  #gap buffers = %ld\n", n_gap_buffers);
-  fprintf(stderr, "  gap buffer size = %ld\n\n", gap_buf_size);
+  fprintf(stderr, "  #merging threads = %ld\n", merge_threads);
+  fprintf(stderr, "  #pool threads = %ld\n", thread_pool::get().n_threads());
+  fprintf(stderr, "Output writer = %s\n",
+      output_writer == OUTPUT_WRITER_MMAP ? "mmap" :
+      output_writer == OUTPUT_WRITER_DIRECT ? "direct" : "stdio");
+  fprintf(stderr, "I/O engine = %s\n",
+      io_uring_engine::enabled() ? "uring" : "threads");
+  fprintf(stderr, "File descriptor pool = %ld\n", fd_pool::capacity());
+  if (numa::enabled())
+    fprintf(stderr, "NUMA nodes = %ld\n", numa::n_nodes());
+  fprintf(stderr, "Huge pages = %s%s\n", huge_pages::mode_name(),
+      huge_pages::mlock_enabled() ? " (mlock)" : "");
+  fprintf(stderr, "Partial SAs on disk = %s\n\n",
+      pack_psa ? "bit-packed" : "raw");
 
-  // Check if the maximum number of open files
-  // is large enough for the merging to work.
-  long n_half_blocks_estimated = 2L * (length / max_block_size + 1);
-  long merge_max_open_files_estimated = 2L * n_half_blocks_estimated;
+  // Check if the maximum number of open files is large enough. The
+  // merging reads the partial SAs and gap arrays using descriptors
+  // from a pool of fixed size (see fd_pool.hpp), so the number of
+  // files does not depend on the input. The pool and the io_uring
+  // rings take at most half of the limit, the files used by the
+  // streaming threads or the output of merging threads (with
+  // the helper I/O threads) have to fit into the other half.
   long stream_max_open_files_estimated = 3L * max_threads + 1;
-  long max_open_files_estimated = std::max(merge_max_open_files_estimated, stream_max_open_files_estimated);
+  long merge_max_open_files_estimated = 3L * merge_threads + 1;
+  long max_open_files_estimated = 2L * std::max(
+      merge_max_open_files_estimated, stream_max_open_files_estimated);
   rlimit rlimit_res;
   if (!getrlimit(RLIMIT_NOFILE, &rlimit_res) &&
       (long)rlimit_res.rlim_cur < max_open_files_estimated) {
@@ -113,21 +212,71 @@ void pSAscan(std::string input_filename, std::string output_filename,
     std::exit(EXIT_FAILURE);
   }
 
+  // With --resume, the state of the computation is saved after each
+  // block. The checkpoint and the files it refers to are deleted when
+  // the merging completes, i.e., also the merging can be resumed.
+  std::string checkpoint_filename = output_filename + ".checkpoint";
+
   long double start = utils::wclock();
-  if (max_block_size < (1L << 31)) {
-    std::vector<half_block_info<int> > hblock_info = partial_sufsort<int>(input_filename,
-        output_filename, gap_filename, length, max_block_size, ram_use, max_threads, gap_buf_size, verbose);
-    merge<int>(output_filename, ram_use, hblock_info);
+  long peak_rss_after_blocks = 0;
+  if (plan.m_block_offset_size == (long)sizeof(int)) {
+    std::vector<half_block_info<int> > hblock_info = partial_sufsort<int>(&text,
+        temp, length, plan, ram_use, max_threads, verbose,
+        !bwt_filename.empty(), checkpoint_filename, resume, pack_psa);
+    peak_rss_after_blocks = utils::peak_rss();
+    std::vector<std::string> merge_input = merge_input_files(hblock_info, resume);
+    merge<int>(output_filename, plan.m_merge_ram, hblock_info, merge_threads,
+        output_writer, output_width, bwt_filename, &text, da_filename);
+    delete_merge_input(checkpoint_filename, merge_input);
   } else {
-    std::vector<half_block_info<uint40> > hblock_info = partial_sufsort<uint40>(input_filename,
-        output_filename, gap_filename, length, max_block_size, ram_use, max_threads, gap_buf_size, verbose);
-    merge<uint40>(output_filename, ram_use, hblock_info);
+    std::vector<half_block_info<uint40> > hblock_info = partial_sufsort<uint40>(&text,
+        temp, length, plan, ram_use, max_threads, verbose,
+        !bwt_filename.empty(), checkpoint_filename, resume, pack_psa);
+    peak_rss_after_blocks = utils::peak_rss();
+    std::vector<std::string> merge_input = merge_input_files(hblock_info, resume);
+    merge<uint40>(output_filename, plan.m_merge_ram, hblock_info, merge_threads,
+        output_writer, output_width, bwt_filename, &text, da_filename);
+    delete_merge_input(checkpoint_filename, merge_input);
   }
   long double total_time = utils::wclock() - start;
 
   fprintf(stderr, "\n\nComputation finished. Summary:\n");
   fprintf(stderr, "  elapsed time: %.2Lfs (%.4Lfs/MiB)\n", total_time, total_time / ((1.L * length) / (1L << 20)));
   fprintf(stderr, "  speed: %.2LfMiB/s\n", ((1.L * length) / (1L << 20)) / total_time);
+  fprintf(stderr, "  peak RAM usage (processing blocks): predicted %.1LfMiB, "
+      "actual RSS %.1LfMiB\n", 1.L * plan.m_predicted_peak / (1L << 20),
+      1.L * peak_rss_after_blocks / (1L << 20));
+  fprintf(stderr, "  peak RAM usage (total): budget %.1LfMiB, actual RSS %.1LfMiB\n",
+      1.L * ram_use / (1L << 20), 1.L * utils::peak_rss() / (1L << 20));
+  long double huge_page_coverage = huge_pages::total_bytes() ?
+    (1.L * huge_pages::huge_bytes()) / huge_pages::total_bytes() : 0.L;
+  fprintf(stderr, "  huge pages: %.1LfMiB of %.1LfMiB in large arrays (%.1Lf%%)",
+      1.L * huge_pages::huge_bytes() / (1L << 20),
+      1.L * huge_pages::total_bytes() / (1L << 20), 100.L * huge_page_coverage);
+  if (huge_pages::mlock_enabled())
+    fprintf(stderr, ", locked %.1LfMiB", 1.L * huge_pages::locked_bytes() / (1L << 20));
+  fprintf(stderr, "\n");
+  long n_large_arrays = huge_pages::arena_hits() + huge_pages::arena_misses();
+  if (huge_pages::arena_bytes() > 0)
+    fprintf(stderr, "  block arena: %.1LfMiB of pages reused, %ld of %ld large "
+        "arrays from the arena, peak %.1LfMiB (capacity %.1LfMiB)\n",
+        1.L * huge_pages::arena_reused_bytes() / (1L << 20),
+        huge_pages::arena_hits(), n_large_arrays,
+        1.L * huge_pages::arena_peak_bytes() / (1L << 20),
+        1.L * huge_pages::arena_bytes() / (1L << 20));
+
+  run_stats::set_value("input_length", length);
+  run_stats::set_value("ram_budget", ram_use);
+  run_stats::set_value("max_block_size", max_block_size);
+  run_stats::set_value("streaming_threads", max_threads);
+  run_stats::set_value("merging_threads", merge_threads);
+  run_stats::set_value("time", total_time);
+  run_stats::set_value("speed_mib_s", ((1.L * length) / (1L << 20)) / total_time);
+  run_stats::set_value("peak_rss_blocks", peak_rss_after_blocks);
+  run_stats::set_value("peak_rss", utils::peak_rss());
+  run_stats::set_value("huge_page_coverage", huge_page_coverage);
+  run_stats::set_value("block_arena_reused", huge_pages::arena_reused_bytes());
+  run_stats::write();
 }
 
 }  // namespace psascan_private
@@ -135,9 +284,32 @@ void pSAscan(std::string input_filename, std::string output_filename,
 
 // The main function.
 void pSAscan(std::string input_filename, std::string output_filename,
-    std::string gap_filename, long ram_use, long max_threads, bool verbose) {
-  psascan_private::pSAscan(input_filename, output_filename,
-      gap_filename, ram_use, max_threads, verbose);
+    std::string gap_filename, long ram_use, long max_threads, bool verbose,
+    long merge_threads = 1, psascan_private::output_writer_kind output_writer =
+    psascan_private::OUTPUT_WRITER_STDIO, long output_width = 40L,
+    std::string bwt_filename = std::string(""), bool resume = false,
+    bool pack_psa = false,
+    std::vector<std::string> temp_dirs = std::vector<std::string>()) {
+  psascan_private::pSAscan(std::vector<std::string>(1, input_filename),
+      output_filename, gap_filename, ram_use, max_threads, verbose,
+      merge_threads, output_writer, output_width, bwt_filename, resume,
+      pack_psa, temp_dirs);
+}
+
+// Suffix array (and optionally the document array) of the
+// concatenation of input files (a generalized suffix array).
+void pSAscan(std::vector<std::string> input_filenames,
+    std::string output_filename, std::string gap_filename, long ram_use,
+    long max_threads, bool verbose, long merge_threads = 1,
+    psascan_private::output_writer_kind output_writer =
+    psascan_private::OUTPUT_WRITER_STDIO, long output_width = 40L,
+    std::string bwt_filename = std::string(""), bool resume = false,
+    bool pack_psa = false,
+    std::vector<std::string> temp_dirs = std::vector<std::string>(),
+    std::string da_filename = std::string("")) {
+  psascan_private::pSAscan(input_filenames, output_filename, gap_filename,
+      ram_use, max_threads, verbose, merge_threads, output_writer,
+      output_width, bwt_filename, resume, pack_psa, temp_dirs, da_filename);
 }
 
 #endif  // __SRC_PSASCAN_SRC_PSASCAN_HPP_INCLUDED
@@ -64,9 +64,10 @@
 
 #include <algorithm>
 #include <vector>
-#include <thread>
 
 #include "utils/utils.hpp"
+#include "utils/huge_pages.hpp"
+#include "utils/thread_pool.hpp"
 
 
 namespace psascan_private {
@@ -126,7 +127,8 @@ class rank4n {
       m_cblock_header2 = (unsigned long *)malloc(n_cblocks * k_sigma * sizeof(unsigned long));
       m_cblock_mapping = (unsigned char *)malloc(n_cblocks * k_sigma * 2);
       m_cblock_type = (unsigned char *)malloc((n_cblocks + 7) / 8);
-      m_freq_trunk = (unsigned *)calloc(n_cblocks * k_cblock_size, sizeof(unsigned));
+      m_freq_trunk = (unsigned *)huge_pages::allocate(
+          n_cblocks * k_cblock_size * sizeof(unsigned), true, true);
       std::fill(m_cblock_type, m_cblock_type + (n_cblocks + 7) / 8, 0);
 
       encode_type_I(text, max_threads);
@@ -138,13 +140,14 @@ class rank4n {
     void encode_type_I(const unsigned char *text, long max_threads) {
       //------------------------------------------------------------------------
       // STEP 1: split all cblocks into equal size ranges (except possible the
-      //         last one). Each range is processed by one thread. During this
+      //         last one). Each range is processed by one task. During this
       //         step we compute: (i) type of each cblock, (ii) encode all
       //         type-I cblocks and for all type-II cblocks, we compute and
       //         store: symbol mapping, symbol type (freq / rare / non-occurring)
       //         and values of freq_cnt_log and rare_cnt_log.
       //------------------------------------------------------------------------
-      unsigned long range_size = (n_cblocks + max_threads - 1) / max_threads;
+      unsigned long n_tasks = max_threads * thread_pool::k_tasks_per_thread;
+      unsigned long range_size = (n_cblocks + n_tasks - 1) / n_tasks;
       unsigned long n_ranges = (n_cblocks + range_size - 1) / range_size;
 
       unsigned long *rare_trunk_size = new unsigned long[n_cblocks];
@@ -153,26 +156,15 @@ class rank4n {
       bool *cblock_type = new bool[n_cblocks];
       std::fill(cblock_type, cblock_type + n_cblocks, 0);
 
-      unsigned **occ = (unsigned **)malloc(n_ranges * sizeof(unsigned *));
-      for (unsigned long i = 0; i < n_ranges; ++i)
-        occ[i] = (unsigned *)malloc((k_cblock_size + 1) * sizeof(unsigned));
-
-      std::thread **threads = new std::thread*[n_ranges];
+      task_group tasks;
       for (unsigned long i = 0; i < n_ranges; ++i) {
         unsigned long range_beg = i * range_size;
         unsigned long range_end = std::min(range_beg + range_size, n_cblocks);
 
-        threads[i] = new std::thread(encode_type_I_aux, std::ref(*this),
-            text, range_beg, range_end, rare_trunk_size, cblock_type, occ[i]);
+        tasks.add(encode_type_I_aux, std::ref(*this), text, range_beg,
+            range_end, rare_trunk_size, cblock_type);
       }
-
-      for (unsigned long i = 0; i < n_ranges; ++i) threads[i]->join();
-      for (unsigned long i = 0; i < n_ranges; ++i) delete threads[i];
-      delete[] threads;
-
-      for (unsigned long i = 0; i < n_ranges; ++i)
-        free(occ[i]);
-      free(occ);
+      tasks.wait();
 
       //------------------------------------------------------------------------
       // STEP 2: compute global information based on local cblock computation:
@@ -221,7 +213,8 @@ class rank4n {
         m_count[k_sigma - 1] += k_cblock_size -
           ((m_cblock_header2[ptr + k_sigma - 1] >> 5) & k_2cblock_size_mask);
       }
-      m_rare_trunk = (unsigned *)calloc(rare_trunk_total_size, sizeof(unsigned));
+      m_rare_trunk = (unsigned *)huge_pages::allocate(
+          rare_trunk_total_size * sizeof(unsigned), true, true);
 
       delete[] cblock_type;
       delete[] rare_trunk_size;
@@ -229,11 +222,12 @@ class rank4n {
 
     static void encode_type_I_aux(rank4n &r, const unsigned char *text,
         unsigned long cblock_range_beg, unsigned long cblock_range_end,
-        unsigned long *rare_trunk_size, bool *cblock_type, unsigned *occ) {
+        unsigned long *rare_trunk_size, bool *cblock_type) {
       std::vector<std::pair<uint32_t, unsigned char> > sorted_chars;
       std::vector<unsigned char> freq_chars;
       std::vector<unsigned char> rare_chars;
 
+      unsigned *occ = (unsigned *)malloc((k_cblock_size + 1) * sizeof(unsigned));
       unsigned *refpoint_precomputed = (unsigned *)malloc(k_cblock_size * sizeof(unsigned));
       unsigned *cblock_count = new unsigned[k_sigma];
       unsigned *list_beg = new unsigned[k_sigma];
@@ -411,24 +405,23 @@ class rank4n {
       delete[] min_block_size_precomputed;
       delete[] refpoint_mask_precomputed;
       free(refpoint_precomputed);
+      free(occ);
     }
 
     void encode_type_II(const unsigned char *text, long max_threads) {
-      unsigned long range_size = (n_cblocks + max_threads - 1) / max_threads;
+      unsigned long n_tasks = max_threads * thread_pool::k_tasks_per_thread;
+      unsigned long range_size = (n_cblocks + n_tasks - 1) / n_tasks;
       unsigned long n_ranges = (n_cblocks + range_size - 1) / range_size;
 
-      std::thread **threads = new std::thread*[n_ranges];
+      task_group tasks;
       for (unsigned long i = 0; i < n_ranges; ++i) {
         unsigned long range_beg = i * range_size;
         unsigned long range_end = std::min(range_beg + range_size, n_cblocks);
 
-        threads[i] = new std::thread(encode_type_II_aux,
+        tasks.add(encode_type_II_aux,
             std::ref(*this), text, range_beg, range_end);
       }
-
-      for (unsigned long i = 0; i < n_ranges; ++i) threads[i]->join();
-      for (unsigned long i = 0; i < n_ranges; ++i) delete threads[i];
-      delete[] threads;
+      tasks.wait();
     }
 
     static void encode_type_II_aux(rank4n &r, const unsigned char *text,
@@ -714,8 +707,8 @@ class rank4n {
         free(m_cblock_header2);
         free(m_cblock_mapping);
         free(m_cblock_type);
-        free(m_freq_trunk);
-        free(m_rare_trunk);
+        huge_pages::deallocate(m_freq_trunk);
+        huge_pages::deallocate(m_rare_trunk);
       }
       free(m_count);
     }
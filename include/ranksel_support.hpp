@@ -34,10 +34,10 @@
 #ifndef __SRC_PSASCAN_SRC_RANKSEL_SUPPORT_HPP_INCLUDED
 #define __SRC_PSASCAN_SRC_RANKSEL_SUPPORT_HPP_INCLUDED
 
-#include <thread>
 #include <algorithm>
 
 #include "bitvector.hpp"
+#include "utils/thread_pool.hpp"
 
 
 namespace psascan_private {
@@ -75,21 +75,19 @@ struct ranksel_support {
     //
     // Compute the sum of 1-bits inside each chunk and write to m_sparse_rank.
     // Since there can be more chunks than threads, we split chunks
-    // into groups and let each thread handle the group of chunks.
-    long chunk_max_group_size = (n_chunks + max_threads - 1) / max_threads;
+    // into groups and let each task handle the group of chunks.
+    long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+    long chunk_max_group_size = (n_chunks + max_tasks - 1) / max_tasks;
     long n_chunk_groups = (n_chunks + chunk_max_group_size - 1) / chunk_max_group_size;
 
-    std::thread **threads = new std::thread*[n_chunk_groups];
+    task_group tasks;
     for (long t = 0; t < n_chunk_groups; ++t) {
       long chunk_group_beg = t * chunk_max_group_size;
       long chunk_group_end = std::min(chunk_group_beg + chunk_max_group_size, n_chunks);
-      threads[t] = new std::thread(process_group_of_chunks, chunk_group_beg,
+      tasks.add(process_group_of_chunks, chunk_group_beg,
           chunk_group_end, m_chunk_size, m_sparse_rank, m_bv);
     }
-
-    for (long t = 0; t < n_chunk_groups; ++t) threads[t]->join();
-    for (long t = 0; t < n_chunk_groups; ++t) delete threads[t];
-    delete[] threads;
+    tasks.wait();
     
     // 3
     //
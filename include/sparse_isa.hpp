@@ -44,7 +44,8 @@
 #define __SRC_PSASCAN_SRC_SPARSE_ISA_HPP_INCLUDED
 
 #include <algorithm>
-#include <thread>
+
+#include "utils/thread_pool.hpp"
 
 
 namespace psascan_private {
@@ -91,21 +92,19 @@ struct sparse_isa {
       long elems = (m_length + k_sampling_rate - 1) / k_sampling_rate + 1;
       m_sparse_isa = (long *)malloc(elems * sizeof(long));
 
-      long max_block_size = (m_length + max_threads - 1) / max_threads;
+      long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+      long max_block_size = (m_length + max_tasks - 1) / max_tasks;
       long n_blocks = (m_length + max_block_size - 1) / max_block_size;
 
-      std::thread **threads = new std::thread*[n_blocks];
+      task_group tasks;
       for (long t = 0; t < n_blocks; ++t) {
         long block_beg = t * max_block_size;
         long block_end = std::min(block_beg + max_block_size, m_length);
 
-        threads[t] = new std::thread(compute_sparse_isa_aux<saidx_t>, m_psa,
+        tasks.add(compute_sparse_isa_aux<saidx_t>, m_psa,
             block_beg, block_end, m_length, m_sparse_isa, std::ref(m_last_isa));
       }
-
-      for (long t = 0; t < n_blocks; ++t) threads[t]->join();
-      for (long t = 0; t < n_blocks; ++t) delete threads[t];
-      delete[] threads;
+      tasks.wait();
 
       m_count = (long *)malloc(k_sigma * sizeof(long));
       std::copy(rank->m_count, rank->m_count + k_sigma, m_count);
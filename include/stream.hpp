@@ -38,14 +38,16 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <vector>
 #include <mutex>
 #include <algorithm>
 
 #include "utils/utils.hpp"
+#include "utils/run_stats.hpp"
 #include "io/multifile.hpp"
 #include "io/multifile_bit_stream_reader.hpp"
 #include "io/async_multifile_bit_stream_reader.hpp"
-#include "io/async_backward_skip_stream_reader.hpp"
+#include "io/async_backward_text_reader.hpp"
 #include "io/async_bit_stream_writer.hpp"
 #include "rank.hpp"
 #include "gap_buffer.hpp"
@@ -57,26 +59,77 @@ namespace psascan_private {
 
 std::mutex stdout_mutex;
 
+//==============================================================================
+// Group the buckets (of 2^bucket_size_bits consecutive gap array entries)
+// into n_increasers super-buckets of about equal total size and permute
+// the b->m_filled values in temp into b, so that the values of each
+// super-bucket are contiguous. block_count[id] is the number of values
+// in bucket id. Returns false if the super-buckets are too unbalanced,
+// in which case the caller has to partition the buffer differently.
+//==============================================================================
 template<typename block_offset_type>
+bool permute_into_sblocks(const block_offset_type *temp,
+    const int *block_count, long n_buckets, long bucket_size_bits,
+    long n_increasers, int *block_id_to_sblock_id, int *oracle, long *ptr,
+    gap_buffer<block_offset_type> *b) {
+  long ideal_sblock_size = (b->m_filled + n_increasers - 1) / n_increasers;
+  long max_sbucket_size = 0;
+  long bucket_id_beg = 0;
+  for (long t = 0; t < n_increasers; ++t) {
+    long bucket_id_end = bucket_id_beg, size = 0L;
+    while (bucket_id_end < n_buckets && size < ideal_sblock_size)
+      size += block_count[bucket_id_end++];
+    b->sblock_size[t] = size;
+    max_sbucket_size = std::min(max_sbucket_size, size);
+    for (long id = bucket_id_beg; id < bucket_id_end; ++id)
+      block_id_to_sblock_id[id] = t;
+    bucket_id_beg = bucket_id_end;
+  }
+
+  if (max_sbucket_size >= 4L * ideal_sblock_size)
+    return false;
+
+  for (long t = 0, curbeg = 0; t < n_increasers; curbeg += b->sblock_size[t++])
+    b->sblock_beg[t] = ptr[t] = curbeg;
+
+  // Permute the elements of the buffer.
+  for (long t = 0; t < b->m_filled; ++t) {
+    long id = (temp[t] >> bucket_size_bits);
+    long sblock_id = block_id_to_sblock_id[id];
+    oracle[t] = ptr[sblock_id]++;
+  }
+
+  for (long t = 0; t < b->m_filled; ++t) {
+    long addr = oracle[t];
+    b->m_content[addr] = temp[t];
+  }
+
+  return true;
+}
+
+template<typename block_offset_type, typename rank_type>
 void parallel_stream(
     gap_buffer_poll<block_offset_type> *full_gap_buffers,
     gap_buffer_poll<block_offset_type> *empty_gap_buffers,
-    long stream_block_beg,
-    long stream_block_end,
-    block_offset_type i,
+    long tail_begin,
+    long tail_end,
+    long slice_length,
+    const std::vector<long> &initial_ranks,
     const long *count,
     block_offset_type whole_suffix_rank,
-    const rank4n<> *rank,
+    const rank_type *rank,
     unsigned char last,
-    std::string text_filename,
+    const concatenated_text *text,
     long length,
-    std::string &tail_gt_filename,
+    const std::vector<std::string> &tail_gt_filenames,
     stream_info *info,
     int thread_id,
     long gap_range_size,
     long gap_buf_size,
     const multifile *tail_gt_begin,
-    long n_increasers) {
+    long n_increasers,
+    const char *stats_step) {
+  long double thread_start = utils::wclock();
 
   static const int max_buckets = 4096;
   int *block_id_to_sblock_id = new int[max_buckets];
@@ -98,148 +151,129 @@ void parallel_stream(
   block_offset_type *bucket_lbound = new block_offset_type[n_increasers + 1];
 
   typedef async_multifile_bit_stream_reader bit_stream_reader_type;
-  typedef async_backward_skip_stream_reader<unsigned char> text_reader_type;
+  typedef async_backward_text_reader text_reader_type;
   typedef async_bit_stream_writer bit_stream_writer_type;
 
-  text_reader_type *text_streamer = new text_reader_type(text_filename, length - stream_block_end, 4L << 20);
-  bit_stream_writer_type *gt_out = new bit_stream_writer_type(tail_gt_filename, 1L << 20);
-  bit_stream_reader_type gt_in(tail_gt_begin, length - stream_block_end, 1L << 20);
-
-  long j = stream_block_end, dbg = 0L;
-  while (j > stream_block_beg) {
-    if (dbg > (1 << 26)) {
-      info->m_mutex.lock();
-      info->m_streamed[thread_id] = stream_block_end - j;
-      info->m_update_count += 1;
-      if (info->m_update_count == info->m_thread_count) {
-        info->m_update_count = 0L;
-        long double elapsed = utils::wclock() - info->m_timestamp;
-        long total_streamed = 0L;
-
-        for (long t = 0; t < info->m_thread_count; ++t)
-          total_streamed += info->m_streamed[t];
-        long double speed = (total_streamed / (1024.L * 1024)) / elapsed;
-
-        stdout_mutex.lock();
-        fprintf(stderr, "\r    Stream: %.2Lf%%. Time: %.2Lf. Speed: %.2LfMiB/s",
-            (total_streamed * 100.L) / info->m_tostream, elapsed, speed);
-        stdout_mutex.unlock();
+  // Stream the slices of the tail not yet taken by other threads.
+  long streamed = 0L, dbg = 0L;
+  for (long slice_id = info->get_slice(); slice_id != -1L; slice_id = info->get_slice()) {
+    long stream_block_beg = tail_begin + slice_id * slice_length;
+    long stream_block_end = std::min(stream_block_beg + slice_length, tail_end);
+    block_offset_type i = (block_offset_type)initial_ranks[slice_id];
+
+    text_reader_type *text_streamer = new text_reader_type(text, length - stream_block_end, 4L << 20);
+    bit_stream_writer_type *gt_out = new bit_stream_writer_type(tail_gt_filenames[slice_id], 1L << 20);
+    bit_stream_reader_type gt_in(tail_gt_begin, length - stream_block_end, 1L << 20);
+
+    long j = stream_block_end;
+    while (j > stream_block_beg) {
+      if (dbg > (1 << 26)) {
+        info->m_mutex.lock();
+        info->m_streamed[thread_id] = streamed + (stream_block_end - j);
+        info->m_update_count += 1;
+        if (info->m_update_count == info->m_thread_count) {
+          info->m_update_count = 0L;
+          long double elapsed = utils::wclock() - info->m_timestamp;
+          long total_streamed = 0L;
+
+          for (long t = 0; t < info->m_thread_count; ++t)
+            total_streamed += info->m_streamed[t];
+          long double speed = (total_streamed / (1024.L * 1024)) / elapsed;
+
+          stdout_mutex.lock();
+          fprintf(stderr, "\r    Stream: %.2Lf%%. Time: %.2Lf. Speed: %.2LfMiB/s",
+              (total_streamed * 100.L) / info->m_tostream, elapsed, speed);
+          stdout_mutex.unlock();
+        }
+        info->m_mutex.unlock();
+        dbg = 0L;
       }
-      info->m_mutex.unlock();
-      dbg = 0L;
-    }
 
-    // Get a gap buffer from the poll of empty buffers.
-    std::unique_lock<std::mutex> lk(empty_gap_buffers->m_mutex);
-    while (!empty_gap_buffers->available())
-      empty_gap_buffers->m_cv.wait(lk);
+      // Get a gap buffer from the poll of empty buffers.
+      std::unique_lock<std::mutex> lk(empty_gap_buffers->m_mutex);
+      while (!empty_gap_buffers->available())
+        empty_gap_buffers->m_cv.wait(lk);
 
-    gap_buffer<block_offset_type> *b = empty_gap_buffers->get();
-    lk.unlock();
-    empty_gap_buffers->m_cv.notify_one(); // let others know they should re-check
+      gap_buffer<block_offset_type> *b = empty_gap_buffers->get();
+      lk.unlock();
+      empty_gap_buffers->m_cv.notify_one(); // let others know they should re-check
 
-    // Process buffer -- fill with gap values.
-    long left = j - stream_block_beg;
-    b->m_filled = std::min(left, b->m_size);
-    dbg += b->m_filled;
-    std::fill(block_count, block_count + n_buckets, 0);
+      // Process buffer -- fill with gap values.
+      long left = j - stream_block_beg;
+      b->m_filled = std::min(left, b->m_size);
+      dbg += b->m_filled;
+      std::fill(block_count, block_count + n_buckets, 0);
 
-    for (long t = 0L; t < b->m_filled; ++t, --j) {
-      unsigned char c = text_streamer->read();
+      for (long t = 0L; t < b->m_filled; ++t, --j) {
+        unsigned char c = text_streamer->read();
 
-      gt_out->write(i > whole_suffix_rank);
-      bool next_gt = (gt_in.read());
+        gt_out->write(i > whole_suffix_rank);
+        bool next_gt = (gt_in.read());
 
-      int delta = (i > whole_suffix_rank && c == 0);
-      i = (block_offset_type)(count[c] + rank->rank((long)i, c) - delta);
-      if (c == last && next_gt) ++i;
-      temp[t] = i;
-      block_count[i >> bucket_size_bits]++;
-    }
-
-    // Compute super-buckets.
-    long ideal_sblock_size = (b->m_filled + n_increasers - 1) / n_increasers;
-    long max_sbucket_size = 0;
-    long bucket_id_beg = 0;
-    for (long t = 0; t < n_increasers; ++t) {
-      long bucket_id_end = bucket_id_beg, size = 0L;
-      while (bucket_id_end < n_buckets && size < ideal_sblock_size)
-        size += block_count[bucket_id_end++];
-      b->sblock_size[t] = size;
-      max_sbucket_size = std::min(max_sbucket_size, size);
-      for (long id = bucket_id_beg; id < bucket_id_end; ++id)
-        block_id_to_sblock_id[id] = t;
-      bucket_id_beg = bucket_id_end;
-    }
-
-    if (max_sbucket_size < 4L * ideal_sblock_size) {
-      for (long t = 0, curbeg = 0; t < n_increasers; curbeg += b->sblock_size[t++])
-        b->sblock_beg[t] = ptr[t] = curbeg;
-
-      // Permute the elements of the buffer.
-      for (long t = 0; t < b->m_filled; ++t) {
-        long id = (temp[t] >> bucket_size_bits);
-        long sblock_id = block_id_to_sblock_id[id];
-        oracle[t] = ptr[sblock_id]++;
+        int delta = (i > whole_suffix_rank && c == 0);
+        i = (block_offset_type)(count[c] + rank->rank((long)i, c) - delta);
+        if (c == last && next_gt) ++i;
+        temp[t] = i;
+        block_count[i >> bucket_size_bits]++;
       }
 
-      for (long t = 0; t < b->m_filled; ++t) {
-        long addr = oracle[t];
-        b->m_content[addr] = temp[t];
-      }
-    } else {
-      // Repeat the partition into sbuckets, this time using random sample.
-      // This is a fallback mechanism in case the quick partition failed.
-      // It is not suppose to happen to often.
-
-      // Compute random sample of elements in the buffer.
-      for (long t = 0; t < buffer_sample_size; ++t)
-        samples[t] = temp[utils::random_long(0L, b->m_filled - 1)];
-      std::sort(samples.begin(), samples.end());
-      samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
-
-      // Compute bucket boundaries (lower bound is enough).
-      std::fill(bucket_lbound, bucket_lbound + n_increasers + 1, gap_range_size);
-
-      long step = (samples.size() + n_increasers - 1) / n_increasers;
-      for (size_t t = 1, p = step; p < samples.size(); ++t, p += step)
-        bucket_lbound[t] = (samples[p - 1] + samples[p] + 1) / 2;
-      bucket_lbound[0] = 0;
-
-      // Compute bucket sizes and sblock id into oracle array.
-      std::fill(b->sblock_size, b->sblock_size + n_increasers, 0L);
-      for (long t = 0; t < b->m_filled; ++t) {
-        block_offset_type x = temp[t];
-        int id = n_increasers;
-        while (bucket_lbound[id] > x) --id;
-        oracle[t] = id;
-        b->sblock_size[id]++;
+      // Compute super-buckets and permute the buffer.
+      if (!permute_into_sblocks(temp, block_count, n_buckets, bucket_size_bits,
+            n_increasers, block_id_to_sblock_id, oracle, ptr, b)) {
+        // Repeat the partition into sbuckets, this time using random sample.
+        // This is a fallback mechanism in case the quick partition failed.
+        // It is not suppose to happen to often.
+
+        // Compute random sample of elements in the buffer.
+        for (long t = 0; t < buffer_sample_size; ++t)
+          samples[t] = temp[utils::random_long(0L, b->m_filled - 1)];
+        std::sort(samples.begin(), samples.end());
+        samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+
+        // Compute bucket boundaries (lower bound is enough).
+        std::fill(bucket_lbound, bucket_lbound + n_increasers + 1, gap_range_size);
+
+        long step = (samples.size() + n_increasers - 1) / n_increasers;
+        for (size_t t = 1, p = step; p < samples.size(); ++t, p += step)
+          bucket_lbound[t] = (samples[p - 1] + samples[p] + 1) / 2;
+        bucket_lbound[0] = 0;
+
+        // Compute bucket sizes and sblock id into oracle array.
+        std::fill(b->sblock_size, b->sblock_size + n_increasers, 0L);
+        for (long t = 0; t < b->m_filled; ++t) {
+          block_offset_type x = temp[t];
+          int id = n_increasers;
+          while (bucket_lbound[id] > x) --id;
+          oracle[t] = id;
+          b->sblock_size[id]++;
+        }
+
+        // Permute elements into their own buckets using oracle.
+        for (long t = 0, curbeg = 0; t < n_increasers; curbeg += b->sblock_size[t++])
+          b->sblock_beg[t] = ptr[t] = curbeg;
+
+        for (long t = 0; t < b->m_filled; ++t) {
+          long sblock_id = oracle[t];
+          oracle[t] = ptr[sblock_id]++;
+        }
+
+        for (long t = 0; t < b->m_filled; ++t) {
+          long addr = oracle[t];
+          b->m_content[addr] = temp[t];
+        }
       }
 
-      // Permute elements into their own buckets using oracle.
-      for (long t = 0, curbeg = 0; t < n_increasers; curbeg += b->sblock_size[t++])
-        b->sblock_beg[t] = ptr[t] = curbeg;
-
-      for (long t = 0; t < b->m_filled; ++t) {
-        long sblock_id = oracle[t];
-        oracle[t] = ptr[sblock_id]++;
-      }
-
-      for (long t = 0; t < b->m_filled; ++t) {
-        long addr = oracle[t];
-        b->m_content[addr] = temp[t];
-      }
+      // Add the buffer to the poll of full buffers and notify waiting thread.
+      std::unique_lock<std::mutex> lk2(full_gap_buffers->m_mutex);
+      full_gap_buffers->add(b);
+      lk2.unlock();
+      full_gap_buffers->m_cv.notify_one();
     }
 
-    // Add the buffer to the poll of full buffers and notify waiting thread.
-    std::unique_lock<std::mutex> lk2(full_gap_buffers->m_mutex);
-    full_gap_buffers->add(b);
-    lk2.unlock();
-    full_gap_buffers->m_cv.notify_one();
+    delete text_streamer;
+    delete gt_out;
+    streamed += stream_block_end - stream_block_beg;
   }
-
-  delete text_streamer;
-  delete gt_out;
   
   // Report that another worker thread has finished.
   std::unique_lock<std::mutex> lk(full_gap_buffers->m_mutex);
@@ -256,6 +290,10 @@ void parallel_stream(
   delete[] oracle;
   delete[] ptr;
   delete[] bucket_lbound;
+
+  long gt_bytes = (streamed + 7L) / 8L;
+  run_stats::add_thread(stats_step, thread_id, utils::wclock() - thread_start,
+      streamed, streamed + gt_bytes, gt_bytes);
 }
 
 }  // namespace psascan_private
@@ -43,13 +43,35 @@
 namespace psascan_private {
 
 //=============================================================================
-// Used to store progress information for different threads during streaming.
+// Return the length of slices into which the tail is split for streaming.
+// There are up to k_stream_slices_per_thread slices per thread, so that a
+// thread that finished its slice early can pick up the next one instead of
+// staying idle until the slowest thread is done. Slices shorter than
+// k_min_stream_slice_length are only used if otherwise some threads would
+// get no slice at all. The same slices are used when computing the initial
+// ranks, which are needed for every slice.
+//=============================================================================
+const long k_stream_slices_per_thread = 4L;
+const long k_min_stream_slice_length = (8L << 20);
+
+inline long stream_slice_length(long tail_length, long max_threads) {
+  long max_slice_length = (tail_length + max_threads - 1) / max_threads;
+  long n_slices = max_threads * k_stream_slices_per_thread;
+  long slice_length = (tail_length + n_slices - 1) / n_slices;
+  return std::max(slice_length, std::min(max_slice_length, k_min_stream_slice_length));
+}
+
+//=============================================================================
+// Used to store progress information for different threads during streaming
+// and to hand out the slices of the tail to the threads.
 //=============================================================================
 struct stream_info {
-  stream_info(long thread_count, long tostream)
+  stream_info(long thread_count, long tostream, long slice_count)
     : m_update_count(0L),
       m_thread_count(thread_count),
-      m_tostream(tostream) {
+      m_tostream(tostream),
+      m_slice_count(slice_count),
+      m_next_slice(0L) {
     m_streamed = new long[thread_count];
     std::fill(m_streamed, m_streamed + thread_count, 0L);
 
@@ -67,9 +89,18 @@ struct stream_info {
     delete[] m_idle_update;
   }
 
+  // Return the id of the next slice to stream or -1 if all slices were taken.
+  long get_slice() {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    if (m_next_slice == m_slice_count) return -1L;
+    else return m_next_slice++;
+  }
+
   long m_update_count;     // number of updates
   long m_thread_count;     // number of threads
   long m_tostream;         // total text length to stream
+  long m_slice_count;      // number of slices of the tail
+  long m_next_slice;       // first slice not yet taken by any thread
   long double m_timestamp; // when the streaming started
   long *m_streamed;        // how many bytes streamed by each thread
   long double *m_idle_update;
@@ -48,6 +48,7 @@ class uint40 {
     uint40() {}
     uint40(std::uint32_t l, std::uint8_t h) : low(l), high(h) {}
     uint40(const uint40& a) : low(a.low), high(a.high) {}
+    uint40& operator=(const uint40& a) = default;
     uint40(const std::int32_t& a) : low(a), high(0) {}
     uint40(const std::uint32_t& a) : low(a), high(0) {}
     uint40(const std::uint64_t& a) :
@@ -36,6 +36,8 @@
 
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <vector>
 #include <condition_variable>
 #include <algorithm>
 
@@ -49,10 +51,19 @@ namespace psascan_private {
 
 //==============================================================================
 // This object creates a given number of threads that will perform gap array
-// updates. Most of the time all threads are sleeping on a conditional variable.
-// Once the gap buffer is available for processing, they are all woken up and
-// perform the update in parallel. The caller then waits until all threads are
-// finished and then puts the gap buffer in the poll of empty buffers.
+// updates. The threads are persistent: after finishing their part of a gap
+// buffer, they spin for a short while waiting for the next buffer, and only
+// then go to sleep on a condition variable, so that when the buffers arrive
+// in quick succession (which is when the streaming threads would wait for
+// empty buffers), no thread is put to sleep or woken up. A new buffer is
+// announced by incrementing the generation counter, and every thread reports
+// finishing its part by decrementing the number of pending parts, which the
+// caller waits for (again, spinning first and then sleeping until the last
+// thread to finish its part wakes it up).
+//
+// The wrapped-around counts (excess values) are collected in a local buffer
+// of each thread and only added to the gap array when the buffer gets full,
+// or when the updater is destroyed.
 //
 // Only one object of this class should exist.
 //==============================================================================
@@ -61,73 +72,64 @@ struct gap_parallel_updater {
 
   template<typename T>
   static void parallel_update(gap_parallel_updater<T> *updater, int id) {
+    std::vector<long> excess;
+    excess.reserve(k_local_excess);
+    long seen_generation = 0L;
     while (true) {
+
       // Wait until there is a gap buffer available or the
       // message 'no more buffers' arrives.
-      std::unique_lock<std::mutex> lk(updater->m_avail_mutex);
-      while (!(updater->m_avail[id]) && !(updater->m_avail_no_more))
-        updater->m_avail_cv.wait(lk);
+      long generation = updater->wait_for_generation(seen_generation);
+      if (generation == k_no_more) {
 
-      if (!(updater->m_avail[id]) && updater->m_avail_no_more) {
         // No more buffers -- exit.
-        lk.unlock();
+        updater->m_gap_array->add_excess(excess.data(), (long)excess.size());
         return;
       }
-
-      updater->m_avail[id] = false;
-      lk.unlock();
+      seen_generation = generation;
 
       // Safely perform the update.
       gap_buffer<T> *buf = updater->m_buffer;
       buffered_gap_array *gap = updater->m_gap_array;
-      int beg = buf->sblock_beg[id];
-      int end = beg + buf->sblock_size[id];
+      long beg = buf->sblock_beg[id];
+      long end = beg + buf->sblock_size[id];
+      unsigned char *count = gap->m_count;
 
-      for (int i = beg; i < end; ++i) {
+      for (long i = beg; i < end; ++i) {
         T x = buf->m_content[i];
-        gap->m_count[x]++;
 
         // Check if values wrapped-around.
-        if (gap->m_count[x] == 0L) {
-          gap->m_excess_mutex.lock();
-          gap->add_excess(x);
-          gap->m_excess_mutex.unlock();
+        if (++count[x] == 0) {
+          excess.push_back(x);
+          if ((long)excess.size() == k_local_excess) {
+            gap->add_excess(excess.data(), (long)excess.size());
+            excess.clear();
+          }
         }
       }
 
-      // Update the number of finished threads.
-      bool finished_last = false;
-      std::unique_lock<std::mutex> lk2(updater->m_finished_mutex);
-      updater->m_finished++;
-      if (updater->m_finished == updater->m_threads_cnt)
-        finished_last = true;
-      lk2.unlock();
-
-      // If this was the last thread finishing, let the caller know.
-      if (finished_last)
-        updater->m_finished_cv.notify_one();
+      // Let the caller know that this part of the buffer is done.
+      if (updater->m_pending.fetch_sub(1L) == 1L)
+        updater->notify_done();
     }
   }
 
   gap_parallel_updater(buffered_gap_array *gap_array, int threads_cnt)
       : m_gap_array(gap_array),
         m_threads_cnt(threads_cnt),
-        m_avail_no_more(false) {
-    m_avail = new bool[m_threads_cnt];
-    std::fill(m_avail, m_avail + m_threads_cnt, false);
+        m_generation(0L),
+        m_pending(0L),
+        m_sleeping(0L),
+        m_caller_sleeping(false) {
     m_threads = new std::thread*[m_threads_cnt];
-
-    // After this, threads immediately hang up on m_avail_cv.
     for (int i = 0; i < m_threads_cnt; ++i)
       m_threads[i] = new std::thread(parallel_update<block_offset_type>, this, i);
   }
 
   ~gap_parallel_updater() {
+
     // Signal all threads to finish.
-    std::unique_lock<std::mutex> lk(m_avail_mutex);
-    m_avail_no_more = true;
-    lk.unlock();
-    m_avail_cv.notify_all();
+    publish(k_no_more);
 
     // Wait until all threads finish and release memory.
     for (int i = 0; i < m_threads_cnt; ++i) {
@@ -135,32 +137,76 @@ struct gap_parallel_updater {
       delete m_threads[i];
     }
     delete[] m_threads;
-    delete[] m_avail;
   }
 
   void update(gap_buffer<block_offset_type> *buffer) {
-    // Prepare a message for each thread that new buffer is available.
-    std::unique_lock<std::mutex> lk(m_avail_mutex);
-    m_finished = 0;
-    m_buffer = buffer;
-    for (int i = 0; i < m_threads_cnt; ++i)
-      m_avail[i] = true;
-    lk.unlock();
 
-    // Wake up all threads to perform the update.
-    m_avail_cv.notify_all();
+    // Hand the buffer to the threads.
+    m_buffer = buffer;
+    m_pending.store(m_threads_cnt, std::memory_order_relaxed);
+    publish(m_generation.load(std::memory_order_relaxed) + 1);
 
     // Wait until all threads report that they are done.
-    std::unique_lock<std::mutex> lk2(m_finished_mutex);
-    while (m_finished != m_threads_cnt)
-      m_finished_cv.wait(lk2);
-    lk2.unlock();
+    wait_for_done();
 
     // We are done processing the buffer. The caller of this method
     // can now place the buffer into the poll of empty buffers.
   }
 
 private:
+  static const long k_no_more = -1L;
+  static const long k_spin_iterations = (1L << 14);
+  static const long k_local_excess = (1L << 16);
+
+  // Make the new generation visible to the threads and
+  // wake up the ones that went to sleep waiting for it.
+  void publish(long generation) {
+    m_generation.store(generation);
+    if (m_sleeping.load() > 0) {
+      std::unique_lock<std::mutex> lk(m_sleep_mutex);
+      lk.unlock();
+      m_sleep_cv.notify_all();
+    }
+  }
+
+  // Return the first generation different from seen_generation.
+  long wait_for_generation(long seen_generation) {
+    for (long spin = 0; spin < k_spin_iterations; ++spin) {
+      long generation = m_generation.load(std::memory_order_acquire);
+      if (generation != seen_generation)
+        return generation;
+    }
+
+    std::unique_lock<std::mutex> lk(m_sleep_mutex);
+    m_sleeping.fetch_add(1L);
+    while (m_generation.load() == seen_generation)
+      m_sleep_cv.wait(lk);
+    m_sleeping.fetch_sub(1L);
+    return m_generation.load();
+  }
+
+  // Wait until m_pending drops to zero.
+  void wait_for_done() {
+    for (long spin = 0; spin < k_spin_iterations; ++spin)
+      if (m_pending.load(std::memory_order_acquire) == 0)
+        return;
+
+    std::unique_lock<std::mutex> lk(m_sleep_mutex);
+    m_caller_sleeping.store(true);
+    while (m_pending.load() > 0)
+      m_done_cv.wait(lk);
+    m_caller_sleeping.store(false);
+  }
+
+  // Called by the thread finishing the last part of the buffer.
+  void notify_done() {
+    if (m_caller_sleeping.load()) {
+      std::unique_lock<std::mutex> lk(m_sleep_mutex);
+      lk.unlock();
+      m_done_cv.notify_one();
+    }
+  }
+
   buffered_gap_array *m_gap_array;
 
   std::thread **m_threads;
@@ -168,18 +214,19 @@ private:
 
   gap_buffer<block_offset_type> *m_buffer;
 
-  // For notifying threads about available buffer.
-  std::mutex m_avail_mutex;
-  std::condition_variable m_avail_cv;
-  bool *m_avail;
-  bool m_avail_no_more;
-
-  // The mutex below is to protect m_finished. The condition
-  // variable allows the caller to wait (and to be notified when done)
-  // until threads complete processing their section of the buffer.
-  int m_finished;
-  std::mutex m_finished_mutex;
-  std::condition_variable m_finished_cv;
+  // The number of the current buffer (or k_no_more), and
+  // the number of threads not yet done with it.
+  std::atomic<long> m_generation;
+  std::atomic<long> m_pending;
+
+  // For threads that stopped spinning.
+  std::atomic<long> m_sleeping;
+  std::mutex m_sleep_mutex;
+  std::condition_variable m_sleep_cv;
+
+  // For the caller of update() that stopped spinning.
+  std::atomic<bool> m_caller_sleeping;
+  std::condition_variable m_done_cv;
 };
 
 template<typename block_offset_type>
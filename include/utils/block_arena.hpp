@@ -0,0 +1,144 @@
+/**
+ * @file    src/psascan_src/utils/block_arena.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef __SRC_PSASCAN_SRC_UTILS_BLOCK_ARENA_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_UTILS_BLOCK_ARENA_HPP_INCLUDED
+
+#include <vector>
+#include <algorithm>
+#include <sys/mman.h>
+
+
+namespace psascan_private {
+
+//==============================================================================
+// The memory of the large arrays of process_block() (the half-blocks, their
+// SA and BWT, the gt bitvectors, the rank, the gap arrays, ...). Allocating
+// and freeing these arrays for every block costs a page fault (and zeroing
+// of the page by the kernel) for every page of every array, which on inputs
+// with many blocks adds up to seconds of system time per block.
+//
+// Instead, the memory of the freed arrays is kept, in chunks of
+// chunk_bytes(), and moved (with mremap, which moves the pages without
+// touching them) into the arrays allocated later. Since the chunks need not
+// be contiguous, the reuse does not depend on the order in which the arrays
+// of different steps are allocated and freed. The memory of the arrays in
+// use plus the kept chunks is bounded by the capacity (the predicted peak
+// of process_block() without the streaming buffers, see memory_planner.hpp),
+// the excess is unmapped.
+//
+// The arena does not map the arrays itself (see huge_pages.hpp, which also
+// serializes the calls), it only supplies and takes back their pages.
+//==============================================================================
+class block_arena {
+  public:
+    static const long k_min_chunk_bytes = (2L << 20);
+    static const long k_max_chunks = 4096;
+
+    block_arena(long capacity) {
+      m_capacity = capacity;
+      m_used_bytes = 0L;
+      m_peak_bytes = 0L;
+      m_reused_bytes = 0L;
+
+      // Bound the number of chunks (each chunk moved into an
+      // array becomes a separate memory area in the kernel).
+      m_chunk_bytes = k_min_chunk_bytes;
+      while (m_chunk_bytes * k_max_chunks < m_capacity)
+        m_chunk_bytes *= 2;
+    }
+
+    // The arrays allocated from the arena have a length that is a
+    // multiple of chunk_bytes(), aligned to k_min_chunk_bytes.
+    long chunk_bytes() const {
+      return m_chunk_bytes;
+    }
+
+    // Move the kept chunks to the beginning of the newly mapped range
+    // [dest..dest + bytes). Returns the length of the prefix of the range
+    // that was used before (and hence is not zero-filled).
+    long allocate(unsigned char *dest, long bytes) {
+      long moved = 0L;
+      while (moved < bytes && !m_chunks.empty()) {
+        unsigned char *chunk = m_chunks.back();
+        m_chunks.pop_back();
+        if (mremap(chunk, m_chunk_bytes, m_chunk_bytes, MREMAP_MAYMOVE |
+              MREMAP_FIXED, dest + moved) == MAP_FAILED) {
+          munmap(chunk, m_chunk_bytes);
+          break;
+        }
+        moved += m_chunk_bytes;
+      }
+      m_reused_bytes += moved;
+      m_used_bytes += bytes;
+      m_peak_bytes = std::max(m_peak_bytes, m_used_bytes + kept_bytes());
+      return moved;
+    }
+
+    // Take back the range [ptr..ptr + bytes) of a freed array. The
+    // chunks that do not fit into the capacity are unmapped.
+    void deallocate(unsigned char *ptr, long bytes) {
+      m_used_bytes -= bytes;
+      for (long offset = 0; offset < bytes; offset += m_chunk_bytes) {
+        if (m_used_bytes + kept_bytes() + m_chunk_bytes <= m_capacity)
+          m_chunks.push_back(ptr + offset);
+        else munmap(ptr + offset, m_chunk_bytes);
+      }
+    }
+
+    long capacity() const { return m_capacity; }
+    long peak_bytes() const { return m_peak_bytes; }
+    long reused_bytes() const { return m_reused_bytes; }
+
+    ~block_arena() {
+      for (size_t i = 0; i < m_chunks.size(); ++i)
+        munmap(m_chunks[i], m_chunk_bytes);
+    }
+
+  private:
+    long kept_bytes() const {
+      return (long)m_chunks.size() * m_chunk_bytes;
+    }
+
+    long m_capacity;
+    long m_chunk_bytes;
+    long m_used_bytes;    // arrays allocated from the arena
+    long m_peak_bytes;    // max of the above plus the kept chunks
+    long m_reused_bytes;  // total length of chunks moved into arrays
+
+    std::vector<unsigned char*> m_chunks;
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_UTILS_BLOCK_ARENA_HPP_INCLUDED
@@ -0,0 +1,415 @@
+/**
+ * @file    src/psascan_src/utils/huge_pages.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef __SRC_PSASCAN_SRC_UTILS_HUGE_PAGES_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_UTILS_HUGE_PAGES_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "block_arena.hpp"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+
+namespace psascan_private {
+
+// How the large arrays are backed by huge pages (--huge-pages).
+enum huge_page_mode {
+  HUGE_PAGES_OFF,      // plain malloc/calloc
+  HUGE_PAGES_THP,      // aligned mmap + madvise(MADV_HUGEPAGE)
+  HUGE_PAGES_HUGETLB   // MAP_HUGETLB (1GiB or 2MiB pages), THP if none left
+};
+
+//==============================================================================
+// Allocation of the large arrays accessed randomly during the streaming and
+// the gap updates (bwtsa, the rank4n trunk, the gt bitvectors, the gap
+// array counts, the gap buffers). With 4KiB pages, most of the random
+// accesses to these arrays miss the TLB. The arrays of at least
+// k_min_bytes are therefore mapped so that they can be backed by huge
+// pages. If the requested kind of huge pages is not available, the
+// allocation falls back to the next one (HUGETLB -> THP -> malloc), so it
+// never fails for lack of huge pages. The arrays marked as hot (the rank
+// trunk, gt bitvectors, gap counts) are also locked in RAM with mlock if
+// enabled (--mlock). The fraction of the arrays actually backed by huge
+// pages is measured (from /proc/self/smaps) when they are freed, and
+// printed at the end of the computation.
+//
+// While the block arena is reserved (see block_arena.hpp), the arrays of at
+// least its chunk size reuse the pages of the arrays freed before.
+//==============================================================================
+struct huge_pages {
+  static const long k_min_bytes = (2L << 20);
+
+  static void set_mode(huge_page_mode mode) {
+    get_state().m_mode = mode;
+  }
+
+  static huge_page_mode mode() {
+    return get_state().m_mode;
+  }
+
+  static void enable_mlock() {
+    get_state().m_mlock = true;
+  }
+
+  static bool mlock_enabled() {
+    return get_state().m_mlock;
+  }
+
+  // Allocate bytes bytes (zero-filled if zero = true). The
+  // memory has to be released with huge_pages::deallocate.
+  static void *allocate(long bytes, bool zero = false, bool hot = false) {
+    state &s = get_state();
+    if (bytes < k_min_bytes)
+      return aligned_malloc(bytes, zero);
+
+    allocation a;
+    init_allocation(a, bytes);
+    void *ptr = NULL;
+    long chunk_bytes = 0L;
+    {
+      std::lock_guard<std::mutex> lk(s.m_mutex);
+      if (s.m_arena != NULL) {
+        chunk_bytes = s.m_arena->chunk_bytes();
+        if (bytes >= chunk_bytes) ++s.m_arena_hits;
+        else ++s.m_arena_misses;
+      }
+    }
+
+    if (chunk_bytes > 0 && bytes >= chunk_bytes) {
+      // The length is a multiple of the chunk size, and
+      // the mapping is aligned to the (2MiB) huge page.
+      long length = (bytes + chunk_bytes - 1) / chunk_bytes * chunk_bytes;
+      ptr = map_large(length, a, false);
+      if (ptr == NULL) ptr = map_plain(length, a);
+      if (ptr != NULL) {
+        long reused_bytes = 0L;
+        {
+          std::lock_guard<std::mutex> lk(s.m_mutex);
+          if (s.m_arena != NULL) {
+            reused_bytes = s.m_arena->allocate((unsigned char *)ptr, a.m_map_bytes);
+            a.m_arena_id = s.m_arena_id;
+          }
+        }
+        if (zero && reused_bytes > 0)
+          std::memset(ptr, 0, std::min(bytes, reused_bytes));
+      }
+    } else ptr = map_large(bytes, a, true);
+
+    if (ptr == NULL) ptr = aligned_malloc(bytes, zero);
+    if (ptr == NULL) return NULL;
+
+    if (hot && s.m_mlock) {
+      if (mlock(ptr, bytes) == 0) a.m_locked = true;
+      else {
+        std::lock_guard<std::mutex> lk(s.m_mutex);
+        if (!s.m_mlock_warned) {
+          s.m_mlock_warned = true;
+          fprintf(stderr, "\nWarning: mlock failed (see ulimit -l), "
+              "continuing without locking\n");
+        }
+      }
+    }
+
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    s.m_allocations[ptr] = a;
+    if (a.m_locked) s.m_locked_bytes += bytes;
+    return ptr;
+  }
+
+  // Release memory returned by allocate (or by malloc).
+  static void deallocate(void *ptr) {
+    if (ptr == NULL) return;
+    state &s = get_state();
+    allocation a;
+    {
+      std::lock_guard<std::mutex> lk(s.m_mutex);
+      std::map<void*, allocation>::iterator it = s.m_allocations.find(ptr);
+      if (it == s.m_allocations.end()) {
+        free(ptr);
+        return;
+      }
+      a = it->second;
+      s.m_allocations.erase(it);
+    }
+
+    long huge = a.m_hugetlb ? a.m_bytes : anon_huge_bytes(ptr, a.m_bytes);
+    {
+      std::lock_guard<std::mutex> lk(s.m_mutex);
+      s.m_total_bytes += a.m_bytes;
+      s.m_huge_bytes += std::min(huge, a.m_bytes);
+    }
+
+    if (a.m_arena_id > 0) {
+      if (a.m_locked) munlock(ptr, a.m_bytes);
+      std::lock_guard<std::mutex> lk(s.m_mutex);
+      if (s.m_arena != NULL && s.m_arena_id == a.m_arena_id) {
+        s.m_arena->deallocate((unsigned char *)ptr, a.m_map_bytes);
+        return;
+      }
+    }
+
+    if (a.m_map_bytes > 0) munmap(ptr, a.m_map_bytes);
+    else {
+      if (a.m_locked) munlock(ptr, a.m_bytes);
+      free(ptr);
+    }
+  }
+
+  // Start keeping the pages of the freed large arrays for reuse (see
+  // block_arena.hpp), up to capacity bytes in total with the arrays in use.
+  static void reserve_arena(long capacity) {
+    state &s = get_state();
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    if (s.m_arena != NULL) return;
+    s.m_arena = new block_arena(capacity);
+    ++s.m_arena_id;
+    s.m_arena_bytes = std::max(s.m_arena_bytes, capacity);
+  }
+
+  // Unmap the kept pages. The arrays allocated from the
+  // arena that are still in use are unmapped when freed.
+  static void release_arena() {
+    state &s = get_state();
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    if (s.m_arena == NULL) return;
+    s.m_arena_peak_bytes = std::max(s.m_arena_peak_bytes,
+        s.m_arena->peak_bytes());
+    s.m_arena_reused_bytes += s.m_arena->reused_bytes();
+    delete s.m_arena;
+    s.m_arena = NULL;
+  }
+
+  // Total size of the freed large arrays and how much of it
+  // was backed by huge pages (and locked with mlock).
+  static long total_bytes() { return get_state().m_total_bytes; }
+  static long huge_bytes() { return get_state().m_huge_bytes; }
+  static long locked_bytes() { return get_state().m_locked_bytes; }
+
+  // The capacity of the block arena, the peak of the arrays allocated
+  // from it plus the kept pages, the total length of the reused pages,
+  // and the number of large arrays allocated from the arena or not
+  // (smaller than its chunk) while it was reserved.
+  static long arena_bytes() { return get_state().m_arena_bytes; }
+  static long arena_peak_bytes() { return get_state().m_arena_peak_bytes; }
+  static long arena_reused_bytes() { return get_state().m_arena_reused_bytes; }
+  static long arena_hits() { return get_state().m_arena_hits; }
+  static long arena_misses() { return get_state().m_arena_misses; }
+
+  static const char *mode_name() {
+    huge_page_mode mode = get_state().m_mode;
+    return mode == HUGE_PAGES_HUGETLB ? "hugetlb" :
+      mode == HUGE_PAGES_THP ? "thp" : "off";
+  }
+
+private:
+  struct allocation {
+    long m_bytes;
+    long m_map_bytes;  // 0 if allocated with malloc
+    long m_arena_id;   // 0 if not allocated from the arena
+    bool m_hugetlb;
+    bool m_locked;
+  };
+
+  struct state {
+    state()
+      : m_mode(HUGE_PAGES_THP),
+        m_mlock(false),
+        m_hugetlb_warned(false),
+        m_mlock_warned(false),
+        m_total_bytes(0L),
+        m_huge_bytes(0L),
+        m_locked_bytes(0L),
+        m_arena(NULL),
+        m_arena_id(0L),
+        m_arena_bytes(0L),
+        m_arena_peak_bytes(0L),
+        m_arena_reused_bytes(0L),
+        m_arena_hits(0L),
+        m_arena_misses(0L) {}
+
+    huge_page_mode m_mode;
+    bool m_mlock;
+    bool m_hugetlb_warned;
+    bool m_mlock_warned;
+    long m_total_bytes;
+    long m_huge_bytes;
+    long m_locked_bytes;
+
+    block_arena *m_arena;
+    long m_arena_id;
+    long m_arena_bytes;
+    long m_arena_peak_bytes;
+    long m_arena_reused_bytes;
+    long m_arena_hits;
+    long m_arena_misses;
+
+    std::mutex m_mutex;
+    std::map<void*, allocation> m_allocations;
+  };
+
+  static state &get_state() {
+    static state s;
+    return s;
+  }
+
+  // Memory not backed by huge pages, aligned to the cache line.
+  static void *aligned_malloc(long bytes, bool zero) {
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, 64, std::max(1L, bytes)))
+      return NULL;
+    if (zero) std::memset(ptr, 0, std::max(1L, bytes));
+    return ptr;
+  }
+
+  static void init_allocation(allocation &a, long bytes) {
+    a.m_bytes = bytes;
+    a.m_map_bytes = 0L;
+    a.m_hugetlb = false;
+    a.m_locked = false;
+    a.m_arena_id = 0L;
+  }
+
+  // Map the memory backed by huge pages of the current mode, or
+  // return NULL if the mode is HUGE_PAGES_OFF or the mapping fails.
+  static void *map_large(long bytes, allocation &a, bool allow_1gib_pages) {
+    state &s = get_state();
+    void *ptr = NULL;
+    if (s.m_mode == HUGE_PAGES_HUGETLB) {
+      if (allow_1gib_pages && bytes >= (1L << 30))
+        ptr = map_hugetlb(bytes, 30, a);
+      if (ptr == NULL)
+        ptr = map_hugetlb(bytes, 21, a);
+      if (ptr == NULL) {
+        std::lock_guard<std::mutex> lk(s.m_mutex);
+        if (!s.m_hugetlb_warned) {
+          s.m_hugetlb_warned = true;
+          fprintf(stderr, "\nWarning: not enough huge pages reserved (see "
+              "/proc/sys/vm/nr_hugepages), using transparent huge pages\n");
+        }
+      }
+    }
+    if (ptr == NULL && s.m_mode != HUGE_PAGES_OFF)
+      ptr = map_thp(bytes, a);
+    return ptr;
+  }
+
+  static void *map_plain(long bytes, allocation &a) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    long map_bytes = (bytes + page_size - 1) / page_size * page_size;
+    void *ptr = mmap(NULL, map_bytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) return NULL;
+    a.m_map_bytes = map_bytes;
+    return ptr;
+  }
+
+  static void *map_hugetlb(long bytes, int page_size_log, allocation &a) {
+#ifdef MAP_HUGETLB
+    long page_size = (1L << page_size_log);
+    long map_bytes = (bytes + page_size - 1) / page_size * page_size;
+    void *ptr = mmap(NULL, map_bytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+        (page_size_log << MAP_HUGE_SHIFT), -1, 0);
+    if (ptr == MAP_FAILED) return NULL;
+    a.m_map_bytes = map_bytes;
+    a.m_hugetlb = true;
+    return ptr;
+#else
+    (void)bytes; (void)page_size_log; (void)a;
+    return NULL;
+#endif
+  }
+
+  // Map the memory aligned to 2MiB, so that all of it
+  // can be backed by transparent huge pages.
+  static void *map_thp(long bytes, allocation &a) {
+    long align = (2L << 20);
+    long map_bytes = (bytes + align - 1) / align * align;
+    char *raw = (char *)mmap(NULL, map_bytes + align, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((void *)raw == MAP_FAILED) return NULL;
+
+    char *ptr = (char *)(((unsigned long)raw + align - 1) & ~(align - 1));
+    if (ptr > raw) munmap(raw, ptr - raw);
+    if (ptr + map_bytes < raw + map_bytes + align)
+      munmap(ptr + map_bytes, (raw + map_bytes + align) - (ptr + map_bytes));
+#ifdef MADV_HUGEPAGE
+    madvise(ptr, map_bytes, MADV_HUGEPAGE);
+#endif
+    a.m_map_bytes = map_bytes;
+    return (void *)ptr;
+  }
+
+  // The number of bytes in [ptr..ptr + bytes) backed by transparent
+  // huge pages, according to /proc/self/smaps. If the range is only a
+  // part of a memory area, the count of the area is scaled down.
+  static long anon_huge_bytes(const void *ptr, long bytes) {
+    std::FILE *f = std::fopen("/proc/self/smaps", "r");
+    if (f == NULL) return 0L;
+
+    unsigned long beg = (unsigned long)ptr;
+    unsigned long end = beg + bytes;
+    unsigned long area_beg = 0UL;
+    unsigned long area_end = 0UL;
+    long result = 0L;
+    char line[512];
+    while (std::fgets(line, sizeof(line), f) != NULL) {
+      unsigned long b, e;
+      long kib;
+      if (std::sscanf(line, "%lx-%lx ", &b, &e) == 2) {
+        area_beg = b;
+        area_end = e;
+      } else if (std::sscanf(line, "AnonHugePages: %ld kB", &kib) == 1 &&
+          area_beg < end && beg < area_end) {
+        unsigned long overlap = std::min(end, area_end) - std::max(beg, area_beg);
+        result += (long)((1.L * kib * 1024L * overlap) / (area_end - area_beg));
+      }
+    }
+    std::fclose(f);
+    return result;
+  }
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_UTILS_HUGE_PAGES_HPP_INCLUDED
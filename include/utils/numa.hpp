@@ -0,0 +1,204 @@
+/**
+ * @file    src/psascan_src/utils/numa.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+
+#ifndef __SRC_PSASCAN_SRC_UTILS_NUMA_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_UTILS_NUMA_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+
+#if defined(__linux__)
+#define PSASCAN_HAVE_NUMA
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#include "utils.hpp"
+
+
+namespace psascan_private {
+
+//==============================================================================
+// Placement of threads and memory on NUMA nodes (--numa). The topology is
+// read from /sys/devices/system/node and the memory policy is set using
+// the mbind system call, so there is no dependency on libnuma. Thread t of
+// a parallel step with n threads runs on node (t * n_nodes) / n, i.e.,
+// consecutive threads (working on consecutive parts of the text) share a
+// node. Nodes without CPUs are not used, the others are numbered from 0 to
+// n_nodes() - 1. If the mode is not enabled or the machine has a single
+// node, all functions do nothing.
+//==============================================================================
+struct numa {
+  static void enable() {
+    enabled_flag() = true;
+  }
+
+  static bool enabled() {
+    return enabled_flag() && n_nodes() > 1;
+  }
+
+  static long n_nodes() {
+    return (long)get_topology().size();
+  }
+
+  // Node of thread t out of n_threads, or -1 if not enabled.
+  static long node_of_thread(long t, long n_threads) {
+    if (!enabled() || n_threads <= 0) return -1L;
+    return std::min(n_nodes() - 1, (t * n_nodes()) / n_threads);
+  }
+
+  // Restrict the calling thread to the CPUs of the given node.
+  static void pin_thread(long node) {
+#ifdef PSASCAN_HAVE_NUMA
+    if (node < 0 || node >= n_nodes()) return;
+    const std::vector<long> &cpus = get_topology()[node].m_cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i)
+      if (cpus[i] < CPU_SETSIZE) CPU_SET(cpus[i], &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)node;
+#endif
+  }
+
+  // Spread the pages of [ptr..ptr + bytes) over all nodes. Pages
+  // already touched are moved. Used for read-mostly structures
+  // accessed randomly by threads on all nodes.
+  static void interleave(const void *ptr, long bytes) {
+    if (!enabled()) return;
+    unsigned long mask = 0UL;
+    for (long i = 0; i < n_nodes(); ++i)
+      if (get_topology()[i].m_id < 64)
+        mask |= (1UL << get_topology()[i].m_id);
+    set_policy(ptr, bytes, k_mpol_interleave, mask);
+  }
+
+  // Place the pages of [ptr..ptr + bytes) on the given node. Pages
+  // not yet touched are allocated there, touched pages are moved.
+  static void bind(const void *ptr, long bytes, long node) {
+    if (!enabled() || node < 0 || node >= n_nodes() ||
+        get_topology()[node].m_id >= 64) return;
+    set_policy(ptr, bytes, k_mpol_preferred, 1UL << get_topology()[node].m_id);
+  }
+
+private:
+  struct node_info {
+    long m_id;
+    std::vector<long> m_cpus;
+  };
+
+  static const int k_mpol_preferred = 1;
+  static const int k_mpol_interleave = 3;
+  static const unsigned k_mpol_mf_move = (1U << 1);
+
+  static bool &enabled_flag() {
+    static bool flag = false;
+    return flag;
+  }
+
+  // Apply the policy to the whole pages contained in the range.
+  static void set_policy(const void *ptr, long bytes, int mode,
+      unsigned long mask) {
+#ifdef PSASCAN_HAVE_NUMA
+    long page_size = sysconf(_SC_PAGESIZE);
+    unsigned long beg = ((unsigned long)ptr + page_size - 1) & ~(page_size - 1);
+    unsigned long end = ((unsigned long)ptr + bytes) & ~(page_size - 1);
+    if (beg >= end) return;
+    syscall(SYS_mbind, beg, end - beg, mode, &mask,
+        8 * sizeof(mask), k_mpol_mf_move);
+#else
+    (void)ptr; (void)bytes; (void)mode; (void)mask;
+#endif
+  }
+
+  // Nodes with at least one CPU.
+  static const std::vector<node_info> &get_topology() {
+    static std::vector<node_info> topology = read_topology();
+    return topology;
+  }
+
+  static std::vector<node_info> read_topology() {
+    std::vector<node_info> ret;
+    std::vector<long> nodes = read_list("/sys/devices/system/node/online");
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      node_info info;
+      info.m_id = nodes[i];
+      info.m_cpus = read_list("/sys/devices/system/node/node" +
+          utils::intToStr(nodes[i]) + "/cpulist");
+      if (!info.m_cpus.empty()) ret.push_back(info);
+    }
+    return ret;
+  }
+
+  // Parse a list such as "0-3,8,10-11" from the file.
+  static std::vector<long> read_list(std::string filename) {
+    std::vector<long> ret;
+    std::FILE *f = std::fopen(filename.c_str(), "r");
+    if (f == NULL) return ret;
+    std::string line;
+    int c;
+    while ((c = std::fgetc(f)) != EOF && c != '\n')
+      line += (char)c;
+    std::fclose(f);
+
+    size_t pos = 0;
+    while (pos < line.size()) {
+      if (!std::isdigit(line[pos])) { ++pos; continue; }
+      long beg = 0L;
+      while (pos < line.size() && std::isdigit(line[pos]))
+        beg = beg * 10 + (line[pos++] - '0');
+      long end = beg;
+      if (pos < line.size() && line[pos] == '-') {
+        end = 0L;
+        ++pos;
+        while (pos < line.size() && std::isdigit(line[pos]))
+          end = end * 10 + (line[pos++] - '0');
+      }
+      for (long x = beg; x <= end; ++x)
+        ret.push_back(x);
+    }
+    return ret;
+  }
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_UTILS_NUMA_HPP_INCLUDED
@@ -34,9 +34,10 @@
 #ifndef __SRC_PSASCAN_SRC_UTILS_PARALLEL_UTILS_HPP_INCLUDED
 #define __SRC_PSASCAN_SRC_UTILS_PARALLEL_UTILS_HPP_INCLUDED
 
-#include <thread>
 #include <algorithm>
 
+#include "thread_pool.hpp"
+
 
 namespace psascan_private {
 namespace parallel_utils {
@@ -84,7 +85,8 @@ long convert_array_to_vbyte_slab(
     unsigned char *dest,
     long max_threads) {
 
-  long max_block_size = (length + max_threads - 1) / max_threads;
+  long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+  long max_block_size = (length + max_tasks - 1) / max_tasks;
   long n_blocks = (length + max_block_size - 1) / max_block_size;
 
   // 1
@@ -92,18 +94,16 @@ long convert_array_to_vbyte_slab(
   // Compute the length of slab for each block.
   long *block_slab_length = new long[n_blocks];
 
-  std::thread **threads = new std::thread*[n_blocks];
+  task_group tasks;
   for (long t = 0; t < n_blocks; ++t) {
     long block_beg = t * max_block_size;
     long block_end = std::min(block_beg + max_block_size, length);
     long block_size = block_end - block_beg;
 
-    threads[t] = new std::thread(compute_size_of_vbyte_slab,
+    tasks.add(compute_size_of_vbyte_slab,
         tab + block_beg, block_size, std::ref(block_slab_length[t]));
   }
-
-  for (long t = 0; t < n_blocks; ++t) threads[t]->join();
-  for (long t = 0; t < n_blocks; ++t) delete threads[t];
+  tasks.wait();
 
   // 2
   //
@@ -123,13 +123,10 @@ long convert_array_to_vbyte_slab(
     long block_end = std::min(block_beg + max_block_size, length);
     long block_size = block_end - block_beg;
 
-    threads[t] = new std::thread(encode_vbyte_slab,
+    tasks.add(encode_vbyte_slab,
         tab + block_beg, block_size, dest + block_slab_length[t]);
   }
-
-  for (long t = 0; t < n_blocks; ++t) threads[t]->join();
-  for (long t = 0; t < n_blocks; ++t) delete threads[t];
-  delete[] threads;
+  tasks.wait();
   delete[] block_slab_length;
 
   return total_slab_length;
@@ -152,22 +149,21 @@ void parallel_copy_aux(const T *src, S *dest, long length) {
 //==============================================================================
 template<typename T, typename S>
 void parallel_copy(const T *src, S *dest, long length, long max_threads) {
-  long max_block_size = (length + max_threads - 1) / max_threads;
+  long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+  long max_block_size = (length + max_tasks - 1) / max_tasks;
   long n_blocks = (length + max_block_size - 1) / max_block_size;
 
-  std::thread **threads = new std::thread*[n_blocks];
+  task_group tasks;
   for (long i = 0; i < n_blocks; ++i) {
     long block_beg = i * max_block_size;
     long block_end = std::min(block_beg + max_block_size, length);
     long block_size = block_end - block_beg;
 
-    threads[i] = new std::thread(parallel_copy_aux<T, S>,
+    tasks.add(parallel_copy_aux<T, S>,
         src + block_beg, dest + block_beg, block_size);
   }
 
-  for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_blocks; ++i) delete threads[i];
-  delete[] threads;
+  tasks.wait();
 }
 
 
@@ -186,22 +182,21 @@ void parallel_fill_aux(T *tab, long length, T x) {
 //==============================================================================
 template<typename T>
 void parallel_fill(T *tab, long length, T x, long max_threads) {
-  long max_block_size = (length + max_threads - 1) / max_threads;
+  long max_tasks = max_threads * thread_pool::k_tasks_per_thread;
+  long max_block_size = (length + max_tasks - 1) / max_tasks;
   long n_blocks = (length + max_block_size - 1) / max_block_size;
 
-  std::thread **threads = new std::thread*[n_blocks];
+  task_group tasks;
   for (long i = 0; i < n_blocks; ++i) {
     long block_beg = i * max_block_size;
     long block_end = std::min(block_beg + max_block_size, length);
     long block_size = block_end - block_beg;
 
-    threads[i] = new std::thread(parallel_fill_aux<T>,
+    tasks.add(parallel_fill_aux<T>,
         tab + block_beg, block_size, x);
   }
 
-  for (long i = 0; i < n_blocks; ++i) threads[i]->join();
-  for (long i = 0; i < n_blocks; ++i) delete threads[i];
-  delete[] threads;
+  tasks.wait();
 }
 
 }  // namespace parallel_utils
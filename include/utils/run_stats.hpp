@@ -0,0 +1,351 @@
+/**
+ * @file    src/psascan_src/utils/run_stats.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#ifndef __SRC_PSASCAN_SRC_UTILS_RUN_STATS_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_UTILS_RUN_STATS_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "utils.hpp"
+
+
+namespace psascan_private {
+
+//==============================================================================
+// Collector of per-phase metrics, written as a JSON document at the end of
+// the computation (--stats-json). Every phase (the steps 1.a-6 of
+// process_block, the steps of in-memory pSAscan, the merging) is recorded
+// with its wall time, the amount of text processed and the number of bytes
+// read and written, in the section (block or merging) in which it was
+// executed. Steps of in-memory pSAscan are nested under the step of
+// process_block that ran it (see set_parent). Threads doing the streaming
+// and the parallel merging are recorded individually under their step.
+// If not enabled, nothing is recorded.
+//==============================================================================
+struct run_stats {
+  static void enable(std::string filename) {
+    state &s = get_state();
+    s.m_filename = filename;
+    s.m_enabled = true;
+  }
+
+  static bool enabled() {
+    return get_state().m_enabled;
+  }
+
+  // Start a new section. Block IDs are 1-based, as printed;
+  // block_id = -1 is the merging.
+  static void begin_section(long block_id, long beg, long end) {
+    state &s = get_state();
+    if (!s.m_enabled) return;
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    section sec;
+    sec.m_block_id = block_id;
+    sec.m_beg = beg;
+    sec.m_end = end;
+    sec.m_start = utils::wclock();
+    sec.m_time = 0.L;
+    s.m_sections.push_back(sec);
+  }
+
+  static void end_section() {
+    state &s = get_state();
+    if (!s.m_enabled) return;
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    if (!s.m_sections.empty())
+      s.m_sections.back().m_time = utils::wclock() - s.m_sections.back().m_start;
+  }
+
+  // Steps added until the next call are nested under the given step.
+  static void set_parent(std::string step) {
+    state &s = get_state();
+    if (!s.m_enabled) return;
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    s.m_parent = step;
+  }
+
+  // Record a step of the current section. If background is true, the
+  // step overlapped with other steps, and time is its own duration.
+  static void add_step(std::string step, std::string name, long double time,
+      long symbols, long bytes_read, long bytes_written,
+      bool background = false) {
+    state &s = get_state();
+    if (!s.m_enabled) return;
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    record r;
+    r.m_step = s.m_parent.empty() ? step : s.m_parent + "/" + step;
+    r.m_name = name;
+    r.m_time = time;
+    r.m_symbols = symbols;
+    r.m_bytes_read = bytes_read;
+    r.m_bytes_written = bytes_written;
+    r.m_background = background;
+    r.m_thread_id = -1L;
+    current_section(s).m_records.push_back(r);
+  }
+
+  // Record the work of a single thread in a step of the current section.
+  static void add_thread(std::string step, long thread_id, long double time,
+      long symbols, long bytes_read, long bytes_written) {
+    state &s = get_state();
+    if (!s.m_enabled) return;
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    record r;
+    r.m_step = step;
+    r.m_time = time;
+    r.m_symbols = symbols;
+    r.m_bytes_read = bytes_read;
+    r.m_bytes_written = bytes_written;
+    r.m_background = false;
+    r.m_thread_id = thread_id;
+    current_section(s).m_records.push_back(r);
+  }
+
+  // Summary values of the whole computation (printed in the order
+  // of the first call, a repeated call overwrites the value).
+  static void set_value(std::string key, long double value) {
+    state &s = get_state();
+    if (!s.m_enabled) return;
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    for (size_t i = 0; i < s.m_values.size(); ++i) {
+      if (s.m_values[i].first == key) {
+        s.m_values[i].second = value;
+        return;
+      }
+    }
+    s.m_values.push_back(std::make_pair(key, value));
+  }
+
+  // Time and volume of a step summed over all sections of one kind.
+  struct step_total {
+    bool m_merge;
+    std::string m_step;
+    std::string m_name;
+    long double m_time;
+    long m_symbols;
+    long m_bytes;
+  };
+
+  // Return the totals of top-level steps (nested steps and threads are
+  // omitted) in the order of their first occurrence, blocks first.
+  // Records with the same step and name are summed.
+  static std::vector<step_total> totals() {
+    state &s = get_state();
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    std::vector<step_total> ret;
+    for (int merge = 0; merge < 2; ++merge) {
+      for (size_t i = 0; i < s.m_sections.size(); ++i) {
+        const section &sec = s.m_sections[i];
+        if ((sec.m_block_id < 0) != (merge > 0)) continue;
+        for (size_t j = 0; j < sec.m_records.size(); ++j) {
+          const record &r = sec.m_records[j];
+          if (r.m_thread_id >= 0 ||
+              r.m_step.find('/') != std::string::npos) continue;
+          size_t k = 0;
+          while (k < ret.size() && (ret[k].m_merge != (merge > 0) ||
+                ret[k].m_step != r.m_step || ret[k].m_name != r.m_name)) ++k;
+          if (k == ret.size()) {
+            step_total t;
+            t.m_merge = (merge > 0);
+            t.m_step = r.m_step;
+            t.m_name = r.m_name;
+            t.m_time = 0.L;
+            t.m_symbols = t.m_bytes = 0L;
+            ret.push_back(t);
+          }
+          ret[k].m_time += r.m_time;
+          ret[k].m_symbols += r.m_symbols;
+          ret[k].m_bytes += r.m_bytes_read + r.m_bytes_written;
+        }
+      }
+    }
+    return ret;
+  }
+
+  // Write all recorded metrics to the file given to enable().
+  // If the filename is empty, the metrics are only collected.
+  static void write() {
+    state &s = get_state();
+    if (!s.m_enabled || s.m_filename.empty()) return;
+    std::lock_guard<std::mutex> lk(s.m_mutex);
+    std::FILE *f = utils::open_file(s.m_filename, "w");
+
+    fprintf(f, "{\n");
+    for (size_t i = 0; i < s.m_values.size(); ++i)
+      fprintf(f, "  \"%s\": %s,\n", s.m_values[i].first.c_str(),
+          number(s.m_values[i].second).c_str());
+
+    fprintf(f, "  \"blocks\": [");
+    bool first = true;
+    for (size_t i = 0; i < s.m_sections.size(); ++i) {
+      const section &sec = s.m_sections[i];
+      if (sec.m_block_id < 0) continue;
+      fprintf(f, "%s\n    {\n", first ? "" : ",");
+      fprintf(f, "      \"block\": %ld,\n", sec.m_block_id);
+      fprintf(f, "      \"beg\": %ld,\n", sec.m_beg);
+      fprintf(f, "      \"end\": %ld,\n", sec.m_end);
+      write_section(f, sec, "      ");
+      fprintf(f, "    }");
+      first = false;
+    }
+    fprintf(f, "%s],\n", first ? "" : "\n  ");
+
+    fprintf(f, "  \"merge\": ");
+    first = true;
+    for (size_t i = 0; i < s.m_sections.size(); ++i) {
+      const section &sec = s.m_sections[i];
+      if (sec.m_block_id >= 0) continue;
+      fprintf(f, "{\n");
+      write_section(f, sec, "    ");
+      fprintf(f, "  }\n");
+      first = false;
+    }
+    if (first) fprintf(f, "null\n");
+    fprintf(f, "}\n");
+
+    std::fclose(f);
+  }
+
+private:
+  struct record {
+    std::string m_step;
+    std::string m_name;
+    long double m_time;
+    long m_symbols;
+    long m_bytes_read;
+    long m_bytes_written;
+    bool m_background;
+    long m_thread_id;  // -1 for records of steps
+  };
+
+  struct section {
+    long m_block_id;
+    long m_beg;
+    long m_end;
+    long double m_start;
+    long double m_time;
+    std::vector<record> m_records;
+  };
+
+  struct state {
+    state() : m_enabled(false) {}
+
+    std::mutex m_mutex;
+    bool m_enabled;
+    std::string m_filename;
+    std::string m_parent;
+    std::vector<section> m_sections;
+    std::vector<std::pair<std::string, long double> > m_values;
+  };
+
+  static state &get_state() {
+    static state s;
+    return s;
+  }
+
+  static section &current_section(state &s) {
+    if (s.m_sections.empty()) {
+      section sec;
+      sec.m_block_id = -1L;
+      sec.m_beg = sec.m_end = 0L;
+      sec.m_start = utils::wclock();
+      sec.m_time = 0.L;
+      s.m_sections.push_back(sec);
+    }
+    return s.m_sections.back();
+  }
+
+  static std::string number(long double x) {
+    char buf[64];
+    if (x == (long double)(long)x) sprintf(buf, "%ld", (long)x);
+    else sprintf(buf, "%.6Lf", x);
+    return std::string(buf);
+  }
+
+  // Write the fields common to steps and threads.
+  static void write_record(std::FILE *f, const record &r) {
+    fprintf(f, "\"time\": %.6Lf, \"symbols\": %ld, \"bytes_read\": %ld, "
+        "\"bytes_written\": %ld", r.m_time, r.m_symbols, r.m_bytes_read,
+        r.m_bytes_written);
+    if (r.m_time > 0.L) {
+      if (r.m_symbols > 0)
+        fprintf(f, ", \"speed_mib_s\": %.3Lf",
+            (r.m_symbols / (1024.L * 1024)) / r.m_time);
+      if (r.m_bytes_read + r.m_bytes_written > 0)
+        fprintf(f, ", \"io_mib_s\": %.3Lf", ((r.m_bytes_read +
+                r.m_bytes_written) / (1024.L * 1024)) / r.m_time);
+    }
+  }
+
+  static void write_section(std::FILE *f, const section &sec,
+      std::string indent) {
+    const char *ind = indent.c_str();
+    fprintf(f, "%s\"time\": %.6Lf,\n", ind, sec.m_time);
+    fprintf(f, "%s\"steps\": [", ind);
+    bool first = true;
+    for (size_t i = 0; i < sec.m_records.size(); ++i) {
+      const record &r = sec.m_records[i];
+      if (r.m_thread_id >= 0) continue;
+      fprintf(f, "%s\n%s  {\"step\": \"%s\", \"name\": \"%s\", ",
+          first ? "" : ",", ind, r.m_step.c_str(), r.m_name.c_str());
+      write_record(f, r);
+      if (r.m_background)
+        fprintf(f, ", \"background\": true");
+
+      // Threads of this step.
+      bool first_thread = true;
+      for (size_t j = 0; j < sec.m_records.size(); ++j) {
+        const record &t = sec.m_records[j];
+        if (t.m_thread_id < 0 || t.m_step != r.m_step) continue;
+        fprintf(f, "%s\n%s    {\"thread\": %ld, ", first_thread ?
+            ", \"threads\": [" : ",", ind, t.m_thread_id);
+        write_record(f, t);
+        fprintf(f, "}");
+        first_thread = false;
+      }
+      if (!first_thread) fprintf(f, "\n%s  ]", ind);
+      fprintf(f, "}");
+      first = false;
+    }
+    fprintf(f, "%s]\n", first ? "" : std::string("\n" + indent).c_str());
+  }
+};
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_UTILS_RUN_STATS_HPP_INCLUDED
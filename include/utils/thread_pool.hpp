@@ -0,0 +1,308 @@
+/**
+ * @file    src/psascan_src/utils/thread_pool.hpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef __SRC_PSASCAN_SRC_UTILS_THREAD_POOL_HPP_INCLUDED
+#define __SRC_PSASCAN_SRC_UTILS_THREAD_POOL_HPP_INCLUDED
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
+#include <unistd.h>
+
+
+namespace psascan_private {
+
+class task_group;
+
+//==============================================================================
+// A persistent pool of worker threads shared by the parallel steps of the
+// computation (rank4n construction, sparse_isa, parallel_copy, ...). The
+// pool is started once by pSAscan() (or on first use, with one thread per
+// core) and lives until the program exits, so the steps no longer create
+// and join new threads every time they are invoked, which on small blocks
+// costs more than the work itself.
+//
+// Each worker has its own deque of tasks. A worker takes the most recently
+// added task from its own deque and, when it is empty, steals the oldest
+// task from the deque of another worker. The steps split their work into
+// k_tasks_per_thread times more tasks than threads, so that the threads
+// finishing their tasks early take over the tasks of the others (e.g., when
+// the cblocks of rank4n have very different costs).
+//
+// Tasks are added and waited for using a task_group (see below). Tasks must
+// not wait for each other (other than through a nested task_group), i.e.,
+// steps with threads communicating with each other (the streaming, the
+// merging, the I/O threads) still use their own std::threads.
+//==============================================================================
+class thread_pool {
+  public:
+    static const long k_tasks_per_thread = 4;
+
+    // Start the shared pool with the given number of threads (the thread
+    // waiting for a task_group counts as one of them). Does nothing if the
+    // pool was already started by this process.
+    static void start(long n_threads) {
+      std::lock_guard<std::mutex> lk(instance_mutex());
+
+      // The pool is not inherited by a forked child (e.g., in
+      // psascan_bench), so the child starts its own.
+      if (instance() != NULL && instance()->m_pid == getpid()) return;
+      instance() = new thread_pool(n_threads);
+    }
+
+    static thread_pool &get() {
+      thread_pool *pool = instance();
+      if (pool == NULL || pool->m_pid != getpid()) {
+        start(std::max(1L, (long)std::thread::hardware_concurrency()));
+        pool = instance();
+      }
+      return *pool;
+    }
+
+    long n_threads() const {
+      return m_n_threads;
+    }
+
+  private:
+    friend class task_group;
+
+    struct task {
+      std::function<void()> m_func;
+      task_group *m_group;
+    };
+
+    struct task_deque {
+      std::mutex m_mutex;
+      std::deque<task*> m_tasks;
+    };
+
+    thread_pool(long n_threads) {
+      m_n_threads = std::max(1L, n_threads);
+      m_pid = getpid();
+      m_queued = 0L;
+      m_next_deque = 0L;
+
+      long n_workers = std::max(1L, m_n_threads - 1);
+      for (long i = 0; i < n_workers; ++i)
+        m_deques.push_back(new task_deque());
+      for (long i = 0; i < n_workers; ++i)
+        m_workers.push_back(new std::thread(worker_code, this, i));
+      for (long i = 0; i < n_workers; ++i)
+        m_workers[i]->detach();
+    }
+
+    static thread_pool* &instance() {
+      static thread_pool *pool = NULL;
+      return pool;
+    }
+
+    static std::mutex &instance_mutex() {
+      static std::mutex mtx;
+      return mtx;
+    }
+
+    // Index of the worker executing the calling thread, or -1.
+    static long &current_worker() {
+      static thread_local long worker_id = -1L;
+      return worker_id;
+    }
+
+    void submit(task *t) {
+      long deque_id = current_worker();
+      if (deque_id < 0)
+        deque_id = (m_next_deque++) % (long)m_deques.size();
+
+      {
+        std::lock_guard<std::mutex> lk(m_deques[deque_id]->m_mutex);
+        m_deques[deque_id]->m_tasks.push_back(t);
+      }
+
+      ++m_queued;
+      std::lock_guard<std::mutex> lk(m_sleep_mutex);
+      m_sleep_cv.notify_one();
+    }
+
+    // Take a task from the own deque or steal one from other workers.
+    task *take(long worker_id) {
+      long n_deques = (long)m_deques.size();
+      for (long i = 0; i < n_deques; ++i) {
+        task_deque *d = m_deques[(worker_id + i) % n_deques];
+        std::lock_guard<std::mutex> lk(d->m_mutex);
+        if (d->m_tasks.empty()) continue;
+
+        task *t = NULL;
+        if (i == 0) {
+          t = d->m_tasks.back();
+          d->m_tasks.pop_back();
+        } else {
+          t = d->m_tasks.front();
+          d->m_tasks.pop_front();
+        }
+        --m_queued;
+        return t;
+      }
+      return NULL;
+    }
+
+    // Take a task of the given group (used by the thread waiting for it).
+    task *take_from_group(const task_group *group) {
+      for (size_t i = 0; i < m_deques.size(); ++i) {
+        task_deque *d = m_deques[i];
+        std::lock_guard<std::mutex> lk(d->m_mutex);
+        for (size_t j = d->m_tasks.size(); j > 0; --j) {
+          if (d->m_tasks[j - 1]->m_group == group) {
+            task *t = d->m_tasks[j - 1];
+            d->m_tasks.erase(d->m_tasks.begin() + (j - 1));
+            --m_queued;
+            return t;
+          }
+        }
+      }
+      return NULL;
+    }
+
+    static void run(task *t);
+
+    static void worker_code(thread_pool *pool, long worker_id) {
+      current_worker() = worker_id;
+      while (true) {
+        task *t = pool->take(worker_id);
+        if (t != NULL) {
+          run(t);
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lk(pool->m_sleep_mutex);
+        while (pool->m_queued <= 0)
+          pool->m_sleep_cv.wait(lk);
+      }
+    }
+
+    long m_n_threads;
+    pid_t m_pid;
+
+    std::vector<task_deque*> m_deques;
+    std::vector<std::thread*> m_workers;
+    std::atomic<long> m_queued;
+    std::atomic<long> m_next_deque;
+
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_sleep_cv;
+};
+
+//==============================================================================
+// A set of tasks run by the shared thread pool. Used in place of starting
+// a std::thread for every part of the work and joining them:
+//
+//   task_group tasks;
+//   for (long t = 0; t < n_tasks; ++t)
+//     tasks.add(func, arg1, arg2, ...);
+//   tasks.wait();
+//
+// The arguments are passed as for std::thread (use std::ref to pass by
+// reference). While waiting, the calling thread runs the tasks of the
+// group that were not yet taken by the workers.
+//==============================================================================
+class task_group {
+  public:
+    task_group()
+      : m_pool(thread_pool::get()),
+        m_pending(0L) {}
+
+    template<typename F, typename... Args>
+    void add(F &&func, Args&&... args) {
+      {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        ++m_pending;
+      }
+
+      thread_pool::task *t = new thread_pool::task();
+      t->m_func = std::bind(std::forward<F>(func), std::forward<Args>(args)...);
+      t->m_group = this;
+      m_pool.submit(t);
+    }
+
+    void wait() {
+      while (true) {
+        {
+          std::lock_guard<std::mutex> lk(m_mutex);
+          if (m_pending == 0) return;
+        }
+
+        thread_pool::task *t = m_pool.take_from_group(this);
+        if (t == NULL) break;
+        thread_pool::run(t);
+      }
+
+      // All remaining tasks are being run by the workers.
+      std::unique_lock<std::mutex> lk(m_mutex);
+      while (m_pending > 0)
+        m_cv.wait(lk);
+    }
+
+    ~task_group() {
+      wait();
+    }
+
+  private:
+    friend class thread_pool;
+
+    // Notify under the lock, since the group is destroyed
+    // as soon as the waiting thread sees m_pending == 0.
+    void finish() {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      if (--m_pending == 0)
+        m_cv.notify_all();
+    }
+
+    thread_pool &m_pool;
+    long m_pending;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+inline void thread_pool::run(task *t) {
+  t->m_func();
+  task_group *group = t->m_group;
+  delete t;
+  group->finish();
+}
+
+}  // namespace psascan_private
+
+#endif  // __SRC_PSASCAN_SRC_UTILS_THREAD_POOL_HPP_INCLUDED
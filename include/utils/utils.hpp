@@ -49,16 +49,23 @@ namespace utils {
 // Time
 long double wclock();
 
+// Memory
+long peak_rss();
+
 // Basic file handling
 std::FILE *open_file(std::string fname, std::string mode);
 long file_size(std::string fname);
 bool file_exists(std::string fname);
 void file_delete(std::string fname);
+void file_rename(std::string old_fname, std::string new_fname);
+void file_sync(std::string fname);
 std::string absolute_path(std::string fname);
+void preallocate_file(std::string fname, long size);
 
 // File I/O
 void read_block(std::string fname, long beg, long length, unsigned char *b);
 void read_block(std::FILE *f, long beg, long length, unsigned char *b);
+bool read_line(std::FILE *f, std::string &line);
 
 template<typename value_type>
 void write_objects_to_file(const value_type *tab, long length, std::string fname) {
@@ -36,8 +36,13 @@
 #include <cstdint>
 #include <ctime>
 #include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
 #include <getopt.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <omp.h>
 
 #include "../include/psascan.hpp"
@@ -48,17 +53,67 @@ char *program_name;
 void usage(int status) {
   printf(
 
-"Usage: %s [OPTION]... FILE\n"
-"Construct the suffix array of text stored in FILE.\n"
+"Usage: %s [OPTION]... FILE...\n"
+"Construct the suffix array of text stored in FILE. If multiple FILEs are\n"
+"given, the text is their concatenation. A directory FILE stands for all\n"
+"regular files in it, in the order of their names.\n"
 "\n"
 "Mandatory arguments to long options are mandatory for short options too.\n"
+"  -b, --bwt[=BWTFILE]     write also the BWT of the text to BWTFILE and its\n"
+"                          primary index to BWTFILE.idx. Default: OUTFILE.bwt\n"
+"  -d, --doc-array[=DAFILE]\n"
+"                          write also the document array (for every suffix,\n"
+"                          the index of the input file it starts in) to DAFILE\n"
+"                          using 32-bit integers. Default: OUTFILE.da\n"
 "  -h, --help              display this help and exit\n"
+"      --io-engine=MODE    method of reading and writing temporary files: uring\n"
+"                          (io_uring, falls back to threads if not supported\n"
+"                          by the kernel) or threads (blocking I/O in helper\n"
+"                          threads). Default: uring\n"
 "  -g, --gap=GAPFILE       specify the file holding the gap array. Default:\n"
 "                          OUTFILE.gap, see the -o flag.\n"
+"      --huge-pages=MODE   back the large arrays with huge pages: thp\n"
+"                          (transparent huge pages), hugetlb (pages reserved\n"
+"                          in /proc/sys/vm/nr_hugepages, falls back to thp if\n"
+"                          there are not enough) or off. Default: thp\n"
+"  -l, --file-list=LIST    read the input filenames (one per line) from LIST.\n"
+"                          They precede the FILEs given on the command line\n"
 "  -m, --mem=MEM           use MEM bytes of RAM for computation. Metric and IEC\n"
-"                          suffixes are recognized, e.g., -l 10k, -l 1Mi, -l 3G\n"
+"                          suffixes are recognized, e.g., -m 10k, -m 1Mi, -m 3G\n"
 "                          gives MEM = 10^4, 2^20, 3*10^6. Default: 3584Mi\n"
-"  -o, --output=OUTFILE    specify output filename. Default: FILE.sa5\n"
+"      --mlock             lock the rank structure, the gap arrays and the\n"
+"                          bitvectors in RAM (see ulimit -l)\n"
+"      --numa              on multi-socket machines, run the threads sorting\n"
+"                          and streaming blocks on distinct NUMA nodes, with\n"
+"                          their data local to the node, and interleave the\n"
+"                          shared structures across all nodes (see README)\n"
+"  -o, --output=OUTFILE    specify output filename. Default: FILE.saX, where\n"
+"                          FILE is the first input file (or LIST), X is the\n"
+"                          number of bytes per integer (FILE.sap for\n"
+"                          bit-packed output)\n"
+"      --output-width=W    write the suffix array using W-bit integers, where\n"
+"                          W is one of 32, 40, 48, 64, or `packed' to use\n"
+"                          ceil(log2(n)) bits per integer. Default: 40\n"
+"      --output-writer=MODE\n"
+"                          method of writing the suffix array: stdio (buffered\n"
+"                          writes), mmap (preallocated memory-mapped file) or\n"
+"                          direct (preallocated file, O_DIRECT). The last two\n"
+"                          keep the output out of the page cache. Default: stdio\n"
+"  -P, --pack-psa          store partial suffix arrays on disk bit-packed\n"
+"                          (uses less disk space and I/O, see README)\n"
+"  -p, --parallel-merge    merge partial suffix arrays using all threads\n"
+"                          (uses more disk space, see README)\n"
+"  -r, --resume            make the computation resumable: save its state to\n"
+"                          OUTFILE.checkpoint after each block and, if the\n"
+"                          checkpoint exists, resume the interrupted\n"
+"                          computation from it (uses more disk space, see\n"
+"                          README)\n"
+"      --stats-json=FILE   write the time, the amount of I/O and the speed of\n"
+"                          every phase (per block and per thread) to FILE as\n"
+"                          a JSON document (see README)\n"
+"  -t, --temp-dir=DIR      create temporary files in DIR. If given multiple\n"
+"                          times, the files are spread over all DIRs, e.g.,\n"
+"                          to use several disks (see README). Overrides -g\n"
 "  -v, --verbose           print detailed information during internal sufsort\n",
     program_name);
 
@@ -73,6 +128,35 @@ bool file_exists(std::string filename) {
   return ret;
 }
 
+// Append filename to the list of input files. A directory
+// is replaced by all regular files in it, sorted by name.
+void add_input(std::string filename, std::vector<std::string> &input_filenames) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) || !S_ISDIR(st.st_mode)) {
+    input_filenames.push_back(filename);
+    return;
+  }
+
+  DIR *dir = opendir(filename.c_str());
+  if (dir == NULL) {
+    fprintf(stderr, "Error: cannot open directory %s\n", filename.c_str());
+    std::perror("opendir");
+    std::exit(EXIT_FAILURE);
+  }
+
+  std::vector<std::string> names;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string path = filename + "/" + std::string(entry->d_name);
+    if (!stat(path.c_str(), &st) && S_ISREG(st.st_mode))
+      names.push_back(path);
+  }
+  closedir(dir);
+
+  std::sort(names.begin(), names.end());
+  input_filenames.insert(input_filenames.end(), names.begin(), names.end());
+}
+
 template<typename int_type>
 bool parse_number(char *str, int_type *ret) {
   *ret = 0;
@@ -134,12 +218,37 @@ int main(int argc, char **argv) {
   srand(time(0) + getpid());
   program_name = argv[0];
   bool verbose = false;
+  bool parallel_merge = false;
+  psascan_private::output_writer_kind output_writer =
+    psascan_private::OUTPUT_WRITER_STDIO;
+  long output_width = 40L;
+  bool compute_bwt = false;
+  bool resume = false;
+  bool pack_psa = false;
+  bool compute_da = false;
+  std::vector<std::string> temp_dirs;
+  std::vector<std::string> input_filenames;
+  std::string list_filename("");
 
   static struct option long_options[] = {
+    {"bwt",      optional_argument, NULL, 'b'},
+    {"doc-array", optional_argument, NULL, 'd'},
     {"help",     no_argument,       NULL, 'h'},
+    {"io-engine", required_argument, NULL, 'E'},
     {"gap",      required_argument, NULL, 'g'},
+    {"file-list", required_argument, NULL, 'l'},
+    {"huge-pages", required_argument, NULL, 'H'},
     {"mem",      required_argument, NULL, 'm'},
+    {"mlock",    no_argument,       NULL, 'L'},
+    {"numa",     no_argument,       NULL, 'N'},
     {"output",   required_argument, NULL, 'o'},
+    {"output-writer", required_argument, NULL, 'W'},
+    {"output-width", required_argument, NULL, 'w'},
+    {"pack-psa", no_argument,       NULL, 'P'},
+    {"parallel-merge", no_argument, NULL, 'p'},
+    {"resume",   no_argument,       NULL, 'r'},
+    {"stats-json", required_argument, NULL, 'S'},
+    {"temp-dir", required_argument, NULL, 't'},
     {"verbose",  no_argument,       NULL, 'v'},
     {NULL,       0,                 NULL,  0}
   };
@@ -147,18 +256,63 @@ int main(int argc, char **argv) {
   std::uint64_t ram_use = ((std::uint64_t)3584 << 20);
   std::string output_filename("");
   std::string gap_filename("");
+  std::string bwt_filename("");
+  std::string da_filename("");
+  std::string stats_filename("");
 
   // Parse command-line options.
   int c;
-  while ((c = getopt_long(argc, argv, "g:hm:o:v",
+  while ((c = getopt_long(argc, argv, "b::d::E:g:H:hLl:m:No:PprS:t:vW:w:",
           long_options, NULL)) != -1) {
     switch(c) {
+      case 'b':
+        compute_bwt = true;
+        if (optarg != NULL)
+          bwt_filename = std::string(optarg);
+        break;
+      case 'd':
+        compute_da = true;
+        if (optarg != NULL)
+          da_filename = std::string(optarg);
+        break;
+      case 'E':
+        {
+          std::string mode(optarg);
+          if (mode == "threads")
+            psascan_private::io_uring_engine::disable();
+          else if (mode != "uring") {
+            fprintf(stderr, "Error: unknown I/O engine (%s)\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          break;
+        }
       case 'g':
         gap_filename = std::string(optarg);
         break;
+      case 'H':
+        {
+          std::string mode(optarg);
+          if (mode == "off")
+            psascan_private::huge_pages::set_mode(psascan_private::HUGE_PAGES_OFF);
+          else if (mode == "thp")
+            psascan_private::huge_pages::set_mode(psascan_private::HUGE_PAGES_THP);
+          else if (mode == "hugetlb")
+            psascan_private::huge_pages::set_mode(psascan_private::HUGE_PAGES_HUGETLB);
+          else {
+            fprintf(stderr, "Error: unknown huge page mode (%s)\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          break;
+        }
       case 'h':
         usage(EXIT_FAILURE);
         break;
+      case 'L':
+        psascan_private::huge_pages::enable_mlock();
+        break;
+      case 'l':
+        list_filename = std::string(optarg);
+        break;
       case 'm':
         {
           bool ok = parse_number(optarg, &ram_use);
@@ -173,9 +327,56 @@ int main(int argc, char **argv) {
           }
           break;
         }
+      case 'N':
+        psascan_private::numa::enable();
+        break;
       case 'o':
         output_filename = std::string(optarg);
         break;
+      case 'P':
+        pack_psa = true;
+        break;
+      case 'p':
+        parallel_merge = true;
+        break;
+      case 'r':
+        resume = true;
+        break;
+      case 'S':
+        stats_filename = std::string(optarg);
+        break;
+      case 't':
+        temp_dirs.push_back(std::string(optarg));
+        break;
+      case 'W':
+        {
+          std::string mode(optarg);
+          if (mode == "stdio")
+            output_writer = psascan_private::OUTPUT_WRITER_STDIO;
+          else if (mode == "mmap")
+            output_writer = psascan_private::OUTPUT_WRITER_MMAP;
+          else if (mode == "direct")
+            output_writer = psascan_private::OUTPUT_WRITER_DIRECT;
+          else {
+            fprintf(stderr, "Error: unknown output writer (%s)\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          break;
+        }
+      case 'w':
+        {
+          std::string width(optarg);
+          if (width == "packed")
+            output_width = psascan_private::OUTPUT_WIDTH_PACKED;
+          else if (width == "32" || width == "40" ||
+              width == "48" || width == "64")
+            output_width = std::atol(optarg);
+          else {
+            fprintf(stderr, "Error: invalid output width (%s)\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          break;
+        }
       case 'v':
         verbose = true;
         break;
@@ -186,34 +387,65 @@ int main(int argc, char **argv) {
     }
   }
 
-  if (optind >= argc) {
+  if (optind >= argc && list_filename.empty()) {
     fprintf(stderr, "Error: FILE not provided\n\n");
     usage(EXIT_FAILURE);
   }
 
-  // Parse the text filename.
-  std::string text_filename = std::string(argv[optind++]);
-  if (optind < argc) {
-    fprintf(stderr, "Warning: multiple input files provided. "
-    "Only the first will be processed.\n");
+  // Parse the text filenames.
+  if (!list_filename.empty()) {
+    if (!file_exists(list_filename)) {
+      fprintf(stderr, "Error: file list (%s) does not exist\n\n",
+          list_filename.c_str());
+      usage(EXIT_FAILURE);
+    }
+    std::ifstream list(list_filename.c_str());
+    std::string line;
+    while (std::getline(list, line))
+      if (!line.empty())
+        add_input(line, input_filenames);
+  }
+  std::string first_filename = list_filename.empty() ?
+    std::string(argv[optind]) : list_filename;
+  while (optind < argc)
+    add_input(std::string(argv[optind++]), input_filenames);
+  if (input_filenames.empty()) {
+    fprintf(stderr, "Error: no input files found\n\n");
+    usage(EXIT_FAILURE);
   }
 
   // Set default output filename (if not provided).
-  if (output_filename.empty())
-    output_filename = text_filename + ".sa5";
+  if (output_filename.empty()) {
+    if (output_width == psascan_private::OUTPUT_WIDTH_PACKED)
+      output_filename = first_filename + ".sap";
+    else output_filename = first_filename + ".sa" +
+      psascan_private::utils::intToStr(output_width / 8);
+  }
 
   // Set default gap filename (if not provided).
   if (gap_filename.empty())
     gap_filename = output_filename;
 
+  // Set default BWT filename (if requested but not provided).
+  if (compute_bwt && bwt_filename.empty())
+    bwt_filename = output_filename + ".bwt";
+
+  // Set default document array filename (if requested but not provided).
+  if (compute_da && da_filename.empty())
+    da_filename = output_filename + ".da";
+
   // Check for the existence of text.
-  if (!file_exists(text_filename)) {
-    fprintf(stderr, "Error: input file (%s) does not exist\n\n",
-        text_filename.c_str());
-    usage(EXIT_FAILURE);
+  for (size_t i = 0; i < input_filenames.size(); ++i) {
+    if (!file_exists(input_filenames[i])) {
+      fprintf(stderr, "Error: input file (%s) does not exist\n\n",
+          input_filenames[i].c_str());
+      usage(EXIT_FAILURE);
+    }
   }
 
-  if (file_exists(output_filename)) {
+  // When resuming, the output left by the interrupted run is overwritten.
+  bool resume_merge = resume && file_exists(output_filename + ".checkpoint");
+  if (file_exists(output_filename) && !resume_merge) {
 
     // Output file exists, should we proceed?
     char *line = NULL;
@@ -237,10 +469,16 @@ int main(int argc, char **argv) {
     free(line);
   }
 
+  // Collect the metrics of all phases (written at the end).
+  if (!stats_filename.empty())
+    psascan_private::run_stats::enable(stats_filename);
+
   // Find the number of (logical) cores on the machine.
   long max_threads = (long)omp_get_max_threads();
 
   // Run pSAscan.
-  pSAscan(text_filename, output_filename, gap_filename,
-      ram_use, max_threads, verbose);
+  ::pSAscan(input_filenames, output_filename, gap_filename,
+      ram_use, max_threads, verbose, parallel_merge ? max_threads : 1,
+      output_writer, output_width, bwt_filename, resume, pack_psa,
+      temp_dirs, da_filename);
 }
@@ -37,7 +37,9 @@
 #include <errno.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <string>
 #include <fstream>
 #include <algorithm>
@@ -92,6 +94,70 @@ void file_delete(std::string fname) {
   }
 }
 
+// Peak resident set size of the process (in bytes).
+long peak_rss() {
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0L;
+  return (long)usage.ru_maxrss << 10;
+}
+
+// Read the line (without the trailing newline) from f.
+// Returns false if there is no more lines to read.
+bool read_line(std::FILE *f, std::string &line) {
+  line.clear();
+  int c;
+  while ((c = std::fgetc(f)) != EOF && c != '\n')
+    line += (char)c;
+  return (c != EOF || !line.empty());
+}
+
+// Atomically replace new_fname with old_fname. The contents of old_fname
+// are first flushed to disk, and the directory after the rename, so that
+// new_fname is valid also after a system crash. The files old_fname
+// refers to have to be flushed by the caller (see file_sync).
+void file_rename(std::string old_fname, std::string new_fname) {
+  file_sync(old_fname);
+  if (std::rename(old_fname.c_str(), new_fname.c_str())) {
+    fprintf(stderr, "Failed to rename %s: %s\n",
+        old_fname.c_str(), strerror(errno));
+    std::exit(EXIT_FAILURE);
+  }
+
+  std::string::size_type slash = new_fname.find_last_of('/');
+  if (slash == std::string::npos) file_sync(".");
+  else file_sync(new_fname.substr(0, std::max((std::string::size_type)1, slash)));
+}
+
+// Flush the contents of the file (or directory) to disk.
+void file_sync(std::string fname) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd == -1 || fsync(fd)) {
+    fprintf(stderr, "Failed to sync %s: %s\n",
+        fname.c_str(), strerror(errno));
+    std::exit(EXIT_FAILURE);
+  }
+  close(fd);
+}
+
+// Create (or truncate) the file and reserve the disk space for size bytes.
+void preallocate_file(std::string fname, long size) {
+  int fd = open(fname.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    std::perror(fname.c_str());
+    std::exit(EXIT_FAILURE);
+  }
+
+  // Not all file systems support fallocate. In that
+  // case at least set the size of the file.
+  if (size > 0 && posix_fallocate(fd, 0, size) && ftruncate(fd, size)) {
+    std::perror(fname.c_str());
+    std::exit(EXIT_FAILURE);
+  }
+
+  close(fd);
+}
+
 std::string absolute_path(std::string fname) {
   char path[1 << 12];
   bool created = false;
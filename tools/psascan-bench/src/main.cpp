@@ -0,0 +1,490 @@
+/**
+ * @file    tools/psascan-bench/src/main.cpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <omp.h>
+
+#include "../../../include/psascan.hpp"
+
+
+char *program_name;
+
+void usage(int status) {
+  printf(
+
+"Usage: %s [OPTION]...\n"
+"Benchmark pSAscan on synthetic inputs. For every input, size, engine, RAM\n"
+"budget and number of threads, print the total speed and the time and speed\n"
+"(in MiB/s of the text processed) of every phase.\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n"
+"  -a, --sigma=SIGMA       alphabet size of the `random' input. Default: 256\n"
+"  -d, --dir=DIR           create the inputs and all files of the external\n"
+"                          memory engine in DIR. Default: current directory\n"
+"  -e, --engine=ENGINE     run ENGINE: em (external memory, as construct_sa)\n"
+"                          or inmem (in-memory pSAscan of the whole text).\n"
+"                          Can be given multiple times. Default: em, inmem\n"
+"  -h, --help              display this help and exit\n"
+"  -i, --input=KIND        generate input of type KIND: random (uniform over\n"
+"                          SIGMA symbols), lowent (low entropy, skewed symbol\n"
+"                          distribution), repetitive (mutated copies of a short\n"
+"                          string) or dna (ACGT with runs of N). Can be given\n"
+"                          multiple times. Default: all\n"
+"  -m, --mem=MEM           run the em engine with RAM budget MEM. A suffix `n'\n"
+"                          gives a multiple of the input size, e.g., -m 2n,\n"
+"                          otherwise as in construct_sa. Can be given multiple\n"
+"                          times. Budgets below the minimum for the number of\n"
+"                          threads are raised to it. Default: 2n, 8n\n"
+"  -n, --size=SIZE         generate inputs of SIZE bytes (metric and IEC\n"
+"                          suffixes are recognized). Can be given multiple\n"
+"                          times. Default: 16Mi, 64Mi\n"
+"  -p, --parallel-merge    merge partial suffix arrays using all threads\n"
+"  -r, --seed=SEED         seed of the input generator. Default: 1\n"
+"  -t, --threads=T         run with T threads. Can be given multiple times.\n"
+"                          Default: 1 and the number of (logical) cores\n"
+"  -v, --verbose           do not suppress the output of pSAscan\n",
+    program_name);
+
+  std::exit(status);
+}
+
+template<typename int_type>
+bool parse_number(char *str, int_type *ret) {
+  *ret = 0;
+  std::uint64_t n_digits = 0;
+  std::uint64_t str_len = std::strlen(str);
+  while (n_digits < str_len && std::isdigit(str[n_digits])) {
+    std::uint64_t digit = str[n_digits] - '0';
+    *ret = (*ret) * 10 + digit;
+    ++n_digits;
+  }
+
+  if (n_digits == 0)
+    return false;
+
+  std::uint64_t suffix_length = str_len - n_digits;
+  if (suffix_length > 0) {
+    if (suffix_length > 2)
+      return false;
+
+    for (std::uint64_t j = 0; j < suffix_length; ++j)
+      str[n_digits + j] = std::tolower(str[n_digits + j]);
+    if (suffix_length == 2 && str[n_digits + 1] != 'i')
+      return false;
+
+    switch(str[n_digits]) {
+      case 'k':
+        if (suffix_length == 1)
+          *ret *= 1000;
+        else
+          *ret <<= 10;
+        break;
+      case 'm':
+        if (suffix_length == 1)
+          *ret *= 1000000;
+        else
+          *ret <<= 20;
+        break;
+      case 'g':
+        if (suffix_length == 1)
+          *ret *= 1000000000;
+        else
+          *ret <<= 30;
+        break;
+      case 't':
+        if (suffix_length == 1)
+          *ret *= 1000000000000;
+        else
+          *ret <<= 40;
+        break;
+      default:
+        return false;
+    }
+  }
+
+  return true;
+}
+
+// RAM budget, either absolute (m_bytes > 0) or
+// relative to the input size (m_bytes = 0).
+struct ram_setting {
+  long m_bytes;
+  long m_multiple;
+
+  long get(long text_length) const {
+    return m_bytes > 0 ? m_bytes : m_multiple * text_length;
+  }
+};
+
+//==============================================================================
+// Generators of synthetic inputs. All use rand(), seeded by the caller,
+// so that the same seed and size always give the same text.
+//==============================================================================
+
+// Uniform over sigma symbols.
+void generate_random(unsigned char *text, long length, int sigma) {
+  psascan_private::utils::fill_random_string(text, length, sigma);
+}
+
+// Symbol i (for i < 15) occurs with probability 2^{-(i + 1)},
+// i.e., the entropy is about two bits per symbol.
+void generate_low_entropy(unsigned char *text, long length) {
+  for (long i = 0; i < length; ++i) {
+    int r = rand(), c = 0;
+    while ((r & 1) && c < 15) { r >>= 1; ++c; }
+    text[i] = 'a' + c;
+  }
+}
+
+// Copies of a random 4KiB string over 4 symbols, every symbol
+// of a copy is replaced with probability 1/10000.
+void generate_repetitive(unsigned char *text, long length) {
+  static const long seed_length = (4L << 10);
+  unsigned char *seed = new unsigned char[seed_length];
+  psascan_private::utils::fill_random_letters(seed, seed_length, 4);
+  for (long i = 0; i < length; ++i) {
+    text[i] = seed[i % seed_length];
+    if (psascan_private::utils::random_int(0, 9999) == 0)
+      text[i] = 'a' + psascan_private::utils::random_int(0, 3);
+  }
+  delete[] seed;
+}
+
+// Uniform over ACGT, with runs of N (of length up to 1000)
+// starting with probability 1/100000 at every position.
+void generate_dna(unsigned char *text, long length) {
+  static const unsigned char acgt[] = { 'A', 'C', 'G', 'T' };
+  for (long i = 0; i < length; ++i) {
+    if (psascan_private::utils::random_int(0, 99999) == 0) {
+      long run_end = std::min(length,
+          i + psascan_private::utils::random_int(1, 1000));
+      while (i < run_end) text[i++] = 'N';
+      --i;
+    } else text[i] = acgt[psascan_private::utils::random_int(0, 3)];
+  }
+}
+
+void generate(std::string kind, unsigned char *text, long length,
+    int sigma, long seed) {
+  srand(seed);
+  if (kind == "random") generate_random(text, length, sigma);
+  else if (kind == "lowent") generate_low_entropy(text, length);
+  else if (kind == "repetitive") generate_repetitive(text, length);
+  else generate_dna(text, length);
+}
+
+// In-memory pSAscan of the whole text (as run on a half-block).
+template<typename saidx_t>
+void run_inmem(unsigned char *text, long length, long max_threads) {
+  unsigned char *sabwt = (unsigned char *)malloc(length * (sizeof(saidx_t) + 1));
+  psascan_private::inmem_psascan_private::inmem_psascan<saidx_t>(
+      text, length, sabwt, max_threads);
+  free(sabwt);
+}
+
+//==============================================================================
+// Run a single benchmark. It is executed in a child process, so that every
+// run starts with a fresh state of the I/O engines and a failing run (e.g.,
+// due to lack of disk space) only skips the run.
+//==============================================================================
+void run_benchmark(std::string input_filename, unsigned char *text,
+    long length, std::string engine, long ram_use, long max_threads,
+    bool parallel_merge, std::string dir, bool verbose) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    std::perror("fork");
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (pid > 0) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+      printf("  failed (rerun with -v for details)\n\n");
+    return;
+  }
+
+  // Close stderr.
+  if (!verbose) {
+    int stderr_temp = open("/dev/null", O_WRONLY);
+    dup2(stderr_temp, 2);
+    close(stderr_temp);
+  }
+
+  omp_set_num_threads(max_threads);
+  psascan_private::run_stats::enable("");
+  long double start = psascan_private::utils::wclock();
+  if (engine == "em") {
+    std::string output_filename = dir + "/psascan_bench.sa5";
+    psascan_private::pSAscan(std::vector<std::string>(1, input_filename),
+        output_filename, output_filename, ram_use, max_threads, verbose,
+        parallel_merge ? max_threads : 1);
+    psascan_private::utils::file_delete(output_filename);
+  } else {
+    psascan_private::run_stats::begin_section(1L, 0L, length);
+    if (length < (1L << 31)) run_inmem<int>(text, length, max_threads);
+    else run_inmem<long>(text, length, max_threads);
+    psascan_private::run_stats::end_section();
+  }
+  long double total_time = psascan_private::utils::wclock() - start;
+
+  printf("  time = %.2Lfs, speed = %.2LfMiB/s\n", total_time,
+      (length / (1024.L * 1024)) / total_time);
+  std::vector<psascan_private::run_stats::step_total> totals =
+    psascan_private::run_stats::totals();
+  for (size_t i = 0; i < totals.size(); ++i) {
+    const psascan_private::run_stats::step_total &t = totals[i];
+    printf("    %-5s %-8s %8.2Lfs %10.2LfMiB/s  %s\n", t.m_merge ? "merge" : "block",
+        t.m_step.c_str(), t.m_time, t.m_time > 0.L ?
+        (t.m_symbols / (1024.L * 1024)) / t.m_time : 0.L, t.m_name.c_str());
+  }
+  printf("\n");
+  fflush(stdout);
+  std::exit(EXIT_SUCCESS);
+}
+
+
+int main(int argc, char **argv) {
+  program_name = argv[0];
+  bool verbose = false;
+  bool parallel_merge = false;
+  int sigma = 256;
+  long seed = 1;
+  std::string dir(".");
+  std::vector<std::string> engines;
+  std::vector<std::string> inputs;
+  std::vector<ram_setting> rams;
+  std::vector<long> sizes;
+  std::vector<long> threads;
+
+  static struct option long_options[] = {
+    {"sigma",    required_argument, NULL, 'a'},
+    {"dir",      required_argument, NULL, 'd'},
+    {"engine",   required_argument, NULL, 'e'},
+    {"help",     no_argument,       NULL, 'h'},
+    {"input",    required_argument, NULL, 'i'},
+    {"mem",      required_argument, NULL, 'm'},
+    {"size",     required_argument, NULL, 'n'},
+    {"parallel-merge", no_argument, NULL, 'p'},
+    {"seed",     required_argument, NULL, 'r'},
+    {"threads",  required_argument, NULL, 't'},
+    {"verbose",  no_argument,       NULL, 'v'},
+    {NULL,       0,                 NULL,  0}
+  };
+
+  // Parse command-line options.
+  int c;
+  while ((c = getopt_long(argc, argv, "a:d:e:hi:m:n:pr:t:v",
+          long_options, NULL)) != -1) {
+    switch(c) {
+      case 'a':
+        sigma = std::atoi(optarg);
+        if (sigma < 1 || sigma > 256) {
+          fprintf(stderr, "Error: invalid alphabet size (%s)\n\n", optarg);
+          usage(EXIT_FAILURE);
+        }
+        break;
+      case 'd':
+        dir = std::string(optarg);
+        break;
+      case 'e':
+        {
+          std::string engine(optarg);
+          if (engine != "em" && engine != "inmem") {
+            fprintf(stderr, "Error: unknown engine (%s)\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          engines.push_back(engine);
+          break;
+        }
+      case 'h':
+        usage(EXIT_FAILURE);
+        break;
+      case 'i':
+        {
+          std::string kind(optarg);
+          if (kind != "random" && kind != "lowent" &&
+              kind != "repetitive" && kind != "dna") {
+            fprintf(stderr, "Error: unknown input (%s)\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          inputs.push_back(kind);
+          break;
+        }
+      case 'm':
+        {
+          ram_setting ram;
+          ram.m_bytes = ram.m_multiple = 0;
+          long len = std::strlen(optarg);
+          bool ok = false;
+          if (len > 1 && std::tolower(optarg[len - 1]) == 'n') {
+            optarg[len - 1] = '\0';
+            ok = parse_number(optarg, &ram.m_multiple) && ram.m_multiple > 0;
+          } else ok = parse_number(optarg, &ram.m_bytes) && ram.m_bytes > 0;
+          if (!ok) {
+            fprintf(stderr, "Error: parsing RAM "
+                "limit (%s) failed\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          rams.push_back(ram);
+          break;
+        }
+      case 'n':
+        {
+          long size = 0;
+          if (!parse_number(optarg, &size) || size == 0) {
+            fprintf(stderr, "Error: invalid size (%s)\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          sizes.push_back(size);
+          break;
+        }
+      case 'p':
+        parallel_merge = true;
+        break;
+      case 'r':
+        seed = std::atol(optarg);
+        break;
+      case 't':
+        {
+          long t = std::atol(optarg);
+          if (t <= 0) {
+            fprintf(stderr, "Error: invalid number of threads (%s)\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          threads.push_back(t);
+          break;
+        }
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        usage(EXIT_FAILURE);
+        break;
+    }
+  }
+
+  if (optind < argc)
+    usage(EXIT_FAILURE);
+
+  // Set defaults.
+  if (engines.empty()) {
+    engines.push_back("em");
+    engines.push_back("inmem");
+  }
+  if (inputs.empty()) {
+    inputs.push_back("random");
+    inputs.push_back("lowent");
+    inputs.push_back("repetitive");
+    inputs.push_back("dna");
+  }
+  if (rams.empty()) {
+    ram_setting ram;
+    ram.m_bytes = 0;
+    ram.m_multiple = 2;
+    rams.push_back(ram);
+    ram.m_multiple = 8;
+    rams.push_back(ram);
+  }
+  if (sizes.empty()) {
+    sizes.push_back(16L << 20);
+    sizes.push_back(64L << 20);
+  }
+  if (threads.empty()) {
+    long max_threads = (long)omp_get_max_threads();
+    threads.push_back(1L);
+    if (max_threads > 1)
+      threads.push_back(max_threads);
+  }
+  dir = psascan_private::utils::absolute_path(dir);
+
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    for (size_t j = 0; j < sizes.size(); ++j) {
+      long length = sizes[j];
+      std::string input_name = inputs[i];
+      if (input_name == "random")
+        input_name += psascan_private::utils::intToStr(sigma);
+
+      // Generate the input.
+      unsigned char *text = (unsigned char *)malloc(length);
+      generate(inputs[i], text, length, sigma, seed);
+      std::string input_filename = dir + "/psascan_bench." + input_name;
+      psascan_private::utils::write_objects_to_file(text, length, input_filename);
+
+      for (size_t e = 0; e < engines.size(); ++e) {
+        for (size_t t = 0; t < threads.size(); ++t) {
+          if (engines[e] == "inmem") {
+            printf("%s, %.1LfMiB, inmem, %ld threads:\n", input_name.c_str(),
+                length / (1024.L * 1024), threads[t]);
+            run_benchmark(input_filename, text, length, engines[e], 0L,
+                threads[t], parallel_merge, dir, verbose);
+            continue;
+          }
+
+          // Budgets below the minimum of the planner are raised to it,
+          // budgets that end up equal to an earlier one are skipped.
+          long min_ram = psascan_private::min_ram_use(length, threads[t]);
+          std::vector<long> used_rams;
+          for (size_t r = 0; r < rams.size(); ++r) {
+            long ram_use = std::max(rams[r].get(length), min_ram);
+            if (std::find(used_rams.begin(), used_rams.end(), ram_use)
+                != used_rams.end()) continue;
+            used_rams.push_back(ram_use);
+            printf("%s, %.1LfMiB, em, RAM %.1LfMiB%s, %ld threads:\n",
+                input_name.c_str(), length / (1024.L * 1024),
+                ram_use / (1024.L * 1024), (ram_use > rams[r].get(length)) ?
+                " (raised to the minimum)" : "", threads[t]);
+            run_benchmark(input_filename, text, length, engines[e], ram_use,
+                threads[t], parallel_merge, dir, verbose);
+          }
+        }
+      }
+
+      psascan_private::utils::file_delete(input_filename);
+      free(text);
+    }
+  }
+}
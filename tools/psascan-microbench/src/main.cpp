@@ -0,0 +1,634 @@
+/**
+ * @file    tools/psascan-microbench/src/main.cpp
+ * @section LICENCE
+ *
+ * This file is part of pSAscan v0.1.1
+ * See: https://github.com/dominikkempa/psascan
+ *
+ * Copyright (C) 2014-2020
+ *   Dominik Kempa <dominik.kempa (at) gmail.com>
+ *   Juha Karkkainen <juha.karkkainen (at) cs.helsinki.fi>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ **/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "../../../include/utils/utils.hpp"
+#include "../../../include/types/uint40.hpp"
+#include "../../../include/rank.hpp"
+#include "../../../include/interleaved_rank.hpp"
+#include "../../../include/approx_rank.hpp"
+#include "../../../include/sparse_isa.hpp"
+#include "../../../include/bitvector.hpp"
+#include "../../../include/ranksel_support.hpp"
+#include "../../../include/bwt_merge.hpp"
+#include "../../../include/gap_buffer.hpp"
+#include "../../../include/stream.hpp"
+#include "../../../include/io/async_vbyte_stream_reader.hpp"
+#include "../../../include/io/async_stream_writer.hpp"
+#include "../../../include/inmem_psascan_src/inmem_psascan.hpp"
+
+using namespace psascan_private;
+
+
+char *program_name;
+
+void usage(int status) {
+  printf(
+
+"Usage: %s [OPTION]...\n"
+"Benchmark the core kernels of pSAscan in isolation. For every kernel, print\n"
+"the time per operation and the effective memory bandwidth, i.e., the number\n"
+"of bytes read and written by the kernel per second. For the random access\n"
+"queries (rank4n, interleaved_rank, approx_rank, sparse_isa) one cache line\n"
+"(64 bytes) is counted per query.\n"
+"\n"
+"Kernels:\n"
+"  rank4n, interleaved_rank, approx_rank\n"
+"                          rank queries forming an LF-mapping chain, as in\n"
+"                          the streaming\n"
+"  sparse_isa              ISA queries at random positions\n"
+"  range_sum               bitvector::range_sum over random ranges\n"
+"  rank0, select1          ranksel_support queries at random positions (one\n"
+"                          in 1024 of the queries is run, the queries scan\n"
+"                          the bitvector)\n"
+"  vbyte_read              async_vbyte_stream_reader::read of a file in the\n"
+"                          page cache\n"
+"  uint40_write            async_stream_writer<uint40>::write to /dev/null\n"
+"  merge_bwt               merging of the BWTs of two half-blocks\n"
+"  sblock_permute          permutation of gap buffers into super-buckets in\n"
+"                          the streaming\n"
+"\n"
+"Mandatory arguments to long options are mandatory for short options too.\n"
+"  -a, --sigma=SIGMA       alphabet size of the random text. Default: 256\n"
+"  -d, --dir=DIR           create temporary files in DIR. Default: current\n"
+"                          directory\n"
+"  -h, --help              display this help and exit\n"
+"  -k, --kernel=KERNEL     run KERNEL. Can be given multiple times. Default:\n"
+"                          all\n"
+"  -n, --size=SIZE         length of the text and bitvectors (metric and IEC\n"
+"                          suffixes are recognized). Default: 64Mi\n"
+"  -q, --queries=Q         number of queries. Default: 10M\n"
+"  -r, --repeat=R          run every kernel R times, print the fastest run.\n"
+"                          Default: 3\n"
+"  -t, --threads=T         use T threads to build the data structures and in\n"
+"                          merge_bwt, and T super-buckets. Default: the\n"
+"                          number of (logical) cores\n",
+    program_name);
+
+  std::exit(status);
+}
+
+template<typename int_type>
+bool parse_number(char *str, int_type *ret) {
+  *ret = 0;
+  std::uint64_t n_digits = 0;
+  std::uint64_t str_len = std::strlen(str);
+  while (n_digits < str_len && std::isdigit(str[n_digits])) {
+    std::uint64_t digit = str[n_digits] - '0';
+    *ret = (*ret) * 10 + digit;
+    ++n_digits;
+  }
+
+  if (n_digits == 0)
+    return false;
+
+  std::uint64_t suffix_length = str_len - n_digits;
+  if (suffix_length > 0) {
+    if (suffix_length > 2)
+      return false;
+
+    for (std::uint64_t j = 0; j < suffix_length; ++j)
+      str[n_digits + j] = std::tolower(str[n_digits + j]);
+    if (suffix_length == 2 && str[n_digits + 1] != 'i')
+      return false;
+
+    switch(str[n_digits]) {
+      case 'k':
+        if (suffix_length == 1)
+          *ret *= 1000;
+        else
+          *ret <<= 10;
+        break;
+      case 'm':
+        if (suffix_length == 1)
+          *ret *= 1000000;
+        else
+          *ret <<= 20;
+        break;
+      case 'g':
+        if (suffix_length == 1)
+          *ret *= 1000000000;
+        else
+          *ret <<= 30;
+        break;
+      case 't':
+        if (suffix_length == 1)
+          *ret *= 1000000000000;
+        else
+          *ret <<= 40;
+        break;
+      default:
+        return false;
+    }
+  }
+
+  return true;
+}
+
+struct config {
+  long m_length;
+  long m_queries;
+  long m_repeat;
+  long m_threads;
+  int m_sigma;
+  std::string m_dir;
+};
+
+// Results of kernels are added here, so that they are not optimized out.
+volatile long sink;
+
+// Print the result of the fastest of the runs. Every run
+// does ops operations, reading and writing bytes bytes.
+void report(std::string kernel, long ops, long bytes,
+    const std::vector<long double> &times) {
+  long double best = *std::min_element(times.begin(), times.end());
+  printf("%-18s %12ld ops %10.2Lf ns/op %10.2LfMiB/s\n", kernel.c_str(), ops,
+      best > 0.L ? (best * 1000000000.L) / ops : 0.L,
+      best > 0.L ? (bytes / (1024.L * 1024)) / best : 0.L);
+  fflush(stdout);
+}
+
+unsigned char *random_text(const config &cfg) {
+  unsigned char *text = (unsigned char *)malloc(cfg.m_length);
+  srand(1);
+  utils::fill_random_string(text, cfg.m_length, cfg.m_sigma);
+  return text;
+}
+
+// Random positions in [0..range).
+std::vector<long> random_positions(long count, long range) {
+  std::vector<long> ret(count);
+  srand(2);
+  for (long i = 0; i < count; ++i)
+    ret[i] = utils::random_long(0L, range - 1);
+  return ret;
+}
+
+// Bitvector with every bit set with probability 1/2.
+bitvector *random_bitvector(long length) {
+  bitvector *bv = new bitvector(length);
+  srand(3);
+  for (long i = 0; i < length; ++i)
+    if (rand() & 1) bv->set(i);
+  return bv;
+}
+
+//==============================================================================
+// Rank queries forming an LF-mapping chain over the text (as in the
+// streaming, where every query depends on the result of the previous one).
+//==============================================================================
+template<typename rank_type>
+void bench_lf_chain(std::string kernel, const config &cfg) {
+  unsigned char *text = random_text(cfg);
+  rank_type *rank = new rank_type(text, cfg.m_length, cfg.m_threads);
+  long count[256];
+  for (long c = 0, s = 0; c < 256; ++c) {
+    count[c] = s;
+    s += (long)rank->m_count[c];
+  }
+
+  std::vector<long double> times;
+  for (long r = 0; r < cfg.m_repeat; ++r) {
+    long double start = utils::wclock();
+    long i = cfg.m_length / 2;
+    for (long q = 0; q < cfg.m_queries; ++q) {
+      unsigned char c = text[q % cfg.m_length];
+      i = count[c] + rank->rank(i, c);
+      if (i >= cfg.m_length) i -= cfg.m_length;
+    }
+    times.push_back(utils::wclock() - start);
+    sink = sink + i;
+  }
+  report(kernel, cfg.m_queries, 64L * cfg.m_queries, times);
+
+  delete rank;
+  free(text);
+}
+
+//==============================================================================
+// ISA queries at random positions. The SA and the BWT (needed to
+// answer the queries) are computed using in-memory pSAscan.
+//==============================================================================
+void bench_sparse_isa(const config &cfg) {
+  typedef approx_rank<8L> rank_type;
+  typedef sparse_isa<rank_type, int, 8L> isa_type;
+
+  if (cfg.m_length >= (1L << 31)) {
+    fprintf(stderr, "Error: sparse_isa requires size < 2^31\n");
+    std::exit(EXIT_FAILURE);
+  }
+
+  unsigned char *text = random_text(cfg);
+  unsigned char *sabwt = (unsigned char *)malloc(cfg.m_length * (sizeof(int) + 1));
+  long i0 = 0L;
+
+  // Close stderr.
+  std::fflush(stderr);
+  int stderr_backup = dup(2);
+  int stderr_temp = open("/dev/null", O_WRONLY);
+  dup2(stderr_temp, 2);
+  close(stderr_temp);
+
+  inmem_psascan_private::inmem_psascan<int>(text, cfg.m_length, sabwt,
+      cfg.m_threads, true, false, NULL, -1, 0, 0, 0, NULL, NULL, &i0);
+
+  // Restore stderr.
+  std::fflush(stderr);
+  dup2(stderr_backup, 2);
+  close(stderr_backup);
+
+  const int *sa = (const int *)sabwt;
+  const unsigned char *bwt = sabwt + cfg.m_length * sizeof(int);
+  rank_type *rank = new rank_type(bwt, cfg.m_length, cfg.m_threads);
+  isa_type *isa = new isa_type(sa, text, cfg.m_length, i0, rank, cfg.m_threads);
+  std::vector<long> positions = random_positions(cfg.m_queries, cfg.m_length);
+
+  std::vector<long double> times;
+  for (long r = 0; r < cfg.m_repeat; ++r) {
+    long double start = utils::wclock();
+    long result = 0L;
+    for (long q = 0; q < cfg.m_queries; ++q)
+      result += isa->query(positions[q]);
+    times.push_back(utils::wclock() - start);
+    sink = sink + result;
+  }
+  report("sparse_isa", cfg.m_queries, 64L * cfg.m_queries, times);
+
+  delete isa;
+  delete rank;
+  free(sabwt);
+  free(text);
+}
+
+void bench_range_sum(const config &cfg) {
+  static const long max_range_length = (1L << 16);
+  bitvector *bv = random_bitvector(cfg.m_length);
+  std::vector<long> positions = random_positions(cfg.m_queries, cfg.m_length);
+  std::vector<long> lengths = random_positions(cfg.m_queries,
+      std::min(max_range_length, cfg.m_length));
+  long bytes = 0L;
+  for (long q = 0; q < cfg.m_queries; ++q) {
+    lengths[q] = std::min(lengths[q], cfg.m_length - positions[q]);
+    bytes += (lengths[q] + 7) / 8;
+  }
+
+  std::vector<long double> times;
+  for (long r = 0; r < cfg.m_repeat; ++r) {
+    long double start = utils::wclock();
+    long result = 0L;
+    for (long q = 0; q < cfg.m_queries; ++q)
+      result += bv->range_sum(positions[q], positions[q] + lengths[q]);
+    times.push_back(utils::wclock() - start);
+    sink = sink + result;
+  }
+  report("range_sum", cfg.m_queries, bytes, times);
+
+  delete bv;
+}
+
+//==============================================================================
+// The queries of ranksel_support scan the bitvector from the beginning of
+// a chunk (up to 2^20 bits), so only one in 1024 of the queries is run.
+//==============================================================================
+void bench_ranksel(std::string kernel, const config &cfg) {
+  long queries = std::max(1L, cfg.m_queries >> 10);
+  bitvector *bv = random_bitvector(cfg.m_length);
+  ranksel_support *ranksel = new ranksel_support(bv, cfg.m_length, cfg.m_threads);
+  long ones = ranksel->rank(cfg.m_length);
+  bool select = (kernel == "select1");
+  std::vector<long> positions = random_positions(queries,
+      select ? std::max(1L, ones) : cfg.m_length + 1);
+
+  std::vector<long double> times;
+  long bytes = 0L;
+  for (long r = 0; r < cfg.m_repeat; ++r) {
+    long double start = utils::wclock();
+    long result = 0L;
+    if (select) {
+      for (long q = 0; q < queries; ++q)
+        result += ranksel->select1(positions[q]);
+    } else {
+      for (long q = 0; q < queries; ++q)
+        result += ranksel->rank0(positions[q]);
+    }
+    times.push_back(utils::wclock() - start);
+    sink = sink + result;
+  }
+
+  // Bytes of the bitvector scanned by the queries.
+  for (long q = 0; q < queries; ++q) {
+    long j = select ? ranksel->select1(positions[q]) : positions[q];
+    bytes += (j % ranksel->m_chunk_size + 7) / 8 + (long)sizeof(long);
+  }
+  report(kernel, queries, bytes, times);
+
+  delete ranksel;
+  delete bv;
+}
+
+// Read v-byte encoded values (distributed as the gap excess values).
+void bench_vbyte_read(const config &cfg) {
+  std::string filename = cfg.m_dir + "/psascan_microbench.vbyte." +
+    utils::random_string_hash();
+  long n_values = cfg.m_length;
+  long file_size = 0L;
+  {
+    std::FILE *f = utils::open_file(filename, "w");
+    std::vector<unsigned char> buf;
+    srand(4);
+    for (long i = 0; i < n_values; ++i) {
+      long x = utils::random_long(0L, (1L << utils::random_int(0, 28)) - 1);
+      while (x > 127) {
+        buf.push_back((x & 0x7f) | 0x80);
+        x >>= 7;
+      }
+      buf.push_back(x);
+      if ((long)buf.size() >= (1L << 20)) {
+        utils::add_objects_to_file(buf.data(), buf.size(), f);
+        file_size += buf.size();
+        buf.clear();
+      }
+    }
+    utils::add_objects_to_file(buf.data(), buf.size(), f);
+    file_size += buf.size();
+    std::fclose(f);
+  }
+
+  std::vector<long double> times;
+  for (long r = 0; r < cfg.m_repeat; ++r) {
+    long double start = utils::wclock();
+    async_vbyte_stream_reader<long> *reader =
+      new async_vbyte_stream_reader<long>(filename);
+    long result = 0L;
+    for (long i = 0; i < n_values; ++i)
+      result += reader->read();
+    delete reader;
+    times.push_back(utils::wclock() - start);
+    sink = sink + result;
+  }
+  report("vbyte_read", n_values, file_size, times);
+
+  utils::file_delete(filename);
+}
+
+// Pack 64-bit values into 40-bit integers while writing them.
+void bench_uint40_write(const config &cfg) {
+  std::vector<long double> times;
+  for (long r = 0; r < cfg.m_repeat; ++r) {
+    long double start = utils::wclock();
+    async_stream_writer<uint40> *writer =
+      new async_stream_writer<uint40>("/dev/null");
+    for (long i = 0; i < cfg.m_length; ++i)
+      writer->write(uint40((std::uint64_t)(i * 0x9E3779B97FL) & ((1UL << 40) - 1)));
+    delete writer;
+    times.push_back(utils::wclock() - start);
+  }
+  report("uint40_write", cfg.m_length, 5L * cfg.m_length, times);
+}
+
+void bench_merge_bwt(const config &cfg) {
+  bitvector *bv = random_bitvector(cfg.m_length);
+  long right_size = bv->range_sum(0, cfg.m_length);
+  long left_size = cfg.m_length - right_size;
+  if (left_size == 0 || right_size == 0) {
+    fprintf(stderr, "Error: size too small for merge_bwt\n");
+    std::exit(EXIT_FAILURE);
+  }
+
+  unsigned char *text = random_text(cfg);
+  unsigned char *bwt = (unsigned char *)malloc(cfg.m_length);
+
+  std::vector<long double> times;
+  for (long r = 0; r < cfg.m_repeat; ++r) {
+    long double start = utils::wclock();
+    long i0 = merge_bwt(text, text + left_size, left_size, right_size,
+        left_size / 2, right_size / 2, 0, bwt, bv, cfg.m_threads);
+    times.push_back(utils::wclock() - start);
+    sink = sink + i0;
+  }
+  report("merge_bwt", cfg.m_length, 2L * cfg.m_length +
+      (cfg.m_length + 7) / 8, times);
+
+  free(bwt);
+  free(text);
+  delete bv;
+}
+
+//==============================================================================
+// Permutation of gap buffers (of the default size) filled with
+// random values into super-buckets, as in parallel_stream.
+//==============================================================================
+void bench_sblock_permute(const config &cfg) {
+  typedef int block_offset_type;
+  static const long gap_buf_size = (1L << 21);
+  static const int max_buckets = 4096;
+  long n_increasers = cfg.m_threads;
+  long gap_range_size = std::min(cfg.m_length, (1L << 31) - 1);
+
+  long bucket_size = 1;
+  long bucket_size_bits = 0;
+  while ((gap_range_size + bucket_size - 1) / bucket_size > max_buckets)
+    bucket_size <<= 1, ++bucket_size_bits;
+  long n_buckets = (gap_range_size + bucket_size - 1) / bucket_size;
+
+  gap_buffer<block_offset_type> *b =
+    new gap_buffer<block_offset_type>(gap_buf_size, n_increasers);
+  block_offset_type *temp = new block_offset_type[b->m_size];
+  int *oracle = new int[b->m_size];
+  int *block_count = new int[n_buckets];
+  int *block_id_to_sblock_id = new int[max_buckets];
+  long *ptr = new long[n_increasers];
+
+  srand(5);
+  for (long t = 0; t < b->m_size; ++t)
+    temp[t] = utils::random_long(0L, gap_range_size - 1);
+  b->m_filled = b->m_size;
+  long n_buffers = std::max(1L, cfg.m_length / b->m_size);
+
+  std::vector<long double> times;
+  for (long r = 0; r < cfg.m_repeat; ++r) {
+    long double start = utils::wclock();
+    for (long k = 0; k < n_buffers; ++k) {
+      std::fill(block_count, block_count + n_buckets, 0);
+      for (long t = 0; t < b->m_filled; ++t)
+        block_count[temp[t] >> bucket_size_bits]++;
+      permute_into_sblocks(temp, block_count, n_buckets, bucket_size_bits,
+          n_increasers, block_id_to_sblock_id, oracle, ptr, b);
+    }
+    times.push_back(utils::wclock() - start);
+    sink = sink + b->m_content[0];
+  }
+
+  // The values are read three times, the oracle is
+  // written and read, and the values are written.
+  long ops = n_buffers * b->m_filled;
+  report("sblock_permute", ops, ops * (4L * sizeof(block_offset_type) +
+        2L * sizeof(int)), times);
+
+  delete[] ptr;
+  delete[] block_id_to_sblock_id;
+  delete[] block_count;
+  delete[] oracle;
+  delete[] temp;
+  delete b;
+}
+
+
+int main(int argc, char **argv) {
+  program_name = argv[0];
+  config cfg;
+  cfg.m_length = (64L << 20);
+  cfg.m_queries = 10000000L;
+  cfg.m_repeat = 3L;
+  cfg.m_threads = (long)omp_get_max_threads();
+  cfg.m_sigma = 256;
+  cfg.m_dir = std::string(".");
+  std::vector<std::string> kernels;
+
+  static const char *all_kernels[] = { "rank4n", "interleaved_rank",
+    "approx_rank", "sparse_isa", "range_sum", "rank0", "select1",
+    "vbyte_read", "uint40_write", "merge_bwt", "sblock_permute" };
+  static const long n_kernels = sizeof(all_kernels) / sizeof(all_kernels[0]);
+
+  static struct option long_options[] = {
+    {"sigma",    required_argument, NULL, 'a'},
+    {"dir",      required_argument, NULL, 'd'},
+    {"help",     no_argument,       NULL, 'h'},
+    {"kernel",   required_argument, NULL, 'k'},
+    {"size",     required_argument, NULL, 'n'},
+    {"queries",  required_argument, NULL, 'q'},
+    {"repeat",   required_argument, NULL, 'r'},
+    {"threads",  required_argument, NULL, 't'},
+    {NULL,       0,                 NULL,  0}
+  };
+
+  // Parse command-line options.
+  int c;
+  while ((c = getopt_long(argc, argv, "a:d:hk:n:q:r:t:",
+          long_options, NULL)) != -1) {
+    switch(c) {
+      case 'a':
+        cfg.m_sigma = std::atoi(optarg);
+        if (cfg.m_sigma < 1 || cfg.m_sigma > 256) {
+          fprintf(stderr, "Error: invalid alphabet size (%s)\n\n", optarg);
+          usage(EXIT_FAILURE);
+        }
+        break;
+      case 'd':
+        cfg.m_dir = std::string(optarg);
+        break;
+      case 'h':
+        usage(EXIT_FAILURE);
+        break;
+      case 'k':
+        {
+          std::string kernel(optarg);
+          if (std::find(all_kernels, all_kernels + n_kernels, kernel) ==
+              all_kernels + n_kernels) {
+            fprintf(stderr, "Error: unknown kernel (%s)\n\n", optarg);
+            usage(EXIT_FAILURE);
+          }
+          kernels.push_back(kernel);
+          break;
+        }
+      case 'n':
+        if (!parse_number(optarg, &cfg.m_length) || cfg.m_length < 2) {
+          fprintf(stderr, "Error: invalid size (%s)\n\n", optarg);
+          usage(EXIT_FAILURE);
+        }
+        break;
+      case 'q':
+        if (!parse_number(optarg, &cfg.m_queries) || cfg.m_queries == 0) {
+          fprintf(stderr, "Error: invalid number of queries (%s)\n\n", optarg);
+          usage(EXIT_FAILURE);
+        }
+        break;
+      case 'r':
+        cfg.m_repeat = std::atol(optarg);
+        if (cfg.m_repeat <= 0) {
+          fprintf(stderr, "Error: invalid number of runs (%s)\n\n", optarg);
+          usage(EXIT_FAILURE);
+        }
+        break;
+      case 't':
+        cfg.m_threads = std::atol(optarg);
+        if (cfg.m_threads <= 0) {
+          fprintf(stderr, "Error: invalid number of threads (%s)\n\n", optarg);
+          usage(EXIT_FAILURE);
+        }
+        break;
+      default:
+        usage(EXIT_FAILURE);
+        break;
+    }
+  }
+
+  if (optind < argc)
+    usage(EXIT_FAILURE);
+
+  if (kernels.empty())
+    kernels.assign(all_kernels, all_kernels + n_kernels);
+
+  fprintf(stderr, "Size = %ld, queries = %ld, sigma = %d, threads = %ld, "
+      "runs = %ld\n\n", cfg.m_length, cfg.m_queries, cfg.m_sigma,
+      cfg.m_threads, cfg.m_repeat);
+
+  for (size_t i = 0; i < kernels.size(); ++i) {
+    std::string kernel = kernels[i];
+    if (kernel == "rank4n") bench_lf_chain<rank4n<> >(kernel, cfg);
+    else if (kernel == "interleaved_rank")
+      bench_lf_chain<interleaved_rank<> >(kernel, cfg);
+    else if (kernel == "approx_rank")
+      bench_lf_chain<approx_rank<8L> >(kernel, cfg);
+    else if (kernel == "sparse_isa") bench_sparse_isa(cfg);
+    else if (kernel == "range_sum") bench_range_sum(cfg);
+    else if (kernel == "rank0" || kernel == "select1") bench_ranksel(kernel, cfg);
+    else if (kernel == "vbyte_read") bench_vbyte_read(cfg);
+    else if (kernel == "uint40_write") bench_uint40_write(cfg);
+    else if (kernel == "merge_bwt") bench_merge_bwt(cfg);
+    else bench_sblock_permute(cfg);
+  }
+}